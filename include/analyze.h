@@ -0,0 +1,44 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include "huffman.h"
+#include "order1.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Bytes per block of the blocked and order-1 predictions
+#define ANALYZE_BLOCK O1_BLOCK_SIZE
+
+/*
+ * What the data allows against what the static coder gets. Predicted
+ * sizes are in bytes and only count the coded data plus tables, not
+ * member headers.
+ */
+typedef struct Analysis {
+  uint64_t size;
+  int symbols;                     // distinct bytes
+  double entropy;                  // order-0 Shannon entropy, bits/byte
+  double entropy1;                 // order-1 conditional entropy, bits/byte
+  double bits_per_byte;            // static Huffman code
+  int max_depth;                   // longest static code
+  uint32_t depths[ALPHABET_SIZE];  // bytes per static code length
+  uint64_t tree_bytes;             // packed tree in the member header
+  uint64_t stored;                 // no coding at all
+  uint64_t static_bytes;           // one tree for the member
+  uint64_t blocked_bytes;          // one canonical table per block
+  uint64_t order1_bytes;           // order1 method
+} Analysis;
+
+/*
+ * Byte histogram (io_read_bytes) and static code (hc_build_code) of the
+ * file, then one more pass for the per block and per context counts
+ */
+[[nodiscard("Handling error")]]
+int analyze_file(char *filename, Analysis *an);
+
+// Name of the smallest prediction: "stored", "static", "blocked", "order1"
+const char *analyze_best(const Analysis *an);
+
+void analyze_print(FILE *out, const char *filename, const Analysis *an);
+
+#endif
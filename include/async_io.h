@@ -0,0 +1,140 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Default bytes per request, a multiple of FLT_GROUP so readers hand out
+// whole filter groups. Holes of sparse files are counted in these units
+#define AIO_CHUNK (256 * 1024)
+// Bounds of aio_set_chunk_size
+#define AIO_MIN_CHUNK 4096
+#define AIO_MAX_CHUNK (64 * 1024 * 1024)
+// Buffer address, offset and length alignment O_DIRECT asks for
+#define AIO_ALIGN 4096
+// Requests kept in flight per stream when io_uring is available
+#define AIO_DEPTH 4
+
+enum {
+  AIO_BACKEND_AUTO = 0, // io_uring when the kernel allows it
+  AIO_BACKEND_SYNC = 1, // plain read/write/pread/pwrite
+};
+
+typedef struct AioRing AioRing;
+
+// Range of a sparse file that is not read or written, see aio_*_init_holes
+typedef struct AioHole {
+  off_t offset;
+  off_t len;
+} AioHole;
+
+typedef struct AioSlot {
+  unsigned char *buf; // chunk bytes
+  size_t len;         // bytes requested (reader) or queued (writer)
+  size_t done;        // bytes transferred
+  off_t offset;
+  int state;
+} AioSlot;
+
+/*
+ * Sequential reader or writer over a file descriptor. With io_uring up to
+ * AIO_DEPTH chunks are read ahead of the consumer or written behind the
+ * producer, so coding overlaps I/O. Without it (old kernel, seccomp, pipes,
+ * AIO_BACKEND_SYNC) every chunk is a blocking syscall. The fd is not owned.
+ */
+typedef struct AioFile {
+  int fd;
+  int writing;
+  int seekable;      // pipes use read/write and no read ahead
+  size_t chunk_size; // bytes per request
+  int direct;        // page cache is bypassed or dropped, see aio_set_direct
+  int direct_fd;     // same file opened with O_DIRECT, -1 if none
+  AioRing *ring;
+  int broken;   // a submission failed, the ring is only drained
+  int depth;    // slots in use: AIO_DEPTH with a ring, 1 without
+  AioSlot slots[AIO_DEPTH];
+  int cur;      // slot being consumed or filled
+  int held;     // reader: slots[cur] was handed out by aio_reader_next
+  int eof;
+  int error;
+  off_t offset; // next request offset, end of written data after close
+  unsigned char *chunk; // aio_read: unread part of the current chunk
+  size_t avail;
+  const AioHole *holes; // not reached yet, skipped by requests
+  int hole_count;
+} AioFile;
+
+// Process wide choice, AIO_BACKEND_*
+void aio_set_backend(int backend);
+
+// 1 if streams opened now would use io_uring
+int aio_uring_available(void);
+
+// Bytes per request of streams opened from now on: a power of two between
+// AIO_MIN_CHUNK and AIO_MAX_CHUNK, -1 otherwise
+[[nodiscard("Handling error")]]
+int aio_set_chunk_size(size_t size);
+
+size_t aio_chunk_size(void);
+
+/*
+ * 1: streams opened from now on keep their data out of the page cache.
+ * Regular files are opened a second time with O_DIRECT and every request
+ * whose offset and length are AIO_ALIGN multiples goes through it; a
+ * write starting elsewhere is cut short to end on such an offset. The rest (the
+ * unaligned edges, or everything on file systems without O_DIRECT) is
+ * written back and dropped with POSIX_FADV_DONTNEED once transferred.
+ */
+void aio_set_direct(int direct);
+
+// Start reading fd from its current position. The rest of a regular file
+// that fits in one chunk is read without a ring, from a buffer of its size
+[[nodiscard("Handling error")]]
+int aio_reader_init(AioFile *f, int fd);
+
+/*
+ * Same, requests jump over holes (sorted, not owned, valid until close).
+ * Holes start at multiples of AIO_CHUNK from the start position and end at
+ * one or at the end of the file; requests stop short at a hole, so with
+ * any chunk size chunks hold whole filter groups. Seekable files only
+ */
+[[nodiscard("Handling error")]]
+int aio_reader_init_holes(AioFile *f, int fd, const AioHole *holes,
+                          int count);
+
+// Next chunk in file order, valid until the next call. Chunks are
+// f->chunk_size bytes except before a hole and the last one on regular files.
+// 0 at end, -1 on error
+ssize_t aio_reader_next(AioFile *f, unsigned char **chunk);
+
+// fread-like copy, do not mix with aio_reader_next. Check f->error on short
+size_t aio_read(AioFile *f, void *dst, size_t n);
+
+// Start writing fd at its current position
+[[nodiscard("Handling error")]]
+int aio_writer_init(AioFile *f, int fd);
+
+// Same, holes as in aio_reader_init_holes are left unwritten
+[[nodiscard("Handling error")]]
+int aio_writer_init_holes(AioFile *f, int fd, const AioHole *holes,
+                          int count);
+
+// Same, for about size bytes: up to one chunk they go out without a ring
+// from a buffer of their size. More are still written, in smaller requests
+[[nodiscard("Handling error")]]
+int aio_writer_init_size(AioFile *f, int fd, const AioHole *holes, int count,
+                         uint64_t size);
+
+[[nodiscard("Handling error")]]
+int aio_write(AioFile *f, const void *src, size_t n);
+
+// Submit the partially filled chunk without waiting for it
+[[nodiscard("Handling error")]]
+int aio_writer_flush(AioFile *f);
+
+// Wait for every request and release the buffers, -1 if any request failed
+[[nodiscard("Handling error")]]
+int aio_close(AioFile *f);
+
+#endif
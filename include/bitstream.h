@@ -0,0 +1,56 @@
+#ifndef BITSTREAM_H
+#define BITSTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * MSB-first bit writer over a growable memory buffer.
+ * Bits are packed the same way as the rest of the archive: the first bit
+ * written lands in bit 7 of the first byte.
+ */
+typedef struct BitWriter {
+  unsigned char *buf;
+  size_t cap;   // allocated bytes
+  size_t pos;   // complete bytes in buf
+  uint64_t acc; // pending bits, right aligned
+  int nbits;    // number of pending bits in acc
+  int error;    // set when an allocation failed
+} BitWriter;
+
+/*
+ * MSB-first bit reader over a memory buffer. Reading past the end yields
+ * zero bits and sets overrun, so callers can check once per block.
+ */
+typedef struct BitReader {
+  const unsigned char *buf;
+  size_t size;
+  size_t pos;
+  uint64_t acc;
+  int nbits;
+  int overrun;
+} BitReader;
+
+void bs_writer_init(BitWriter *bw);
+
+void bs_writer_reset(BitWriter *bw);
+
+void bs_writer_free(BitWriter *bw);
+
+void bs_write_bits(BitWriter *bw, uint32_t value, int count);
+
+// Pad the last byte with zero bits, returns the number of bytes in buf
+size_t bs_flush(BitWriter *bw);
+
+void bs_reader_init(BitReader *br, const unsigned char *buf, size_t size);
+
+int bs_read_bit(BitReader *br);
+
+uint32_t bs_read_bits(BitReader *br, int count);
+
+// Elias gamma code for value >= 1, small values take few bits
+void bs_write_gamma(BitWriter *bw, uint32_t value);
+
+uint32_t bs_read_gamma(BitReader *br);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "bitstream.h"
+#include "bwt.h"
+#include "huffman.h"
+#include "io_tool.h"
+#include "lz77.h"
+#include "order1.h"
+#include "split.h"
+#include <stddef.h>
+
+/*
+ * Block coders
+ *
+ * Methods other than static split each member into blocks and keep their
+ * state in a BlockCoder for the whole member.
+ */
+typedef struct BlockCoder {
+  unsigned char method;
+  size_t block_size;
+  AdaptiveModel adaptive; // IO_METHOD_ADAPTIVE, carried across blocks
+  Order1Coder *order1;    // IO_METHOD_ORDER1, scratch tables
+  BwtCoder *bwt;          // IO_METHOD_BWT, sorting arrays
+  LzCoder *lz;            // IO_METHOD_LZ77, hash chains and tokens
+  SplitCoder *split;      // IO_METHOD_SPLIT, cell histograms
+} BlockCoder;
+
+// Bytes per block of a block based method, 0 for any other method
+size_t block_size(unsigned char method);
+
+[[nodiscard("Handling error")]]
+int block_coder_init(BlockCoder *coder, unsigned char method, int level);
+
+// Start a new member with the buffers of the last one
+[[nodiscard("Handling error")]]
+int block_coder_reset(BlockCoder *coder, int level);
+
+void block_coder_free(BlockCoder *coder);
+
+// Coder for the next member of method in *coder: kept (and reset) when it
+// already codes that method, else (re)made; *has_coder tells whether
+// *coder holds one, before and after
+[[nodiscard("Handling error")]]
+int block_coder_for(BlockCoder *coder, int *has_coder, unsigned char method,
+                    int level);
+
+// Largest compressed block accepted for n original bytes
+size_t block_bound(unsigned char method, size_t n);
+
+[[nodiscard("Handling error")]]
+int block_encode(BlockCoder *coder, const unsigned char *buf, size_t n,
+                 BitWriter *bw);
+
+// FltCost of the coder's method: n bytes coded as a member of their own
+// would be, the coder is left as a new member finds it
+uint64_t block_trial_cost(void *coder, const unsigned char *buf, size_t n);
+
+[[nodiscard("Handling error")]]
+int block_decode(BlockCoder *coder, BitReader *br, unsigned char *buf,
+                 size_t n);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef BWT_H
+#define BWT_H
+
+#include "bitstream.h"
+#include "huffman.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes per block sorting block, about bzip2 -9, multiple of FLT_GROUP
+#define BWT_BLOCK_SIZE (225 * 4096)
+
+// Symbols after move-to-front and zero run coding
+#define BWT_RUNA 0
+#define BWT_RUNB 1
+#define BWT_ALPHABET 257 // RUNA, RUNB and MTF values 1..255
+
+/*
+ * Block sorting coder:
+ * Burrows-Wheeler transform -> move-to-front -> zero runs -> canonical
+ * Huffman table. Scratch arrays are sized for BWT_BLOCK_SIZE once.
+ */
+typedef struct BwtCoder {
+  uint32_t *sa;   // sorted rotations, inverse links when decoding
+  uint32_t *rank; // equivalence classes while sorting
+  uint32_t *tmp;
+  uint32_t *cnt;
+  unsigned char *last; // last column of the sorted rotations
+  uint16_t *syms;      // coded symbols
+} BwtCoder;
+
+BwtCoder *bwt_new(void);
+
+void bwt_free(BwtCoder *coder);
+
+// Writes the last column of the sorted rotations, returns the row of buf
+uint32_t bwt_forward(BwtCoder *coder, const unsigned char *buf, size_t n,
+                     unsigned char *last);
+
+void bwt_inverse(BwtCoder *coder, const unsigned char *last, size_t n,
+                 uint32_t primary, unsigned char *buf);
+
+[[nodiscard("Handling error")]]
+int bwt_encode_block(BwtCoder *coder, const unsigned char *buf, size_t n,
+                     BitWriter *bw);
+
+[[nodiscard("Handling error")]]
+int bwt_decode_block(BwtCoder *coder, BitReader *br, unsigned char *buf,
+                     size_t n);
+
+#endif
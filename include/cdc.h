@@ -0,0 +1,55 @@
+#ifndef CDC_H
+#define CDC_H
+
+#include "hash128.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Content defined chunking. A gear rolling hash runs over the bytes and a
+ * chunk ends where its top CDC_AVG_BITS bits are zero, so the cuts depend
+ * on the data around them and not on offsets: bytes inserted in a file
+ * only change the chunks next to them.
+ */
+#define CDC_MIN (2 << 10)
+#define CDC_AVG_BITS 13 // 8 KB on average
+#define CDC_MAX (64 << 10)
+
+// Length of the first chunk of buf[0 .. n). Pass at least CDC_MAX bytes
+// unless the file ends sooner, the rest of a shorter buf is one chunk
+size_t cdc_cut(const unsigned char *buf, size_t n);
+
+// A chunk and where its bytes can be read back
+typedef struct CdcChunk {
+  Hash128 hash;    // encoder only
+  uint64_t offset; // in the file of member
+  uint32_t len;
+  uint32_t crc;    // decoder only, CRC-32C of the chunk
+  uint32_t member; // input (encoder) or restored member (decoder)
+} CdcChunk;
+
+/*
+ * Chunks in the order they were first stored, the id of a chunk is its
+ * position. Encoders also find them by hash (open addressing on hash.lo)
+ */
+typedef struct CdcIndex {
+  CdcChunk *chunks;
+  uint64_t count, cap;
+  uint64_t *slots; // chunk id + 1, 0 when free; NULL without lookups
+  uint64_t slot_mask;
+} CdcIndex;
+
+// lookup 0 for decoders, which only add chunks and take them by id
+[[nodiscard("Handling error")]]
+int cdc_index_init(CdcIndex *index, int lookup);
+
+void cdc_index_free(CdcIndex *index);
+
+// Id of the first chunk with this hash and length, -1 if there is none
+int64_t cdc_index_find(const CdcIndex *index, Hash128 hash, uint32_t len);
+
+// Returns the id given to chunk or -1
+[[nodiscard("Handling error")]]
+int64_t cdc_index_add(CdcIndex *index, const CdcChunk *chunk);
+
+#endif
@@ -1,11 +1,108 @@
 #ifndef COMPRESS_H
 #define COMPRESS_H
 
+#include <stddef.h>
 #include <stdio.h>
 
+typedef struct CompressOptions {
+  unsigned char method; // IO_METHOD_*
+  int level;            // 1 (fast) .. 9 (best), LZ77 match search effort
+  unsigned char filter; // FLT_*, or FLT_AUTO to pick one per member
+} CompressOptions;
+
+// Default options: static method, filter chosen per member
+void compress_default_options(CompressOptions *options);
+
 char compress_encode_files(FILE *file, int argc, char *argv[]);
 
+char compress_encode_files_opt(FILE *file, int argc, char *argv[],
+                               const CompressOptions *options);
+
+/*
+ * Add argv[1 .. argc - 2] at the end of the archive in file (opened "r+b"),
+ * nothing before it is rewritten. The members are checked first and the
+ * method is the archive's, whatever options says. On error the archive is
+ * cut back to its old end
+ */
+[[nodiscard("Handling error")]]
+int compress_append_files(FILE *file, int argc, char *argv[],
+                          const CompressOptions *options);
+
 [[nodiscard("Handling error")]]
 int decompress_file(FILE *file);
 
+// Decode every member and check its checksums without writing anything
+[[nodiscard("Handling error")]]
+int verify_file(FILE *file);
+
+// Print name, original and stored size of every member, seeking over the
+// payloads
+[[nodiscard("Handling error")]]
+int list_file(FILE *file);
+
+/*
+ * Buffer API
+ *
+ * One frame per call: HC_BUFFER_MAGIC, format version, method, filter,
+ * varint original size, the body of the method and the CRC32C of the
+ * original bytes. Functions return HC_OK
+ * or one of the HC_ERR_* codes, they never exit the process.
+ */
+#define HC_BUFFER_MAGIC "HUFB"
+
+enum {
+  HC_OK = 0,
+  HC_ERR_ARGS = -1,    // NULL buffer, unknown method or filter
+  HC_ERR_SPACE = -2,   // dst is too small
+  HC_ERR_CORRUPT = -3, // src is not a valid frame
+  HC_ERR_MEMORY = -4,
+  HC_ERR_CHECKSUM = -5, // decoded bytes do not match the stored CRC32C
+};
+
+/*
+ * Contexts own every scratch buffer a call needs: tree, code tables, block
+ * coder and filter copies. Reusing one across calls with the same method
+ * allocates nothing once it has seen the largest block. A context serves
+ * one thread at a time.
+ */
+typedef struct HcCompressCtx HcCompressCtx;
+typedef struct HcDecompressCtx HcDecompressCtx;
+
+HcCompressCtx *hc_cctx_new(void);
+
+void hc_cctx_free(HcCompressCtx *ctx);
+
+HcDecompressCtx *hc_dctx_new(void);
+
+void hc_dctx_free(HcDecompressCtx *ctx);
+
+// dst_cap that hc_compress_buffer never runs out of for n bytes
+size_t hc_compress_bound(size_t n, unsigned char method);
+
+// options may be NULL for the defaults
+[[nodiscard("Handling error")]]
+int hc_compress_buffer(const unsigned char *src, size_t src_len,
+                       unsigned char *dst, size_t dst_cap, size_t *dst_len,
+                       const CompressOptions *options);
+
+[[nodiscard("Handling error")]]
+int hc_compress_ctx(HcCompressCtx *ctx, const unsigned char *src,
+                    size_t src_len, unsigned char *dst, size_t dst_cap,
+                    size_t *dst_len, const CompressOptions *options);
+
+// Original size stored in the frame header
+[[nodiscard("Handling error")]]
+int hc_decompressed_size(const unsigned char *src, size_t src_len,
+                         size_t *size);
+
+[[nodiscard("Handling error")]]
+int hc_decompress_buffer(const unsigned char *src, size_t src_len,
+                         unsigned char *dst, size_t dst_cap,
+                         size_t *dst_len);
+
+[[nodiscard("Handling error")]]
+int hc_decompress_ctx(HcDecompressCtx *ctx, const unsigned char *src,
+                      size_t src_len, unsigned char *dst, size_t dst_cap,
+                      size_t *dst_len);
+
 #endif
@@ -0,0 +1,25 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CRC-32C (Castagnoli), the checksum of iSCSI and ext4. On x86-64 with
+ * SSE4.2 the crc32 instruction runs three interleaved streams, elsewhere
+ * a slicing-by-8 table is used. Both give the same values.
+ */
+
+// Continue crc (0 to start) over n more bytes
+uint32_t crc32c_update(uint32_t crc, const void *buf, size_t n);
+
+// Checksum of A followed by B, from crc(A), crc(B) and the length of B
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, size_t len_b);
+
+// Force the table code even when the CPU has crc32 (tests, benchmarks)
+void crc32c_set_software(int software);
+
+// 1 if crc32c_update currently uses the crc32 instruction
+int crc32c_hardware(void);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "compress.h"
+#include <stdint.h>
+
+/*
+ * Compression daemon. The server listens on a Unix domain socket with a
+ * pool of worker threads started up front, each owning an HcCompressCtx
+ * and an HcDecompressCtx for its whole life, so a job pays neither process
+ * startup nor allocations once its worker has seen an input that large.
+ *
+ * A job turns one input into one buffer API frame, or a frame back into
+ * the original bytes. The client passes both files as descriptors
+ * (SCM_RIGHTS) or names them with absolute paths: the daemon does not
+ * share the client's working directory and creates path outputs itself.
+ * A job whose output is its input (the same file, a hard link to it) is
+ * refused before anything is truncated. A connection carries any number
+ * of jobs, one after the other: the request (descriptors attached to it),
+ * then paths_len bytes of paths, then the daemon's reply. A worker takes
+ * a connection for one job only; between jobs it waits in the acceptor's
+ * poll set, so idle clients never hold a worker. Frames are read
+ * back with `compresor --client socket -d frame out` or the buffer API.
+ */
+#define DAEMON_MAGIC "HUFD"
+#define DAEMON_MAGIC_SIZE 4
+// Inputs and outputs of a job are held whole
+#define DAEMON_INPUT_MAX (256u << 20)
+// Workers started when asked for 0: one per CPU, up to this many
+#define DAEMON_MAX_WORKERS 64
+
+enum {
+  DAEMON_OP_COMPRESS = 1,
+  DAEMON_OP_DECOMPRESS = 2,
+};
+
+// Reply status: HC_OK, an HC_ERR_* code of the buffer API or one of these
+enum {
+  DAEMON_ERR_IO = -10,    // a file could not be opened, read or written
+  DAEMON_ERR_LARGE = -11, // input or output over DAEMON_INPUT_MAX
+  DAEMON_ERR_PROTO = -12, // malformed request, or no reply came back
+};
+
+typedef struct DaemonRequest {
+  char magic[DAEMON_MAGIC_SIZE];
+  uint8_t op;     // DAEMON_OP_*
+  uint8_t method; // CompressOptions of DAEMON_OP_COMPRESS
+  uint8_t filter;
+  uint8_t level;
+  uint32_t paths_len; // input and output path, each NUL terminated; 0 when
+                      // two descriptors come with the request
+} DaemonRequest;
+
+typedef struct DaemonReply {
+  int32_t status;
+  uint32_t reserved;
+  uint64_t written; // bytes of the output
+} DaemonReply;
+
+typedef struct Daemon Daemon;
+
+// Listen on socket_path (a stale socket there is replaced) with workers
+// threads, 0 for one per CPU
+[[nodiscard("Handling error")]]
+Daemon *daemon_start(const char *socket_path, int workers);
+
+// Stop accepting, let running jobs finish, close every connection and
+// remove the socket
+void daemon_stop(Daemon *daemon);
+
+// Client side: a connected socket, or -1
+[[nodiscard("Handling error")]]
+int daemon_connect(const char *socket_path);
+
+// One job over sock on two open descriptors. Returns the reply status,
+// *written the output bytes. options NULL for the defaults
+[[nodiscard("Handling error")]]
+int daemon_run_fds(int sock, int op, int in_fd, int out_fd,
+                   const CompressOptions *options, uint64_t *written);
+
+// Same with absolute paths the daemon opens
+[[nodiscard("Handling error")]]
+int daemon_run_paths(int sock, int op, const char *in, const char *out,
+                     const CompressOptions *options, uint64_t *written);
+
+// Same with files the client opens, so relative paths work. As for path
+// jobs, an output that is the input itself is refused with HC_ERR_ARGS
+[[nodiscard("Handling error")]]
+int daemon_run_files(int sock, int op, const char *in, const char *out,
+                     const CompressOptions *options, uint64_t *written);
+
+#endif
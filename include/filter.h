@@ -0,0 +1,75 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Reversible filters applied to member bytes before counting and undone
+ * after decoding. They turn slowly changing numeric samples (int32, float)
+ * into skewed byte distributions that Huffman coding can shrink.
+ */
+enum {
+  FLT_NONE = 0,
+  FLT_DELTA1 = 1,   // byte minus previous byte
+  FLT_DELTA2 = 2,   // byte minus byte 2 positions back (int16 samples)
+  FLT_DELTA4 = 3,   // 4 back (int32/float)
+  FLT_DELTA8 = 4,   // 8 back (int64/double)
+  FLT_SHUFFLE4 = 5, // byte planes of 4-byte samples
+  FLT_SHUFFLE8 = 6, // byte planes of 8-byte samples
+  FLT_COUNT
+};
+
+// Ask for the filter to be chosen per member from a sample
+#define FLT_AUTO 0xFF
+
+// Shuffles work on groups of FLT_GROUP bytes: callers must hand over
+// chunks that are multiples of it, only the last chunk may be shorter
+#define FLT_GROUP 4096
+// Bytes of each member used to pick a filter
+#define FLT_SAMPLE (64 * 1024)
+// Bytes of the sample coded for each candidate by a FltCost, and the
+// fewest worth the trials
+#define FLT_TRIAL (16 * 1024)
+#define FLT_TRIAL_MIN FLT_GROUP
+
+typedef struct FilterState {
+  unsigned char kind;
+  unsigned char history[8]; // last stride bytes for delta filters
+  unsigned int pos;
+} FilterState;
+
+void flt_init(FilterState *state, unsigned char kind);
+
+void flt_encode(FilterState *state, unsigned char *buf, size_t n);
+
+void flt_decode(FilterState *state, unsigned char *buf, size_t n);
+
+// Coded size in bits of n bytes, UINT64_MAX when they could not be coded
+typedef uint64_t (*FltCost)(void *ctx, const unsigned char *buf, size_t n);
+
+// Filter with the smallest order-0 coded size for the sample
+unsigned char flt_choose(const unsigned char *sample, size_t n);
+
+// Same choice, trial holds n bytes of scratch instead of a malloc
+unsigned char flt_choose_with(const unsigned char *sample, size_t n,
+                              unsigned char *trial);
+
+/*
+ * flt_choose_with, then the shuffles are measured against that choice with
+ * cost (the member's own coder) on the first FLT_TRIAL bytes: they only
+ * reorder bytes, so their order-0 size is always that of FLT_NONE. A NULL
+ * cost, or a sample under FLT_TRIAL_MIN bytes, keeps the order-0 choice.
+ */
+unsigned char flt_choose_cost(const unsigned char *sample, size_t n,
+                              unsigned char *trial, FltCost cost, void *ctx);
+
+// flt_choose_cost on the start of a regular file, FLT_NONE for anything else
+unsigned char flt_choose_file(const char *file_name, FltCost cost, void *ctx);
+
+const char *flt_name(unsigned char kind);
+
+// Returns a FLT_* value, FLT_AUTO for "auto" or -1
+int flt_parse(const char *name);
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+#include "compress.h"
+#include "huffman.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Fixed codes
+ *
+ * A code table chosen ahead of time for data of a known kind (messages of
+ * one schema, text of one language) and shared by both ends, so nothing
+ * about the code travels with the data. Tables are saved as canonical
+ * code lengths in a text file:
+ *
+ *   HUFT 1
+ *   <byte> <length>     one line per byte that has a code, '#' comments
+ *
+ * tools/gen_decoder turns a saved table into a C source with the codes as
+ * constants and a decoder specialized for them. The build compiles one per
+ * file in tables/ into the library, declared in generated fixed_<name>.h.
+ * Coded data is the codes MSB first, the last byte padded with zeros, like
+ * a static member payload.
+ */
+#define HC_FIXED_MAGIC "HUFT"
+#define HC_FIXED_VERSION 1
+
+// First level of the generated lookup tables, longer codes take a second
+#define HC_FIXED_ROOT_BITS 10
+
+typedef struct HcFixedCode {
+  const char *name;
+  const HuffTable *table; // lengths, canonical codes, count/symbol arrays
+  const HcCodeTable *codes; // same codes for hc_pack_codes
+  int every_byte;           // all 256 bytes have a code
+  // size bytes from n coded bytes, HC_OK or HC_ERR_CORRUPT
+  int (*decode)(const unsigned char *src, size_t n, unsigned char *dst,
+                size_t size);
+} HcFixedCode;
+
+[[nodiscard("Handling error")]]
+int hc_fixed_read_table(FILE *file, HuffTable *table);
+
+[[nodiscard("Handling error")]]
+int hc_fixed_write_table(FILE *file, const HuffTable *table);
+
+// Table for data like the counted bytes; unseen bytes still get a code
+[[nodiscard("Handling error")]]
+int hc_fixed_table_from_counts(HuffTable *table, const uint64_t *counts);
+
+// dst bytes hc_fixed_encode never runs out of for n bytes
+size_t hc_fixed_bound(size_t n);
+
+// HC_ERR_ARGS for a byte without a code, HC_ERR_SPACE if cap is short
+[[nodiscard("Handling error")]]
+int hc_fixed_encode(const HcFixedCode *code, const unsigned char *src,
+                    size_t n, unsigned char *dst, size_t cap, size_t *len);
+
+[[nodiscard("Handling error")]]
+int hc_fixed_decode(const HcFixedCode *code, const unsigned char *src,
+                    size_t n, unsigned char *dst, size_t size);
+
+// Any table, read at run time: hc_read_symbol bit by bit
+[[nodiscard("Handling error")]]
+int hc_fixed_decode_table(const HuffTable *table, const unsigned char *src,
+                          size_t n, unsigned char *dst, size_t size);
+
+#endif
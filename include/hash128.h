@@ -0,0 +1,35 @@
+#ifndef HASH128_H
+#define HASH128_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * MurmurHash3 x64 128, fed in pieces of any length. Not cryptographic:
+ * equal hashes only point at candidates, callers compare the bytes.
+ */
+typedef struct Hash128 {
+  uint64_t lo, hi; // h1 and h2 of the reference code
+} Hash128;
+
+typedef struct Hash128State {
+  uint64_t h1, h2;
+  uint64_t len;
+  unsigned char tail[16]; // bytes waiting for a whole 16 byte block
+  size_t tail_len;
+} Hash128State;
+
+void hash128_init(Hash128State *state, uint32_t seed);
+
+void hash128_update(Hash128State *state, const void *buf, size_t n);
+
+Hash128 hash128_final(const Hash128State *state);
+
+// Whole buffer at once
+Hash128 hash128(const void *buf, size_t n, uint32_t seed);
+
+static inline int hash128_equal(Hash128 a, Hash128 b) {
+  return a.lo == b.lo && a.hi == b.hi;
+}
+
+#endif
@@ -1,6 +1,23 @@
 #ifndef HUFFMAN_H
 #define HUFFMAN_H
 
+#include "bitstream.h"
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ALPHABET_SIZE 0x100
+
+// Bytes encoded between two rebuilds of the adaptive tree
+#define HC_ADAPTIVE_BLOCK 4096
+// Counts are halved once their sum exceeds this limit
+#define HC_ADAPTIVE_LIMIT (1 << 16)
+
+// Canonical tables cover bytes plus a few extra symbols for other coders
+#define HC_MAX_SYMBOLS 320
+// Longest canonical code, lengths are stored in 4 bits
+#define HC_MAX_CODE_LENGTH 15
+
 typedef struct Node {
   unsigned char byte;
   double frequency;
@@ -8,10 +25,159 @@ typedef struct Node {
   struct Node *left, *right;
 } Node;
 
+// Longest code of a 256 leaf tree (255 bits) plus its length byte
+#define HC_CODE_BYTES (1 + ALPHABET_SIZE / 8)
+
+// Codes up to HC_WORD_BITS long live in their table entry
+#define HC_WORD_BITS 32
+
+typedef struct HcCode {
+  uint32_t word; // code right aligned, or offset in spill for long codes
+  uint32_t len;  // bits, 0 for unused bytes (and a lone symbol)
+} HcCode;
+
+/*
+ * Flat encoder table: 2 KB of {word, len} entries on their own cache
+ * lines. Longer codes only show up on very skewed inputs, their bits are
+ * kept MSB first in spill.
+ */
+typedef struct HcCodeTable {
+  alignas(64) HcCode codes[ALPHABET_SIZE];
+  unsigned char spill[ALPHABET_SIZE * (HC_CODE_BYTES - 1)];
+} HcCodeTable;
+
+/*
+ * Tree and codes in fixed storage, leaves first in nodes. A tree over
+ * ALPHABET_SIZE leaves never needs more room, so rebuilding it does not
+ * touch the allocator.
+ */
+typedef struct HuffTree {
+  Node *root;
+  unsigned char *code[ALPHABET_SIZE]; // same layout as hc_build_code
+  Node nodes[2 * ALPHABET_SIZE - 1];
+  Node *heap[ALPHABET_SIZE];
+  unsigned char bits[ALPHABET_SIZE][HC_CODE_BYTES];
+  HcCodeTable flat;                   // same codes for the encoders
+} HuffTree;
+
+typedef struct AdaptiveModel {
+  unsigned int counts[ALPHABET_SIZE];
+  unsigned long total;
+  HuffTree tree;
+} AdaptiveModel;
+
+/*
+ * Canonical Huffman table: only the code lengths have to be stored, codes
+ * are assigned in (length, symbol) order and decoded with count/symbol
+ * arrays instead of a tree.
+ */
+typedef struct HuffTable {
+  int nsyms;
+  unsigned char lens[HC_MAX_SYMBOLS];
+  uint32_t codes[HC_MAX_SYMBOLS];
+  unsigned short count[HC_MAX_CODE_LENGTH + 1]; // codes of each length
+  unsigned short symbol[HC_MAX_SYMBOLS];        // symbols in code order
+} HuffTable;
+
 unsigned char **hc_endoce_file(char *file_name, Node **root);
 
+// Tree and code for the file as seen through filter (FLT_*)
+unsigned char **hc_encode_file_filtered(char *file_name, Node **root,
+                                        unsigned char filter);
+
+// Same, counting only the data between holes as io_save_static codes it
+unsigned char **hc_encode_file_sparse(char *file_name, Node **root,
+                                      unsigned char filter);
+
+// arr holds ALPHABET_SIZE leaves with counts, it is reordered in place
+Node *hc_tree_from_histogram(Node *arr, double total);
+
+// Code of every leaf: code[c][0] bits, MSB first in code[c][1..]
+unsigned char **hc_build_code(Node *root);
+
+// Flat copy of codes laid out as by hc_build_code
+void hc_code_table_build(HcCodeTable *table, unsigned char *const *code);
+
+/*
+ * Append the codes of in to out, 4 bytes at a time. acc keeps the pending
+ * bits (right aligned, nbits < 32 of them) between calls. Returns bytes
+ * written
+ */
+size_t hc_pack_codes(const HcCodeTable *table, const unsigned char *in,
+                     size_t n, unsigned char *out, uint64_t *acc, int *nbits);
+
+// Write the pending bits padded with zeros, returns bytes written (<= 4)
+size_t hc_pack_flush(uint64_t *acc, int *nbits, unsigned char *out);
+
+// Same bits through a BitWriter
+static inline void hc_write_code(BitWriter *bw, const HcCodeTable *table,
+                                 unsigned char byte) {
+  const HcCode *c = &table->codes[byte];
+  if (c->len <= HC_WORD_BITS) {
+    bs_write_bits(bw, c->word, c->len);
+    return;
+  }
+  const unsigned char *p = table->spill + c->word;
+  for (uint32_t j = 0; j < c->len; j += 8, ++p) {
+    int k = c->len - j < 8 ? c->len - j : 8;
+    bs_write_bits(bw, *p >> (8 - k), k);
+  }
+}
+
+// Same tree and codes as hc_tree_from_histogram + hc_build_code, stored in
+// tree. -1 if arr has no used byte
+[[nodiscard("Handling error")]]
+int hc_tree_build(HuffTree *tree, Node *arr, double total);
+
 int hc_free_tree(Node *root);
 
 int hc_free_code(unsigned char **code);
 
+[[nodiscard("Handling error")]]
+int hc_adaptive_init(AdaptiveModel *model);
+
+void hc_adaptive_free(AdaptiveModel *model);
+
+// Encode n bytes with the current tree, then update the model
+[[nodiscard("Handling error")]]
+int hc_adaptive_encode_block(AdaptiveModel *model, const unsigned char *buf,
+                             size_t n, BitWriter *bw);
+
+// Decode n bytes with the current tree, then update the model
+[[nodiscard("Handling error")]]
+int hc_adaptive_decode_block(AdaptiveModel *model, BitReader *br,
+                             unsigned char *buf, size_t n);
+
+// Code lengths limited to max_len, unused symbols get length 0
+[[nodiscard("Handling error")]]
+int hc_lengths_from_counts(const uint32_t *counts, int nsyms,
+                           unsigned char *lens, int max_len);
+
+// Assign canonical codes, fails if the lengths are not a prefix code
+[[nodiscard("Handling error")]]
+int hc_table_build(HuffTable *table, const unsigned char *lens, int nsyms);
+
+[[nodiscard("Handling error")]]
+int hc_table_from_counts(HuffTable *table, const uint32_t *counts, int nsyms);
+
+// Lengths of used symbols: 9-bit count, then gamma gap and 4-bit length
+void hc_table_write(BitWriter *bw, const HuffTable *table);
+
+[[nodiscard("Handling error")]]
+int hc_table_read(BitReader *br, HuffTable *table, int nsyms);
+
+// Bits hc_table_write takes for this table
+uint32_t hc_table_header_bits(const HuffTable *table);
+
+// Bits needed to code counts with table, header excluded
+uint64_t hc_table_cost(const HuffTable *table, const uint32_t *counts);
+
+static inline void hc_write_symbol(BitWriter *bw, const HuffTable *table,
+                                   int sym) {
+  bs_write_bits(bw, table->codes[sym], table->lens[sym]);
+}
+
+// Returns the symbol or -1 on an invalid code
+int hc_read_symbol(BitReader *br, const HuffTable *table);
+
 #endif
@@ -1,29 +1,343 @@
 #ifndef IO_TOOL_H
 #define IO_TOOL_H
 
+#include "async_io.h"
+#include "cdc.h"
+#include "hash128.h"
 #include "huffman.h"
 #include "stdio.h"
+#include <stdint.h>
 
+// Every archive starts with IO_MAGIC, the format version and the method
+#define IO_MAGIC "HUFZ"
+#define IO_MAGIC_SIZE 4
+// 2: CRC32C of the original bytes after every block and member
+// 3: stored length (and original size for block methods) in member headers
+// 4: compact member headers (io_write_header)
+// 5: hole map of sparse files in member headers
+// 6: duplicate members (IO_FILTER_DUP)
+#define IO_FORMAT_VERSION 6
+
+enum {
+  IO_METHOD_STATIC = 0,   // one tree per member, stored in the header
+  IO_METHOD_ADAPTIVE = 1, // no tree, rebuilt every HC_ADAPTIVE_BLOCK bytes
+  IO_METHOD_ORDER1 = 2,   // one table per previous byte, per O1_BLOCK_SIZE
+  IO_METHOD_BWT = 3,      // block sorting + move-to-front before coding
+  IO_METHOD_LZ77 = 4,     // matches + literals, deflate style alphabets
+  IO_METHOD_SOLID = 5,    // one tree per group of members (io_save_solid)
+  IO_METHOD_SPLIT = 6,    // one table per segment where statistics change
+  IO_METHOD_DEDUP = 7,    // chunks stored once, new ones coded as split
+};
+
+// Adds the byte counts of file to pq[byte], returns the size or -1
 double io_read_bytes(Node *pq, char *file);
 
+double io_read_bytes_filtered(Node *pq, char *file, unsigned char filter);
+
+// Same, skipping the holes of io_hole_map as sparse members do
+double io_read_bytes_sparse(Node *pq, char *file, unsigned char filter);
+
 [[nodiscard("Handling error")]]
 int io_save_code(FILE *file, char *filename, unsigned char **huff_code,
                  Node *root);
 
+// Same as io_save_code, bytes go through filter (FLT_*) before coding
+[[nodiscard("Handling error")]]
+int io_save_code_filtered(FILE *file, char *filename,
+                          unsigned char **huff_code, Node *root,
+                          unsigned char filter);
+
 int io_read_filename(FILE *file, char *filename);
 
 [[nodiscard("Handling error")]]
 Node *io_read_huffman_tree(FILE *file);
 
+// Preorder tree: 1 for internal nodes, 0 and the byte for leaves.
+// Returns the position after the tree in buffer
+int io_write_in_orden(Node *node, unsigned char *buffer, int index);
+
+// Tree written by io_write_in_orden at buf[*pos], NULL if it is malformed
+[[nodiscard("Handling error")]]
+Node *io_parse_tree(const unsigned char *buf, size_t n, size_t *pos);
+
+// Same, the nodes are taken from tree (codes are left alone)
+[[nodiscard("Handling error")]]
+int io_parse_tree_into(const unsigned char *buf, size_t n, size_t *pos,
+                       HuffTree *tree);
+
 [[nodiscard("Handling error")]]
 off_t io_read_file_size(FILE *file);
 
+[[nodiscard("Handling error")]]
+int io_read_filter(FILE *file);
+
+// wfile NULL only checks the member against its checksum
 [[nodiscard("Handling error")]]
 int io_write_decompress_file(FILE *wfile, FILE *rfile, Node *root,
-                             off_t file_size);
+                             off_t file_size, unsigned char filter);
 
 FILE *io_open_unique_file(const char *filename, const char *mode);
 
+// Same, path gets the name actually opened (IO_NAME_MAX + 1 bytes)
+FILE *io_open_unique_path(const char *filename, const char *mode,
+                          char *path);
+
+// Ask the kernel to start reading a file we are going to need soon
+void io_prefetch_file(const char *filename);
+
 int io_is_end_of_file(FILE *file);
 
+[[nodiscard("Handling error")]]
+int io_write_archive_header(FILE *file, unsigned char method);
+
+// Returns the method stored in the header or -1
+[[nodiscard("Handling error")]]
+int io_read_archive_header(FILE *file);
+
+// Longest LEB128 encoding of a 64-bit value
+#define IO_VARINT_MAX 10
+
+// Encode value at out, returns the bytes used
+size_t io_put_varint(unsigned char *out, uint64_t value);
+
+int io_write_varint(FILE *file, uint64_t value);
+
+// Decode the varint at buf[*pos] and move *pos past it
+[[nodiscard("Handling error")]]
+int io_get_varint(const unsigned char *buf, size_t n, size_t *pos,
+                  uint64_t *value);
+
+[[nodiscard("Handling error")]]
+int io_read_varint(FILE *file, uint64_t *value);
+
+// Checksums are stored as 4 bytes, little endian
+#define IO_CRC_SIZE 4
+
+void io_store_crc(unsigned char *out, uint32_t crc);
+
+uint32_t io_load_crc(const unsigned char *in);
+
+/*
+ * io_save_code writes a standalone member: name, byte tree, off_t size,
+ * filter, the stored length in IO_LENGTH_SIZE bytes little endian (zero if
+ * the file could not seek), payload and checksum
+ */
+#define IO_LENGTH_SIZE 8
+
+void io_store_u64(unsigned char *out, uint64_t value);
+
+uint64_t io_load_u64(const unsigned char *in);
+
+[[nodiscard("Handling error")]]
+int io_read_u64(FILE *file, uint64_t *value);
+
+/*
+ * Archive members start with a compact header: its length as a varint,
+ * then
+ *   varint shared   bytes taken from the name of the previous member
+ *   varint n        and n more bytes of the name
+ *   filter          one byte
+ *   varint size     original bytes
+ *   varint payload  bytes from the end of the header to the end of the
+ *                   member, 0 when the archive could not seek
+ *   varint holes    then for each hole the bytes of data since the end
+ *                   of the previous one and its length, both varints
+ *   tree            static members only, io_pack_tree
+ * Size and payload are filled in after the member is written, their
+ * varints are padded to the width their largest possible value needs.
+ * Size counts the holes, the payload only codes the data between them.
+ *
+ * A member with the same bytes as an earlier one of the archive has
+ * IO_FILTER_DUP as filter, then only varint size and varint back, how
+ * many members before it the original is. It has no payload.
+ */
+#define IO_FILTER_DUP 0xFF
+#define IO_NAME_MAX 255
+// 511 node flags and 256 leaf bytes
+#define IO_TREE_MAX ((2 * ALPHABET_SIZE - 1 + 8 * ALPHABET_SIZE + 7) / 8)
+// Holes kept per member, later ones are coded as zeros
+#define IO_HOLES_MAX 1024
+#define IO_HEADER_MAX                                                        \
+  (5 * IO_VARINT_MAX + IO_NAME_MAX + 1 + 2 * IO_VARINT_MAX * IO_HOLES_MAX + \
+   IO_TREE_MAX)
+
+typedef struct IoHeader {
+  char name[IO_NAME_MAX + 1]; // the next header shares a prefix with it
+  unsigned char filter;
+  uint64_t size;
+  uint64_t payload;
+  uint64_t data; // size without the holes: the bytes the payload decodes to
+  uint64_t dup; // IO_FILTER_DUP members: back to the original, else 0
+  int hole_count;
+  AioHole holes[IO_HOLES_MAX];
+  Node *root;                        // static members, nodes from pool
+  Node pool[2 * ALPHABET_SIZE - 1];
+} IoHeader;
+
+/*
+ * Holes of a regular file of size bytes (SEEK_HOLE / SEEK_DATA), shrunk to
+ * AIO_CHUNK boundaries as aio_reader_init_holes needs: smaller holes are
+ * left as data. Returns how many were stored, 0 if the file system cannot
+ * tell. The file position is left at 0
+ */
+int io_hole_map(int fd, off_t size, AioHole *holes);
+
+// Before the first header of an archive
+void io_header_init(IoHeader *header);
+
+[[nodiscard("Handling error")]]
+int io_read_header(FILE *file, unsigned char method, IoHeader *header);
+
+// Preorder tree with one bit per node kind and 8 bits per leaf byte,
+// returns the bytes used (up to IO_TREE_MAX)
+size_t io_pack_tree(const Node *root, unsigned char *out);
+
+// Static member with a compact header, huff_code counts the data between
+// the holes (hc_encode_file_sparse), NULL when there is none (the member
+// then has no tree). last_name holds the previous name of the archive
+// ("" at first, IO_NAME_MAX + 1 bytes) and is updated
+[[nodiscard("Handling error")]]
+int io_save_static(FILE *file, char *last_name, char *filename,
+                   unsigned char **huff_code, Node *root,
+                   unsigned char filter);
+
+// Member with the bytes of the one back members before it (io_read_header
+// sets header->dup), size is checked when it is restored
+[[nodiscard("Handling error")]]
+int io_save_dup(FILE *file, char *last_name, const char *filename,
+                uint64_t size, uint64_t back);
+
+// Hash128 (seed 0) of the whole file
+[[nodiscard("Handling error")]]
+int io_hash_file(const char *filename, Hash128 *hash);
+
+// 1 if both files hold the same bytes, 0 if not, -1 on error
+[[nodiscard("Handling error")]]
+int io_same_file(const char *a, const char *b);
+
+// Defined in block.h
+typedef struct BlockCoder BlockCoder;
+
+// io_same_file between filename and the member after header (read by
+// io_read_header), decoded into a temporary file. coder NULL for static
+[[nodiscard("Handling error")]]
+int io_member_matches(FILE *rfile, BlockCoder *coder, const IoHeader *header,
+                      const char *filename);
+
+// Restore a duplicate member into wfile from the output of its original:
+// a reflink (FICLONE) where the file system shares extents, else
+// copy_file_range, else read and write. The result must be size bytes
+[[nodiscard("Handling error")]]
+int io_copy_file(FILE *wfile, const char *source, uint64_t size);
+
+// Read the header at the current position and seek past the payload,
+// *stored gets the bytes of the whole member. Members without lengths are
+// walked (blocks) or decoded (static)
+[[nodiscard("Handling error")]]
+int io_read_member_info(FILE *file, unsigned char method, IoHeader *header,
+                        uint64_t *stored);
+
+// Members of block based methods (adaptive, order1, bwt, lz77), level only
+// matters for lz77
+[[nodiscard("Handling error")]]
+int io_save_blocks(FILE *file, char *filename, unsigned char method,
+                   int level, unsigned char filter);
+
+// Blocks after a header read by io_read_header. wfile NULL only checks
+// them against their checksums
+[[nodiscard("Handling error")]]
+int io_write_blocks_decompress_file(FILE *wfile, FILE *rfile,
+                                    unsigned char method,
+                                    unsigned char filter);
+
+// Same as io_save_blocks with a coder kept by the caller between members,
+// reset (block_coder_reset) before each one. last_name as in
+// io_save_static, NULL to store the whole name
+[[nodiscard("Handling error")]]
+int io_save_blocks_with(FILE *file, char *last_name, char *filename,
+                        BlockCoder *coder, unsigned char filter);
+
+[[nodiscard("Handling error")]]
+int io_write_blocks_decompress_with(FILE *wfile, FILE *rfile,
+                                    BlockCoder *coder, unsigned char filter);
+
+/*
+ * Member after a header read by io_read_header into wfile (NULL only
+ * checks it), coder NULL for static members. The output is sized first
+ * with its data extents allocated when the payload could plausibly hold
+ * that much, holes are only seeked over
+ */
+[[nodiscard("Handling error")]]
+int io_write_member(FILE *wfile, FILE *rfile, BlockCoder *coder,
+                    const IoHeader *header);
+
+/*
+ * IO_METHOD_DEDUP members: the file is cut into chunks (cdc_cut), chunks
+ * already in the index become references and the new ones are coded in
+ * blocks. The payload is a list of records, each starting with a varint:
+ *   0                 end of the member, its CRC-32C follows
+ *   count << 1 | 1    count new chunks: their lengths as varints, then one
+ *                     block of their bytes (filtered from its own start):
+ *                     varint coded bytes, block_encode bits, CRC-32C
+ *   back << 1         the chunk stored back chunks before the next new one
+ * References are relative, so members appended later still point right.
+ * Holes are not kept, their zeros make chunks that are stored once.
+ */
+// sources[member] is filename, sources[i] the files of earlier chunks:
+// a chunk is only referenced once its bytes are compared with them
+[[nodiscard("Handling error")]]
+int io_save_chunked(FILE *file, char *last_name, char *filename,
+                    BlockCoder *coder, unsigned char filter, CdcIndex *index,
+                    char **sources, uint32_t member);
+
+// Member after a header read by io_read_header into wfile (NULL only
+// checks it). paths[i] holds restored member i, references to member
+// (this one) are read from wfile; verify mode passes no paths
+[[nodiscard("Handling error")]]
+int io_write_chunked(FILE *wfile, FILE *rfile, BlockCoder *coder,
+                     const IoHeader *header, CdcIndex *index, char **paths,
+                     uint32_t member);
+
+// Solid groups: members share one tree and one code stream, up to
+// IO_SOLID_MEMBERS members or about IO_SOLID_BYTES bytes per group
+#define IO_SOLID_MEMBERS 4096
+#define IO_SOLID_BYTES (64ull << 20)
+
+// One group of count files, filters[i] for filenames[i]. last_name as in
+// io_save_static
+[[nodiscard("Handling error")]]
+int io_save_solid(FILE *file, char *last_name, char **filenames,
+                  const unsigned char *filters, int count);
+
+typedef struct IoSolidMember {
+  char name[IO_NAME_MAX + 1];
+  unsigned char filter;
+  uint64_t size;
+  uint32_t crc;
+} IoSolidMember;
+
+// Reader state, reused for every group of an archive
+typedef struct IoSolidGroup IoSolidGroup;
+
+[[nodiscard("Handling error")]]
+IoSolidGroup *io_solid_group_new(void);
+
+void io_solid_group_free(IoSolidGroup *group);
+
+// Header of the next group, its members are then decoded in order
+[[nodiscard("Handling error")]]
+int io_read_solid_group(FILE *file, IoSolidGroup *group);
+
+int io_solid_count(const IoSolidGroup *group);
+
+// Bytes of the code stream after the header
+uint64_t io_solid_payload(const IoSolidGroup *group);
+
+const IoSolidMember *io_solid_member(const IoSolidGroup *group, int index);
+
+// Member index of the group into wfile, NULL only checks it
+[[nodiscard("Handling error")]]
+int io_solid_decode_member(FILE *rfile, IoSolidGroup *group, int index,
+                           FILE *wfile);
+
 #endif
@@ -0,0 +1,57 @@
+#ifndef LZ77_H
+#define LZ77_H
+
+#include "bitstream.h"
+#include "huffman.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define LZ_BLOCK_SIZE (1 << 20)
+#define LZ_WINDOW 32768 // farthest distance a match may reach back
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH 258
+#define LZ_HASH_BITS 15
+
+// deflate alphabets: literals, end of block and 29 length codes; 30 distances
+#define LZ_END_OF_BLOCK 256
+#define LZ_LITLEN_SYMBOLS 286
+#define LZ_DIST_SYMBOLS 30
+
+#define LZ_DEFAULT_LEVEL 6
+
+typedef struct LzToken {
+  uint16_t value; // literal byte or match length
+  uint16_t dist;  // 0 for literals
+} LzToken;
+
+/*
+ * LZ77 coder: hash chains over the block find earlier copies, tokens are
+ * coded with one literal/length table and one distance table per block.
+ * The level sets how many chain links are followed per position.
+ */
+typedef struct LzCoder {
+  int level;
+  int32_t head[1 << LZ_HASH_BITS];
+  int32_t *prev; // previous position with the same hash
+  LzToken *tokens;
+} LzCoder;
+
+LzCoder *lz_new(int level);
+
+void lz_free(LzCoder *coder);
+
+// Clamped to 1..9, applies from the next block
+void lz_set_level(LzCoder *coder, int level);
+
+// Split buf into tokens, returns their number
+size_t lz_parse(LzCoder *coder, const unsigned char *buf, size_t n);
+
+[[nodiscard("Handling error")]]
+int lz_encode_block(LzCoder *coder, const unsigned char *buf, size_t n,
+                    BitWriter *bw);
+
+[[nodiscard("Handling error")]]
+int lz_decode_block(LzCoder *coder, BitReader *br, unsigned char *buf,
+                    size_t n);
+
+#endif
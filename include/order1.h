@@ -0,0 +1,40 @@
+#ifndef ORDER1_H
+#define ORDER1_H
+
+#include "bitstream.h"
+#include "huffman.h"
+
+// Bytes per order-1 block, each block carries its own tables
+#define O1_BLOCK_SIZE (1 << 20)
+// Index of the table shared by contexts too rare to pay for their own
+#define O1_SHARED ALPHABET_SIZE
+
+/*
+ * Order-1 coder: the table used for a byte depends on the byte before it.
+ * Contexts whose own table would not pay for its header are grouped into
+ * one shared table.
+ */
+typedef struct Order1Coder {
+  uint32_t counts[ALPHABET_SIZE + 1][ALPHABET_SIZE]; // [context][byte]
+  unsigned char own[ALPHABET_SIZE];                  // context has a table
+  HuffTable tables[ALPHABET_SIZE + 1];
+} Order1Coder;
+
+Order1Coder *o1_new(void);
+
+void o1_free(Order1Coder *coder);
+
+// Bits o1_encode_block would write for buf, -1 on error. counts keeps
+// the context histograms of buf afterwards
+[[nodiscard("Handling error")]]
+int64_t o1_block_bits(Order1Coder *coder, const unsigned char *buf, size_t n);
+
+[[nodiscard("Handling error")]]
+int o1_encode_block(Order1Coder *coder, const unsigned char *buf, size_t n,
+                    BitWriter *bw);
+
+[[nodiscard("Handling error")]]
+int o1_decode_block(Order1Coder *coder, BitReader *br, unsigned char *buf,
+                    size_t n);
+
+#endif
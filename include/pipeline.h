@@ -0,0 +1,64 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Items in flight on each side of the compute stage
+#define PIPE_DEPTH 3
+
+/*
+ * Bounded single producer / single consumer queue of pointers. Push and pop
+ * are lock free; a side that finds the queue full (empty) spins briefly,
+ * then sleeps on a futex until the other side moves.
+ */
+typedef struct SpscRing {
+  alignas(64) _Atomic uint32_t head; // next item to pop, consumer owned
+  alignas(64) _Atomic uint32_t tail; // next free slot, producer owned
+  alignas(64) _Atomic uint32_t waiters;
+  uint32_t mask;
+  void **items;
+} SpscRing;
+
+[[nodiscard("Handling error")]]
+int spsc_init(SpscRing *ring, uint32_t capacity);
+
+void spsc_free(SpscRing *ring);
+
+void spsc_push(SpscRing *ring, void *item);
+
+void *spsc_pop(SpscRing *ring);
+
+// Return values of the stage callbacks
+enum { PIPE_OK = 0, PIPE_END = 1, PIPE_ERROR = -1 };
+
+/*
+ * Three stage pipeline: read runs on its own thread and fills input items,
+ * work runs on the calling thread and turns one input item into one output
+ * item, write runs on its own thread and drains output items. Items are
+ * owned by the caller and recycled through the queues, PIPE_DEPTH of each.
+ *
+ * read returns PIPE_OK with an item filled, PIPE_END at end of input.
+ * work returns PIPE_END when it needs no more input: its output is still
+ * written and the reader stops. Any PIPE_ERROR stops all stages.
+ *
+ * A caller whose input fits in one item sets small: the stages then run
+ * one after the other on the calling thread with in[0] and out[0] only,
+ * since there is nothing to overlap that would pay for the threads.
+ */
+typedef struct PipeStages {
+  int (*read)(void *ctx, void *in);
+  int (*work)(void *ctx, void *in, void *out);
+  int (*write)(void *ctx, void *out);
+  void *ctx;
+  void *in[PIPE_DEPTH];
+  void *out[PIPE_DEPTH];
+  int small;
+} PipeStages;
+
+// 0 when every stage succeeded, the reader and writer threads are joined
+[[nodiscard("Handling error")]]
+int pipe_run(PipeStages *stages);
+
+#endif
@@ -13,7 +13,11 @@ char pq_is_full(PriorityQueue* pq);
 
 char pq_is_empty(PriorityQueue* pq);
 
-void pq_new(PriorityQueue* pq, Node* arr, int size);
+// Copies the size nodes of arr, -1 if out of memory
+int pq_new(PriorityQueue* pq, Node* arr, int size);
+
+// Queue over caller storage of capacity pointers, nothing to erase
+void pq_init(PriorityQueue* pq, Node** storage, int capacity);
 
 void pq_erase(PriorityQueue* pq);
 
@@ -21,11 +25,13 @@ void pq_heapifyUp(PriorityQueue* pq,int idx);
 
 void pq_heapifyDown(PriorityQueue* pq,int idx);
 
-void pq_push(PriorityQueue* pq, Node* n);
+// -1 when the queue is full
+int pq_push(PriorityQueue* pq, Node* n);
 
+// NULL when the queue is empty
 Node* pq_top(PriorityQueue* pq);
 
-void pq_pop(PriorityQueue* pq);
+int pq_pop(PriorityQueue* pq);
 
 
 #endif
@@ -0,0 +1,42 @@
+#ifndef SPLIT_H
+#define SPLIT_H
+
+#include "bitstream.h"
+#include "huffman.h"
+
+// Bytes per split block
+#define SPLIT_BLOCK_SIZE (1 << 20)
+// Segments start and end on cells of this many bytes
+#define SPLIT_CELL 4096
+#define SPLIT_CELLS (SPLIT_BLOCK_SIZE / SPLIT_CELL)
+
+/*
+ * Order-0 coder that cuts a block into segments where the byte statistics
+ * change and gives each segment its own canonical table. A cut is kept
+ * only when the two tables plus the cut cost fewer bits than one table.
+ */
+typedef struct SplitCoder {
+  uint32_t prefix[SPLIT_CELLS + 1][ALPHABET_SIZE]; // counts before each cell
+  uint32_t counts[ALPHABET_SIZE];
+  uint16_t ends[SPLIT_CELLS]; // last cell (exclusive) of each segment
+  int segments;
+  HuffTable table;
+} SplitCoder;
+
+SplitCoder *split_new(void);
+
+void split_free(SplitCoder *coder);
+
+// Segments chosen for buf (in coder->ends), -1 on error
+[[nodiscard("Handling error")]]
+int split_plan(SplitCoder *coder, const unsigned char *buf, size_t n);
+
+[[nodiscard("Handling error")]]
+int split_encode_block(SplitCoder *coder, const unsigned char *buf, size_t n,
+                       BitWriter *bw);
+
+[[nodiscard("Handling error")]]
+int split_decode_block(SplitCoder *coder, BitReader *br, unsigned char *buf,
+                       size_t n);
+
+#endif
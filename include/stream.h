@@ -0,0 +1,68 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "compress.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Streaming API
+ *
+ * The caller points in / avail_in at whatever input it has and out /
+ * avail_out at whatever room it has, then calls hc_stream_compress or
+ * hc_stream_decompress as often as it likes, in the style of zlib. A call
+ * consumes and produces what it can and returns: nothing blocks, nothing
+ * reads or writes a file, so a non-blocking server can drive it from its
+ * event loop.
+ *
+ * A stream is HC_STREAM_MAGIC, format version, method and filter, then the
+ * same blocks as a buffer API frame (varint original and coded size, coded
+ * block, CRC32C), a varint 0 and the CRC32C of all original bytes. The
+ * size is not known up front, so it is not stored. Only block methods
+ * stream: adaptive, order1, bwt, lz77 and split.
+ */
+#define HC_STREAM_MAGIC "HUFS"
+
+// Returned once the whole stream went through, after HC_OK calls
+#define HC_STREAM_END 1
+
+typedef struct HcStreamState HcStreamState;
+
+typedef struct HcStream {
+  const unsigned char *in; // next input byte
+  size_t avail_in;
+  unsigned char *out; // next output byte
+  size_t avail_out;
+  uint64_t total_in, total_out;
+  HcStreamState *state;
+} HcStream;
+
+// options may be NULL for lz77; FLT_AUTO picks the filter on the first block
+[[nodiscard("Handling error")]]
+int hc_stream_compress_init(HcStream *stream, const CompressOptions *options);
+
+/*
+ * Codes a block each time one fills up. With finish set, whatever is held
+ * becomes the last block and the stream is closed: keep calling with
+ * finish set, and room in out, until HC_STREAM_END
+ */
+[[nodiscard("Handling error")]]
+int hc_stream_compress(HcStream *stream, int finish);
+
+[[nodiscard("Handling error")]]
+int hc_stream_decompress_init(HcStream *stream);
+
+/*
+ * HC_OK when it needs more input or more room, HC_STREAM_END after the
+ * final checksum matched. Bytes after the stream stay in in / avail_in
+ */
+[[nodiscard("Handling error")]]
+int hc_stream_decompress(HcStream *stream);
+
+// Start another stream with the same options, keeping every buffer
+[[nodiscard("Handling error")]]
+int hc_stream_reset(HcStream *stream);
+
+void hc_stream_end(HcStream *stream);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef WALK_H
+#define WALK_H
+
+#include <stddef.h>
+
+// Threads used by walk_paths when asked for 0
+#define WALK_MAX_THREADS 16
+
+typedef struct WalkList {
+  char **paths;
+  size_t count;
+  size_t cap;
+} WalkList;
+
+/*
+ * Expand the directories among paths into the regular files below them.
+ * Directories are read by several threads at once (openat, getdents64,
+ * fstatat on the entries the kernel gives no type for), symbolic links are
+ * not followed and other special files are skipped. The files of each
+ * directory argument are sorted so a directory's files stay together and
+ * subdirectories come after them; any other argument is kept as given, in
+ * its place. threads 0 picks one per CPU up to WALK_MAX_THREADS.
+ */
+[[nodiscard("Handling error")]]
+int walk_paths(char *const *paths, int count, int threads, WalkList *list);
+
+void walk_list_free(WalkList *list);
+
+#endif
@@ -0,0 +1,179 @@
+#include "analyze.h"
+#include "async_io.h"
+#include "io_tool.h"
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Shannon bits of a histogram: N log2 N - sum c log2 c
+static double analyze_bits(const uint64_t *counts) {
+  double total = 0, sum = 0;
+  for (int s = 0; s < ALPHABET_SIZE; ++s) {
+    if (counts[s] > 0) {
+      total += counts[s];
+      sum += counts[s] * log2((double)counts[s]);
+    }
+  }
+  return total > 0 ? total * log2(total) - sum : 0;
+}
+
+// Histogram and static tree, built as compress_static_file builds them
+static int analyze_static(char *filename, Analysis *an) {
+  Node arr[ALPHABET_SIZE];
+  for (int i = 0; i < ALPHABET_SIZE; ++i) {
+    arr[i].byte = i;
+    arr[i].frequency = 0;
+    arr[i].is_leaf = 1;
+    arr[i].left = arr[i].right = NULL;
+  }
+  double total = io_read_bytes(arr, filename);
+  if (total < 0)
+    return -1;
+  uint64_t counts[ALPHABET_SIZE];
+  for (int i = 0; i < ALPHABET_SIZE; ++i) {
+    counts[i] = arr[i].frequency;
+    an->symbols += counts[i] > 0;
+  }
+  an->size = an->stored = total;
+  if (an->symbols == 0)
+    return 0;
+  an->entropy = analyze_bits(counts) / total;
+
+  // hc_tree_from_histogram reorders arr, counts keeps the byte order
+  Node *root = hc_tree_from_histogram(arr, total);
+  unsigned char **code = root != NULL ? hc_build_code(root) : NULL;
+  if (code == NULL) {
+    fprintf(stderr, "Error building the tree of %s\n", filename);
+    hc_free_tree(root);
+    return -1;
+  }
+  uint64_t bits = 0;
+  for (int c = 0; c < ALPHABET_SIZE; ++c) {
+    if (counts[c] == 0 || code[c] == NULL)
+      continue;
+    int len = code[c][0]; // 0 for a lone byte, the static coder stores none
+    ++an->depths[len];
+    if (len > an->max_depth)
+      an->max_depth = len;
+    bits += counts[c] * len;
+  }
+  an->bits_per_byte = bits / total;
+  unsigned char tree[IO_TREE_MAX];
+  an->tree_bytes = io_pack_tree(root, tree);
+  an->static_bytes = (bits + 7) / 8 + an->tree_bytes;
+  hc_free_code(code);
+  hc_free_tree(root);
+  return 0;
+}
+
+/*
+ * Blocks of ANALYZE_BLOCK bytes: an order-0 table per block and the
+ * order-1 tables o1_encode_block would pick, both padded to bytes like
+ * coded blocks are. The context counts add up to the order-1 entropy.
+ */
+static int analyze_blocks(char *filename, Analysis *an) {
+  int fd = open(filename, O_RDONLY);
+  AioFile reader;
+  if (fd < 0 || aio_reader_init(&reader, fd) != 0) {
+    fprintf(stderr, "No se pudo leer el archivo: %s\n", filename);
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  unsigned char *buf = malloc(ANALYZE_BLOCK);
+  Order1Coder *o1 = o1_new();
+  uint64_t(*pairs)[ALPHABET_SIZE] = calloc(ALPHABET_SIZE, sizeof(*pairs));
+  int status = buf == NULL || o1 == NULL || pairs == NULL ? -1 : 0;
+  size_t n;
+  while (status == 0 && (n = aio_read(&reader, buf, ANALYZE_BLOCK)) > 0) {
+    uint32_t counts[ALPHABET_SIZE] = {0};
+    for (size_t i = 0; i < n; ++i)
+      ++counts[buf[i]];
+    HuffTable table;
+    int64_t o1_bits = o1_block_bits(o1, buf, n);
+    if (o1_bits < 0 ||
+        hc_table_from_counts(&table, counts, ALPHABET_SIZE) != 0) {
+      status = -1;
+      break;
+    }
+    an->blocked_bytes += (hc_table_header_bits(&table) +
+                          hc_table_cost(&table, counts) + 7) /
+                         8;
+    an->order1_bytes += (o1_bits + 7) / 8;
+    for (int c = 0; c < ALPHABET_SIZE; ++c)
+      for (int s = 0; s < ALPHABET_SIZE; ++s)
+        pairs[c][s] += o1->counts[c][s];
+  }
+  if (aio_close(&reader) != 0)
+    status = -1;
+  close(fd);
+  if (status == 0 && an->size > 0) {
+    double bits = 0;
+    for (int c = 0; c < ALPHABET_SIZE; ++c)
+      bits += analyze_bits(pairs[c]);
+    an->entropy1 = bits / an->size;
+  } else if (status != 0) {
+    fprintf(stderr, "Error analyzing file: %s\n", filename);
+  }
+  free(pairs);
+  o1_free(o1);
+  free(buf);
+  return status;
+}
+
+int analyze_file(char *filename, Analysis *an) {
+  memset(an, 0, sizeof(Analysis));
+  if (analyze_static(filename, an) != 0)
+    return -1;
+  return an->size > 0 ? analyze_blocks(filename, an) : 0;
+}
+
+const char *analyze_best(const Analysis *an) {
+  // ties go to the simpler method
+  const char *best = "stored";
+  uint64_t size = an->stored;
+  if (an->static_bytes < size)
+    best = "static", size = an->static_bytes;
+  if (an->blocked_bytes < size)
+    best = "blocked", size = an->blocked_bytes;
+  if (an->order1_bytes < size)
+    best = "order1";
+  return best;
+}
+
+static double analyze_ratio(uint64_t bytes, uint64_t size) {
+  return size > 0 ? 100.0 * bytes / size : 0;
+}
+
+void analyze_print(FILE *out, const char *filename, const Analysis *an) {
+  unsigned long long size = an->size;
+  fprintf(out, "%s\n", filename);
+  fprintf(out, "  size          %llu bytes, %d distinct\n", size, an->symbols);
+  fprintf(out, "  entropy       %.3f bits/byte order-0, %.3f order-1\n",
+          an->entropy, an->entropy1);
+  fprintf(out,
+          "  static code   %.3f bits/byte (+%.3f), max depth %d, "
+          "tree %llu bytes\n",
+          an->bits_per_byte, an->bits_per_byte - an->entropy, an->max_depth,
+          (unsigned long long)an->tree_bytes);
+  fprintf(out, "  code lengths ");
+  for (int len = 0; len < ALPHABET_SIZE; ++len)
+    if (an->depths[len] > 0)
+      fprintf(out, " %d:%u", len, an->depths[len]);
+  fprintf(out, "\n");
+  fprintf(out,
+          "  predicted     stored %llu, static %llu (%.1f%%), "
+          "blocked %llu (%.1f%%), order1 %llu (%.1f%%)\n",
+          (unsigned long long)an->stored,
+          (unsigned long long)an->static_bytes,
+          analyze_ratio(an->static_bytes, size),
+          (unsigned long long)an->blocked_bytes,
+          analyze_ratio(an->blocked_bytes, size),
+          (unsigned long long)an->order1_bytes,
+          analyze_ratio(an->order1_bytes, size));
+  const char *best = analyze_best(an);
+  fprintf(out, "  best          %s%s\n", best,
+          strcmp(best, "stored") == 0 ? ", not worth compressing" : "");
+}
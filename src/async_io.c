@@ -0,0 +1,517 @@
+// O_DIRECT and sync_file_range
+#define _GNU_SOURCE
+#include "async_io.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define AIO_HAVE_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+enum { AIO_SLOT_IDLE = 0, AIO_SLOT_BUSY, AIO_SLOT_DONE };
+
+static int aio_backend = AIO_BACKEND_AUTO;
+static size_t aio_chunk = AIO_CHUNK;
+static int aio_direct = 0;
+
+void aio_set_backend(int backend) { aio_backend = backend; }
+
+int aio_set_chunk_size(size_t size) {
+  if (size < AIO_MIN_CHUNK || size > AIO_MAX_CHUNK || (size & (size - 1))) {
+    fprintf(stderr, "Error: I/O size must be a power of two from %d to %d.\n",
+            AIO_MIN_CHUNK, AIO_MAX_CHUNK);
+    return -1;
+  }
+  aio_chunk = size;
+  return 0;
+}
+
+size_t aio_chunk_size(void) { return aio_chunk; }
+
+void aio_set_direct(int direct) { aio_direct = direct; }
+
+/*
+ * io_uring through the raw syscalls, only what sequential streams need:
+ * one submission per request, completions reaped in any order.
+ */
+#ifdef AIO_HAVE_URING
+struct AioRing {
+  int fd;
+  unsigned *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_map, *cq_map;
+  size_t sq_len, cq_len, sqes_len;
+};
+
+static void aio_ring_free(AioRing *ring) {
+  if (ring == NULL)
+    return;
+  if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+    munmap(ring->sqes, ring->sqes_len);
+  if (ring->cq_map != NULL && ring->cq_map != MAP_FAILED &&
+      ring->cq_map != ring->sq_map)
+    munmap(ring->cq_map, ring->cq_len);
+  if (ring->sq_map != NULL && ring->sq_map != MAP_FAILED)
+    munmap(ring->sq_map, ring->sq_len);
+  close(ring->fd);
+  free(ring);
+}
+
+static AioRing *aio_ring_new(unsigned entries) {
+  if (aio_backend == AIO_BACKEND_SYNC)
+    return NULL;
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (fd < 0)
+    return NULL; // ENOSYS, EPERM under seccomp or io_uring_disabled
+  AioRing *ring = calloc(1, sizeof(AioRing));
+  if (ring == NULL) {
+    close(fd);
+    return NULL;
+  }
+  ring->fd = fd;
+  ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (ring->cq_len > ring->sq_len)
+      ring->sq_len = ring->cq_len;
+    ring->cq_len = ring->sq_len;
+  }
+  ring->sq_map = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (ring->sq_map == MAP_FAILED) {
+    aio_ring_free(ring);
+    return NULL;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    ring->cq_map = ring->sq_map;
+  else
+    ring->cq_map = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (ring->cq_map == MAP_FAILED || ring->sqes == MAP_FAILED) {
+    aio_ring_free(ring);
+    return NULL;
+  }
+  unsigned char *sq = ring->sq_map, *cq = ring->cq_map;
+  ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+  ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  return ring;
+}
+
+static int aio_ring_enter(AioRing *ring, unsigned submit, unsigned wait) {
+  int ret;
+  do {
+    ret = syscall(__NR_io_uring_enter, ring->fd, submit, wait,
+                  wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+  } while (ret < 0 && errno == EINTR);
+  return ret;
+}
+
+static int aio_ring_submit(AioRing *ring, int writing, int fd, void *buf,
+                           size_t len, off_t offset, uint64_t data) {
+  unsigned tail = *ring->sq_tail;
+  unsigned idx = tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = writing ? IORING_OP_WRITE : IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (uintptr_t)buf;
+  sqe->len = len;
+  sqe->off = offset;
+  sqe->user_data = data;
+  ring->sq_array[idx] = idx;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  return aio_ring_enter(ring, 1, 0) == 1 ? 0 : -1;
+}
+
+// One completion, waits for it if none is ready
+static int aio_ring_reap(AioRing *ring, int *res, uint64_t *data) {
+  for (;;) {
+    unsigned head = *ring->cq_head;
+    if (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+      *res = cqe->res;
+      *data = cqe->user_data;
+      __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+      return 0;
+    }
+    if (aio_ring_enter(ring, 0, 1) < 0)
+      return -1;
+  }
+}
+#else
+struct AioRing {
+  int unused;
+};
+
+static void aio_ring_free(AioRing *ring) { (void)ring; }
+
+static AioRing *aio_ring_new(unsigned entries) {
+  (void)entries;
+  return NULL;
+}
+
+static int aio_ring_submit(AioRing *ring, int writing, int fd, void *buf,
+                           size_t len, off_t offset, uint64_t data) {
+  (void)ring, (void)writing, (void)fd, (void)buf, (void)len, (void)offset;
+  (void)data;
+  return -1;
+}
+
+static int aio_ring_reap(AioRing *ring, int *res, uint64_t *data) {
+  (void)ring, (void)res, (void)data;
+  return -1;
+}
+#endif
+
+int aio_uring_available(void) {
+  AioRing *ring = aio_ring_new(AIO_DEPTH);
+  aio_ring_free(ring);
+  return ring != NULL;
+}
+
+// O_DIRECT descriptor when the transfer is aligned, the plain one otherwise
+static int aio_fd(const AioFile *f, const void *buf, off_t offset,
+                  size_t len) {
+  if (f->direct_fd >= 0 && (uintptr_t)buf % AIO_ALIGN == 0 &&
+      offset % AIO_ALIGN == 0 && len % AIO_ALIGN == 0)
+    return f->direct_fd;
+  return f->fd;
+}
+
+/*
+ * Blocking transfer of the rest of a slot. Also finishes short or failed
+ * ring requests, so an old kernel without IORING_OP_READ still works.
+ */
+static void aio_finish_sync(AioFile *f, AioSlot *s) {
+  while (s->done < s->len) {
+    unsigned char *p = s->buf + s->done;
+    size_t n = s->len - s->done;
+    off_t offset = s->offset + s->done;
+    int fd = aio_fd(f, p, offset, n);
+    ssize_t r;
+    if (f->seekable)
+      r = f->writing ? pwrite(fd, p, n, offset) : pread(fd, p, n, offset);
+    else
+      r = f->writing ? write(f->fd, p, n) : read(f->fd, p, n);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("aio");
+      f->error = 1;
+      break;
+    }
+    if (r == 0)
+      break; // end of file
+    s->done += r;
+    // a pipe hands out what it has, the consumer decides to wait for more
+    if (!f->seekable && !f->writing)
+      break;
+  }
+  s->state = AIO_SLOT_DONE;
+}
+
+static int aio_ring_usable(const AioFile *f) {
+  return f->ring != NULL && !f->broken;
+}
+
+static void aio_submit(AioFile *f, AioSlot *s) {
+  s->done = 0;
+  s->state = AIO_SLOT_BUSY;
+  if (aio_ring_usable(f)) {
+    if (aio_ring_submit(f->ring, f->writing,
+                        aio_fd(f, s->buf, s->offset, s->len), s->buf, s->len,
+                        s->offset, s - f->slots) == 0)
+      return;
+    // the entry may still sit in the queue: never submit through it again,
+    // requests already in flight are still reaped
+    f->broken = 1;
+  }
+  aio_finish_sync(f, s);
+}
+
+// Wait until slot s is no longer in flight
+static void aio_wait_slot(AioFile *f, AioSlot *s) {
+  while (s->state == AIO_SLOT_BUSY) {
+    int res;
+    uint64_t data;
+    if (aio_ring_reap(f->ring, &res, &data) != 0) {
+      perror("aio");
+      f->error = 1;
+      s->state = AIO_SLOT_DONE;
+      return;
+    }
+    AioSlot *done = &f->slots[data];
+    done->state = AIO_SLOT_DONE;
+    done->done = res > 0 ? res : 0;
+    if (res < 0 || (done->done < done->len && (f->writing || res > 0)))
+      aio_finish_sync(f, done);
+  }
+}
+
+// Move the next request past a hole starting where it would go
+static off_t aio_skip_holes(AioFile *f) {
+  while (f->hole_count > 0 && f->offset >= f->holes->offset) {
+    if (f->offset < f->holes->offset + f->holes->len)
+      f->offset = f->holes->offset + f->holes->len;
+    ++f->holes;
+    --f->hole_count;
+  }
+  return f->offset;
+}
+
+/*
+ * Bytes the request at f->offset may take: a chunk, less if a hole starts
+ * earlier or if a write has to end on an AIO_ALIGN offset for O_DIRECT
+ */
+static size_t aio_room(AioFile *f) {
+  off_t offset = aio_skip_holes(f);
+  size_t room = f->chunk_size;
+  if (f->hole_count > 0 && f->holes->offset - offset < (off_t)room)
+    room = f->holes->offset - offset;
+  if (f->writing && f->direct_fd >= 0 && offset % AIO_ALIGN != 0 &&
+      AIO_ALIGN - offset % AIO_ALIGN < (off_t)room)
+    room = AIO_ALIGN - offset % AIO_ALIGN;
+  return room;
+}
+
+static void aio_next_request(AioFile *f, AioSlot *s) {
+  s->len = aio_room(f);
+  s->offset = f->offset;
+  f->offset += s->len;
+}
+
+// Direct mode: a transferred slot leaves the page cache
+static void aio_drop(AioFile *f, AioSlot *s) {
+  if (!f->direct || !f->seekable || s->done == 0)
+    return;
+  // dirty pages are not dropped, they have to be written back first
+  if (f->writing)
+    sync_file_range(f->fd, s->offset, s->done,
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                        SYNC_FILE_RANGE_WAIT_AFTER);
+  posix_fadvise(f->fd, s->offset, s->done, POSIX_FADV_DONTNEED);
+}
+
+// Second descriptor of a regular file with O_DIRECT, -1 if not possible
+static int aio_open_direct(int fd, int writing) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    return -1;
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+  // EINVAL on file systems without O_DIRECT (tmpfs): dropping pages is left
+  return open(path, (writing ? O_WRONLY : O_RDONLY) | O_DIRECT | O_CLOEXEC);
+}
+
+// size is the bytes expected, UINT64_MAX if not known
+static int aio_open(AioFile *f, int fd, int writing, uint64_t size) {
+  memset(f, 0, sizeof(AioFile));
+  f->fd = fd;
+  f->writing = writing;
+  f->chunk_size = aio_chunk;
+  f->direct_fd = -1;
+  f->offset = lseek(fd, 0, SEEK_CUR);
+  f->seekable = f->offset >= 0;
+  if (!f->seekable)
+    f->offset = 0;
+  if (aio_direct && f->seekable) {
+    f->direct = 1;
+    f->direct_fd = aio_open_direct(fd, writing);
+  }
+  struct stat st;
+  if (!writing && f->seekable && fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    size = st.st_size > f->offset ? (uint64_t)(st.st_size - f->offset) : 0;
+  // a stream of one request has nothing to overlap: no ring, and a buffer
+  // no bigger than the stream
+  int one = size <= aio_chunk;
+  while (one && f->chunk_size > AIO_MIN_CHUNK && f->chunk_size / 2 >= size)
+    f->chunk_size /= 2;
+  f->ring = f->seekable && !one ? aio_ring_new(AIO_DEPTH) : NULL;
+  f->depth = f->ring != NULL ? AIO_DEPTH : 1;
+  for (int i = 0; i < f->depth; ++i) {
+    // aligned so the same buffers can serve O_DIRECT
+    void *buf;
+    if (posix_memalign(&buf, AIO_ALIGN, f->chunk_size) != 0) {
+      fprintf(stderr, "Error allocating I/O buffers.\n");
+      f->error = 1;
+      return aio_close(f);
+    }
+    f->slots[i].buf = buf;
+  }
+  return 0;
+}
+
+static int aio_holes(AioFile *f, const AioHole *holes, int count) {
+  if (count > 0 && !f->seekable) {
+    fprintf(stderr, "Error: holes need a seekable file.\n");
+    f->error = 1;
+    return aio_close(f);
+  }
+  f->holes = holes;
+  f->hole_count = count;
+  return 0;
+}
+
+int aio_reader_init(AioFile *f, int fd) {
+  return aio_reader_init_holes(f, fd, NULL, 0);
+}
+
+int aio_reader_init_holes(AioFile *f, int fd, const AioHole *holes,
+                          int count) {
+  if (aio_open(f, fd, 0, UINT64_MAX) != 0 || aio_holes(f, holes, count) != 0)
+    return -1;
+  if (f->seekable)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL); // bigger kernel readahead
+  if (f->ring != NULL) {
+    for (int i = 0; i < f->depth; ++i) {
+      aio_next_request(f, &f->slots[i]);
+      aio_submit(f, &f->slots[i]);
+    }
+  }
+  return 0;
+}
+
+ssize_t aio_reader_next(AioFile *f, unsigned char **chunk) {
+  if (f->held) {
+    // the chunk handed out last time goes to the back of the queue
+    AioSlot *s = &f->slots[f->cur];
+    aio_drop(f, s);
+    s->state = AIO_SLOT_IDLE;
+    if (!f->eof && aio_ring_usable(f)) {
+      aio_next_request(f, s);
+      aio_submit(f, s);
+    }
+    f->cur = (f->cur + 1) % f->depth;
+    f->held = 0;
+  }
+  if (f->error)
+    return -1;
+  if (f->eof)
+    return 0;
+  AioSlot *s = &f->slots[f->cur];
+  if (s->state == AIO_SLOT_IDLE) {
+    // nothing read ahead: plain syscall on demand
+    s->len = aio_room(f);
+    s->offset = f->offset;
+    aio_submit(f, s);
+    if (f->seekable)
+      f->offset += s->done;
+  }
+  aio_wait_slot(f, s);
+  if (f->error)
+    return -1;
+  f->held = 1;
+  if (s->done == 0 || (f->seekable && s->done < s->len))
+    f->eof = 1;
+  *chunk = s->buf;
+  return s->done;
+}
+
+size_t aio_read(AioFile *f, void *dst, size_t n) {
+  unsigned char *out = dst;
+  size_t got = 0;
+  while (got < n) {
+    if (f->avail == 0) {
+      ssize_t r = aio_reader_next(f, &f->chunk);
+      if (r <= 0)
+        break;
+      f->avail = r;
+    }
+    size_t k = n - got < f->avail ? n - got : f->avail;
+    memcpy(out + got, f->chunk, k);
+    f->chunk += k;
+    f->avail -= k;
+    got += k;
+  }
+  return got;
+}
+
+int aio_writer_init(AioFile *f, int fd) {
+  return aio_writer_init_holes(f, fd, NULL, 0);
+}
+
+int aio_writer_init_holes(AioFile *f, int fd, const AioHole *holes,
+                          int count) {
+  return aio_writer_init_size(f, fd, holes, count, UINT64_MAX);
+}
+
+int aio_writer_init_size(AioFile *f, int fd, const AioHole *holes, int count,
+                         uint64_t size) {
+  if (aio_open(f, fd, 1, size) != 0)
+    return -1;
+  return aio_holes(f, holes, count);
+}
+
+int aio_write(AioFile *f, const void *src, size_t n) {
+  const unsigned char *p = src;
+  while (n > 0 && !f->error) {
+    AioSlot *s = &f->slots[f->cur];
+    size_t room = aio_room(f);
+    size_t k = room - s->len < n ? room - s->len : n;
+    memcpy(s->buf + s->len, p, k);
+    s->len += k;
+    p += k;
+    n -= k;
+    if (s->len == room && aio_writer_flush(f) != 0)
+      return -1;
+  }
+  return f->error ? -1 : 0;
+}
+
+int aio_writer_flush(AioFile *f) {
+  AioSlot *s = &f->slots[f->cur];
+  if (s->len > 0 && !f->error) {
+    s->offset = aio_skip_holes(f);
+    f->offset += s->len;
+    aio_submit(f, s);
+    f->cur = (f->cur + 1) % f->depth;
+    // the slot filled next must not be in flight any more
+    s = &f->slots[f->cur];
+    aio_wait_slot(f, s);
+    aio_drop(f, s);
+    s->len = 0;
+    s->done = 0;
+    s->state = AIO_SLOT_IDLE;
+  }
+  return f->error ? -1 : 0;
+}
+
+int aio_close(AioFile *f) {
+  if (f->writing && aio_writer_flush(f) != 0)
+    f->error = 1;
+  for (int i = 0; i < f->depth; ++i) {
+    if (f->ring != NULL)
+      aio_wait_slot(f, &f->slots[i]);
+    if (f->slots[i].state == AIO_SLOT_DONE)
+      aio_drop(f, &f->slots[i]);
+    free(f->slots[i].buf);
+    f->slots[i].buf = NULL;
+  }
+  aio_ring_free(f->ring);
+  f->ring = NULL;
+  if (f->direct_fd >= 0)
+    close(f->direct_fd);
+  f->direct_fd = -1;
+  return f->error ? -1 : 0;
+}
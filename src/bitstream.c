@@ -0,0 +1,111 @@
+#include "bitstream.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BS_INITIAL_CAPACITY 4096
+
+static int bs_reserve(BitWriter *bw, size_t extra) {
+  if (bw->pos + extra <= bw->cap)
+    return 0;
+  size_t cap = bw->cap ? bw->cap : BS_INITIAL_CAPACITY;
+  while (cap < bw->pos + extra)
+    cap *= 2;
+  unsigned char *buf = realloc(bw->buf, cap);
+  if (buf == NULL) {
+    bw->error = 1;
+    return -1;
+  }
+  bw->buf = buf;
+  bw->cap = cap;
+  return 0;
+}
+
+void bs_writer_init(BitWriter *bw) {
+  bw->buf = NULL;
+  bw->cap = 0;
+  bw->pos = 0;
+  bw->acc = 0;
+  bw->nbits = 0;
+  bw->error = 0;
+}
+
+// Keep the allocation, forget the content
+void bs_writer_reset(BitWriter *bw) {
+  bw->pos = 0;
+  bw->acc = 0;
+  bw->nbits = 0;
+  bw->error = 0;
+}
+
+void bs_writer_free(BitWriter *bw) {
+  free(bw->buf);
+  bs_writer_init(bw);
+}
+
+void bs_write_bits(BitWriter *bw, uint32_t value, int count) {
+  if (count == 0)
+    return;
+  if (bs_reserve(bw, 5) != 0)
+    return;
+  bw->acc = (bw->acc << count) | (value & (0xFFFFFFFFu >> (32 - count)));
+  bw->nbits += count;
+  while (bw->nbits >= 8) {
+    bw->nbits -= 8;
+    bw->buf[bw->pos++] = (unsigned char)(bw->acc >> bw->nbits);
+  }
+  bw->acc &= (1u << bw->nbits) - 1;
+}
+
+size_t bs_flush(BitWriter *bw) {
+  if (bw->nbits > 0)
+    bs_write_bits(bw, 0, 8 - bw->nbits);
+  return bw->pos;
+}
+
+void bs_reader_init(BitReader *br, const unsigned char *buf, size_t size) {
+  br->buf = buf;
+  br->size = size;
+  br->pos = 0;
+  br->acc = 0;
+  br->nbits = 0;
+  br->overrun = 0;
+}
+
+int bs_read_bit(BitReader *br) {
+  if (br->nbits == 0) {
+    if (br->pos < br->size) {
+      br->acc = br->buf[br->pos++];
+    } else {
+      br->acc = 0;
+      br->overrun = 1;
+    }
+    br->nbits = 8;
+  }
+  --br->nbits;
+  return (br->acc >> br->nbits) & 1;
+}
+
+uint32_t bs_read_bits(BitReader *br, int count) {
+  uint32_t value = 0;
+  for (int i = 0; i < count; ++i)
+    value = (value << 1) | bs_read_bit(br);
+  return value;
+}
+
+void bs_write_gamma(BitWriter *bw, uint32_t value) {
+  int n = 0;
+  while ((value >> n) > 1)
+    ++n;
+  bs_write_bits(bw, 0, n);
+  bs_write_bits(bw, value, n + 1);
+}
+
+uint32_t bs_read_gamma(BitReader *br) {
+  int n = 0;
+  // a corrupt stream of zeros must not loop forever
+  while (bs_read_bit(br) == 0) {
+    if (++n > 31 || br->overrun)
+      return 0;
+  }
+  return (1u << n) | bs_read_bits(br, n);
+}
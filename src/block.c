@@ -0,0 +1,142 @@
+#include "block.h"
+#include <stdio.h>
+
+size_t block_size(unsigned char method) {
+  switch (method) {
+  case IO_METHOD_ADAPTIVE:
+    return HC_ADAPTIVE_BLOCK;
+  case IO_METHOD_ORDER1:
+    return O1_BLOCK_SIZE;
+  case IO_METHOD_BWT:
+    return BWT_BLOCK_SIZE;
+  case IO_METHOD_LZ77:
+    return LZ_BLOCK_SIZE;
+  case IO_METHOD_SPLIT:
+  case IO_METHOD_DEDUP: // new chunks go through the split coder
+    return SPLIT_BLOCK_SIZE;
+  default:
+    return 0;
+  }
+}
+
+int block_coder_init(BlockCoder *coder, unsigned char method, int level) {
+  coder->method = method;
+  coder->block_size = block_size(method);
+  coder->order1 = NULL;
+  coder->bwt = NULL;
+  coder->lz = NULL;
+  coder->split = NULL;
+  switch (method) {
+  case IO_METHOD_ADAPTIVE:
+    return hc_adaptive_init(&coder->adaptive);
+  case IO_METHOD_ORDER1:
+    coder->order1 = o1_new();
+    return coder->order1 == NULL ? -1 : 0;
+  case IO_METHOD_BWT:
+    coder->bwt = bwt_new();
+    return coder->bwt == NULL ? -1 : 0;
+  case IO_METHOD_LZ77:
+    coder->lz = lz_new(level);
+    return coder->lz == NULL ? -1 : 0;
+  case IO_METHOD_SPLIT:
+  case IO_METHOD_DEDUP:
+    coder->split = split_new();
+    return coder->split == NULL ? -1 : 0;
+  default:
+    fprintf(stderr, "Error: method %d is not block based.\n", (int)method);
+    return -1;
+  }
+}
+
+int block_coder_reset(BlockCoder *coder, int level) {
+  // only the adaptive model carries state from block to block
+  if (coder->method == IO_METHOD_ADAPTIVE)
+    return hc_adaptive_init(&coder->adaptive);
+  if (coder->lz != NULL)
+    lz_set_level(coder->lz, level);
+  return 0;
+}
+
+void block_coder_free(BlockCoder *coder) {
+  if (coder->method == IO_METHOD_ADAPTIVE)
+    hc_adaptive_free(&coder->adaptive);
+  o1_free(coder->order1);
+  bwt_free(coder->bwt);
+  lz_free(coder->lz);
+  split_free(coder->split);
+}
+
+int block_coder_for(BlockCoder *coder, int *has_coder, unsigned char method,
+                    int level) {
+  if (*has_coder && coder->method == method)
+    return block_coder_reset(coder, level);
+  if (*has_coder)
+    block_coder_free(coder);
+  *has_coder = block_coder_init(coder, method, level) == 0;
+  return *has_coder ? 0 : -1;
+}
+
+size_t block_bound(unsigned char method, size_t n) {
+  if (method == IO_METHOD_ADAPTIVE)
+    return n * 32; // adaptive codes are not length limited
+  // 15-bit codes (LZ77: 48 bits per 3-byte match) plus up to 257 tables
+  return n * 2 + (ALPHABET_SIZE + 1) * 1024;
+}
+
+int block_encode(BlockCoder *coder, const unsigned char *buf, size_t n,
+                 BitWriter *bw) {
+  switch (coder->method) {
+  case IO_METHOD_ADAPTIVE:
+    return hc_adaptive_encode_block(&coder->adaptive, buf, n, bw);
+  case IO_METHOD_ORDER1:
+    return o1_encode_block(coder->order1, buf, n, bw);
+  case IO_METHOD_LZ77:
+    return lz_encode_block(coder->lz, buf, n, bw);
+  case IO_METHOD_SPLIT:
+  case IO_METHOD_DEDUP:
+    return split_encode_block(coder->split, buf, n, bw);
+  default:
+    return bwt_encode_block(coder->bwt, buf, n, bw);
+  }
+}
+
+uint64_t block_trial_cost(void *arg, const unsigned char *buf, size_t n) {
+  BlockCoder *coder = arg;
+  BitWriter bw;
+  bs_writer_init(&bw);
+  uint64_t bits = 0;
+  int status = 0;
+  // the adaptive model learns from every block, start and end fresh
+  if (coder->method == IO_METHOD_ADAPTIVE)
+    status = hc_adaptive_init(&coder->adaptive);
+  for (size_t i = 0; status == 0 && i < n; i += coder->block_size) {
+    size_t k = n - i < coder->block_size ? n - i : coder->block_size;
+    bs_writer_reset(&bw);
+    status = block_encode(coder, buf + i, k, &bw);
+    bits += (uint64_t)bs_flush(&bw) * 8;
+    if (bw.error)
+      status = -1;
+  }
+  if (coder->method == IO_METHOD_ADAPTIVE &&
+      hc_adaptive_init(&coder->adaptive) != 0)
+    status = -1;
+  bs_writer_free(&bw);
+  return status == 0 ? bits : UINT64_MAX;
+}
+
+int block_decode(BlockCoder *coder, BitReader *br, unsigned char *buf,
+                 size_t n) {
+  switch (coder->method) {
+  case IO_METHOD_ADAPTIVE:
+    return hc_adaptive_decode_block(&coder->adaptive, br, buf, n);
+  case IO_METHOD_ORDER1:
+    return o1_decode_block(coder->order1, br, buf, n);
+  case IO_METHOD_LZ77:
+    return lz_decode_block(coder->lz, br, buf, n);
+  case IO_METHOD_SPLIT:
+  case IO_METHOD_DEDUP:
+    return split_decode_block(coder->split, br, buf, n);
+  default:
+    return bwt_decode_block(coder->bwt, br, buf, n);
+  }
+}
@@ -0,0 +1,239 @@
+#include "bwt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+BwtCoder *bwt_new(void) {
+  BwtCoder *coder = calloc(1, sizeof(BwtCoder));
+  if (coder == NULL)
+    return NULL;
+  size_t n = BWT_BLOCK_SIZE;
+  coder->sa = malloc(n * sizeof(uint32_t));
+  coder->rank = malloc(n * sizeof(uint32_t));
+  coder->tmp = malloc(n * sizeof(uint32_t));
+  coder->cnt = malloc(n * sizeof(uint32_t));
+  coder->last = malloc(n);
+  coder->syms = malloc((n + 1) * sizeof(uint16_t));
+  if (!coder->sa || !coder->rank || !coder->tmp || !coder->cnt ||
+      !coder->last || !coder->syms) {
+    fprintf(stderr, "Error allocating block sorting coder.\n");
+    bwt_free(coder);
+    return NULL;
+  }
+  return coder;
+}
+
+void bwt_free(BwtCoder *coder) {
+  if (coder == NULL)
+    return;
+  free(coder->sa);
+  free(coder->rank);
+  free(coder->tmp);
+  free(coder->cnt);
+  free(coder->last);
+  free(coder->syms);
+  free(coder);
+}
+
+/*
+ * Sort the cyclic rotations by prefix doubling: after round k rotations
+ * are ordered by their first 2^k bytes, each round is one counting sort
+ * on the class of the first half.
+ */
+uint32_t bwt_forward(BwtCoder *coder, const unsigned char *buf, size_t n,
+                     unsigned char *last) {
+  uint32_t *p = coder->sa, *c = coder->rank, *pn = coder->tmp;
+  uint32_t *cnt = coder->cnt;
+  uint32_t classes = ALPHABET_SIZE;
+
+  memset(cnt, 0, ALPHABET_SIZE * sizeof(uint32_t));
+  for (size_t i = 0; i < n; ++i)
+    ++cnt[buf[i]];
+  for (int i = 1; i < ALPHABET_SIZE; ++i)
+    cnt[i] += cnt[i - 1];
+  for (size_t i = n; i-- > 0;)
+    p[--cnt[buf[i]]] = i;
+  c[p[0]] = 0;
+  classes = 1;
+  for (size_t i = 1; i < n; ++i) {
+    if (buf[p[i]] != buf[p[i - 1]])
+      ++classes;
+    c[p[i]] = classes - 1;
+  }
+
+  for (size_t k = 1; k < n && classes < n; k <<= 1) {
+    // rotations starting k earlier, already sorted by their second half
+    for (size_t i = 0; i < n; ++i)
+      pn[i] = p[i] >= k ? p[i] - k : p[i] + n - k;
+    memset(cnt, 0, classes * sizeof(uint32_t));
+    for (size_t i = 0; i < n; ++i)
+      ++cnt[c[pn[i]]];
+    for (uint32_t i = 1; i < classes; ++i)
+      cnt[i] += cnt[i - 1];
+    for (size_t i = n; i-- > 0;)
+      p[--cnt[c[pn[i]]]] = pn[i];
+    // new classes compare (first half, second half), stored in pn
+    pn[p[0]] = 0;
+    classes = 1;
+    for (size_t i = 1; i < n; ++i) {
+      size_t a = p[i] + k, b = p[i - 1] + k;
+      if (a >= n)
+        a -= n;
+      if (b >= n)
+        b -= n;
+      if (c[p[i]] != c[p[i - 1]] || c[a] != c[b])
+        ++classes;
+      pn[p[i]] = classes - 1;
+    }
+    uint32_t *t = c;
+    c = pn;
+    pn = t;
+  }
+
+  uint32_t primary = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (p[i] == 0)
+      primary = i;
+    last[i] = buf[p[i] ? p[i] - 1 : n - 1];
+  }
+  return primary;
+}
+
+void bwt_inverse(BwtCoder *coder, const unsigned char *last, size_t n,
+                 uint32_t primary, unsigned char *buf) {
+  uint32_t start[ALPHABET_SIZE] = {0};
+  uint32_t *next = coder->sa;
+  for (size_t i = 0; i < n; ++i)
+    ++start[last[i]];
+  for (uint32_t i = 0, sum = 0; i < ALPHABET_SIZE; ++i) {
+    uint32_t t = start[i];
+    start[i] = sum;
+    sum += t;
+  }
+  // row of the first column -> row holding the same byte in the last one
+  for (size_t i = 0; i < n; ++i)
+    next[start[last[i]]++] = i;
+  uint32_t pos = next[primary];
+  for (size_t i = 0; i < n; ++i) {
+    buf[i] = last[pos];
+    pos = next[pos];
+  }
+}
+
+// Zero runs in bijective base 2, RUNA = 1 and RUNB = 2
+static size_t bwt_put_run(uint16_t *syms, size_t k, uint32_t run) {
+  while (run > 0) {
+    if (run & 1) {
+      syms[k++] = BWT_RUNA;
+      run = (run - 1) >> 1;
+    } else {
+      syms[k++] = BWT_RUNB;
+      run = (run - 2) >> 1;
+    }
+  }
+  return k;
+}
+
+/*
+ * Block layout (bits):
+ * 1. Row of the original block, 32 bits
+ * 2. Number of symbols, 32 bits
+ * 3. Symbol table, then the symbols
+ */
+int bwt_encode_block(BwtCoder *coder, const unsigned char *buf, size_t n,
+                     BitWriter *bw) {
+  if (n > BWT_BLOCK_SIZE)
+    return -1;
+  uint32_t primary = bwt_forward(coder, buf, n, coder->last);
+
+  // move-to-front, zeros are collected into runs
+  unsigned char order[ALPHABET_SIZE];
+  for (int i = 0; i < ALPHABET_SIZE; ++i)
+    order[i] = i;
+  size_t k = 0;
+  uint32_t run = 0;
+  for (size_t i = 0; i < n; ++i) {
+    unsigned char b = coder->last[i];
+    int j = 0;
+    while (order[j] != b)
+      ++j;
+    if (j == 0) {
+      ++run;
+      continue;
+    }
+    k = bwt_put_run(coder->syms, k, run);
+    run = 0;
+    memmove(order + 1, order, j);
+    order[0] = b;
+    coder->syms[k++] = j + 1;
+  }
+  k = bwt_put_run(coder->syms, k, run);
+
+  uint32_t counts[BWT_ALPHABET] = {0};
+  for (size_t i = 0; i < k; ++i)
+    ++counts[coder->syms[i]];
+  HuffTable table;
+  if (hc_table_from_counts(&table, counts, BWT_ALPHABET) != 0)
+    return -1;
+  bs_write_bits(bw, primary, 32);
+  bs_write_bits(bw, k, 32);
+  hc_table_write(bw, &table);
+  for (size_t i = 0; i < k; ++i)
+    hc_write_symbol(bw, &table, coder->syms[i]);
+  return bw->error ? -1 : 0;
+}
+
+int bwt_decode_block(BwtCoder *coder, BitReader *br, unsigned char *buf,
+                     size_t n) {
+  uint32_t primary = bs_read_bits(br, 32);
+  uint32_t k = bs_read_bits(br, 32);
+  HuffTable table;
+  if (n > BWT_BLOCK_SIZE || primary >= n || k > n ||
+      hc_table_read(br, &table, BWT_ALPHABET) != 0) {
+    fprintf(stderr, "Error decoding block sorting header.\n");
+    return -1;
+  }
+
+  unsigned char order[ALPHABET_SIZE];
+  for (int i = 0; i < ALPHABET_SIZE; ++i)
+    order[i] = i;
+  size_t out = 0;
+  uint32_t run = 0, weight = 1;
+  for (uint32_t i = 0; i < k; ++i) {
+    int sym = hc_read_symbol(br, &table);
+    if (sym < 0 || br->overrun) {
+      fprintf(stderr, "Error decoding block sorting data: invalid code.\n");
+      return -1;
+    }
+    if (sym == BWT_RUNA || sym == BWT_RUNB) {
+      run += weight << sym; // RUNA adds weight, RUNB twice the weight
+      weight <<= 1;
+      if (run > n - out) {
+        fprintf(stderr, "Error decoding block sorting data: run too long.\n");
+        return -1;
+      }
+      continue;
+    }
+    memset(coder->last + out, order[0], run);
+    out += run;
+    run = 0;
+    weight = 1;
+    if (out >= n) {
+      fprintf(stderr, "Error decoding block sorting data: block too long.\n");
+      return -1;
+    }
+    int j = sym - 1;
+    unsigned char b = order[j];
+    memmove(order + 1, order, j);
+    order[0] = b;
+    coder->last[out++] = b;
+  }
+  memset(coder->last + out, order[0], run);
+  out += run;
+  if (out != n) {
+    fprintf(stderr, "Error decoding block sorting data: size mismatch.\n");
+    return -1;
+  }
+  bwt_inverse(coder, coder->last, n, primary, buf);
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include "cdc.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Cut where the top bits of the hash are zero: they depend on the last
+// 64 bytes, lower bits on fewer
+#define CDC_MASK (((1ull << CDC_AVG_BITS) - 1) << (64 - CDC_AVG_BITS))
+
+static uint64_t cdc_gear[256];
+static pthread_once_t cdc_once = PTHREAD_ONCE_INIT;
+
+// Any fixed random table works, the cuts are not part of the format
+static void cdc_init(void) {
+  uint64_t x = 0x9e3779b97f4a7c15ull; // splitmix64
+  for (int i = 0; i < 256; ++i) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    cdc_gear[i] = z ^ (z >> 31);
+  }
+}
+
+size_t cdc_cut(const unsigned char *buf, size_t n) {
+  if (n <= CDC_MIN)
+    return n;
+  pthread_once(&cdc_once, cdc_init);
+  size_t end = n < CDC_MAX ? n : CDC_MAX;
+  uint64_t h = 0;
+  // the 64 bytes before CDC_MIN fill the hash, cuts start there
+  for (size_t i = CDC_MIN - 64; i < CDC_MIN; ++i)
+    h = (h << 1) + cdc_gear[buf[i]];
+  for (size_t i = CDC_MIN; i < end; ++i) {
+    h = (h << 1) + cdc_gear[buf[i]];
+    if ((h & CDC_MASK) == 0)
+      return i + 1;
+  }
+  return end;
+}
+
+int cdc_index_init(CdcIndex *index, int lookup) {
+  index->count = index->cap = 0;
+  index->chunks = NULL;
+  index->slots = NULL;
+  index->slot_mask = 0;
+  if (!lookup)
+    return 0;
+  index->slots = calloc(1024, sizeof(uint64_t));
+  if (index->slots == NULL) {
+    fprintf(stderr, "Error allocating chunk index.\n");
+    return -1;
+  }
+  index->slot_mask = 1023;
+  return 0;
+}
+
+void cdc_index_free(CdcIndex *index) {
+  free(index->chunks);
+  free(index->slots);
+}
+
+int64_t cdc_index_find(const CdcIndex *index, Hash128 hash, uint32_t len) {
+  if (index->slots == NULL)
+    return -1;
+  for (uint64_t s = hash.lo & index->slot_mask; index->slots[s] != 0;
+       s = (s + 1) & index->slot_mask) {
+    const CdcChunk *c = &index->chunks[index->slots[s] - 1];
+    if (c->len == len && hash128_equal(c->hash, hash))
+      return index->slots[s] - 1;
+  }
+  return -1;
+}
+
+static void cdc_slot_put(uint64_t *slots, uint64_t mask, Hash128 hash,
+                         uint64_t id) {
+  uint64_t s = hash.lo & mask;
+  while (slots[s] != 0)
+    s = (s + 1) & mask;
+  slots[s] = id + 1;
+}
+
+// Twice the slots once they are half full
+static int cdc_slots_grow(CdcIndex *index) {
+  uint64_t mask = 2 * index->slot_mask + 1;
+  uint64_t *slots = calloc(mask + 1, sizeof(uint64_t));
+  if (slots == NULL)
+    return -1;
+  for (uint64_t id = 0; id < index->count; ++id)
+    cdc_slot_put(slots, mask, index->chunks[id].hash, id);
+  free(index->slots);
+  index->slots = slots;
+  index->slot_mask = mask;
+  return 0;
+}
+
+int64_t cdc_index_add(CdcIndex *index, const CdcChunk *chunk) {
+  if (index->count == index->cap) {
+    uint64_t cap = index->cap ? 2 * index->cap : 1024;
+    CdcChunk *chunks = realloc(index->chunks, cap * sizeof(CdcChunk));
+    if (chunks == NULL) {
+      fprintf(stderr, "Error allocating chunk index.\n");
+      return -1;
+    }
+    index->chunks = chunks;
+    index->cap = cap;
+  }
+  if (index->slots != NULL && 2 * (index->count + 1) > index->slot_mask &&
+      cdc_slots_grow(index) != 0) {
+    fprintf(stderr, "Error allocating chunk index.\n");
+    return -1;
+  }
+  index->chunks[index->count] = *chunk;
+  if (index->slots != NULL)
+    cdc_slot_put(index->slots, index->slot_mask, chunk->hash, index->count);
+  return index->count++;
+}
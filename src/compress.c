@@ -1,85 +1,1150 @@
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "block.h"
+#include "cdc.h"
 #include "compress.h"
+#include "crc32c.h"
+#include "filter.h"
 #include "huffman.h"
 #include "io_tool.h"
+#include "lz77.h"
+
+void compress_default_options(CompressOptions *options) {
+  options->method = IO_METHOD_STATIC;
+  options->level = LZ_DEFAULT_LEVEL;
+  options->filter = FLT_AUTO;
+}
 
 char compress_encode_files(FILE *file, int argc, char **argv) {
+  CompressOptions options;
+  compress_default_options(&options);
+  return compress_encode_files_opt(file, argc, argv, &options);
+}
+
+static int compress_static_file(FILE *file, char *last_name, char *filename,
+                                unsigned char filter) {
+  Node *root = NULL;
+  // NULL for an empty file too, io_save_static tells the two apart
+  unsigned char **huff_code = hc_encode_file_sparse(filename, &root, filter);
+  if (huff_code == NULL && root != NULL) {
+    fprintf(stderr, "Error building huffman code for file: %s\n", filename);
+    hc_free_tree(root);
+    return -1;
+  }
+
+  int status =
+      io_save_static(file, last_name, filename, huff_code, root, filter);
+  // handle error
+  if (status < 0)
+    fprintf(stderr, "Error saving code for file: %s\n", filename);
+
+  // free huffman tree and code
+  hc_free_tree(root);
+  hc_free_code(huff_code);
+  return status;
+}
+
+// coder is the member's block coder, NULL for a static member
+static unsigned char compress_filter_for(char *filename, unsigned char filter,
+                                         BlockCoder *coder) {
+  if (filter != FLT_AUTO)
+    return filter;
+  filter = flt_choose_file(filename, coder ? block_trial_cost : NULL, coder);
+  if (filter != FLT_NONE)
+    printf("Filtro: %s\n", flt_name(filter));
+  return filter;
+}
+
+// Files in groups of up to IO_SOLID_MEMBERS, cut once IO_SOLID_BYTES is
+// reached (a file larger than that gets a group of its own)
+static int compress_solid_files(FILE *file, char *last_name, int count,
+                                char **filenames, unsigned char filter) {
+  unsigned char *filters = malloc(count ? count : 1);
+  if (filters == NULL) {
+    fprintf(stderr, "Error allocating solid group.\n");
+    return -1;
+  }
+  int status = 0;
+  for (int first = 0; status == 0 && first < count;) {
+    int n = 0;
+    uint64_t bytes = 0;
+    while (first + n < count && n < IO_SOLID_MEMBERS &&
+           (n == 0 || bytes < IO_SOLID_BYTES)) {
+      char *filename = filenames[first + n];
+      printf("Comprimiendo: %s\n", filename);
+      struct stat st;
+      if (stat(filename, &st) == 0 && S_ISREG(st.st_mode))
+        bytes += st.st_size;
+      filters[n++] = compress_filter_for(filename, filter, NULL);
+    }
+    status = io_save_solid(file, last_name, filenames + first, filters, n);
+    if (status < 0)
+      fprintf(stderr, "Error saving solid group from file: %s\n",
+              filenames[first]);
+    first += n;
+  }
+  free(filters);
+  return status;
+}
+
+typedef struct DupEntry {
+  uint64_t size;
+  Hash128 hash;
+  int index;
+} DupEntry;
+
+static int dup_compare(uint64_t a, uint64_t b) { return (a > b) - (a < b); }
+
+static int dup_by_size(const void *pa, const void *pb) {
+  const DupEntry *a = pa, *b = pb;
+  int c = dup_compare(a->size, b->size);
+  return c != 0 ? c : a->index - b->index;
+}
+
+static int dup_by_hash(const void *pa, const void *pb) {
+  const DupEntry *a = pa, *b = pb;
+  int c = dup_compare(a->size, b->size);
+  if (c == 0)
+    c = dup_compare(a->hash.hi, b->hash.hi);
+  if (c == 0)
+    c = dup_compare(a->hash.lo, b->hash.lo);
+  return c != 0 ? c : a->index - b->index;
+}
+
+/*
+ * originals[i] gets the first earlier file with the same bytes as
+ * filenames[i], or -1. Only regular files sharing their size with another
+ * one are hashed, a size of its own already makes a file unique. A file
+ * that cannot be read is left to fail when it is compressed
+ */
+static int compress_find_dups(int count, char **filenames, int *originals) {
+  DupEntry *entries = malloc((count ? count : 1) * sizeof(DupEntry));
+  if (entries == NULL) {
+    fprintf(stderr, "Error allocating duplicate table.\n");
+    return -1;
+  }
+  int n = 0;
+  for (int i = 0; i < count; ++i) {
+    originals[i] = -1;
+    struct stat st;
+    if (stat(filenames[i], &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+      entries[n++] = (DupEntry){st.st_size, {0, 0}, i};
+  }
+  qsort(entries, n, sizeof(DupEntry), dup_by_size);
+  int hashed = 0;
+  for (int i = 0; i < n; ++i) {
+    int shared = (i > 0 && entries[i - 1].size == entries[i].size) ||
+                 (i + 1 < n && entries[i + 1].size == entries[i].size);
+    if (shared && io_hash_file(filenames[entries[i].index],
+                               &entries[hashed].hash) == 0) {
+      entries[hashed].size = entries[i].size;
+      entries[hashed++].index = entries[i].index;
+    }
+  }
+  qsort(entries, hashed, sizeof(DupEntry), dup_by_hash);
+  // within a run of equal hashes, compare with the originals before it
+  for (int run = 0, i = 0; i < hashed; ++i) {
+    if (entries[run].size != entries[i].size ||
+        !hash128_equal(entries[run].hash, entries[i].hash))
+      run = i;
+    for (int j = run; j < i && originals[entries[i].index] < 0; ++j) {
+      int first = entries[j].index;
+      if (originals[first] < 0 &&
+          io_same_file(filenames[first], filenames[entries[i].index]) == 1)
+        originals[entries[i].index] = first;
+    }
+  }
+  free(entries);
+  return 0;
+}
+
+/*
+ * Members already in an archive that files appended with -r may copy.
+ * Only members of a size some new file has are kept
+ */
+typedef struct OldMember {
+  char name[IO_NAME_MAX + 1];
+  char prev[IO_NAME_MAX + 1]; // name before it, for the header's prefix
+  off_t offset;               // of its header
+  uint64_t size;
+  uint64_t index;             // among all members of the archive
+} OldMember;
+
+typedef struct OldMembers {
+  OldMember *list;
+  int count;
+  int cap;
+  uint64_t total; // members in the archive
+  uint64_t *sizes; // sizes of the new files, sorted
+  int size_count;
+} OldMembers;
+
+static int old_by_size(const void *pa, const void *pb) {
+  return dup_compare(*(const uint64_t *)pa, *(const uint64_t *)pb);
+}
+
+static int old_members_init(OldMembers *old, int count, char **filenames) {
+  *old = (OldMembers){NULL, 0, 0, 0, malloc((count ? count : 1) *
+                                            sizeof(uint64_t)), 0};
+  if (old->sizes == NULL) {
+    fprintf(stderr, "Error allocating duplicate table.\n");
+    return -1;
+  }
+  for (int i = 0; i < count; ++i) {
+    struct stat st;
+    if (stat(filenames[i], &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+      old->sizes[old->size_count++] = st.st_size;
+  }
+  qsort(old->sizes, old->size_count, sizeof(uint64_t), old_by_size);
+  return 0;
+}
+
+static void old_members_free(OldMembers *old) {
+  free(old->list);
+  free(old->sizes);
+}
+
+// Count a member read from offset, keep it if a new file may copy it
+static int old_members_add(OldMembers *old, const char *prev,
+                           const IoHeader *header, off_t offset) {
+  uint64_t index = old->total++;
+  if (header->dup > 0 ||
+      bsearch(&header->size, old->sizes, old->size_count, sizeof(uint64_t),
+              old_by_size) == NULL)
+    return 0;
+  if (old->count == old->cap) {
+    int cap = old->cap ? 2 * old->cap : 16;
+    OldMember *list = realloc(old->list, cap * sizeof(OldMember));
+    if (list == NULL) {
+      fprintf(stderr, "Error allocating duplicate table.\n");
+      return -1;
+    }
+    old->list = list;
+    old->cap = cap;
+  }
+  OldMember *m = &old->list[old->count++];
+  memcpy(m->name, header->name, IO_NAME_MAX + 1);
+  memcpy(m->prev, prev, IO_NAME_MAX + 1);
+  m->offset = offset;
+  m->size = header->size;
+  m->index = index;
+  return 0;
+}
+
+/*
+ * matches[i] gets the member of old holding the bytes of filenames[i], or
+ * -1. Files with an original among the new ones are skipped, they copy
+ * that one. Candidates share the size and are confirmed by decoding them,
+ * the file position is restored after
+ */
+static int compress_find_old(FILE *file, int method, const OldMembers *old,
+                             int count, char **filenames,
+                             const int *originals, int *matches,
+                             BlockCoder *coder, int *has_coder) {
+  for (int i = 0; i < count; ++i)
+    matches[i] = -1;
+  if (old == NULL || old->count == 0)
+    return 0;
+  off_t end = ftello(file);
+  IoHeader header;
+  int status = end < 0 ? -1 : 0;
+  for (int i = 0; i < count && status == 0; ++i) {
+    struct stat st;
+    if (originals[i] >= 0 || stat(filenames[i], &st) != 0 ||
+        !S_ISREG(st.st_mode))
+      continue;
+    for (int j = 0; j < old->count && matches[i] < 0 && status == 0; ++j) {
+      const OldMember *m = &old->list[j];
+      if (m->size != (uint64_t)st.st_size)
+        continue;
+      io_header_init(&header);
+      memcpy(header.name, m->prev, IO_NAME_MAX + 1);
+      if (fseeko(file, m->offset, SEEK_SET) != 0 ||
+          io_read_header(file, method, &header) != 0 ||
+          (method != IO_METHOD_STATIC &&
+           block_coder_for(coder, has_coder, method, LZ_DEFAULT_LEVEL) != 0)) {
+        status = -1;
+        break;
+      }
+      int same = io_member_matches(
+          file, method == IO_METHOD_STATIC ? NULL : coder, &header,
+          filenames[i]);
+      if (same < 0)
+        status = -1;
+      else if (same == 1)
+        matches[i] = j;
+    }
+  }
+  if (status != 0 || fseeko(file, end, SEEK_SET) != 0) {
+    fprintf(stderr, "Error comparing with the archive members.\n");
+    return -1;
+  }
+  return 0;
+}
+
+// Member of filename as a reference to original, back members before it
+static int compress_dup_file(FILE *file, char *last_name, char *filename,
+                             const char *original, uint64_t back) {
+  printf("Igual a: %s\n", original);
+  struct stat st;
+  if (stat(filename, &st) != 0 ||
+      io_save_dup(file, last_name, filename, st.st_size, back) != 0) {
+    fprintf(stderr, "Error saving code for file: %s\n", filename);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * argv[1 .. argc - 2] as members after the current position. old holds the
+ * members already in the archive when appending, else NULL
+ */
+static int compress_members(FILE *file, char *last_name, int argc,
+                            char **argv, const CompressOptions *options,
+                            const OldMembers *old) {
+  // block coders keep their buffers from one member to the next
+  BlockCoder coder;
+  int has_coder = 0;
+  int status = 0;
+  if (options->method == IO_METHOD_SOLID)
+    return compress_solid_files(file, last_name, argc - 2, argv + 1,
+                                options->filter);
+  // originals[i - 1] for argv[i], indexes of argv, and old[matches[i - 1]]
+  int *originals = malloc((argc > 2 ? argc - 2 : 1) * 2 * sizeof(int));
+  int *matches = originals + (argc > 2 ? argc - 2 : 1);
+  // chunks of this run, for IO_METHOD_DEDUP
+  CdcIndex chunks;
+  if (originals == NULL ||
+      compress_find_dups(argc - 2, argv + 1, originals) != 0 ||
+      compress_find_old(file, options->method, old, argc - 2, argv + 1,
+                        originals, matches, &coder, &has_coder) != 0 ||
+      cdc_index_init(&chunks, options->method == IO_METHOD_DEDUP) != 0) {
+    if (has_coder)
+      block_coder_free(&coder);
+    free(originals);
+    return -1;
+  }
+  for (int i = 1; i < argc - 1; ++i) {
+    printf("Comprimiendo: %s\n", argv[i]);
+    if (originals[i - 1] >= 0 || matches[i - 1] >= 0) {
+      if (originals[i - 1] >= 0)
+        status = compress_dup_file(file, last_name, argv[i],
+                                   argv[originals[i - 1] + 1],
+                                   i - 1 - originals[i - 1]);
+      else
+        status = compress_dup_file(
+            file, last_name, argv[i], old->list[matches[i - 1]].name,
+            old->total + i - 1 - old->list[matches[i - 1]].index);
+      if (status != 0)
+        break;
+      continue;
+    }
+    // overlap the next file's disk reads with this one
+    if (i + 1 < argc - 1 && originals[i] < 0 && matches[i] < 0)
+      io_prefetch_file(argv[i + 1]);
+    if (options->method != IO_METHOD_STATIC) {
+      status = block_coder_for(&coder, &has_coder, options->method,
+                               options->level);
+      unsigned char filter =
+          status == 0 ? compress_filter_for(argv[i], options->filter, &coder)
+                      : FLT_NONE;
+      if (status == 0 && options->method == IO_METHOD_DEDUP)
+        status = io_save_chunked(file, last_name, argv[i], &coder, filter,
+                                 &chunks, argv + 1, i - 1);
+      else if (status == 0)
+        status =
+            io_save_blocks_with(file, last_name, argv[i], &coder, filter);
+      if (status < 0)
+        fprintf(stderr, "Error saving code for file: %s\n", argv[i]);
+    } else {
+      unsigned char filter =
+          compress_filter_for(argv[i], options->filter, NULL);
+      status = compress_static_file(file, last_name, argv[i], filter);
+    }
+    if (status != 0)
+      break;
+  }
+  if (has_coder)
+    block_coder_free(&coder);
+  cdc_index_free(&chunks);
+  free(originals);
+  return status;
+}
+
+char compress_encode_files_opt(FILE *file, int argc, char **argv,
+                               const CompressOptions *options) {
   // por cada archivo
   //  crear código de huffman
   //  escribir nombre
   //  escribir posible tamaño
   //  guardar código
   //  escribir tamaño anterior
-  int status = 0;
-  for (int i = 1; i < argc - 1; ++i) {
-    Node **root;
-    printf("Comprimiendo: %s\n", argv[i]);
-    unsigned char **huff_code = hc_endoce_file(argv[i], root);
-    if (huff_code == NULL) {
-      status = 1;
-      break;
+  if (io_write_archive_header(file, options->method) != 0)
+    return -1;
+  char last_name[IO_NAME_MAX + 1] = ""; // members share name prefixes
+  return compress_members(file, last_name, argc, argv, options, NULL);
+  //
+}
+
+/*
+ * Walk the members of an archive from after its header to the end, as -l
+ * does, and keep the last name for the prefix of the next one. Any damage
+ * is found here, before something is written after it. old gets the
+ * members new files may copy
+ */
+static int compress_archive_end(FILE *file, int method, char *last_name,
+                                OldMembers *old) {
+  if (method == IO_METHOD_SOLID) {
+    IoSolidGroup *group = io_solid_group_new();
+    if (group == NULL)
+      return -1;
+    int status = 0;
+    while (status == 0 && !io_is_end_of_file(file)) {
+      if (io_read_solid_group(file, group) != 0 ||
+          fseeko(file, io_solid_payload(group), SEEK_CUR) != 0) {
+        status = -1;
+      } else if (io_solid_count(group) > 0) {
+        const IoSolidMember *m =
+            io_solid_member(group, io_solid_count(group) - 1);
+        memcpy(last_name, m->name, IO_NAME_MAX + 1);
+      }
     }
+    io_solid_group_free(group);
+    return status;
+  }
+  IoHeader header;
+  io_header_init(&header);
+  while (!io_is_end_of_file(file)) {
+    uint64_t stored;
+    off_t offset = ftello(file);
+    if (offset < 0 || io_read_member_info(file, method, &header, &stored) != 0)
+      return -1;
+    // dedup members may need chunks of others, they are not copied
+    if (method != IO_METHOD_DEDUP &&
+        old_members_add(old, last_name, &header, offset) != 0)
+      return -1;
+    memcpy(last_name, header.name, IO_NAME_MAX + 1);
+  }
+  return 0;
+}
 
-    status = io_save_code(file, argv[i], huff_code, *root);
-    // handle error
-    if (status < 0) {
-      fprintf(stderr, "Error saving code for file: %s\n", argv[i]);
+int compress_append_files(FILE *file, int argc, char **argv,
+                          const CompressOptions *options) {
+  int method = io_read_archive_header(file);
+  if (method < 0)
+    return -1;
+  char last_name[IO_NAME_MAX + 1] = "";
+  OldMembers old;
+  if (old_members_init(&old, argc - 2, argv + 1) != 0)
+    return -1;
+  off_t end;
+  if (compress_archive_end(file, method, last_name, &old) != 0 ||
+      (end = ftello(file)) < 0 || fseeko(file, end, SEEK_SET) != 0) {
+    fprintf(stderr, "Error: the archive is damaged, nothing appended.\n");
+    old_members_free(&old);
+    return -1;
+  }
+  // one method per archive: new members follow the one in its header
+  CompressOptions append = *options;
+  if (append.method != method)
+    printf("Usando el metodo del archivo (%d)\n", method);
+  append.method = method;
+  int status = compress_members(file, last_name, argc, argv, &append, &old);
+  old_members_free(&old);
+  if (fflush(file) != 0)
+    status = -1;
+  if (status != 0) {
+    // drop the partial member, the archive stays as it was
+    if (ftruncate(fileno(file), end) != 0)
+      perror("ftruncate");
+    fseeko(file, end, SEEK_SET);
+    return -1;
+  }
+  return 0;
+}
+
+// Output of a member, NULL to only check it (not an error in verify mode).
+// path gets the name opened unless it is NULL
+static int decompress_open(const char *filename, int verify, FILE **out,
+                           char *path) {
+  *out = NULL;
+  if (verify)
+    return 0;
+  // read and write: dedup members copy chunks from their own output
+  *out = io_open_unique_path(filename, "w+b", path);
+  if (*out == NULL) {
+    fprintf(stderr, "Error opening output file: %s\n", filename);
+    return -1;
+  }
+  return 0;
+}
+
+// Where each member went, by position in the archive, for its duplicates
+typedef struct DecompressPaths {
+  char **names;
+  uint64_t count, cap;
+} DecompressPaths;
+
+static int decompress_paths_add(DecompressPaths *paths, const char *path) {
+  if (paths->count == paths->cap) {
+    uint64_t cap = paths->cap ? 2 * paths->cap : 64;
+    char **names = realloc(paths->names, cap * sizeof(char *));
+    if (names == NULL)
+      return -1;
+    paths->names = names;
+    paths->cap = cap;
+  }
+  paths->names[paths->count] = strdup(path);
+  return paths->names[paths->count++] == NULL ? -1 : 0;
+}
+
+static void decompress_paths_free(DecompressPaths *paths) {
+  for (uint64_t i = 0; i < paths->count; ++i)
+    free(paths->names[i]);
+  free(paths->names);
+}
+
+/*
+ * Copy of the restored original, header->dup members back. In verify mode
+ * the original was already checked, only the reference is
+ */
+static int decompress_dup(const IoHeader *header, const DecompressPaths *paths,
+                          uint64_t index, FILE *out_file) {
+  if (header->dup > index) {
+    fprintf(stderr, "Error: %s refers to a member before the archive.\n",
+            header->name);
+    return -1;
+  }
+  if (out_file == NULL)
+    return 0;
+  return io_copy_file(out_file, paths->names[index - header->dup],
+                      header->size);
+}
+
+/* Read header: name, filter, sizes and tree
+ * Read code
+ * Read checksum
+ */
+static int decompress_members(FILE *file, int method, BlockCoder *coder,
+                              int *has_coder, int verify) {
+  IoHeader header;
+  io_header_init(&header);
+  DecompressPaths paths = {NULL, 0, 0};
+  CdcIndex chunks;
+  int status = cdc_index_init(&chunks, 0);
+  for (uint64_t index = 0; status == 0 && !io_is_end_of_file(file);
+       ++index) {
+    if (io_read_header(file, method, &header) != 0) {
+      status = -1;
       break;
     }
+    const char *filename = header.name;
+    printf("%s file: %s\n", verify ? "Verifying" : "Decompressing", filename);
+    FILE *out_file;
+    char path[IO_NAME_MAX + 1];
+    status = decompress_open(filename, verify, &out_file, path);
+    if (status == 0 && !verify)
+      status = decompress_paths_add(&paths, path);
+    if (status == 0 && header.dup > 0)
+      status = decompress_dup(&header, &paths, index, out_file);
+    else if (status == 0 && method != IO_METHOD_STATIC)
+      status = block_coder_for(coder, has_coder, method, LZ_DEFAULT_LEVEL);
+    if (status == 0 && header.dup == 0 && method == IO_METHOD_DEDUP)
+      status = io_write_chunked(out_file, file, coder, &header, &chunks,
+                                paths.names, index);
+    else if (status == 0 && header.dup == 0)
+      status = io_write_member(out_file, file,
+                               method == IO_METHOD_STATIC ? NULL : coder,
+                               &header);
+    if (out_file != NULL) {
+      fclose(out_file);
+      // nothing is left of a failed member, not even its sized output
+      if (status < 0)
+        remove(path);
+    }
+    if (status < 0)
+      fprintf(stderr, "Error %s file: %s\n",
+              verify ? "verifying" : "writing decompressed", filename);
+    else
+      printf(verify ? "OK\n" : "Sucess\n");
+  }
+  decompress_paths_free(&paths);
+  cdc_index_free(&chunks);
+  return status;
+}
 
-    // free huffman tree
-    hc_free_tree(*root);
+// Groups of members sharing one code stream, decoded in order
+static int decompress_solid(FILE *file, int verify) {
+  IoSolidGroup *group = io_solid_group_new();
+  if (group == NULL)
+    return -1;
+  int status = 0;
+  while (status == 0 && !io_is_end_of_file(file)) {
+    status = io_read_solid_group(file, group);
+    for (int i = 0; status == 0 && i < io_solid_count(group); ++i) {
+      const char *filename = io_solid_member(group, i)->name;
+      printf("%s file: %s\n", verify ? "Verifying" : "Decompressing",
+             filename);
+      FILE *out_file;
+      status = decompress_open(filename, verify, &out_file, NULL);
+      if (status == 0)
+        status = io_solid_decode_member(file, group, i, out_file);
+      if (out_file != NULL)
+        fclose(out_file);
+      if (status < 0)
+        fprintf(stderr, "Error %s file: %s\n",
+                verify ? "verifying" : "writing decompressed", filename);
+      else
+        printf(verify ? "OK\n" : "Sucess\n");
+    }
   }
+  io_solid_group_free(group);
   return status;
-  //
 }
 
-/* Read file name
- * Read tree
- * Read the final bytes of the file
- * Read code
+// One block coder serves every member of the archive
+static int decompress_archive(FILE *file, int verify) {
+  int method = io_read_archive_header(file);
+  if (method < 0)
+    return -1;
+  if (method == IO_METHOD_SOLID)
+    return decompress_solid(file, verify);
+  BlockCoder coder;
+  int has_coder = 0;
+  int result = decompress_members(file, method, &coder, &has_coder, verify);
+  if (has_coder)
+    block_coder_free(&coder);
+  return result;
+}
+
+int decompress_file(FILE *file) { return decompress_archive(file, 0); }
+
+int verify_file(FILE *file) { return decompress_archive(file, 1); }
+
+// Percentage saved, like gzip -l
+static double list_ratio(uint64_t size, uint64_t stored) {
+  return size == 0 ? 0.0 : 100.0 * (1.0 - (double)stored / (double)size);
+}
+
+static void list_member(uint64_t stored, uint64_t size, const char *name,
+                        uint64_t *total_stored, uint64_t *total_size) {
+  printf("%14llu %14llu %6.1f%%  %s\n", (unsigned long long)stored,
+         (unsigned long long)size, list_ratio(size, stored), name);
+  *total_size += size;
+  *total_stored += stored;
+}
+
+/*
+ * Members of a solid group have no bytes of their own: each one is shown
+ * with the share of the group matching its size, the last one takes what
+ * the rounding left
  */
-int decompress_file(FILE *file) {
-  // Read file name
-  while (!io_is_end_of_file(file)) {
-    char filename[256];
-    int n = io_read_filename(file, filename);
-    if (n < 0) {
-      fprintf(stderr, "Error reading filename.\n");
-      return -1;
-    }
-    filename[n] = '\0'; // Null-terminate the string
-    printf("Decompressing file: %s\n", filename);
-    // Read huffman tree
-    Node *root = io_read_huffman_tree(file);
-    if (root == NULL) {
-      fprintf(stderr, "Error reading huffman tree.\n");
-      return -1;
+static int list_solid(FILE *file, uint64_t *total_stored,
+                      uint64_t *total_size) {
+  IoSolidGroup *group = io_solid_group_new();
+  if (group == NULL)
+    return -1;
+  int status = 0;
+  while (status == 0 && !io_is_end_of_file(file)) {
+    off_t start = ftello(file);
+    if (io_read_solid_group(file, group) != 0 || start < 0) {
+      status = -1;
+      break;
     }
-    // Read file size
-    off_t file_size = io_read_file_size(file);
-    if (file_size < 0) {
-      fprintf(stderr, "Error reading file size.\n");
-      hc_free_tree(root);
-      return -1;
+    uint64_t bytes = ftello(file) - start + io_solid_payload(group);
+    if (fseeko(file, io_solid_payload(group), SEEK_CUR) != 0) {
+      status = -1;
+      break;
     }
-    // Write decompressed file
-    FILE *out_file = io_open_unique_file(filename, "wb");
-    if (out_file == NULL) {
-      fprintf(stderr, "Error opening output file: %s\n", filename);
-      hc_free_tree(root);
-      return -1;
+    int count = io_solid_count(group);
+    uint64_t size = 0, left = bytes;
+    for (int i = 0; i < count; ++i)
+      size += io_solid_member(group, i)->size;
+    for (int i = 0; i < count; ++i) {
+      const IoSolidMember *m = io_solid_member(group, i);
+      uint64_t share =
+          i == count - 1 ? left
+          : size == 0    ? bytes / count
+                         : (uint64_t)((double)bytes * m->size / size);
+      share = share < left ? share : left;
+      left -= share;
+      list_member(share, m->size, m->name, total_stored, total_size);
     }
-    int status = io_write_decompress_file(out_file, file, root, file_size);
-    if (status < 0) {
-      fprintf(stderr, "Error writing decompressed file: %s\n", filename);
-      fclose(out_file);
-      hc_free_tree(root);
+  }
+  io_solid_group_free(group);
+  return status;
+}
+
+int list_file(FILE *file) {
+  int method = io_read_archive_header(file);
+  if (method < 0)
+    return -1;
+  printf("%14s %14s %7s  %s\n", "compressed", "uncompressed", "ratio",
+         "name");
+  uint64_t total_size = 0, total_stored = 0;
+  if (method == IO_METHOD_SOLID &&
+      list_solid(file, &total_stored, &total_size) != 0) {
+    fprintf(stderr, "Error reading member header.\n");
+    return -1;
+  }
+  IoHeader header;
+  io_header_init(&header);
+  while (!io_is_end_of_file(file)) {
+    uint64_t stored;
+    if (io_read_member_info(file, method, &header, &stored) != 0) {
+      fprintf(stderr, "Error reading member header.\n");
       return -1;
     }
-    fclose(out_file);
-    printf("Sucess\n");
+    list_member(stored, header.size, header.name, &total_stored,
+                &total_size);
   }
+  printf("%14llu %14llu %6.1f%%  (totals)\n",
+         (unsigned long long)total_stored, (unsigned long long)total_size,
+         list_ratio(total_size, total_stored));
   return 0;
 }
+
+// magic, version, method, filter and the original size
+#define HC_FRAME_HEADER (IO_MAGIC_SIZE + 3 + IO_VARINT_MAX)
+
+// Longest code a Huffman tree over n bytes can assign: a code of length L
+// needs at least Fibonacci(L + 2) bytes. One extra bit covers ties
+static size_t hc_max_code_length(size_t n) {
+  size_t a = 1, b = 2; // Fibonacci(L + 2), Fibonacci(L + 3)
+  size_t len = 0;
+  while (b <= n && len < ALPHABET_SIZE - 2) {
+    size_t t = a + b;
+    a = b;
+    b = t;
+    ++len;
+  }
+  return len + 1;
+}
+
+size_t hc_compress_bound(size_t n, unsigned char method) {
+  if (n > SIZE_MAX / 64)
+    return SIZE_MAX;
+  if (method == IO_METHOD_STATIC)
+    return HC_FRAME_HEADER + 3 * ALPHABET_SIZE +
+           (n / 8 + 1) * hc_max_code_length(n) + IO_CRC_SIZE;
+  size_t bs = block_size(method);
+  if (bs == 0)
+    return 0;
+  size_t blocks = (n + bs - 1) / bs;
+  size_t last = n - (blocks ? blocks - 1 : 0) * bs;
+  size_t bound = HC_FRAME_HEADER + 1 + IO_CRC_SIZE;
+  size_t head = 2 * IO_VARINT_MAX + IO_CRC_SIZE;
+  if (blocks > 1)
+    bound += (blocks - 1) * (head + block_bound(method, bs));
+  if (blocks > 0)
+    bound += head + block_bound(method, last);
+  return bound;
+}
+
+struct HcCompressCtx {
+  HuffTree tree;
+  BlockCoder coder;
+  int has_coder;           // coder is set up for coder.method
+  BitWriter bw;            // one compressed block
+  unsigned char *scratch;  // filtered copy of one block
+  size_t scratch_cap;
+  unsigned char trial[FLT_SAMPLE]; // flt_choose_cost
+};
+
+struct HcDecompressCtx {
+  HuffTree tree;
+  BlockCoder coder;
+  int has_coder;
+};
+
+// Contexts hold cache aligned tables, malloc only promises 16 bytes
+static void *hc_ctx_alloc(size_t size) {
+  size_t align = alignof(HcCodeTable);
+  return aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+HcCompressCtx *hc_cctx_new(void) {
+  HcCompressCtx *ctx = hc_ctx_alloc(sizeof(HcCompressCtx));
+  if (ctx == NULL)
+    return NULL;
+  ctx->has_coder = 0;
+  bs_writer_init(&ctx->bw);
+  ctx->scratch = NULL;
+  ctx->scratch_cap = 0;
+  return ctx;
+}
+
+void hc_cctx_free(HcCompressCtx *ctx) {
+  if (ctx == NULL)
+    return;
+  if (ctx->has_coder)
+    block_coder_free(&ctx->coder);
+  bs_writer_free(&ctx->bw);
+  free(ctx->scratch);
+  free(ctx);
+}
+
+HcDecompressCtx *hc_dctx_new(void) {
+  HcDecompressCtx *ctx = hc_ctx_alloc(sizeof(HcDecompressCtx));
+  if (ctx != NULL)
+    ctx->has_coder = 0;
+  return ctx;
+}
+
+void hc_dctx_free(HcDecompressCtx *ctx) {
+  if (ctx == NULL)
+    return;
+  if (ctx->has_coder)
+    block_coder_free(&ctx->coder);
+  free(ctx);
+}
+
+static int hc_put(unsigned char *dst, size_t cap, size_t *len,
+                  const void *src, size_t n) {
+  if (cap - *len < n)
+    return HC_ERR_SPACE;
+  memcpy(dst + *len, src, n);
+  *len += n;
+  return HC_OK;
+}
+
+/*
+ * Static body: tree, then the codes of every byte. Both passes filter the
+ * input through a small copy so src stays untouched
+ */
+static int hc_compress_static(HcCompressCtx *ctx, const unsigned char *src,
+                              size_t n, unsigned char filter,
+                              unsigned char *dst, size_t cap, size_t *len,
+                              uint32_t *crc) {
+  *crc = crc32c_update(0, src, n);
+  if (n == 0)
+    return HC_OK;
+  unsigned char scratch[FLT_GROUP];
+  uint64_t counts[ALPHABET_SIZE] = {0};
+  FilterState fstate;
+  flt_init(&fstate, filter);
+  for (size_t i = 0; i < n; i += FLT_GROUP) {
+    size_t k = n - i < FLT_GROUP ? n - i : FLT_GROUP;
+    memcpy(scratch, src + i, k);
+    flt_encode(&fstate, scratch, k);
+    for (size_t j = 0; j < k; ++j)
+      ++counts[scratch[j]];
+  }
+  Node arr[ALPHABET_SIZE];
+  for (int c = 0; c < ALPHABET_SIZE; ++c) {
+    arr[c].byte = c;
+    arr[c].frequency = counts[c];
+    arr[c].is_leaf = 1;
+    arr[c].left = arr[c].right = NULL;
+  }
+  if (hc_tree_build(&ctx->tree, arr, (double)n) != 0)
+    return HC_ERR_MEMORY;
+  const HcCodeTable *table = &ctx->tree.flat;
+  // the exact payload size is known before writing it
+  uint64_t bits = 0;
+  for (int c = 0; c < ALPHABET_SIZE; ++c)
+    bits += counts[c] * table->codes[c].len;
+  unsigned char tree[3 * ALPHABET_SIZE];
+  size_t t_s = io_write_in_orden(ctx->tree.root, tree, 0);
+  int status = hc_put(dst, cap, len, tree, t_s);
+  if (status == HC_OK && cap - *len < (bits + 7) / 8)
+    status = HC_ERR_SPACE;
+  if (status != HC_OK)
+    return status;
+  uint64_t acc = 0;
+  int nbits = 0;
+  flt_init(&fstate, filter);
+  for (size_t i = 0; i < n; i += FLT_GROUP) {
+    size_t k = n - i < FLT_GROUP ? n - i : FLT_GROUP;
+    memcpy(scratch, src + i, k);
+    flt_encode(&fstate, scratch, k);
+    *len += hc_pack_codes(table, scratch, k, dst + *len, &acc, &nbits);
+  }
+  *len += hc_pack_flush(&acc, &nbits, dst + *len);
+  return HC_OK;
+}
+
+static int hc_decompress_static(HcDecompressCtx *ctx,
+                                const unsigned char *src, size_t n,
+                                size_t pos, unsigned char *dst,
+                                size_t size) {
+  if (size == 0)
+    return HC_OK;
+  if (io_parse_tree_into(src, n, &pos, &ctx->tree) != 0)
+    return HC_ERR_CORRUPT;
+  Node *root = ctx->tree.root;
+  size_t out = 0;
+  if (root->is_leaf) {
+    // a single byte value takes no bits at all
+    memset(dst, root->byte, size);
+    out = size;
+  }
+  Node *current = root;
+  for (size_t i = pos; i < n && out < size; ++i) {
+    for (int b = 7; b >= 0; --b) {
+      current = (src[i] >> b) & 1 ? current->right : current->left;
+      if (current->is_leaf) {
+        dst[out++] = current->byte;
+        current = root;
+        if (out == size)
+          break;
+      }
+    }
+  }
+  return out == size ? HC_OK : HC_ERR_CORRUPT;
+}
+
+// Block body: same blocks as an archive member, varint 0 at the end.
+// The checksum of the frame is left to the caller
+static int hc_compress_blocks(HcCompressCtx *ctx, const unsigned char *src,
+                              size_t n, const CompressOptions *options,
+                              unsigned char filter, unsigned char *dst,
+                              size_t cap, size_t *len, uint32_t *crc) {
+  if (block_coder_for(&ctx->coder, &ctx->has_coder, options->method,
+                      options->level) != 0)
+    return HC_ERR_MEMORY;
+  BlockCoder *coder = &ctx->coder;
+  // filters work in place, src is only copied when there is one
+  if (filter != FLT_NONE && ctx->scratch_cap < coder->block_size) {
+    unsigned char *scratch = realloc(ctx->scratch, coder->block_size);
+    if (scratch == NULL)
+      return HC_ERR_MEMORY;
+    ctx->scratch = scratch;
+    ctx->scratch_cap = coder->block_size;
+  }
+  FilterState fstate;
+  flt_init(&fstate, filter);
+  BitWriter *bw = &ctx->bw;
+  for (size_t i = 0; i < n; i += coder->block_size) {
+    size_t k = n - i < coder->block_size ? n - i : coder->block_size;
+    const unsigned char *block = src + i;
+    uint32_t b_crc = crc32c_update(0, block, k);
+    *crc = crc32c_combine(*crc, b_crc, k);
+    if (filter != FLT_NONE) {
+      memcpy(ctx->scratch, block, k);
+      flt_encode(&fstate, ctx->scratch, k);
+      block = ctx->scratch;
+    }
+    bs_writer_reset(bw);
+    if (block_encode(coder, block, k, bw) != 0)
+      return HC_ERR_MEMORY;
+    size_t c_s = bs_flush(bw);
+    if (bw->error)
+      return HC_ERR_MEMORY;
+    unsigned char head[2 * IO_VARINT_MAX], tail[IO_CRC_SIZE];
+    size_t h_s = io_put_varint(head, k);
+    h_s += io_put_varint(head + h_s, c_s);
+    io_store_crc(tail, b_crc);
+    int status = hc_put(dst, cap, len, head, h_s);
+    if (status == HC_OK)
+      status = hc_put(dst, cap, len, bw->buf, c_s);
+    if (status == HC_OK)
+      status = hc_put(dst, cap, len, tail, IO_CRC_SIZE);
+    if (status != HC_OK)
+      return status;
+  }
+  unsigned char end = 0;
+  return hc_put(dst, cap, len, &end, 1);
+}
+
+static int hc_decompress_blocks(HcDecompressCtx *ctx,
+                                const unsigned char *src, size_t n,
+                                size_t pos, unsigned char method,
+                                unsigned char filter, unsigned char *dst,
+                                size_t size, uint32_t *crc) {
+  if (block_coder_for(&ctx->coder, &ctx->has_coder, method,
+                      LZ_DEFAULT_LEVEL) != 0)
+    return HC_ERR_MEMORY;
+  BlockCoder *coder = &ctx->coder;
+  size_t max_comp = block_bound(method, coder->block_size);
+  FilterState fstate;
+  flt_init(&fstate, filter);
+  size_t out = 0;
+  for (;;) {
+    uint64_t r_s, c_s;
+    if (io_get_varint(src, n, &pos, &r_s) != 0)
+      return HC_ERR_CORRUPT;
+    if (r_s == 0)
+      break; // end of body
+    if (io_get_varint(src, n, &pos, &c_s) != 0 ||
+        r_s > coder->block_size || r_s > size - out || c_s > max_comp ||
+        c_s > n - pos || n - pos - c_s < IO_CRC_SIZE)
+      return HC_ERR_CORRUPT;
+    BitReader br;
+    bs_reader_init(&br, src + pos, c_s);
+    if (block_decode(coder, &br, dst + out, r_s) != 0)
+      return HC_ERR_CORRUPT;
+    flt_decode(&fstate, dst + out, r_s);
+    pos += c_s;
+    uint32_t b_crc = crc32c_update(0, dst + out, r_s);
+    if (b_crc != io_load_crc(src + pos))
+      return HC_ERR_CHECKSUM;
+    *crc = crc32c_combine(*crc, b_crc, r_s);
+    out += r_s;
+    pos += IO_CRC_SIZE;
+  }
+  return out == size ? HC_OK : HC_ERR_CORRUPT;
+}
+
+int hc_compress_ctx(HcCompressCtx *ctx, const unsigned char *src,
+                    size_t src_len, unsigned char *dst, size_t dst_cap,
+                    size_t *dst_len, const CompressOptions *options) {
+  CompressOptions defaults;
+  if (options == NULL) {
+    compress_default_options(&defaults);
+    options = &defaults;
+  }
+  if (dst_len == NULL)
+    return HC_ERR_ARGS;
+  *dst_len = 0;
+  if (ctx == NULL || (src == NULL && src_len > 0) || dst == NULL ||
+      options->method == IO_METHOD_SOLID ||
+      options->method > IO_METHOD_SPLIT ||
+      (options->filter >= FLT_COUNT && options->filter != FLT_AUTO))
+    return HC_ERR_ARGS;
+  unsigned char filter = options->filter;
+  // block methods measure the shuffles with their own coder
+  if (filter == FLT_AUTO && src_len > 0 &&
+      options->method != IO_METHOD_STATIC &&
+      block_coder_for(&ctx->coder, &ctx->has_coder, options->method,
+                      options->level) != 0)
+    return HC_ERR_MEMORY;
+  if (filter == FLT_AUTO)
+    filter = src_len == 0
+                 ? FLT_NONE
+                 : flt_choose_cost(
+                       src, src_len < FLT_SAMPLE ? src_len : FLT_SAMPLE,
+                       ctx->trial,
+                       options->method == IO_METHOD_STATIC ? NULL
+                                                           : block_trial_cost,
+                       &ctx->coder);
+  unsigned char head[HC_FRAME_HEADER];
+  memcpy(head, HC_BUFFER_MAGIC, IO_MAGIC_SIZE);
+  head[IO_MAGIC_SIZE] = IO_FORMAT_VERSION;
+  head[IO_MAGIC_SIZE + 1] = options->method;
+  head[IO_MAGIC_SIZE + 2] = filter;
+  size_t h_s = IO_MAGIC_SIZE + 3 + io_put_varint(head + IO_MAGIC_SIZE + 3,
+                                                 src_len);
+  size_t len = 0;
+  uint32_t crc = 0;
+  int status = hc_put(dst, dst_cap, &len, head, h_s);
+  if (status == HC_OK && options->method == IO_METHOD_STATIC)
+    status = hc_compress_static(ctx, src, src_len, filter, dst, dst_cap, &len,
+                                &crc);
+  else if (status == HC_OK)
+    status = hc_compress_blocks(ctx, src, src_len, options, filter, dst,
+                                dst_cap, &len, &crc);
+  // checksum of the whole input closes the frame
+  unsigned char tail[IO_CRC_SIZE];
+  io_store_crc(tail, crc);
+  if (status == HC_OK)
+    status = hc_put(dst, dst_cap, &len, tail, IO_CRC_SIZE);
+  if (status == HC_OK)
+    *dst_len = len;
+  return status;
+}
+
+int hc_compress_buffer(const unsigned char *src, size_t src_len,
+                       unsigned char *dst, size_t dst_cap, size_t *dst_len,
+                       const CompressOptions *options) {
+  HcCompressCtx *ctx = hc_cctx_new();
+  if (ctx == NULL) {
+    if (dst_len != NULL)
+      *dst_len = 0;
+    return HC_ERR_MEMORY;
+  }
+  int status = hc_compress_ctx(ctx, src, src_len, dst, dst_cap, dst_len,
+                               options);
+  hc_cctx_free(ctx);
+  return status;
+}
+
+// Checks the frame header, *pos is left at the start of the body
+static int hc_parse_frame(const unsigned char *src, size_t src_len,
+                          unsigned char *method, unsigned char *filter,
+                          size_t *size, size_t *pos) {
+  if (src == NULL)
+    return HC_ERR_ARGS;
+  if (src_len < IO_MAGIC_SIZE + 3 ||
+      memcmp(src, HC_BUFFER_MAGIC, IO_MAGIC_SIZE) != 0 ||
+      src[IO_MAGIC_SIZE] != IO_FORMAT_VERSION ||
+      src[IO_MAGIC_SIZE + 1] == IO_METHOD_SOLID ||
+      src[IO_MAGIC_SIZE + 1] > IO_METHOD_SPLIT ||
+      src[IO_MAGIC_SIZE + 2] >= FLT_COUNT)
+    return HC_ERR_CORRUPT;
+  *method = src[IO_MAGIC_SIZE + 1];
+  *filter = src[IO_MAGIC_SIZE + 2];
+  *pos = IO_MAGIC_SIZE + 3;
+  uint64_t value;
+  if (io_get_varint(src, src_len, pos, &value) != 0 || value > SIZE_MAX)
+    return HC_ERR_CORRUPT;
+  *size = value;
+  return HC_OK;
+}
+
+int hc_decompressed_size(const unsigned char *src, size_t src_len,
+                         size_t *size) {
+  unsigned char method, filter;
+  size_t pos;
+  return hc_parse_frame(src, src_len, &method, &filter, size, &pos);
+}
+
+int hc_decompress_ctx(HcDecompressCtx *ctx, const unsigned char *src,
+                      size_t src_len, unsigned char *dst, size_t dst_cap,
+                      size_t *dst_len) {
+  if (dst_len == NULL)
+    return HC_ERR_ARGS;
+  *dst_len = 0;
+  if (ctx == NULL)
+    return HC_ERR_ARGS;
+  unsigned char method, filter;
+  size_t size, pos;
+  int status = hc_parse_frame(src, src_len, &method, &filter, &size, &pos);
+  if (status != HC_OK)
+    return status;
+  if (size > dst_cap)
+    return HC_ERR_SPACE;
+  if (dst == NULL && size > 0)
+    return HC_ERR_ARGS;
+  if (src_len - pos < IO_CRC_SIZE)
+    return HC_ERR_CORRUPT;
+  size_t body_end = src_len - IO_CRC_SIZE;
+  uint32_t crc = 0;
+  if (method == IO_METHOD_STATIC) {
+    status = hc_decompress_static(ctx, src, body_end, pos, dst, size);
+    if (status == HC_OK) {
+      // filters were applied in FLT_GROUP chunks from the start
+      FilterState fstate;
+      flt_init(&fstate, filter);
+      flt_decode(&fstate, dst, size);
+      crc = crc32c_update(0, dst, size);
+    }
+  } else {
+    status = hc_decompress_blocks(ctx, src, body_end, pos, method, filter,
+                                  dst, size, &crc);
+  }
+  if (status == HC_OK && crc != io_load_crc(src + body_end))
+    status = HC_ERR_CHECKSUM;
+  if (status == HC_OK)
+    *dst_len = size;
+  return status;
+}
+
+int hc_decompress_buffer(const unsigned char *src, size_t src_len,
+                         unsigned char *dst, size_t dst_cap,
+                         size_t *dst_len) {
+  HcDecompressCtx *ctx = hc_dctx_new();
+  if (ctx == NULL) {
+    if (dst_len != NULL)
+      *dst_len = 0;
+    return HC_ERR_MEMORY;
+  }
+  int status = hc_decompress_ctx(ctx, src, src_len, dst, dst_cap, dst_len);
+  hc_dctx_free(ctx);
+  return status;
+}
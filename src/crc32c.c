@@ -0,0 +1,180 @@
+#include "crc32c.h"
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define CRC32C_X86 1
+#endif
+
+// Reflected Castagnoli polynomial
+#define CRC32C_POLY 0x82F63B78u
+
+// Bytes per stream of the interleaved loops
+#define CRC32C_LONG 8192
+#define CRC32C_SHORT 256
+
+static uint32_t crc_table[8][256];       // slicing-by-8
+static uint32_t crc_x2n[32];             // x^(2^k) mod p
+static uint32_t crc_long[4][256];        // append CRC32C_LONG zero bytes
+static uint32_t crc_short[4][256];       // append CRC32C_SHORT zero bytes
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+static int crc_use_hw;
+static int crc_force_sw;
+
+// a * b modulo p, bit 31 is x^0 in the reflected representation
+static uint32_t crc_multmodp(uint32_t a, uint32_t b) {
+  uint32_t m = 1u << 31, p = 0;
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0)
+        break;
+    }
+    m >>= 1;
+    b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+  }
+  return p;
+}
+
+// x^(8n) modulo p: the effect of n zero bytes on the register
+static uint32_t crc_x8nmodp(size_t n) {
+  uint32_t p = 1u << 31;
+  int k = 3;
+  while (n) {
+    if (n & 1)
+      p = crc_multmodp(crc_x2n[k & 31], p);
+    n >>= 1;
+    ++k;
+  }
+  return p;
+}
+
+static void crc_zeros_table(uint32_t zeros[4][256], size_t n) {
+  uint32_t op = crc_x8nmodp(n);
+  for (int k = 0; k < 4; ++k)
+    for (uint32_t b = 0; b < 256; ++b)
+      zeros[k][b] = crc_multmodp(op, b << (8 * k));
+}
+
+static uint32_t crc_shift(uint32_t zeros[4][256], uint32_t crc) {
+  return zeros[0][crc & 0xFF] ^ zeros[1][(crc >> 8) & 0xFF] ^
+         zeros[2][(crc >> 16) & 0xFF] ^ zeros[3][crc >> 24];
+}
+
+static void crc_init(void) {
+  for (uint32_t b = 0; b < 256; ++b) {
+    uint32_t c = b;
+    for (int k = 0; k < 8; ++k)
+      c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+    crc_table[0][b] = c;
+  }
+  for (uint32_t b = 0; b < 256; ++b)
+    for (int k = 1; k < 8; ++k)
+      crc_table[k][b] = (crc_table[k - 1][b] >> 8) ^
+                        crc_table[0][crc_table[k - 1][b] & 0xFF];
+  crc_x2n[0] = 1u << 30; // x^1
+  for (int k = 1; k < 32; ++k)
+    crc_x2n[k] = crc_multmodp(crc_x2n[k - 1], crc_x2n[k - 1]);
+  crc_zeros_table(crc_long, CRC32C_LONG);
+  crc_zeros_table(crc_short, CRC32C_SHORT);
+#ifdef CRC32C_X86
+  crc_use_hw = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+static uint64_t crc_load64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v; // little endian, as the reflected CRC expects
+}
+
+static uint32_t crc_software(uint32_t crc, const unsigned char *p,
+                             size_t n) {
+  while (n && ((uintptr_t)p & 7)) {
+    crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xFF];
+    --n;
+  }
+  for (; n >= 8; n -= 8, p += 8) {
+    uint64_t v = crc_load64(p) ^ crc;
+    crc = crc_table[7][v & 0xFF] ^ crc_table[6][(v >> 8) & 0xFF] ^
+          crc_table[5][(v >> 16) & 0xFF] ^ crc_table[4][(v >> 24) & 0xFF] ^
+          crc_table[3][(v >> 32) & 0xFF] ^ crc_table[2][(v >> 40) & 0xFF] ^
+          crc_table[1][(v >> 48) & 0xFF] ^ crc_table[0][v >> 56];
+  }
+  while (n--)
+    crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xFF];
+  return crc;
+}
+
+#ifdef CRC32C_X86
+/*
+ * The crc32 instruction has a latency of three cycles and a throughput of
+ * one, so three streams over consecutive stretches keep it busy. The
+ * partial CRCs are merged by shifting over the following stretch
+ */
+__attribute__((target("sse4.2"))) static uint32_t
+crc_hardware(uint32_t crc, const unsigned char *p, size_t n) {
+  uint64_t c0 = crc;
+  while (n && ((uintptr_t)p & 7)) {
+    c0 = _mm_crc32_u8((uint32_t)c0, *p++);
+    --n;
+  }
+  while (n >= 3 * CRC32C_LONG) {
+    uint64_t c1 = 0, c2 = 0;
+    const unsigned char *end = p + CRC32C_LONG;
+    do {
+      c0 = _mm_crc32_u64(c0, crc_load64(p));
+      c1 = _mm_crc32_u64(c1, crc_load64(p + CRC32C_LONG));
+      c2 = _mm_crc32_u64(c2, crc_load64(p + 2 * CRC32C_LONG));
+      p += 8;
+    } while (p < end);
+    c0 = crc_shift(crc_long, (uint32_t)c0) ^ c1;
+    c0 = crc_shift(crc_long, (uint32_t)c0) ^ c2;
+    p += 2 * CRC32C_LONG;
+    n -= 3 * CRC32C_LONG;
+  }
+  while (n >= 3 * CRC32C_SHORT) {
+    uint64_t c1 = 0, c2 = 0;
+    const unsigned char *end = p + CRC32C_SHORT;
+    do {
+      c0 = _mm_crc32_u64(c0, crc_load64(p));
+      c1 = _mm_crc32_u64(c1, crc_load64(p + CRC32C_SHORT));
+      c2 = _mm_crc32_u64(c2, crc_load64(p + 2 * CRC32C_SHORT));
+      p += 8;
+    } while (p < end);
+    c0 = crc_shift(crc_short, (uint32_t)c0) ^ c1;
+    c0 = crc_shift(crc_short, (uint32_t)c0) ^ c2;
+    p += 2 * CRC32C_SHORT;
+    n -= 3 * CRC32C_SHORT;
+  }
+  for (; n >= 8; n -= 8, p += 8)
+    c0 = _mm_crc32_u64(c0, crc_load64(p));
+  while (n--)
+    c0 = _mm_crc32_u8((uint32_t)c0, *p++);
+  return (uint32_t)c0;
+}
+#endif
+
+uint32_t crc32c_update(uint32_t crc, const void *buf, size_t n) {
+  pthread_once(&crc_once, crc_init);
+  const unsigned char *p = buf;
+  crc = ~crc;
+#ifdef CRC32C_X86
+  if (crc_use_hw && !crc_force_sw)
+    return ~crc_hardware(crc, p, n);
+#endif
+  return ~crc_software(crc, p, n);
+}
+
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, size_t len_b) {
+  pthread_once(&crc_once, crc_init);
+  return crc_multmodp(crc_x8nmodp(len_b), crc_a) ^ crc_b;
+}
+
+void crc32c_set_software(int software) { crc_force_sw = software; }
+
+int crc32c_hardware(void) {
+  pthread_once(&crc_once, crc_init);
+  return crc_use_hw && !crc_force_sw;
+}
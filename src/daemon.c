@@ -0,0 +1,667 @@
+#define _GNU_SOURCE
+#include "daemon.h"
+#include "io_tool.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Connections accepted and not taken by a worker yet
+#define DAEMON_BACKLOG 256
+// Longest pair of paths in a request
+#define DAEMON_PATHS_MAX 8192
+
+typedef struct DaemonWorker {
+  Daemon *daemon;
+  pthread_t thread;
+  HcCompressCtx *cctx;
+  HcDecompressCtx *dctx;
+  unsigned char *in, *out; // grow to the largest job seen
+  size_t in_cap, out_cap;
+  int client; // connection being served, -1 between them
+} DaemonWorker;
+
+struct Daemon {
+  char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+  int listen_fd;
+  int wake[2]; // written by daemon_stop and when a connection is parked
+  pthread_t acceptor;
+  pthread_mutex_t lock;
+  pthread_cond_t ready; // a connection waits, or stopping
+  pthread_cond_t room;  // the queue has room again
+  int queue[DAEMON_BACKLOG];
+  int head, count;
+  int *parked; // served connections for the acceptor to poll again
+  int parked_count, parked_cap;
+  int stopping;
+  int worker_count;
+  DaemonWorker *workers;
+};
+
+static int daemon_send_all(int fd, const void *buf, size_t n) {
+  const unsigned char *p = buf;
+  while (n > 0) {
+    ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w <= 0)
+      return -1;
+    p += w;
+    n -= w;
+  }
+  return 0;
+}
+
+// 0 when all n bytes came, 1 if the peer closed before the first one
+static int daemon_recv_all(int fd, void *buf, size_t n) {
+  unsigned char *p = buf;
+  size_t done = 0;
+  while (done < n) {
+    ssize_t r = recv(fd, p + done, n - done, 0);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return r == 0 && done == 0 ? 1 : -1;
+    done += r;
+  }
+  return 0;
+}
+
+static int daemon_write_all(int fd, const unsigned char *buf, size_t n) {
+  while (n > 0) {
+    ssize_t w = write(fd, buf, n);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w <= 0)
+      return -1;
+    buf += w;
+    n -= w;
+  }
+  return 0;
+}
+
+static int daemon_grow(unsigned char **buf, size_t *cap, size_t n) {
+  if (n <= *cap)
+    return 0;
+  unsigned char *p = realloc(*buf, n);
+  if (p == NULL)
+    return -1;
+  *buf = p;
+  *cap = n;
+  return 0;
+}
+
+// The whole input into w->in, *n its length
+static int daemon_read_input(DaemonWorker *w, int fd, size_t *n) {
+  struct stat st;
+  size_t hint = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) ? st.st_size : 0;
+  *n = 0;
+  for (;;) {
+    size_t want = *n + (hint > *n ? hint - *n : 64 << 10) + 1;
+    if (want > DAEMON_INPUT_MAX + 1)
+      want = DAEMON_INPUT_MAX + 1;
+    if (daemon_grow(&w->in, &w->in_cap, want) != 0)
+      return HC_ERR_MEMORY;
+    ssize_t r = read(fd, w->in + *n, w->in_cap - *n);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r < 0)
+      return DAEMON_ERR_IO;
+    if (r == 0)
+      return HC_OK;
+    *n += r;
+    if (*n > DAEMON_INPUT_MAX)
+      return DAEMON_ERR_LARGE;
+  }
+}
+
+static int daemon_job(DaemonWorker *w, const DaemonRequest *req, int in_fd,
+                      int out_fd, uint64_t *written) {
+  size_t n, len;
+  int status = daemon_read_input(w, in_fd, &n);
+  if (status != HC_OK)
+    return status;
+  if (req->op == DAEMON_OP_COMPRESS) {
+    CompressOptions options = {req->method, req->level, req->filter};
+    size_t cap = hc_compress_bound(n, options.method);
+    if (cap == 0 || cap > 2ull * DAEMON_INPUT_MAX)
+      return HC_ERR_ARGS;
+    if (daemon_grow(&w->out, &w->out_cap, cap) != 0)
+      return HC_ERR_MEMORY;
+    status = hc_compress_ctx(w->cctx, w->in, n, w->out, cap, &len, &options);
+  } else {
+    size_t size;
+    status = hc_decompressed_size(w->in, n, &size);
+    if (status != HC_OK)
+      return status;
+    if (size > DAEMON_INPUT_MAX)
+      return DAEMON_ERR_LARGE;
+    // a zero capacity buffer is still a buffer
+    if (daemon_grow(&w->out, &w->out_cap, size + 1) != 0)
+      return HC_ERR_MEMORY;
+    status = hc_decompress_ctx(w->dctx, w->in, n, w->out, size, &len);
+  }
+  if (status != HC_OK)
+    return status;
+  if (daemon_write_all(out_fd, w->out, len) != 0)
+    return DAEMON_ERR_IO;
+  *written = len;
+  return HC_OK;
+}
+
+/*
+ * The request and its descriptors. Returns 0, 1 when the client closed
+ * the connection between jobs, -1 when it broke the protocol
+ */
+static int daemon_recv_request(int client, DaemonRequest *req, int *fds,
+                               int *nfds) {
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(2 * sizeof(int))];
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct iovec iov = {req, sizeof(*req)};
+  struct msghdr msg = {0};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  ssize_t r;
+  do {
+    r = recvmsg(client, &msg, MSG_CMSG_CLOEXEC);
+  } while (r < 0 && errno == EINTR);
+  *nfds = 0;
+  // a failed call leaves msg_controllen alone, control holds nothing
+  if (r < 0)
+    return -1;
+  for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c != NULL;
+       c = CMSG_NXTHDR(&msg, c)) {
+    if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+      continue;
+    int count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (int i = 0; i < count; ++i) {
+      int fd;
+      memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+      if (*nfds < 2)
+        fds[(*nfds)++] = fd;
+      else
+        close(fd);
+    }
+  }
+  if (r == 0)
+    return 1;
+  if ((msg.msg_flags & MSG_CTRUNC) ||
+      ((size_t)r < sizeof(*req) &&
+       daemon_recv_all(client, (unsigned char *)req + r,
+                       sizeof(*req) - r) != 0) ||
+      memcmp(req->magic, DAEMON_MAGIC, DAEMON_MAGIC_SIZE) != 0)
+    return -1;
+  return 0;
+}
+
+// Writing the output would destroy the input (same path, hard or symlink)
+static int daemon_same_file(int in_fd, int out_fd) {
+  struct stat a, b;
+  return fstat(in_fd, &a) == 0 && fstat(out_fd, &b) == 0 &&
+         S_ISREG(a.st_mode) && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+}
+
+/*
+ * Both files of a job by path. The output is only truncated once it is
+ * known not to be the input
+ */
+static int daemon_open_pair(const char *in, const char *out, int *in_fd,
+                            int *out_fd) {
+  *in_fd = open(in, O_RDONLY | O_CLOEXEC);
+  if (*in_fd < 0)
+    return DAEMON_ERR_IO;
+  *out_fd = open(out, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+  int status = *out_fd < 0 ? DAEMON_ERR_IO
+               : daemon_same_file(*in_fd, *out_fd) ? HC_ERR_ARGS
+               : ftruncate(*out_fd, 0) != 0        ? DAEMON_ERR_IO
+                                                   : HC_OK;
+  if (status != HC_OK) {
+    close(*in_fd);
+    if (*out_fd >= 0)
+      close(*out_fd);
+    *in_fd = *out_fd = -1;
+  }
+  return status;
+}
+
+/*
+ * Input and output of a request: its descriptors, or its paths opened here.
+ * The paths are read even for a bad op, the next request follows them
+ */
+static int daemon_open_files(int client, const DaemonRequest *req, int *fds,
+                             int nfds, int *in_fd, int *out_fd) {
+  int known = req->op == DAEMON_OP_COMPRESS || req->op == DAEMON_OP_DECOMPRESS;
+  if (req->paths_len == 0) {
+    if (nfds != 2 || !known || daemon_same_file(fds[0], fds[1]))
+      return HC_ERR_ARGS;
+    *in_fd = fds[0];
+    *out_fd = fds[1];
+    return HC_OK;
+  }
+  if (req->paths_len > DAEMON_PATHS_MAX)
+    return DAEMON_ERR_PROTO;
+  char paths[DAEMON_PATHS_MAX + 1];
+  if (daemon_recv_all(client, paths, req->paths_len) != 0)
+    return DAEMON_ERR_PROTO;
+  paths[req->paths_len] = '\0';
+  const char *in = paths;
+  size_t in_len = strlen(in);
+  if (in_len + 1 >= req->paths_len)
+    return HC_ERR_ARGS;
+  const char *out = paths + in_len + 1;
+  if (!known || in[0] != '/' || out[0] != '/' ||
+      in_len + strlen(out) + 2 != req->paths_len)
+    return HC_ERR_ARGS;
+  return daemon_open_pair(in, out, in_fd, out_fd);
+}
+
+// One job of a connection, 1 if the connection may carry another
+static int daemon_serve(DaemonWorker *w, int client) {
+  DaemonRequest req;
+  int fds[2], nfds;
+  int got = daemon_recv_request(client, &req, fds, &nfds);
+  DaemonReply reply = {HC_OK, 0, 0};
+  int in_fd = -1, out_fd = -1;
+  if (got == 0)
+    reply.status = daemon_open_files(client, &req, fds, nfds, &in_fd, &out_fd);
+  if (got == 0 && reply.status == HC_OK)
+    reply.status = daemon_job(w, &req, in_fd, out_fd, &reply.written);
+  if (req.paths_len > 0 && in_fd >= 0)
+    close(in_fd);
+  if (req.paths_len > 0 && out_fd >= 0 && close(out_fd) != 0 &&
+      reply.status == HC_OK)
+    reply.status = DAEMON_ERR_IO;
+  for (int i = 0; i < nfds; ++i)
+    close(fds[i]);
+  if (got != 0)
+    return 0;
+  return daemon_send_all(client, &reply, sizeof(reply)) == 0 &&
+         reply.status != DAEMON_ERR_PROTO;
+}
+
+// With d->lock held
+static int daemon_park(Daemon *d, int client) {
+  if (d->parked_count == d->parked_cap) {
+    int cap = d->parked_cap ? d->parked_cap * 2 : 16;
+    int *p = realloc(d->parked, cap * sizeof(*p));
+    if (p == NULL)
+      return -1;
+    d->parked = p;
+    d->parked_cap = cap;
+  }
+  d->parked[d->parked_count++] = client;
+  return 0;
+}
+
+static void *daemon_worker_main(void *arg) {
+  DaemonWorker *w = arg;
+  Daemon *d = w->daemon;
+  pthread_mutex_lock(&d->lock);
+  for (;;) {
+    while (d->count == 0 && !d->stopping)
+      pthread_cond_wait(&d->ready, &d->lock);
+    if (d->count == 0)
+      break;
+    int client = d->queue[d->head];
+    d->head = (d->head + 1) % DAEMON_BACKLOG;
+    --d->count;
+    w->client = client;
+    pthread_cond_signal(&d->room);
+    pthread_mutex_unlock(&d->lock);
+
+    int keep = daemon_serve(w, client);
+
+    pthread_mutex_lock(&d->lock);
+    w->client = -1;
+    // back to the acceptor until the next request arrives, so an idle
+    // client does not hold a worker
+    if (keep && !d->stopping && daemon_park(d, client) == 0) {
+      if (write(d->wake[1], "p", 1) < 0 && errno != EAGAIN)
+        perror("write");
+    } else {
+      close(client);
+    }
+  }
+  pthread_mutex_unlock(&d->lock);
+  return NULL;
+}
+
+// Queue a connection with a request waiting, 0 if stopping instead
+static int daemon_enqueue(Daemon *d, int client) {
+  pthread_mutex_lock(&d->lock);
+  while (d->count == DAEMON_BACKLOG && !d->stopping)
+    pthread_cond_wait(&d->room, &d->lock);
+  if (d->stopping) {
+    pthread_mutex_unlock(&d->lock);
+    close(client);
+    return 0;
+  }
+  d->queue[(d->head + d->count++) % DAEMON_BACKLOG] = client;
+  pthread_cond_signal(&d->ready);
+  pthread_mutex_unlock(&d->lock);
+  return 1;
+}
+
+static int daemon_poll_add(struct pollfd **fds, size_t *count, size_t *cap,
+                           int fd) {
+  if (*count == *cap) {
+    size_t grown = *cap * 2;
+    struct pollfd *p = realloc(*fds, grown * sizeof(**fds));
+    if (p == NULL) {
+      close(fd);
+      return -1;
+    }
+    *fds = p;
+    *cap = grown;
+  }
+  (*fds)[(*count)++] = (struct pollfd){fd, POLLIN, 0};
+  return 0;
+}
+
+// Polls the listening socket and the idle connections, new and parked,
+// and queues each one that has something to read (a request, or the
+// client hanging up), so only connections with work take a worker
+static void *daemon_accept_main(void *arg) {
+  Daemon *d = arg;
+  size_t count = 2, cap = 16;
+  struct pollfd *fds = malloc(cap * sizeof(*fds));
+  if (fds == NULL) {
+    perror("malloc");
+    return NULL;
+  }
+  fds[0] = (struct pollfd){d->listen_fd, POLLIN, 0};
+  fds[1] = (struct pollfd){d->wake[0], POLLIN, 0};
+  for (int run = 1; run;) {
+    if (poll(fds, count, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("poll");
+      break;
+    }
+    // the new entries below are only polled on the next round
+    size_t polled = count;
+    if (fds[1].revents != 0) {
+      char drain[64];
+      while (read(d->wake[0], drain, sizeof(drain)) > 0)
+        ;
+      pthread_mutex_lock(&d->lock);
+      run = !d->stopping;
+      for (int i = 0; run && i < d->parked_count; ++i)
+        daemon_poll_add(&fds, &count, &cap, d->parked[i]);
+      if (run)
+        d->parked_count = 0;
+      pthread_mutex_unlock(&d->lock);
+    }
+    if (run && fds[0].revents != 0) {
+      int client = accept4(d->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+      // the client may have gone already
+      if (client >= 0)
+        daemon_poll_add(&fds, &count, &cap, client);
+    }
+    for (size_t i = polled; i-- > 2 && run;) {
+      if (fds[i].revents == 0)
+        continue;
+      int client = fds[i].fd;
+      fds[i] = fds[--count];
+      run = daemon_enqueue(d, client);
+    }
+  }
+  for (size_t i = 2; i < count; ++i)
+    close(fds[i].fd);
+  free(fds);
+  return NULL;
+}
+
+static void daemon_free(Daemon *d) {
+  for (int i = 0; i < d->worker_count; ++i) {
+    hc_cctx_free(d->workers[i].cctx);
+    hc_dctx_free(d->workers[i].dctx);
+    free(d->workers[i].in);
+    free(d->workers[i].out);
+  }
+  free(d->workers);
+  for (int i = 0; i < d->parked_count; ++i)
+    close(d->parked[i]);
+  free(d->parked);
+  if (d->listen_fd >= 0)
+    close(d->listen_fd);
+  if (d->wake[0] >= 0) {
+    close(d->wake[0]);
+    close(d->wake[1]);
+  }
+  pthread_mutex_destroy(&d->lock);
+  pthread_cond_destroy(&d->ready);
+  pthread_cond_destroy(&d->room);
+  free(d);
+}
+
+static int daemon_listen(Daemon *d, const char *socket_path) {
+  struct sockaddr_un addr = {0};
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Error: socket path too long: %s\n", socket_path);
+    return -1;
+  }
+  strcpy(addr.sun_path, socket_path);
+  strcpy(d->path, socket_path);
+  // a socket nobody answers on is left over from a daemon that died
+  struct stat st;
+  if (lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    int probe = daemon_connect(socket_path);
+    if (probe >= 0) {
+      close(probe);
+      fprintf(stderr, "Error: a daemon already listens on %s\n",
+              socket_path);
+      return -1;
+    }
+    unlink(socket_path);
+  }
+  d->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (d->listen_fd < 0 ||
+      bind(d->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(d->listen_fd, DAEMON_BACKLOG) != 0) {
+    perror(socket_path);
+    return -1;
+  }
+  return 0;
+}
+
+Daemon *daemon_start(const char *socket_path, int workers) {
+  if (workers <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = cpus < 1 ? 1 : cpus > DAEMON_MAX_WORKERS ? DAEMON_MAX_WORKERS
+                                                      : cpus;
+  }
+  Daemon *d = calloc(1, sizeof(Daemon));
+  if (d == NULL)
+    return NULL;
+  d->listen_fd = d->wake[0] = d->wake[1] = -1;
+  pthread_mutex_init(&d->lock, NULL);
+  pthread_cond_init(&d->ready, NULL);
+  pthread_cond_init(&d->room, NULL);
+  d->workers = calloc(workers, sizeof(DaemonWorker));
+  if (d->workers == NULL) {
+    daemon_free(d);
+    return NULL;
+  }
+  // contexts first: a daemon that cannot serve does not listen
+  for (; d->worker_count < workers; ++d->worker_count) {
+    DaemonWorker *w = &d->workers[d->worker_count];
+    w->daemon = d;
+    w->client = -1;
+    w->cctx = hc_cctx_new();
+    w->dctx = hc_dctx_new();
+    if (w->cctx == NULL || w->dctx == NULL) {
+      fprintf(stderr, "Error allocating worker contexts.\n");
+      ++d->worker_count;
+      daemon_free(d);
+      return NULL;
+    }
+  }
+  if (pipe2(d->wake, O_CLOEXEC | O_NONBLOCK) != 0 || daemon_listen(d, socket_path) != 0) {
+    daemon_free(d);
+    return NULL;
+  }
+  int started = 0;
+  for (; started < workers; ++started)
+    if (pthread_create(&d->workers[started].thread, NULL, daemon_worker_main,
+                       &d->workers[started]) != 0)
+      break;
+  if (started < workers ||
+      pthread_create(&d->acceptor, NULL, daemon_accept_main, d) != 0) {
+    fprintf(stderr, "Error starting daemon threads.\n");
+    pthread_mutex_lock(&d->lock);
+    d->stopping = 1;
+    pthread_cond_broadcast(&d->ready);
+    pthread_mutex_unlock(&d->lock);
+    for (int i = 0; i < started; ++i)
+      pthread_join(d->workers[i].thread, NULL);
+    unlink(d->path);
+    daemon_free(d);
+    return NULL;
+  }
+  return d;
+}
+
+void daemon_stop(Daemon *d) {
+  if (d == NULL)
+    return;
+  pthread_mutex_lock(&d->lock);
+  d->stopping = 1;
+  pthread_cond_broadcast(&d->room);
+  pthread_mutex_unlock(&d->lock);
+  // after the flag, so the acceptor sees it when it wakes
+  if (write(d->wake[1], "x", 1) < 0 && errno != EAGAIN)
+    perror("write");
+  pthread_join(d->acceptor, NULL);
+  unlink(d->path);
+
+  pthread_mutex_lock(&d->lock);
+  // queued connections never get a job, served ones end after theirs
+  while (d->count > 0) {
+    close(d->queue[d->head]);
+    d->head = (d->head + 1) % DAEMON_BACKLOG;
+    --d->count;
+  }
+  for (int i = 0; i < d->worker_count; ++i)
+    if (d->workers[i].client >= 0)
+      shutdown(d->workers[i].client, SHUT_RD);
+  pthread_cond_broadcast(&d->ready);
+  pthread_mutex_unlock(&d->lock);
+  for (int i = 0; i < d->worker_count; ++i)
+    pthread_join(d->workers[i].thread, NULL);
+  daemon_free(d);
+}
+
+int daemon_connect(const char *socket_path) {
+  struct sockaddr_un addr = {0};
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path))
+    return -1;
+  strcpy(addr.sun_path, socket_path);
+  int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock < 0)
+    return -1;
+  if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+static void daemon_request_init(DaemonRequest *req, int op,
+                                const CompressOptions *options) {
+  CompressOptions defaults;
+  if (options == NULL) {
+    compress_default_options(&defaults);
+    options = &defaults;
+  }
+  memcpy(req->magic, DAEMON_MAGIC, DAEMON_MAGIC_SIZE);
+  req->op = op;
+  req->method = options->method;
+  req->filter = options->filter;
+  req->level = options->level;
+  req->paths_len = 0;
+}
+
+static int daemon_recv_reply(int sock, uint64_t *written) {
+  DaemonReply reply;
+  if (daemon_recv_all(sock, &reply, sizeof(reply)) != 0)
+    return DAEMON_ERR_PROTO;
+  if (written != NULL)
+    *written = reply.written;
+  return reply.status;
+}
+
+int daemon_run_fds(int sock, int op, int in_fd, int out_fd,
+                   const CompressOptions *options, uint64_t *written) {
+  DaemonRequest req;
+  daemon_request_init(&req, op, options);
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(2 * sizeof(int))];
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct iovec iov = {&req, sizeof(req)};
+  struct msghdr msg = {0};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+  c->cmsg_level = SOL_SOCKET;
+  c->cmsg_type = SCM_RIGHTS;
+  c->cmsg_len = CMSG_LEN(2 * sizeof(int));
+  int fds[2] = {in_fd, out_fd};
+  memcpy(CMSG_DATA(c), fds, sizeof(fds));
+  ssize_t w;
+  do {
+    w = sendmsg(sock, &msg, MSG_NOSIGNAL);
+  } while (w < 0 && errno == EINTR);
+  // the descriptors went with the first byte, the rest goes plain
+  if (w < 0 || (w < (ssize_t)sizeof(req) &&
+                daemon_send_all(sock, (unsigned char *)&req + w,
+                                sizeof(req) - w) != 0))
+    return DAEMON_ERR_PROTO;
+  return daemon_recv_reply(sock, written);
+}
+
+int daemon_run_paths(int sock, int op, const char *in, const char *out,
+                     const CompressOptions *options, uint64_t *written) {
+  size_t in_len = strlen(in) + 1, out_len = strlen(out) + 1;
+  if (in_len + out_len > DAEMON_PATHS_MAX)
+    return HC_ERR_ARGS;
+  DaemonRequest req;
+  daemon_request_init(&req, op, options);
+  req.paths_len = in_len + out_len;
+  if (daemon_send_all(sock, &req, sizeof(req)) != 0 ||
+      daemon_send_all(sock, in, in_len) != 0 ||
+      daemon_send_all(sock, out, out_len) != 0)
+    return DAEMON_ERR_PROTO;
+  return daemon_recv_reply(sock, written);
+}
+
+int daemon_run_files(int sock, int op, const char *in, const char *out,
+                     const CompressOptions *options, uint64_t *written) {
+  int in_fd, out_fd;
+  int status = daemon_open_pair(in, out, &in_fd, &out_fd);
+  if (status != HC_OK)
+    return status;
+  status = daemon_run_fds(sock, op, in_fd, out_fd, options, written);
+  close(in_fd);
+  if (close(out_fd) != 0 && status == HC_OK)
+    status = DAEMON_ERR_IO;
+  return status;
+}
@@ -0,0 +1,192 @@
+#include "filter.h"
+#include "huffman.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char *flt_names[FLT_COUNT] = {
+    "none", "delta", "delta2", "delta4", "delta8", "shuffle4", "shuffle8"};
+
+static int flt_stride(unsigned char kind) {
+  switch (kind) {
+  case FLT_DELTA1:
+    return 1;
+  case FLT_DELTA2:
+    return 2;
+  case FLT_DELTA4:
+  case FLT_SHUFFLE4:
+    return 4;
+  case FLT_DELTA8:
+  case FLT_SHUFFLE8:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+void flt_init(FilterState *state, unsigned char kind) {
+  state->kind = kind;
+  state->pos = 0;
+  memset(state->history, 0, sizeof(state->history));
+}
+
+/*
+ * Byte planes: byte j of every sample goes to plane j. A trailing partial
+ * sample stays in place.
+ */
+static void flt_shuffle(unsigned char *buf, size_t n, int stride, int undo) {
+  unsigned char tmp[FLT_GROUP];
+  for (size_t g = 0; g < n; g += FLT_GROUP) {
+    size_t len = n - g < FLT_GROUP ? n - g : FLT_GROUP;
+    size_t samples = len / stride;
+    unsigned char *p = buf + g;
+    for (size_t k = 0; k < samples; ++k) {
+      for (int j = 0; j < stride; ++j) {
+        if (undo)
+          tmp[k * stride + j] = p[j * samples + k];
+        else
+          tmp[j * samples + k] = p[k * stride + j];
+      }
+    }
+    memcpy(p, tmp, samples * stride);
+  }
+}
+
+void flt_encode(FilterState *state, unsigned char *buf, size_t n) {
+  int stride = flt_stride(state->kind);
+  if (state->kind == FLT_SHUFFLE4 || state->kind == FLT_SHUFFLE8) {
+    flt_shuffle(buf, n, stride, 0);
+    return;
+  }
+  if (stride == 0)
+    return;
+  for (size_t i = 0; i < n; ++i) {
+    unsigned char raw = buf[i];
+    buf[i] = raw - state->history[state->pos];
+    state->history[state->pos] = raw;
+    state->pos = (state->pos + 1) % stride;
+  }
+}
+
+void flt_decode(FilterState *state, unsigned char *buf, size_t n) {
+  int stride = flt_stride(state->kind);
+  if (state->kind == FLT_SHUFFLE4 || state->kind == FLT_SHUFFLE8) {
+    flt_shuffle(buf, n, stride, 1);
+    return;
+  }
+  if (stride == 0)
+    return;
+  for (size_t i = 0; i < n; ++i) {
+    buf[i] += state->history[state->pos];
+    state->history[state->pos] = buf[i];
+    state->pos = (state->pos + 1) % stride;
+  }
+}
+
+// Size in bits of the sample coded with its own order-0 table
+static uint64_t flt_trial_cost(const unsigned char *buf, size_t n) {
+  uint32_t counts[ALPHABET_SIZE] = {0};
+  for (size_t i = 0; i < n; ++i)
+    ++counts[buf[i]];
+  HuffTable table;
+  if (hc_table_from_counts(&table, counts, ALPHABET_SIZE) != 0)
+    return UINT64_MAX;
+  return hc_table_cost(&table, counts) + hc_table_header_bits(&table);
+}
+
+unsigned char flt_choose(const unsigned char *sample, size_t n) {
+  unsigned char *trial = malloc(n ? n : 1);
+  if (trial == NULL)
+    return FLT_NONE;
+  unsigned char best = flt_choose_with(sample, n, trial);
+  free(trial);
+  return best;
+}
+
+unsigned char flt_choose_with(const unsigned char *sample, size_t n,
+                              unsigned char *trial) {
+  uint64_t none = flt_trial_cost(sample, n);
+  uint64_t best_cost = none;
+  unsigned char best = FLT_NONE;
+  for (unsigned char kind = FLT_NONE + 1; kind < FLT_COUNT; ++kind) {
+    FilterState state;
+    flt_init(&state, kind);
+    memcpy(trial, sample, n);
+    flt_encode(&state, trial, n);
+    uint64_t cost = flt_trial_cost(trial, n);
+    if (cost < best_cost) {
+      best_cost = cost;
+      best = kind;
+    }
+  }
+  // a filter has to win clearly, text should stay unfiltered
+  return best_cost < none - none / 32 ? best : FLT_NONE;
+}
+
+static uint64_t flt_coded_cost(unsigned char kind, const unsigned char *sample,
+                               size_t n, unsigned char *trial, FltCost cost,
+                               void *ctx) {
+  FilterState state;
+  flt_init(&state, kind);
+  memcpy(trial, sample, n);
+  flt_encode(&state, trial, n);
+  return cost(ctx, trial, n);
+}
+
+unsigned char flt_choose_cost(const unsigned char *sample, size_t n,
+                              unsigned char *trial, FltCost cost, void *ctx) {
+  unsigned char chosen = flt_choose_with(sample, n, trial);
+  // a few bytes cannot save what coding them three more times costs
+  if (cost == NULL || n < FLT_TRIAL_MIN)
+    return chosen;
+  size_t m = n < FLT_TRIAL ? n : FLT_TRIAL;
+  uint64_t base = flt_coded_cost(chosen, sample, m, trial, cost, ctx);
+  uint64_t best_cost = base;
+  unsigned char best = chosen;
+  const unsigned char shuffles[] = {FLT_SHUFFLE4, FLT_SHUFFLE8};
+  for (size_t i = 0; i < sizeof(shuffles); ++i) {
+    uint64_t c = flt_coded_cost(shuffles[i], sample, m, trial, cost, ctx);
+    if (c < best_cost) {
+      best_cost = c;
+      best = shuffles[i];
+    }
+  }
+  return best_cost < base - base / 32 ? best : chosen;
+}
+
+unsigned char flt_choose_file(const char *file_name, FltCost cost, void *ctx) {
+  struct stat st;
+  // sampling a pipe would eat the data we are about to compress
+  if (stat(file_name, &st) != 0 || !S_ISREG(st.st_mode))
+    return FLT_NONE;
+  FILE *file = fopen(file_name, "rb");
+  if (file == NULL)
+    return FLT_NONE;
+  unsigned char *sample = malloc(FLT_SAMPLE);
+  unsigned char kind = FLT_NONE;
+  if (sample != NULL) {
+    size_t n = fread(sample, 1, FLT_SAMPLE, file);
+    // sized to the sample, small files are the common case
+    unsigned char *trial = malloc(n ? n : 1);
+    if (trial != NULL)
+      kind = flt_choose_cost(sample, n, trial, cost, ctx);
+    free(trial);
+    free(sample);
+  }
+  fclose(file);
+  return kind;
+}
+
+const char *flt_name(unsigned char kind) {
+  return kind < FLT_COUNT ? flt_names[kind] : "unknown";
+}
+
+int flt_parse(const char *name) {
+  if (strcmp(name, "auto") == 0)
+    return FLT_AUTO;
+  for (int kind = 0; kind < FLT_COUNT; ++kind)
+    if (strcmp(name, flt_names[kind]) == 0)
+      return kind;
+  return -1;
+}
@@ -0,0 +1,109 @@
+#include "fixed.h"
+#include <stdlib.h>
+#include <string.h>
+
+int hc_fixed_read_table(FILE *file, HuffTable *table) {
+  unsigned char lens[ALPHABET_SIZE] = {0};
+  char line[128];
+  int header = 0, used = 0;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char *p = line + strspn(line, " \t\r\n");
+    if (*p == '\0' || *p == '#')
+      continue;
+    int a, b;
+    char magic[8];
+    if (!header) {
+      if (sscanf(p, "%7s %d", magic, &a) != 2 ||
+          strcmp(magic, HC_FIXED_MAGIC) != 0 || a != HC_FIXED_VERSION) {
+        fprintf(stderr, "Error: not a code table.\n");
+        return -1;
+      }
+      header = 1;
+      continue;
+    }
+    if (sscanf(p, "%d %d", &a, &b) != 2 || a < 0 || a >= ALPHABET_SIZE ||
+        b < 1 || b > HC_MAX_CODE_LENGTH || lens[a] != 0) {
+      fprintf(stderr, "Error: bad code table line: %s", p);
+      return -1;
+    }
+    lens[a] = b;
+    ++used;
+  }
+  if (!header || used == 0 || hc_table_build(table, lens, ALPHABET_SIZE) != 0) {
+    fprintf(stderr, "Error: the code table has no valid code.\n");
+    return -1;
+  }
+  return 0;
+}
+
+int hc_fixed_write_table(FILE *file, const HuffTable *table) {
+  if (fprintf(file, "%s %d\n# byte length\n", HC_FIXED_MAGIC,
+              HC_FIXED_VERSION) < 0)
+    return -1;
+  for (int c = 0; c < ALPHABET_SIZE && c < table->nsyms; ++c)
+    if (table->lens[c] != 0 && fprintf(file, "%d %d\n", c, table->lens[c]) < 0)
+      return -1;
+  return 0;
+}
+
+int hc_fixed_table_from_counts(HuffTable *table, const uint64_t *counts) {
+  uint64_t max = 0;
+  for (int c = 0; c < ALPHABET_SIZE; ++c)
+    if (counts[c] > max)
+      max = counts[c];
+  int shift = 0;
+  while ((max >> shift) >= (1u << 24))
+    ++shift;
+  // one more for every byte, data of the same kind may hold any of them
+  uint32_t scaled[ALPHABET_SIZE];
+  for (int c = 0; c < ALPHABET_SIZE; ++c)
+    scaled[c] = (counts[c] >> shift) + 1;
+  return hc_table_from_counts(table, scaled, ALPHABET_SIZE);
+}
+
+size_t hc_fixed_bound(size_t n) {
+  // hc_pack_codes stores whole 32-bit words
+  return (n * HC_MAX_CODE_LENGTH + 7) / 8 + 8;
+}
+
+int hc_fixed_encode(const HcFixedCode *code, const unsigned char *src,
+                    size_t n, unsigned char *dst, size_t cap, size_t *len) {
+  if (len == NULL)
+    return HC_ERR_ARGS;
+  *len = 0;
+  if (code == NULL || (src == NULL && n > 0) || dst == NULL)
+    return HC_ERR_ARGS;
+  if (cap < hc_fixed_bound(n))
+    return HC_ERR_SPACE;
+  if (!code->every_byte)
+    for (size_t i = 0; i < n; ++i)
+      if (code->table->lens[src[i]] == 0)
+        return HC_ERR_ARGS;
+  uint64_t acc = 0;
+  int nbits = 0;
+  size_t k = hc_pack_codes(code->codes, src, n, dst, &acc, &nbits);
+  *len = k + hc_pack_flush(&acc, &nbits, dst + k);
+  return HC_OK;
+}
+
+int hc_fixed_decode(const HcFixedCode *code, const unsigned char *src,
+                    size_t n, unsigned char *dst, size_t size) {
+  if (code == NULL || (src == NULL && n > 0) || (dst == NULL && size > 0))
+    return HC_ERR_ARGS;
+  return code->decode(src, n, dst, size);
+}
+
+int hc_fixed_decode_table(const HuffTable *table, const unsigned char *src,
+                          size_t n, unsigned char *dst, size_t size) {
+  if (table == NULL || (src == NULL && n > 0) || (dst == NULL && size > 0))
+    return HC_ERR_ARGS;
+  BitReader br;
+  bs_reader_init(&br, src, n);
+  for (size_t i = 0; i < size; ++i) {
+    int s = hc_read_symbol(&br, table);
+    if (s < 0 || br.overrun)
+      return HC_ERR_CORRUPT;
+    dst[i] = s;
+  }
+  return HC_OK;
+}
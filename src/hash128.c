@@ -0,0 +1,107 @@
+#include "hash128.h"
+#include <string.h>
+
+#define HASH128_C1 0x87c37b91114253d5ull
+#define HASH128_C2 0x4cf5ad432745937full
+
+static inline uint64_t hash128_rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t hash128_load(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+static inline uint64_t hash128_fmix(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdull;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ull;
+  k ^= k >> 33;
+  return k;
+}
+
+static inline uint64_t hash128_mix1(uint64_t k1) {
+  return hash128_rotl(k1 * HASH128_C1, 31) * HASH128_C2;
+}
+
+static inline uint64_t hash128_mix2(uint64_t k2) {
+  return hash128_rotl(k2 * HASH128_C2, 33) * HASH128_C1;
+}
+
+// n / 16 whole blocks
+static void hash128_blocks(Hash128State *s, const unsigned char *p,
+                           size_t blocks) {
+  uint64_t h1 = s->h1, h2 = s->h2;
+  for (size_t i = 0; i < blocks; ++i, p += 16) {
+    h1 ^= hash128_mix1(hash128_load(p));
+    h1 = hash128_rotl(h1, 27) + h2;
+    h1 = h1 * 5 + 0x52dce729;
+    h2 ^= hash128_mix2(hash128_load(p + 8));
+    h2 = hash128_rotl(h2, 31) + h1;
+    h2 = h2 * 5 + 0x38495ab5;
+  }
+  s->h1 = h1;
+  s->h2 = h2;
+}
+
+void hash128_init(Hash128State *state, uint32_t seed) {
+  state->h1 = state->h2 = seed;
+  state->len = 0;
+  state->tail_len = 0;
+}
+
+void hash128_update(Hash128State *state, const void *buf, size_t n) {
+  const unsigned char *p = buf;
+  state->len += n;
+  if (state->tail_len > 0) {
+    size_t k = 16 - state->tail_len < n ? 16 - state->tail_len : n;
+    memcpy(state->tail + state->tail_len, p, k);
+    state->tail_len += k;
+    p += k;
+    n -= k;
+    if (state->tail_len < 16)
+      return;
+    hash128_blocks(state, state->tail, 1);
+    state->tail_len = 0;
+  }
+  hash128_blocks(state, p, n / 16);
+  memcpy(state->tail, p + n / 16 * 16, n % 16);
+  state->tail_len = n % 16;
+}
+
+Hash128 hash128_final(const Hash128State *state) {
+  uint64_t h1 = state->h1, h2 = state->h2;
+  uint64_t k1 = 0, k2 = 0;
+  const unsigned char *t = state->tail;
+  for (size_t i = state->tail_len; i > 8; --i)
+    k2 = (k2 << 8) | t[i - 1];
+  for (size_t i = state->tail_len < 8 ? state->tail_len : 8; i > 0; --i)
+    k1 = (k1 << 8) | t[i - 1];
+  if (state->tail_len > 8)
+    h2 ^= hash128_mix2(k2);
+  if (state->tail_len > 0)
+    h1 ^= hash128_mix1(k1);
+
+  h1 ^= state->len;
+  h2 ^= state->len;
+  h1 += h2;
+  h2 += h1;
+  h1 = hash128_fmix(h1);
+  h2 = hash128_fmix(h2);
+  h1 += h2;
+  h2 += h1;
+  return (Hash128){h1, h2};
+}
+
+Hash128 hash128(const void *buf, size_t n, uint32_t seed) {
+  Hash128State state;
+  hash128_init(&state, seed);
+  hash128_update(&state, buf, n);
+  return hash128_final(&state);
+}
@@ -1,10 +1,12 @@
 #include "huffman.h"
+#include "bitstream.h"
+#include "filter.h"
 #include "io_tool.h"
 #include "priority_queue.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#define ALPHABET_SIZE 0x100
 #define C_LENGHT 0
 
 // Select just nodes with frequency greater than 0
@@ -46,8 +48,8 @@ static int select_nodes(Node *pq, double total) {
   return count; // return number of nodes with non-zero frequency
 }
 
-// Build Huffman tree
-static Node *hc_build_tree(PriorityQueue *pq) {
+// Build Huffman tree, internal nodes come from pool when there is one
+static Node *hc_build_tree(PriorityQueue *pq, Node *pool) {
   int nodes = pq->size;
   
   // Handle empty queue
@@ -62,7 +64,15 @@ static Node *hc_build_tree(PriorityQueue *pq) {
   
   // Build tree for multiple nodes
   for (int i = 0; i < nodes - 1; ++i) {
-    Node *n = calloc(1, sizeof(Node));
+    Node *n = pool != NULL ? pool++ : calloc(1, sizeof(Node));
+    if (n == NULL) {
+      // every entry left in the queue is a partial tree
+      while (!pq_is_empty(pq)) {
+        hc_free_tree(pq_top(pq));
+        pq_pop(pq);
+      }
+      return NULL;
+    }
     n->is_leaf = 0;
     n->left = pq_top(pq);
     pq_pop(pq);
@@ -74,12 +84,20 @@ static Node *hc_build_tree(PriorityQueue *pq) {
   return pq_top(pq);
 }
 
-static void hc_inorden(Node *node, unsigned char **code, int depth,
-                       unsigned char *prefix) {
+static int hc_inorden(Node *node, unsigned char **code, int depth,
+                      unsigned char *prefix,
+                      unsigned char (*store)[HC_CODE_BYTES]) {
   if (node->is_leaf) {
     size_t s = depth / 8 + 1; // this extra one is to save the depth
     s += (depth % 8) ? 1 : 0;
-    code[node->byte] = (unsigned char *)calloc(s, sizeof(unsigned char));
+    if (store != NULL) {
+      code[node->byte] = store[node->byte];
+      memset(code[node->byte], 0, s);
+    } else {
+      code[node->byte] = (unsigned char *)calloc(s, sizeof(unsigned char));
+    }
+    if (code[node->byte] == NULL)
+      return -1;
     code[node->byte][C_LENGHT] = (unsigned char)depth;
     for (int i = 0; i < depth; ++i) {
       int idx = 1 + i / 8; // this extra one is to save the depth
@@ -88,19 +106,22 @@ static void hc_inorden(Node *node, unsigned char **code, int depth,
 
   } else {
     // visit left children (0)
-    hc_inorden(node->left, code, depth + 1, prefix);
+    if (hc_inorden(node->left, code, depth + 1, prefix, store) != 0)
+      return -1;
     // visit right children (1)
     int idx = depth / 8;
     prefix[idx] |= (1 << (7 - depth % 8)); // turn on bit
-    hc_inorden(node->right, code, depth + 1, prefix);
+    if (hc_inorden(node->right, code, depth + 1, prefix, store) != 0)
+      return -1;
     // turn off bit
     prefix[idx] = ~prefix[idx];
     prefix[idx] |= (1 << (7 - depth % 8));
     prefix[idx] = ~prefix[idx];
   }
+  return 0;
 }
 
-static unsigned char **hc_build_code(Node *root) {
+unsigned char **hc_build_code(Node *root) {
   if (root == NULL) {
     return NULL;
   }
@@ -110,17 +131,141 @@ static unsigned char **hc_build_code(Node *root) {
   // remember prefix code
   unsigned char *p =
       (unsigned char *)calloc(ALPHABET_SIZE, sizeof(unsigned char));
-  hc_inorden(root, code, 0, p);
+  if (code == NULL || p == NULL || hc_inorden(root, code, 0, p, NULL) != 0) {
+    free(p);
+    if (code != NULL)
+      hc_free_code(code);
+    return NULL;
+  }
   free(p);
   return code;
 }
 
+void hc_code_table_build(HcCodeTable *table, unsigned char *const *code) {
+  size_t spilled = 0;
+  for (int c = 0; c < ALPHABET_SIZE; ++c) {
+    HcCode *e = &table->codes[c];
+    e->word = 0;
+    e->len = code[c] == NULL ? 0 : code[c][C_LENGHT];
+    size_t bytes = (e->len + 7) / 8;
+    if (e->len > HC_WORD_BITS) {
+      memcpy(table->spill + spilled, code[c] + 1, bytes);
+      e->word = spilled;
+      spilled += bytes;
+      continue;
+    }
+    for (size_t j = 0; j < bytes; ++j)
+      e->word = (e->word << 8) | code[c][1 + j];
+    e->word >>= bytes * 8 - e->len; // drop the padding of the last byte
+  }
+}
+
+/*
+ * Add len bits, hand out 4 bytes once 32 are pending. Bits above the
+ * pending ones are left in acc, they are shifted out before they matter
+ */
+static inline size_t hc_pack_bits(uint64_t *acc, int *nbits, uint32_t word,
+                                  int len, unsigned char *out) {
+  *acc = (*acc << len) | word;
+  *nbits += len;
+  if (*nbits < 32)
+    return 0;
+  *nbits -= 32;
+  uint32_t w = (uint32_t)(*acc >> *nbits);
+  out[0] = w >> 24;
+  out[1] = w >> 16;
+  out[2] = w >> 8;
+  out[3] = w;
+  return 4;
+}
+
+size_t hc_pack_codes(const HcCodeTable *table, const unsigned char *in,
+                     size_t n, unsigned char *out, uint64_t *acc,
+                     int *nbits) {
+  uint64_t a = *acc;
+  int bits = *nbits;
+  size_t pos = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const HcCode *c = &table->codes[in[i]];
+    if (c->len <= HC_WORD_BITS) {
+      pos += hc_pack_bits(&a, &bits, c->word, c->len, out + pos);
+      continue;
+    }
+    const unsigned char *p = table->spill + c->word;
+    for (uint32_t j = 0; j < c->len; j += 8, ++p) {
+      int k = c->len - j < 8 ? c->len - j : 8;
+      pos += hc_pack_bits(&a, &bits, *p >> (8 - k), k, out + pos);
+    }
+  }
+  *acc = a & (((uint64_t)1 << bits) - 1);
+  *nbits = bits;
+  return pos;
+}
+
+size_t hc_pack_flush(uint64_t *acc, int *nbits, unsigned char *out) {
+  size_t pos = 0;
+  while (*nbits >= 8) {
+    *nbits -= 8;
+    out[pos++] = *acc >> *nbits;
+  }
+  if (*nbits > 0)
+    out[pos++] = *acc << (8 - *nbits);
+  *acc = 0;
+  *nbits = 0;
+  return pos;
+}
+
+Node *hc_tree_from_histogram(Node *arr, double total) {
+  // erase not used bytes
+  int size = select_nodes(arr, total);
+  // priority queue
+  PriorityQueue pq;
+  if (pq_new(&pq, arr, size) != 0)
+    return NULL;
+  // huffman tree
+  Node *root = hc_build_tree(&pq, NULL);
+  pq_erase(&pq);
+  return root;
+}
+
+int hc_tree_build(HuffTree *tree, Node *arr, double total) {
+  int size = select_nodes(arr, total);
+  tree->root = NULL;
+  memset(tree->code, 0, sizeof(tree->code));
+  if (size == 0)
+    return -1;
+  // leaves first, then internal nodes, pushed in hc_tree_from_histogram
+  // order so both build the same tree
+  PriorityQueue pq;
+  pq_init(&pq, tree->heap, ALPHABET_SIZE);
+  for (int i = 0; i < size; ++i) {
+    tree->nodes[i] = arr[i];
+    (void)pq_push(&pq, &tree->nodes[i]);
+  }
+  tree->root = hc_build_tree(&pq, tree->nodes + size);
+  unsigned char prefix[ALPHABET_SIZE] = {0};
+  if (hc_inorden(tree->root, tree->code, 0, prefix, tree->bits) != 0)
+    return -1;
+  hc_code_table_build(&tree->flat, tree->code);
+  return 0;
+}
+
 // similar a adjacent matrix
 // dynamic array of unsigned char arrays
 // each element contains size code and code
 unsigned char **hc_endoce_file(char *file_name, Node **root) {
+  return hc_encode_file_filtered(file_name, root, FLT_NONE);
+}
+
+static unsigned char **
+hc_encode_counted(char *file_name, Node **root, unsigned char filter,
+                  double (*count)(Node *, char *, unsigned char)) {
   // Create nodes
   Node *arr = (Node *)malloc(ALPHABET_SIZE * sizeof(Node));
+  if (arr == NULL) {
+    *root = NULL;
+    return NULL;
+  }
   // Initialization of each node
   for (int i = 0; i < ALPHABET_SIZE; ++i) {
     arr[i].byte = i;
@@ -128,23 +273,98 @@ unsigned char **hc_endoce_file(char *file_name, Node **root) {
     arr[i].is_leaf = 1;
     arr[i].left = arr[i].right = NULL;
   }
-  double tbytes = io_read_bytes(arr, file_name);
-  // erase not used bytes
-  double size = select_nodes(arr, tbytes);
-
-  // priority queue
-  PriorityQueue pq;
-  pq_new(&pq, arr, size);
-  // TODO: error here
+  double tbytes = count(arr, file_name, filter);
+  if (tbytes < 0) {
+    free(arr);
+    *root = NULL;
+    return NULL;
+  }
+  *root = hc_tree_from_histogram(arr, tbytes);
   free(arr);
-  // huffman tree
-  *root = hc_build_tree(&pq);
-  pq_erase(&pq);
   // huffman code
   unsigned char **code = hc_build_code(*root);
   return code;
 }
 
+unsigned char **hc_encode_file_filtered(char *file_name, Node **root,
+                                        unsigned char filter) {
+  return hc_encode_counted(file_name, root, filter, io_read_bytes_filtered);
+}
+
+unsigned char **hc_encode_file_sparse(char *file_name, Node **root,
+                                      unsigned char filter) {
+  return hc_encode_counted(file_name, root, filter, io_read_bytes_sparse);
+}
+
+/*
+ * Adaptive mode
+ *
+ * Encoder and decoder start from the same flat model (every byte seen once)
+ * and rebuild the tree after each block from the counts seen so far, so no
+ * tree is stored and the first block can be written before the input ends.
+ */
+
+static int hc_adaptive_rebuild(AdaptiveModel *model) {
+  Node arr[ALPHABET_SIZE];
+  for (int i = 0; i < ALPHABET_SIZE; ++i) {
+    arr[i].byte = i;
+    arr[i].frequency = model->counts[i];
+    arr[i].is_leaf = 1;
+    arr[i].left = arr[i].right = NULL;
+  }
+  return hc_tree_build(&model->tree, arr, (double)model->total);
+}
+
+static int hc_adaptive_update(AdaptiveModel *model, const unsigned char *buf,
+                              size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    ++model->counts[buf[i]];
+  model->total += n;
+  // forget old statistics, counts never drop to zero
+  while (model->total > HC_ADAPTIVE_LIMIT) {
+    model->total = 0;
+    for (int i = 0; i < ALPHABET_SIZE; ++i) {
+      model->counts[i] = (model->counts[i] + 1) / 2;
+      model->total += model->counts[i];
+    }
+  }
+  return hc_adaptive_rebuild(model);
+}
+
+int hc_adaptive_init(AdaptiveModel *model) {
+  for (int i = 0; i < ALPHABET_SIZE; ++i)
+    model->counts[i] = 1;
+  model->total = ALPHABET_SIZE;
+  return hc_adaptive_rebuild(model);
+}
+
+// The model owns no heap memory since the tree lives in a HuffTree
+void hc_adaptive_free(AdaptiveModel *model) { model->tree.root = NULL; }
+
+int hc_adaptive_encode_block(AdaptiveModel *model, const unsigned char *buf,
+                             size_t n, BitWriter *bw) {
+  for (size_t i = 0; i < n; ++i)
+    hc_write_code(bw, &model->tree.flat, buf[i]);
+  if (bw->error)
+    return -1;
+  return hc_adaptive_update(model, buf, n);
+}
+
+int hc_adaptive_decode_block(AdaptiveModel *model, BitReader *br,
+                             unsigned char *buf, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    Node *current = model->tree.root;
+    while (!current->is_leaf)
+      current = bs_read_bit(br) ? current->right : current->left;
+    buf[i] = current->byte;
+  }
+  if (br->overrun) {
+    fprintf(stderr, "Error decoding adaptive block: truncated data.\n");
+    return -1;
+  }
+  return hc_adaptive_update(model, buf, n);
+}
+
 int hc_free_tree(Node *root) {
   if (root == NULL)
     return 0;
@@ -165,3 +385,190 @@ int hc_free_code(unsigned char **code) {
   free(code);
   return 0;
 }
+
+/*
+ * Canonical tables
+ */
+
+// leaves are identified by their position in the leaves array
+static void hc_leaf_depths(Node *node, Node *leaves, int depth,
+                           unsigned char *lens, int *max_depth) {
+  if (node->is_leaf) {
+    lens[node - leaves] = depth ? depth : 1; // a lone symbol still needs 1 bit
+    if (lens[node - leaves] > *max_depth)
+      *max_depth = lens[node - leaves];
+    return;
+  }
+  hc_leaf_depths(node->left, leaves, depth + 1, lens, max_depth);
+  hc_leaf_depths(node->right, leaves, depth + 1, lens, max_depth);
+}
+
+int hc_lengths_from_counts(const uint32_t *counts, int nsyms,
+                           unsigned char *lens, int max_len) {
+  Node leaves[HC_MAX_SYMBOLS];
+  Node inner[HC_MAX_SYMBOLS];
+  Node *heap[HC_MAX_SYMBOLS];
+  uint32_t scaled[HC_MAX_SYMBOLS];
+  if (nsyms > HC_MAX_SYMBOLS)
+    return -1;
+  for (int i = 0; i < nsyms; ++i) {
+    scaled[i] = counts[i];
+    lens[i] = 0;
+  }
+  for (;;) {
+    PriorityQueue pq;
+    pq_init(&pq, heap, nsyms);
+    for (int i = 0; i < nsyms; ++i) {
+      if (scaled[i] == 0)
+        continue;
+      leaves[i].frequency = scaled[i];
+      leaves[i].is_leaf = 1;
+      leaves[i].left = leaves[i].right = NULL;
+      pq_push(&pq, &leaves[i]);
+    }
+    if (pq.size == 0)
+      return 0;
+    // same merge loop as hc_build_tree, nodes come from the inner array
+    int used = 0;
+    while (pq.size > 1) {
+      Node *n = &inner[used++];
+      n->is_leaf = 0;
+      n->left = pq_top(&pq);
+      pq_pop(&pq);
+      n->right = pq_top(&pq);
+      pq_pop(&pq);
+      n->frequency = n->left->frequency + n->right->frequency;
+      pq_push(&pq, n);
+    }
+    Node *root = pq_top(&pq);
+    int max_depth = 0;
+    hc_leaf_depths(root, leaves, 0, lens, &max_depth);
+    if (max_depth <= max_len)
+      return 0;
+    // too deep: flatten the distribution and try again
+    for (int i = 0; i < nsyms; ++i)
+      if (scaled[i])
+        scaled[i] = (scaled[i] >> 1) | 1;
+  }
+}
+
+int hc_table_build(HuffTable *table, const unsigned char *lens, int nsyms) {
+  unsigned short offs[HC_MAX_CODE_LENGTH + 2];
+  uint32_t next[HC_MAX_CODE_LENGTH + 2];
+  if (nsyms > HC_MAX_SYMBOLS)
+    return -1;
+  table->nsyms = nsyms;
+  for (int len = 0; len <= HC_MAX_CODE_LENGTH; ++len)
+    table->count[len] = 0;
+  for (int s = 0; s < nsyms; ++s) {
+    if (lens[s] > HC_MAX_CODE_LENGTH)
+      return -1;
+    table->lens[s] = lens[s];
+    table->count[lens[s]]++;
+  }
+  table->count[0] = 0;
+  // reject oversubscribed lengths, they would not decode
+  int left = 1;
+  for (int len = 1; len <= HC_MAX_CODE_LENGTH; ++len) {
+    left <<= 1;
+    left -= table->count[len];
+    if (left < 0)
+      return -1;
+  }
+  offs[1] = 0;
+  next[1] = 0;
+  for (int len = 1; len <= HC_MAX_CODE_LENGTH; ++len) {
+    offs[len + 1] = offs[len] + table->count[len];
+    next[len + 1] = (next[len] + table->count[len]) << 1;
+  }
+  for (int s = 0; s < nsyms; ++s) {
+    int len = lens[s];
+    if (len == 0)
+      continue;
+    table->codes[s] = next[len]++;
+    table->symbol[offs[len]++] = s;
+  }
+  return 0;
+}
+
+int hc_table_from_counts(HuffTable *table, const uint32_t *counts, int nsyms) {
+  unsigned char lens[HC_MAX_SYMBOLS];
+  if (hc_lengths_from_counts(counts, nsyms, lens, HC_MAX_CODE_LENGTH) != 0)
+    return -1;
+  return hc_table_build(table, lens, nsyms);
+}
+
+void hc_table_write(BitWriter *bw, const HuffTable *table) {
+  int used = 0;
+  for (int s = 0; s < table->nsyms; ++s)
+    if (table->lens[s])
+      ++used;
+  bs_write_bits(bw, used, 9);
+  int prev = -1;
+  for (int s = 0; s < table->nsyms; ++s) {
+    if (table->lens[s] == 0)
+      continue;
+    bs_write_gamma(bw, s - prev);
+    bs_write_bits(bw, table->lens[s], 4);
+    prev = s;
+  }
+}
+
+int hc_table_read(BitReader *br, HuffTable *table, int nsyms) {
+  unsigned char lens[HC_MAX_SYMBOLS] = {0};
+  if (nsyms > HC_MAX_SYMBOLS)
+    return -1;
+  int used = bs_read_bits(br, 9);
+  int s = -1;
+  for (int i = 0; i < used; ++i) {
+    s += bs_read_gamma(br);
+    if (br->overrun || s < 0 || s >= nsyms) {
+      fprintf(stderr, "Error reading code table: invalid symbol.\n");
+      return -1;
+    }
+    lens[s] = bs_read_bits(br, 4);
+  }
+  if (hc_table_build(table, lens, nsyms) != 0) {
+    fprintf(stderr, "Error reading code table: invalid code lengths.\n");
+    return -1;
+  }
+  return 0;
+}
+
+uint32_t hc_table_header_bits(const HuffTable *table) {
+  uint32_t bits = 9;
+  int prev = -1;
+  for (int s = 0; s < table->nsyms; ++s) {
+    if (table->lens[s] == 0)
+      continue;
+    int n = 0;
+    while (((uint32_t)(s - prev) >> n) > 1)
+      ++n;
+    bits += 2 * n + 1 + 4;
+    prev = s;
+  }
+  return bits;
+}
+
+uint64_t hc_table_cost(const HuffTable *table, const uint32_t *counts) {
+  uint64_t bits = 0;
+  for (int s = 0; s < table->nsyms; ++s)
+    bits += (uint64_t)counts[s] * table->lens[s];
+  return bits;
+}
+
+int hc_read_symbol(BitReader *br, const HuffTable *table) {
+  int code = 0;  // bits read so far
+  int first = 0; // first code of the current length
+  int index = 0; // position of that code in symbol[]
+  for (int len = 1; len <= HC_MAX_CODE_LENGTH; ++len) {
+    code |= bs_read_bit(br);
+    int count = table->count[len];
+    if (code - first < count)
+      return table->symbol[index + code - first];
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+  }
+  return -1;
+}
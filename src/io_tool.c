@@ -1,14 +1,23 @@
+// SEEK_DATA, SEEK_HOLE and fallocate
+#define _GNU_SOURCE
 #include "io_tool.h"
+#include "async_io.h"
 #include "huffman.h"
+#include "block.h"
+#include "bwt.h"
+#include "crc32c.h"
+#include "filter.h"
+#include "pipeline.h"
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-#define BUFFER_SIZE 4096 // can be parameterized
-
 /*
  * 1 if is internal node, 0 if leaf
  * there is a byte after the indicator
@@ -26,9 +35,6 @@ int io_write_in_orden(Node *node, unsigned char *buffer, int index) {
   return index;
 }
 
-/*
- * Use BUFFER_SIZE to write the huffman tree
- */
 // Simple recursive tree writing - this is the reference implementation
 static int io_write_node_recursive(FILE *file, Node *node) {
   if (node->is_leaf) {
@@ -53,91 +59,271 @@ int io_write_huffman_tree(FILE *wfile, Node *root) {
   return io_write_node_recursive(wfile, root);
 }
 
+// Hand the rest of a stdio stream over to an async writer, size as in
+// aio_writer_init_size
+static int io_writer_attach(AioFile *writer, FILE *file, const AioHole *holes,
+                            int hole_count, uint64_t size) {
+  if (fflush(file) != 0)
+    return -1;
+  return aio_writer_init_size(writer, fileno(file), holes, hole_count, size);
+}
+
+// Wait for the writer and move the stdio stream past its data
+static int io_writer_detach(AioFile *writer, FILE *file) {
+  int status = aio_close(writer);
+  if (writer->seekable && fseeko(file, writer->offset, SEEK_SET) != 0)
+    status = -1;
+  return status;
+}
+
+/*
+ * Chunks travelling through the pipeline (pipeline.h). Input chunks hold
+ * raw or compressed bytes, output chunks coded bytes or a block's bits.
+ */
+typedef struct IoChunk {
+  unsigned char *data;
+  size_t len;
+  uint64_t raw_len; // block methods: original size of the block
+  uint32_t crc;     // block methods: CRC32C of the original bytes
+  BitWriter bw;     // block encoder output
+} IoChunk;
+
+// Checksums are stored little endian
+void io_store_crc(unsigned char *out, uint32_t crc) {
+  for (int i = 0; i < 4; ++i)
+    out[i] = crc >> (8 * i);
+}
+
+uint32_t io_load_crc(const unsigned char *in) {
+  return in[0] | in[1] << 8 | in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+static int io_write_crc(AioFile *writer, uint32_t crc) {
+  unsigned char buf[IO_CRC_SIZE];
+  io_store_crc(buf, crc);
+  return aio_write(writer, buf, IO_CRC_SIZE);
+}
+
+static int io_read_crc(FILE *file, uint32_t *crc) {
+  unsigned char buf[IO_CRC_SIZE];
+  if (fread(buf, 1, IO_CRC_SIZE, file) < IO_CRC_SIZE) {
+    fprintf(stderr, "Error reading checksum: unexpected end of file.\n");
+    return -1;
+  }
+  *crc = io_load_crc(buf);
+  return 0;
+}
+
+void io_store_u64(unsigned char *out, uint64_t value) {
+  for (int i = 0; i < IO_LENGTH_SIZE; ++i)
+    out[i] = value >> (8 * i);
+}
+
+uint64_t io_load_u64(const unsigned char *in) {
+  uint64_t value = 0;
+  for (int i = IO_LENGTH_SIZE - 1; i >= 0; --i)
+    value = value << 8 | in[i];
+  return value;
+}
+
+int io_read_u64(FILE *file, uint64_t *value) {
+  unsigned char buf[IO_LENGTH_SIZE];
+  if (fread(buf, 1, IO_LENGTH_SIZE, file) < IO_LENGTH_SIZE) {
+    fprintf(stderr, "Error reading member length: unexpected end of file.\n");
+    return -1;
+  }
+  *value = io_load_u64(buf);
+  return 0;
+}
+
 /*
- * NOTE: I am using 'long long' to save the file size, take care with capacity
+ * Fill in len bytes reserved at offset at once the member is written.
+ * Archives that cannot seek (pipes) keep the zeros there, readers then
+ * walk the payload instead
  */
-[[nodiscard]]
+static int io_patch(FILE *file, off_t at, const unsigned char *buf,
+                    size_t len) {
+  if (pwrite(fileno(file), buf, len, at) != (ssize_t)len) {
+    fprintf(stderr, "Error writing member length.\n");
+    return -1;
+  }
+  return 0;
+}
+
+// PIPE_DEPTH input and output chunks, no data buffer for a zero capacity
+static int io_chunks_alloc(IoChunk *chunks, PipeStages *stages,
+                           size_t in_cap, size_t out_cap) {
+  int status = 0;
+  for (int i = 0; i < 2 * PIPE_DEPTH; ++i) {
+    size_t cap = i < PIPE_DEPTH ? in_cap : out_cap;
+    // a small pipeline only uses the first item of each side
+    if (stages->small && i % PIPE_DEPTH != 0)
+      cap = 0;
+    chunks[i].data = cap ? malloc(cap) : NULL;
+    chunks[i].len = 0;
+    bs_writer_init(&chunks[i].bw);
+    if (cap && chunks[i].data == NULL)
+      status = -1;
+    if (i < PIPE_DEPTH)
+      stages->in[i] = &chunks[i];
+    else
+      stages->out[i - PIPE_DEPTH] = &chunks[i];
+  }
+  if (status != 0)
+    fprintf(stderr, "Error allocating pipeline buffers.\n");
+  return status;
+}
+
+static void io_chunks_free(IoChunk *chunks) {
+  for (int i = 0; i < 2 * PIPE_DEPTH; ++i) {
+    free(chunks[i].data);
+    bs_writer_free(&chunks[i].bw);
+  }
+}
+
+typedef struct StaticEncoder {
+  AioFile reader, writer;
+  HcCodeTable table;
+  FilterState filter;
+  uint64_t acc; // pending bits, right aligned
+  int nbits;
+  uint32_t crc; // of the original bytes
+} StaticEncoder;
+
+static int io_static_read(void *ctx, void *item) {
+  StaticEncoder *enc = ctx;
+  IoChunk *in = item;
+  in->len = aio_read(&enc->reader, in->data, AIO_CHUNK);
+  if (enc->reader.error)
+    return PIPE_ERROR;
+  return in->len > 0 ? PIPE_OK : PIPE_END;
+}
+
+static int io_static_encode(void *ctx, void *in_item, void *out_item) {
+  StaticEncoder *enc = ctx;
+  IoChunk *in = in_item, *out = out_item;
+  enc->crc = crc32c_update(enc->crc, in->data, in->len);
+  flt_encode(&enc->filter, in->data, in->len);
+  out->len = hc_pack_codes(&enc->table, in->data, in->len, out->data,
+                           &enc->acc, &enc->nbits);
+  return PIPE_OK;
+}
+
+static int io_chunk_write(void *ctx, void *item) {
+  AioFile *writer = ctx;
+  IoChunk *out = item;
+  return aio_write(writer, out->data, out->len) == 0 ? PIPE_OK : PIPE_ERROR;
+}
+
+static int io_static_write(void *ctx, void *item) {
+  return io_chunk_write(&((StaticEncoder *)ctx)->writer, item);
+}
+
+/*
+ * Payload and checksum of a static member, read from rfd by a three stage
+ * pipeline (read, code, write). *end is the archive offset after them, -1
+ * when the archive cannot seek
+ */
+[[nodiscard("Handling error")]]
+static int io_static_payload(FILE *wfile, int rfd, unsigned char **huff_code,
+                             unsigned char filter, const AioHole *holes,
+                             int hole_count, off_t *end) {
+  // longest code bounds the output of one chunk
+  int max_len = 0;
+  for (int c = 0; huff_code != NULL && c < ALPHABET_SIZE; ++c)
+    if (huff_code[c] != NULL && huff_code[c][0] > max_len)
+      max_len = huff_code[c][0];
+  StaticEncoder enc;
+  // no code when there are no bytes to code, only the checksum is written
+  if (huff_code != NULL)
+    hc_code_table_build(&enc.table, huff_code);
+  enc.crc = 0;
+  enc.acc = 0;
+  enc.nbits = 0;
+  flt_init(&enc.filter, filter);
+  struct stat st;
+  int regular = fstat(rfd, &st) == 0 && S_ISREG(st.st_mode);
+  // the payload goes through async streams on both sides
+  if (aio_reader_init_holes(&enc.reader, rfd, holes, hole_count) != 0)
+    return -1;
+  if (io_writer_attach(&enc.writer, wfile, NULL, 0,
+                       regular ? (uint64_t)st.st_size * max_len / 8 + 8 +
+                                     IO_CRC_SIZE
+                               : UINT64_MAX) != 0) {
+    (void)aio_close(&enc.reader);
+    return -1;
+  }
+  IoChunk chunks[2 * PIPE_DEPTH];
+  PipeStages stages = {.read = io_static_read,
+                       .work = io_static_encode,
+                       .write = io_static_write,
+                       .ctx = &enc,
+                       .small = regular && st.st_size <= AIO_CHUNK};
+  // up to 31 bits may be pending from the previous chunk
+  int status = io_chunks_alloc(chunks, &stages, AIO_CHUNK,
+                               (size_t)AIO_CHUNK * max_len / 8 + 4);
+  if (status == 0)
+    status = pipe_run(&stages);
+  if (status != 0)
+    fprintf(stderr, "Error writing huffman code to file.\n");
+  // Write the remaining bits
+  unsigned char last[8];
+  size_t l_s = hc_pack_flush(&enc.acc, &enc.nbits, last);
+  // then the checksum of the member
+  io_store_crc(last + l_s, enc.crc);
+  l_s += IO_CRC_SIZE;
+  if (status == 0 && aio_write(&enc.writer, last, l_s) != 0) {
+    fprintf(stderr, "Error writing remaining bits to file.\n");
+    status = -1;
+  }
+  // close file
+  if (io_writer_detach(&enc.writer, wfile) != 0)
+    status = -1;
+  *end = enc.writer.seekable ? enc.writer.offset : -1;
+  if (aio_close(&enc.reader) != 0)
+    status = -1;
+  io_chunks_free(chunks);
+  return status;
+}
+
 int io_write_huffman_code(FILE *wfile, unsigned char **huff_code,
-                          char *file_name) {
-  FILE *rfile = fopen(file_name, "rb");
-  if (rfile == NULL) {
+                          char *file_name, unsigned char filter) {
+  int rfd = open(file_name, O_RDONLY);
+  if (rfd < 0) {
     fprintf(stderr, "No se pudo abrir el archivo: %s\n", file_name);
     return -1;
   }
   // save file size
-  off_t file_size;
-  fseeko(rfile, 0, SEEK_END);
-  file_size = ftello(rfile);
-  fseeko(rfile, 0, SEEK_SET);
-  // Write file size
-  if (fwrite(&file_size, sizeof(off_t), 1, wfile) < 1) {
+  struct stat st;
+  if (fstat(rfd, &st) != 0) {
+    close(rfd);
+    return -1;
+  }
+  off_t file_size = st.st_size;
+  // Write file size and filter
+  if (fwrite(&file_size, sizeof(off_t), 1, wfile) < 1 ||
+      fputc(filter, wfile) == EOF) {
     fprintf(stderr, "Error writing file size to file.\n");
-    fclose(rfile);
-    return -1;
-  }
-  unsigned char rbuff[BUFFER_SIZE];
-  size_t r_s = 0; // read bytes
-  unsigned char wbuff[BUFFER_SIZE];
-  for (int i = 0; i < BUFFER_SIZE; ++i)
-    wbuff[i] = 0;
-  size_t w_lim = BUFFER_SIZE * 8;
-  size_t w_idx = 0; // new position in write buffer
-  int bit = 0;
-  while ((r_s = fread(rbuff, 1, BUFFER_SIZE, rfile)) > 0) {
-    for (size_t i = 0; i < r_s; ++i) {
-      unsigned char c = rbuff[i];
-      // if has space
-      if (huff_code[c][0] <= w_lim - w_idx) {
-        for (size_t j = 0; j < huff_code[c][0]; ++j) {
-          // locate byte and write bit
-          size_t ofs = w_idx % 8;
-          bit = (huff_code[c][j / 8 + 1] & 1 << (7 - (j % 8))) ? 1 : 0;
-          wbuff[w_idx / 8] |= bit << (7 - w_idx % 8);
-          ++w_idx;
-        }
-      } else {
-        // write buffer
-        size_t w_size = w_idx / 8;
-        if (fwrite(wbuff, sizeof(unsigned char), w_size, wfile) < w_size) {
-          fprintf(stderr, "Error writing huffman code to file.\n");
-          fclose(rfile);
-          return -1;
-        }
-        // save the rest of the bits (preserve partial byte)
-        unsigned char remaining_bits = 0;
-        if (w_idx % 8 != 0) {
-          remaining_bits = wbuff[w_idx / 8];  // Save the partial byte
-        }
-        // Clear buffer and restore partial byte
-        for (size_t i = 0; i < BUFFER_SIZE; ++i)
-          wbuff[i] = 0;
-        if (w_idx % 8 != 0) {
-          wbuff[0] = remaining_bits;  // Restore the partial byte
-        }
-        w_idx %= 8; // reset index to write
-        // write last char
-        for (size_t j = 0; j < huff_code[c][0]; ++j) {
-          // locate byte and write bit
-          size_t ofs = w_idx % 8;
-          bit = (huff_code[c][j / 8 + 1] & 1 << (7 - (j % 8))) ? 1 : 0;
-          wbuff[w_idx / 8] |= bit << (7 - w_idx % 8);
-          ++w_idx;
-        }
-      }
-    }
+    close(rfd);
+    return -1;
   }
-  // Write the remaining bits in the buffer
-  if (w_idx > 0) {
-    size_t w_size = w_idx / 8 + (w_idx % 8 ? 1 : 0);
-    if (fwrite(wbuff, sizeof(unsigned char), w_size, wfile) < w_size) {
-      fprintf(stderr, "Error writing remaining bits to file.\n");
-      fclose(rfile);
-      return -1;
-    }
+  // then the stored length, known once the payload is written
+  unsigned char length[IO_LENGTH_SIZE] = {0};
+  off_t length_at = ftello(wfile); // -1 on a pipe
+  if (fwrite(length, 1, IO_LENGTH_SIZE, wfile) < IO_LENGTH_SIZE) {
+    fprintf(stderr, "Error writing member length.\n");
+    close(rfd);
+    return -1;
   }
-  // close file
-  fclose(rfile);
-  return 0;
+  off_t end;
+  int status =
+      io_static_payload(wfile, rfd, huff_code, filter, NULL, 0, &end);
+  io_store_u64(length, end - (length_at + IO_LENGTH_SIZE));
+  if (status == 0 && length_at >= 0 && end >= 0 &&
+      io_patch(wfile, length_at, length, IO_LENGTH_SIZE) != 0)
+    status = -1;
+  close(rfd);
+  return status;
 }
 
 int io_create_directories(const char *path) {
@@ -175,25 +361,57 @@ int io_create_directories(const char *path) {
  *
  * */
 
-double io_read_bytes(Node *pq, char *file_name) {
-  FILE *file = fopen(file_name, "rb");
-  if (file == NULL) {
+// Holes are skipped when sparse, as io_save_static and io_save_blocks do
+static double io_count_bytes(Node *pq, char *file_name, unsigned char filter,
+                             int sparse) {
+  int fd = open(file_name, O_RDONLY);
+  AioHole holes[IO_HOLES_MAX];
+  int hole_count = 0;
+  struct stat st;
+  if (sparse && fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    hole_count = io_hole_map(fd, st.st_size, holes);
+  AioFile reader;
+  if (fd < 0 || aio_reader_init_holes(&reader, fd, holes, hole_count) != 0) {
     fprintf(stderr, "No se pudo leer el archivo: %s\n", file_name);
-    exit(EXIT_FAILURE);
+    if (fd >= 0)
+      close(fd);
+    return -1;
   }
-  unsigned char buffer[BUFFER_SIZE];
+  unsigned char *buffer;
   double total_bytes = 0;
-  size_t bytes_read;
-  while ((bytes_read = fread(buffer, 1, BUFFER_SIZE, file)) > 0) {
+  ssize_t bytes_read;
+  FilterState fstate;
+  flt_init(&fstate, filter);
+  while ((bytes_read = aio_reader_next(&reader, &buffer)) > 0) {
+    flt_encode(&fstate, buffer, bytes_read);
     total_bytes += bytes_read;
-    for (size_t i = 0; i < bytes_read; ++i) {
+    for (ssize_t i = 0; i < bytes_read; ++i) {
       ++pq[buffer[i]].frequency;
     }
   }
-  fclose(file);
+  int status = aio_close(&reader);
+  close(fd);
+  if (status != 0 || bytes_read < 0) {
+    fprintf(stderr, "No se pudo leer el archivo: %s\n", file_name);
+    return -1;
+  }
   return total_bytes;
 }
 
+double io_read_bytes(Node *pq, char *file_name) {
+  return io_read_bytes_filtered(pq, file_name, FLT_NONE);
+}
+
+// Count the bytes as the encoder will see them, after the filter
+double io_read_bytes_filtered(Node *pq, char *file_name,
+                              unsigned char filter) {
+  return io_count_bytes(pq, file_name, filter, 0);
+}
+
+double io_read_bytes_sparse(Node *pq, char *file_name, unsigned char filter) {
+  return io_count_bytes(pq, file_name, filter, 1);
+}
+
 /*
  * Requires
  * - File descriptor
@@ -204,11 +422,18 @@ double io_read_bytes(Node *pq, char *file_name) {
  * 1. Write name
  * 2. Write tree
  * 3. Save position to save file size with long long
- * 4. Write file
+ * 4. Write filter
+ * 5. Write file
  * */
 [[nodiscard("Handling error")]]
 int io_save_code(FILE *file, char *filename, unsigned char **huff_code,
                  Node *root) {
+  return io_save_code_filtered(file, filename, huff_code, root, FLT_NONE);
+}
+
+int io_save_code_filtered(FILE *file, char *filename,
+                          unsigned char **huff_code, Node *root,
+                          unsigned char filter) {
   // Write name
   int status = 0;
   status = fwrite(filename, sizeof(char), strlen(filename) + 1, file);
@@ -218,7 +443,7 @@ int io_save_code(FILE *file, char *filename, unsigned char **huff_code,
   }
   // Write tree
   io_write_huffman_tree(file, root);
-  status = io_write_huffman_code(file, huff_code, filename);
+  status = io_write_huffman_code(file, huff_code, filename, filter);
   // handle error
   if (status < 0) {
     fprintf(stderr, "Error writing huffman code for file: %s\n", filename);
@@ -304,6 +529,59 @@ Node *io_read_huffman_tree(FILE *file) {
   return io_read_node_recursive(file);
 }
 
+/*
+ * Same layout as io_write_in_orden, depth is bounded by the leaf count.
+ * Nodes come from pool (up to *left of them) when there is one
+ */
+static Node *io_parse_node(const unsigned char *buf, size_t n, size_t *pos,
+                           int depth, Node **pool, int *left) {
+  if (*pos >= n || depth >= ALPHABET_SIZE)
+    return NULL;
+  unsigned char kind = buf[*pos];
+  if (kind == 0 && *pos + 1 >= n)
+    return NULL;
+  Node *node;
+  if (pool == NULL) {
+    node = calloc(1, sizeof(Node));
+  } else if (*left > 0) {
+    node = (*pool)++;
+    --*left;
+    node->left = node->right = NULL;
+  } else {
+    return NULL; // more nodes than any tree over ALPHABET_SIZE leaves
+  }
+  if (node == NULL)
+    return NULL;
+  ++*pos;
+  node->is_leaf = kind == 0;
+  if (kind == 0) {
+    node->byte = buf[(*pos)++];
+  } else if (kind != 1 ||
+             (node->left = io_parse_node(buf, n, pos, depth + 1, pool,
+                                         left)) == NULL ||
+             (node->right = io_parse_node(buf, n, pos, depth + 1, pool,
+                                          left)) == NULL) {
+    if (pool == NULL) {
+      hc_free_tree(node->left);
+      free(node);
+    }
+    return NULL;
+  }
+  return node;
+}
+
+Node *io_parse_tree(const unsigned char *buf, size_t n, size_t *pos) {
+  return io_parse_node(buf, n, pos, 0, NULL, NULL);
+}
+
+int io_parse_tree_into(const unsigned char *buf, size_t n, size_t *pos,
+                       HuffTree *tree) {
+  Node *pool = tree->nodes;
+  int left = 2 * ALPHABET_SIZE - 1;
+  tree->root = io_parse_node(buf, n, pos, 0, &pool, &left);
+  return tree->root == NULL ? -1 : 0;
+}
+
 off_t io_read_file_size(FILE *file) {
   off_t file_size;
   if (fread(&file_size, sizeof(off_t), 1, file) < 1) {
@@ -313,78 +591,158 @@ off_t io_read_file_size(FILE *file) {
   return file_size;
 }
 
-int io_write_decompress_file(FILE *wfile, FILE *rfile, Node *root,
-                             off_t file_size) {
-  // Create read buffer
-  char read_buffer[BUFFER_SIZE];
-  size_t bytes_read;
-  // Create write buffer
-  char write_buffer[BUFFER_SIZE];
-  size_t write_index = 0; // Index in write buffer
-  // Parameters
-  off_t dec_bytes = 0;  // Decompressed bytes
-  Node *current = root; // Current node in the huffman tree
-  off_t offset = 0;     // Offset in the file
-  int should_break = 0; // Flag to break out of outer loop
-  
-  // Read from file
-  while ((bytes_read = fread(read_buffer, 1, BUFFER_SIZE, rfile)) > 0 && !should_break) {
-    for (int i = 0; i < bytes_read << 3; ++i) { // For each bit
-      // Tree transition
-      if ((read_buffer[i >> 3] & (1 << (7 - (i % 8))))) {
-        current = current->right; // Go right
-      } else {
-        current = current->left; // Go left
-      }
-      if (current->is_leaf) {
-        // Add byte to write buffer
-        write_buffer[write_index++] = current->byte;
-        current = root; // Reset to root
-        ++dec_bytes;
-        // Write buffer to file
-        if (write_index == BUFFER_SIZE) {
-          if (fwrite(write_buffer, sizeof(char), write_index, wfile) <
-              write_index) {
-            fprintf(stderr, "Error writing decompressed data to file.\n");
-            return -1;
-          }
-          write_index = 0; // Reset write index
-        }
-        // Check if we have decompressed enough bytes
-        if (dec_bytes == file_size) {
-          // Move the file descriptor to the end of the previous code
-          offset = (i >> 3) - bytes_read + 1;
-          should_break = 1; // Set flag to break out of outer loop
-          break; // Break out of inner loop
-        }
+int io_read_filter(FILE *file) {
+  int filter = fgetc(file);
+  if (filter == EOF || filter >= FLT_COUNT) {
+    fprintf(stderr, "Error reading filter: invalid value.\n");
+    return -1;
+  }
+  return filter;
+}
+
+// Compressed bytes per pipeline chunk, each may decode to 8 bytes
+#define IO_DECODE_CHUNK (32 * 1024)
+
+typedef struct StaticDecoder {
+  FILE *rfile;
+  AioFile writer;
+  Node *root, *current;
+  off_t remaining; // bytes still to decode
+  off_t consumed;  // compressed bytes used so far
+  FilterState filter;
+  // decoded bytes past the last whole FLT_GROUP, filters need whole groups
+  unsigned char carry[FLT_GROUP];
+  size_t carry_len;
+  uint32_t crc;
+  int discard; // verify only, nothing is written
+} StaticDecoder;
+
+static int io_static_read_code(void *ctx, void *item) {
+  StaticDecoder *dec = ctx;
+  IoChunk *in = item;
+  in->len = fread(in->data, 1, IO_DECODE_CHUNK, dec->rfile);
+  if (in->len == 0)
+    return ferror(dec->rfile) ? PIPE_ERROR : PIPE_END;
+  return PIPE_OK;
+}
+
+static int io_static_decode(void *ctx, void *in_item, void *out_item) {
+  StaticDecoder *dec = ctx;
+  IoChunk *in = in_item, *out = out_item;
+  memcpy(out->data, dec->carry, dec->carry_len);
+  size_t pos = dec->carry_len;
+  Node *current = dec->current;
+  size_t used = in->len;
+  for (size_t i = 0; i < in->len << 3; ++i) { // For each bit
+    // Tree transition
+    if (in->data[i >> 3] & (1 << (7 - (i % 8))))
+      current = current->right; // Go right
+    else
+      current = current->left; // Go left
+    if (current->is_leaf) {
+      out->data[pos++] = current->byte;
+      current = dec->root; // Reset to root
+      if (--dec->remaining == 0) {
+        used = (i >> 3) + 1; // the rest belongs to the next member
+        break;
       }
     }
   }
-  
-  if (dec_bytes != file_size) {
+  dec->current = current;
+  dec->consumed += used;
+  size_t whole = dec->remaining == 0 ? pos : pos - pos % FLT_GROUP;
+  dec->carry_len = pos - whole;
+  memcpy(dec->carry, out->data + whole, dec->carry_len);
+  flt_decode(&dec->filter, out->data, whole);
+  dec->crc = crc32c_update(dec->crc, out->data, whole);
+  out->len = whole;
+  return dec->remaining == 0 ? PIPE_END : PIPE_OK;
+}
+
+static int io_static_write_plain(void *ctx, void *item) {
+  StaticDecoder *dec = ctx;
+  return dec->discard ? PIPE_OK : io_chunk_write(&dec->writer, item);
+}
+
+/*
+ * Read, tree walk and write run as a pipeline. The reader may run ahead
+ * of the member, the archive is repositioned right after its payload.
+ * file_size counts the decoded bytes, the holes are skipped in the output
+ */
+static int io_static_decompress(FILE *wfile, FILE *rfile, Node *root,
+                                off_t file_size, unsigned char filter,
+                                const AioHole *holes, int hole_count) {
+  StaticDecoder dec;
+  dec.rfile = rfile;
+  dec.root = root;
+  dec.current = root;
+  dec.remaining = file_size;
+  dec.consumed = 0;
+  dec.carry_len = 0;
+  dec.crc = 0;
+  dec.discard = wfile == NULL;
+  flt_init(&dec.filter, filter);
+  off_t start = ftello(rfile);
+  if (!dec.discard &&
+      io_writer_attach(&dec.writer, wfile, holes, hole_count, file_size) != 0)
+    return -1;
+  IoChunk chunks[2 * PIPE_DEPTH];
+  PipeStages stages = {.read = io_static_read_code,
+                       .work = io_static_decode,
+                       .write = io_static_write_plain,
+                       .ctx = &dec,
+                       .small = file_size <= IO_DECODE_CHUNK};
+  int status = io_chunks_alloc(chunks, &stages, IO_DECODE_CHUNK,
+                               IO_DECODE_CHUNK * 8 + FLT_GROUP);
+  if (status == 0 && file_size > 0 && root->is_leaf) {
+    // a single symbol takes no bits at all
+    for (off_t left = file_size; status == 0 && left > 0;) {
+      size_t n = left < IO_DECODE_CHUNK ? left : IO_DECODE_CHUNK;
+      memset(chunks[0].data, root->byte, n);
+      flt_decode(&dec.filter, chunks[0].data, n);
+      dec.crc = crc32c_update(dec.crc, chunks[0].data, n);
+      if (!dec.discard)
+        status = aio_write(&dec.writer, chunks[0].data, n);
+      left -= n;
+    }
+    dec.remaining = 0;
+  } else if (status == 0 && file_size > 0) {
+    status = pipe_run(&stages);
+  }
+  if (status == 0 && dec.remaining != 0) {
     fprintf(stderr, "Decompressed bytes do not match expected file size.\n");
-    return -1; // Error: decompressed bytes do not match expected size
+    status = -1;
+  } else if (status != 0) {
+    fprintf(stderr, "Error writing decompressed data to file.\n");
   }
-  // Write remaining bytes in buffer
-  if (write_index > 0) {
-    if (fwrite(write_buffer, sizeof(char), write_index, wfile) < write_index) {
-      fprintf(stderr, "Error writing remaining decompressed data to file.\n");
-      return -1;
-    }
+  if (!dec.discard && io_writer_detach(&dec.writer, wfile) != 0)
+    status = -1;
+  io_chunks_free(chunks);
+  // Move the file descriptor to the end of the code, the checksum follows
+  uint32_t crc;
+  if (status == 0 && (fseeko(rfile, start + dec.consumed, SEEK_SET) != 0 ||
+                      io_read_crc(rfile, &crc) != 0))
+    status = -1;
+  if (status == 0 && crc != dec.crc) {
+    fprintf(stderr, "Error: member checksum mismatch.\n");
+    status = -1;
   }
-  printf("pos: %ld\n", ftell(rfile));
-  fseek(rfile, offset, SEEK_CUR);
-  printf("pos: %ld\n", ftell(rfile));
-  return 0; // Decompression complete
+  return status;
 }
 
-FILE *io_open_unique_file(const char *filename, const char *mode) {
-  char new_name[256];
+int io_write_decompress_file(FILE *wfile, FILE *rfile, Node *root,
+                             off_t file_size, unsigned char filter) {
+  return io_static_decompress(wfile, rfile, root, file_size, filter, NULL, 0);
+}
+
+FILE *io_open_unique_path(const char *filename, const char *mode,
+                          char *path) {
+  char new_name[IO_NAME_MAX + 1];
   int count = 0;
 
   FILE *fp = NULL;
 
-  strncpy(new_name, filename, 255);
+  strncpy(new_name, filename, IO_NAME_MAX);
   new_name[sizeof(new_name) - 1] = '\0';
 
   io_create_directories(new_name);
@@ -399,9 +757,49 @@ FILE *io_open_unique_file(const char *filename, const char *mode) {
     fprintf(stderr, "Error opening file: %s\n", new_name);
     return NULL; // Error opening file
   }
+  if (path != NULL)
+    memcpy(path, new_name, sizeof(new_name));
   return fp;
 }
 
+FILE *io_open_unique_file(const char *filename, const char *mode) {
+  return io_open_unique_path(filename, mode, NULL);
+}
+
+int io_hole_map(int fd, off_t size, AioHole *holes) {
+  int count = 0;
+  for (off_t pos = 0; pos < size && count < IO_HOLES_MAX;) {
+    off_t hole = lseek(fd, pos, SEEK_HOLE);
+    if (hole < 0 || hole >= size)
+      break; // no holes left, or SEEK_HOLE is not supported
+    off_t data = lseek(fd, hole, SEEK_DATA);
+    if (data < 0)
+      data = size; // ENXIO: the hole runs to the end of the file
+    // only the whole chunks inside it, a hole at the end may keep its tail
+    off_t start = (hole + AIO_CHUNK - 1) / AIO_CHUNK * AIO_CHUNK;
+    off_t stop = data >= size ? size : data / AIO_CHUNK * AIO_CHUNK;
+    if (stop > start)
+      holes[count++] = (AioHole){start, stop - start};
+    pos = data;
+  }
+  // holes only: keep the last chunk as data, static members need a tree
+  if (count == 1 && holes[0].offset == 0 && holes[0].len == size) {
+    holes[0].len = (size - 1) / AIO_CHUNK * AIO_CHUNK;
+    if (holes[0].len == 0)
+      count = 0;
+  }
+  lseek(fd, 0, SEEK_SET);
+  return count;
+}
+
+void io_prefetch_file(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return; // the real open reports the error
+  posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+  close(fd);
+}
+
 int io_is_end_of_file(FILE *file) {
   int c = fgetc(file);
   if (c == EOF) {
@@ -411,3 +809,1633 @@ int io_is_end_of_file(FILE *file) {
     return 0;        // Not end of file
   }
 }
+
+int io_write_archive_header(FILE *file, unsigned char method) {
+  unsigned char header[IO_MAGIC_SIZE + 2];
+  memcpy(header, IO_MAGIC, IO_MAGIC_SIZE);
+  header[IO_MAGIC_SIZE] = IO_FORMAT_VERSION;
+  header[IO_MAGIC_SIZE + 1] = method;
+  if (fwrite(header, 1, sizeof(header), file) < sizeof(header)) {
+    fprintf(stderr, "Error writing archive header.\n");
+    return -1;
+  }
+  return 0;
+}
+
+int io_read_archive_header(FILE *file) {
+  unsigned char header[IO_MAGIC_SIZE + 2];
+  if (fread(header, 1, sizeof(header), file) < sizeof(header) ||
+      memcmp(header, IO_MAGIC, IO_MAGIC_SIZE) != 0) {
+    fprintf(stderr, "Error: not a compressed archive.\n");
+    return -1;
+  }
+  if (header[IO_MAGIC_SIZE] != IO_FORMAT_VERSION) {
+    fprintf(stderr, "Error: unsupported archive version %d.\n",
+            (int)header[IO_MAGIC_SIZE]);
+    return -1;
+  }
+  if (header[IO_MAGIC_SIZE + 1] > IO_METHOD_DEDUP) {
+    fprintf(stderr, "Error: unknown compression method %d.\n",
+            (int)header[IO_MAGIC_SIZE + 1]);
+    return -1;
+  }
+  return header[IO_MAGIC_SIZE + 1];
+}
+
+/*
+ * 7 bits per byte, least significant group first, high bit set when more
+ * bytes follow
+ */
+size_t io_put_varint(unsigned char *out, uint64_t value) {
+  size_t n = 0;
+  do {
+    unsigned char b = value & 0x7F;
+    value >>= 7;
+    if (value)
+      b |= 0x80;
+    out[n++] = b;
+  } while (value);
+  return n;
+}
+
+int io_write_varint(FILE *file, uint64_t value) {
+  unsigned char buf[IO_VARINT_MAX];
+  size_t n = io_put_varint(buf, value);
+  return fwrite(buf, 1, n, file) < n ? -1 : 0;
+}
+
+int io_get_varint(const unsigned char *buf, size_t n, size_t *pos,
+                  uint64_t *value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (*pos >= n)
+      return -1;
+    unsigned char c = buf[(*pos)++];
+    *value |= (uint64_t)(c & 0x7F) << shift;
+    if (!(c & 0x80))
+      return 0;
+  }
+  return -1;
+}
+
+int io_read_varint(FILE *file, uint64_t *value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = fgetc(file);
+    if (c == EOF) {
+      fprintf(stderr, "Error reading varint: unexpected end of file.\n");
+      return -1;
+    }
+    *value |= (uint64_t)(c & 0x7F) << shift;
+    if (!(c & 0x80))
+      return 0;
+  }
+  fprintf(stderr, "Error reading varint: value too long.\n");
+  return -1;
+}
+
+static size_t io_varint_size(uint64_t value) {
+  size_t n = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++n;
+  }
+  return n;
+}
+
+// value in exactly width bytes (padded with empty groups), 0 if too large
+static size_t io_put_varint_width(unsigned char *out, uint64_t value,
+                                  size_t width) {
+  if (width < io_varint_size(value))
+    return 0;
+  for (size_t i = 0; i + 1 < width; ++i) {
+    out[i] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  out[width - 1] = value;
+  return width;
+}
+
+/*
+ * Compact tree: same preorder as io_write_in_orden, one bit per node
+ * (1 internal, 0 leaf) and 8 bits after each leaf for its byte
+ */
+typedef struct IoBits {
+  unsigned char *out;
+  size_t pos;
+  uint32_t acc;
+  int nbits;
+} IoBits;
+
+static void io_bits_put(IoBits *bits, uint32_t value, int count) {
+  bits->acc = bits->acc << count | value;
+  bits->nbits += count;
+  while (bits->nbits >= 8) {
+    bits->nbits -= 8;
+    bits->out[bits->pos++] = bits->acc >> bits->nbits;
+  }
+}
+
+static void io_pack_node(IoBits *bits, const Node *node) {
+  if (node->is_leaf) {
+    io_bits_put(bits, node->byte, 9); // flag 0 and the byte
+    return;
+  }
+  io_bits_put(bits, 1, 1);
+  io_pack_node(bits, node->left);
+  io_pack_node(bits, node->right);
+}
+
+size_t io_pack_tree(const Node *root, unsigned char *out) {
+  IoBits bits = {out, 0, 0, 0};
+  io_pack_node(&bits, root);
+  if (bits.nbits > 0)
+    io_bits_put(&bits, 0, 8 - bits.nbits);
+  return bits.pos;
+}
+
+static Node *io_unpack_node(BitReader *br, int depth, Node **pool,
+                            int *left) {
+  if (depth >= ALPHABET_SIZE || *left == 0)
+    return NULL;
+  Node *node = (*pool)++;
+  --*left;
+  node->left = node->right = NULL;
+  node->is_leaf = !bs_read_bit(br);
+  if (node->is_leaf)
+    node->byte = bs_read_bits(br, 8);
+  else if ((node->left = io_unpack_node(br, depth + 1, pool, left)) == NULL ||
+           (node->right = io_unpack_node(br, depth + 1, pool, left)) == NULL)
+    return NULL;
+  return br->overrun ? NULL : node;
+}
+
+// Name as the bytes shared with last_name (NULL: none) and the rest
+static size_t io_put_name(unsigned char *out, const char *last_name,
+                          const char *filename, size_t name_len) {
+  size_t shared = 0;
+  if (last_name != NULL)
+    while (shared < name_len && last_name[shared] == filename[shared])
+      ++shared;
+  size_t n = io_put_varint(out, shared);
+  n += io_put_varint(out + n, name_len - shared);
+  memcpy(out + n, filename + shared, name_len - shared);
+  return n + name_len - shared;
+}
+
+// Name written by io_put_name, name holds the previous one on entry
+static int io_get_name(const unsigned char *buf, size_t len, size_t *pos,
+                       char *name) {
+  uint64_t shared, rest;
+  if (io_get_varint(buf, len, pos, &shared) != 0 || shared > strlen(name) ||
+      io_get_varint(buf, len, pos, &rest) != 0 ||
+      rest > IO_NAME_MAX - shared || rest > len - *pos ||
+      shared + rest == 0 || memchr(buf + *pos, '\0', rest) != NULL)
+    return -1;
+  memcpy(name + shared, buf + *pos, rest);
+  name[shared + rest] = '\0';
+  *pos += rest;
+  return 0;
+}
+
+void io_header_init(IoHeader *header) {
+  header->name[0] = '\0';
+  header->root = NULL;
+}
+
+/*
+ * Writes the header of a member. Size and payload get size_width and
+ * payload_width bytes, payload is zero until io_finish_header fills both
+ * in (static members need size right away, pipes are never patched). *at is
+ * the archive offset of the size field and *payload_at of the payload,
+ * both -1 when the archive cannot seek
+ */
+static int io_write_header(FILE *file, char *last_name, const char *filename,
+                           unsigned char filter, uint64_t size,
+                           size_t size_width, size_t payload_width,
+                           const AioHole *holes, int hole_count,
+                           const unsigned char *tree,
+                           size_t tree_len, off_t *at, off_t *payload_at) {
+  size_t name_len = strlen(filename);
+  if (name_len == 0 || name_len > IO_NAME_MAX) {
+    fprintf(stderr, "Error: file name too long: %s\n", filename);
+    return -1;
+  }
+  unsigned char body[IO_HEADER_MAX];
+  size_t b_s = io_put_name(body, last_name, filename, name_len);
+  body[b_s++] = filter;
+  size_t fields = b_s;
+  b_s += io_put_varint_width(body + b_s, size, size_width);
+  b_s += io_put_varint_width(body + b_s, 0, payload_width);
+  b_s += io_put_varint(body + b_s, hole_count);
+  off_t end = 0; // of the previous hole
+  for (int i = 0; i < hole_count; ++i) {
+    b_s += io_put_varint(body + b_s, holes[i].offset - end);
+    b_s += io_put_varint(body + b_s, holes[i].len);
+    end = holes[i].offset + holes[i].len;
+  }
+  if (tree_len > 0)
+    memcpy(body + b_s, tree, tree_len);
+  b_s += tree_len;
+  // the length first, readers take the whole header in one read
+  unsigned char head[IO_VARINT_MAX];
+  size_t h_s = io_put_varint(head, b_s);
+  off_t start = ftello(file); // -1 on a pipe
+  if (fwrite(head, 1, h_s, file) < h_s ||
+      fwrite(body, 1, b_s, file) < b_s) {
+    fprintf(stderr, "Error writing header of %s\n", filename);
+    return -1;
+  }
+  *at = start < 0 ? -1 : start + (off_t)(h_s + fields);
+  *payload_at = start < 0 ? -1 : start + (off_t)(h_s + b_s);
+  if (last_name != NULL)
+    memcpy(last_name, filename, name_len + 1);
+  return 0;
+}
+
+// Fill in size and payload once the member ends at offset end
+static int io_finish_header(FILE *file, off_t at, off_t payload_at, off_t end,
+                            uint64_t size, size_t size_width,
+                            size_t payload_width) {
+  if (at < 0 || end < 0)
+    return 0; // not seekable, readers walk the payload
+  unsigned char fields[2 * IO_VARINT_MAX];
+  if (io_put_varint_width(fields, size, size_width) == 0 ||
+      io_put_varint_width(fields + size_width, end - payload_at,
+                          payload_width) == 0) {
+    fprintf(stderr, "Error: file changed while it was compressed.\n");
+    return -1;
+  }
+  return io_patch(file, at, fields, size_width + payload_width);
+}
+
+// Bytes the size field needs: exact for regular files, else the largest
+static size_t io_size_width(const struct stat *st) {
+  return S_ISREG(st->st_mode) ? io_varint_size(st->st_size) : IO_VARINT_MAX;
+}
+
+int io_save_static(FILE *file, char *last_name, char *filename,
+                   unsigned char **huff_code, Node *root,
+                   unsigned char filter) {
+  int rfd = open(filename, O_RDONLY);
+  if (rfd < 0) {
+    fprintf(stderr, "No se pudo abrir el archivo: %s\n", filename);
+    return -1;
+  }
+  struct stat st;
+  if (fstat(rfd, &st) != 0) {
+    close(rfd);
+    return -1;
+  }
+  // the payload never needs more than the longest code per byte
+  int max_len = 0;
+  for (int c = 0; huff_code != NULL && c < ALPHABET_SIZE; ++c)
+    if (huff_code[c] != NULL && huff_code[c][0] > max_len)
+      max_len = huff_code[c][0];
+  size_t size_width = io_size_width(&st);
+  size_t payload_width =
+      S_ISREG(st.st_mode)
+          ? io_varint_size((uint64_t)st.st_size * max_len / 8 + 1 +
+                           IO_CRC_SIZE)
+          : IO_VARINT_MAX;
+  AioHole holes[IO_HOLES_MAX];
+  int hole_count = S_ISREG(st.st_mode) ? io_hole_map(rfd, st.st_size, holes)
+                                       : 0;
+  off_t data = st.st_size;
+  for (int i = 0; i < hole_count; ++i)
+    data -= holes[i].len;
+  // an empty file (or one of holes only) is stored without a tree
+  if (huff_code == NULL && (!S_ISREG(st.st_mode) || data != 0)) {
+    fprintf(stderr, "Error building huffman code for file: %s\n", filename);
+    close(rfd);
+    return -1;
+  }
+  unsigned char tree[IO_TREE_MAX];
+  size_t t_s = huff_code == NULL ? 0 : io_pack_tree(root, tree);
+  off_t at, payload_at, end;
+  int status = io_write_header(file, last_name, filename, filter, st.st_size,
+                               size_width, payload_width, holes, hole_count,
+                               tree, t_s, &at, &payload_at);
+  if (status == 0)
+    status = io_static_payload(file, rfd, huff_code, filter, holes,
+                               hole_count, &end);
+  if (status == 0)
+    status = io_finish_header(file, at, payload_at, end, st.st_size,
+                              size_width, payload_width);
+  close(rfd);
+  return status;
+}
+
+int io_read_header(FILE *file, unsigned char method, IoHeader *header) {
+  uint64_t len;
+  unsigned char buf[IO_HEADER_MAX];
+  if (io_read_varint(file, &len) != 0)
+    return -1;
+  if (len > IO_HEADER_MAX || fread(buf, 1, len, file) < len) {
+    fprintf(stderr, "Error reading member header.\n");
+    return -1;
+  }
+  size_t pos = 0;
+  uint64_t size, payload;
+  if (io_get_name(buf, len, &pos, header->name) != 0 || pos >= len ||
+      (buf[pos] >= FLT_COUNT && buf[pos] != IO_FILTER_DUP))
+    goto corrupt;
+  header->filter = buf[pos++];
+  header->dup = 0;
+  header->hole_count = 0;
+  header->root = NULL;
+  if (header->filter == IO_FILTER_DUP) {
+    if (io_get_varint(buf, len, &pos, &size) != 0 || size > INT64_MAX ||
+        io_get_varint(buf, len, &pos, &header->dup) != 0 ||
+        header->dup == 0 || pos != len)
+      goto corrupt;
+    header->size = header->data = size;
+    header->payload = 0;
+    return 0;
+  }
+  if (io_get_varint(buf, len, &pos, &size) != 0 || size > INT64_MAX ||
+      io_get_varint(buf, len, &pos, &payload) != 0 || payload > INT64_MAX)
+    goto corrupt;
+  header->size = size;
+  header->payload = payload;
+  header->data = size;
+  // holes start at whole chunks and end at one or at the end of the file
+  uint64_t count, end = 0;
+  if (io_get_varint(buf, len, &pos, &count) != 0 || count > IO_HOLES_MAX)
+    goto corrupt;
+  header->hole_count = count;
+  for (uint64_t i = 0; i < count; ++i) {
+    uint64_t gap, hole;
+    if (io_get_varint(buf, len, &pos, &gap) != 0 ||
+        io_get_varint(buf, len, &pos, &hole) != 0 || gap > size - end ||
+        hole == 0 || hole > size - end - gap || (end + gap) % AIO_CHUNK != 0 ||
+        (hole % AIO_CHUNK != 0 && end + gap + hole != size))
+      goto corrupt;
+    header->holes[i] = (AioHole){end + gap, hole};
+    end += gap + hole;
+    header->data -= hole;
+  }
+  if (method == IO_METHOD_STATIC && pos == len && header->data == 0) {
+    header->root = NULL; // nothing to decode
+  } else if (method == IO_METHOD_STATIC) {
+    BitReader br;
+    bs_reader_init(&br, buf + pos, len - pos);
+    Node *pool = header->pool;
+    int left = 2 * ALPHABET_SIZE - 1;
+    header->root = io_unpack_node(&br, 0, &pool, &left);
+    if (header->root == NULL)
+      goto corrupt;
+  } else if (pos != len) {
+    goto corrupt;
+  }
+  return 0;
+corrupt:
+  fprintf(stderr, "Error: corrupt member header.\n");
+  return -1;
+}
+
+/*
+ * Block based member:
+ * 1. Write the header (io_write_header)
+ * 2. For each block: original size, compressed size, compressed bits
+ * 3. A zero original size ends the member, then the member checksum when
+ *    there was more than one block (else it equals the block checksum)
+ * Blocks are read, coded and written by a three stage pipeline, adaptive
+ * blocks are still submitted as soon as they are coded.
+ */
+typedef struct BlockJob {
+  BlockCoder *coder; // owned by the caller, may serve several members
+  FilterState filter;
+  AioFile reader, writer;
+  FILE *rfile; // decoding: the archive
+  size_t max_comp;
+  uint64_t size;     // original bytes of the member so far
+  uint64_t blocks;   // written or read so far
+  uint32_t crc;      // of the member so far, combined from the blocks
+  uint32_t expected; // decoding: member checksum read after the last block
+  int discard;       // decoding: verify only, nothing is written
+} BlockJob;
+
+static int io_blocks_read(void *ctx, void *item) {
+  BlockJob *job = ctx;
+  IoChunk *in = item;
+  in->len = aio_read(&job->reader, in->data, job->coder->block_size);
+  if (job->reader.error)
+    return PIPE_ERROR;
+  return in->len > 0 ? PIPE_OK : PIPE_END;
+}
+
+static int io_blocks_encode(void *ctx, void *in_item, void *out_item) {
+  BlockJob *job = ctx;
+  IoChunk *in = in_item, *out = out_item;
+  bs_writer_reset(&out->bw);
+  out->crc = crc32c_update(0, in->data, in->len);
+  flt_encode(&job->filter, in->data, in->len);
+  if (block_encode(job->coder, in->data, in->len, &out->bw) != 0)
+    return PIPE_ERROR;
+  out->raw_len = in->len;
+  out->len = bs_flush(&out->bw);
+  return out->bw.error ? PIPE_ERROR : PIPE_OK;
+}
+
+static int io_blocks_write(void *ctx, void *item) {
+  BlockJob *job = ctx;
+  IoChunk *out = item;
+  unsigned char head[2 * IO_VARINT_MAX];
+  size_t h_s = io_put_varint(head, out->raw_len);
+  h_s += io_put_varint(head + h_s, out->len);
+  job->crc = crc32c_combine(job->crc, out->crc, out->raw_len);
+  job->size += out->raw_len;
+  ++job->blocks;
+  if (aio_write(&job->writer, head, h_s) != 0 ||
+      aio_write(&job->writer, out->bw.buf, out->len) != 0 ||
+      io_write_crc(&job->writer, out->crc) != 0 ||
+      (job->coder->method == IO_METHOD_ADAPTIVE &&
+       aio_writer_flush(&job->writer) != 0)) {
+    fprintf(stderr, "Error writing block to file.\n");
+    return PIPE_ERROR;
+  }
+  return PIPE_OK;
+}
+
+int io_save_blocks(FILE *file, char *filename, unsigned char method,
+                   int level, unsigned char filter) {
+  BlockCoder coder;
+  if (block_coder_init(&coder, method, level) != 0)
+    return -1;
+  int status = io_save_blocks_with(file, NULL, filename, &coder, filter);
+  block_coder_free(&coder);
+  return status;
+}
+
+// Bytes a member of size bytes can take at most, headers of blocks included
+static uint64_t io_blocks_bound(const BlockCoder *coder, uint64_t size) {
+  uint64_t blocks = (size + coder->block_size - 1) / coder->block_size;
+  return blocks * (2 * IO_VARINT_MAX + IO_CRC_SIZE +
+                   block_bound(coder->method, coder->block_size)) +
+         1 + IO_CRC_SIZE;
+}
+
+int io_save_blocks_with(FILE *file, char *last_name, char *filename,
+                        BlockCoder *coder, unsigned char filter) {
+  int rfd = open(filename, O_RDONLY);
+  if (rfd < 0) {
+    fprintf(stderr, "No se pudo abrir el archivo: %s\n", filename);
+    return -1;
+  }
+  struct stat st;
+  if (fstat(rfd, &st) != 0) {
+    close(rfd);
+    return -1;
+  }
+  // size and payload are known once the blocks are written
+  size_t size_width = io_size_width(&st);
+  size_t payload_width = S_ISREG(st.st_mode)
+                             ? io_varint_size(io_blocks_bound(coder, st.st_size))
+                             : IO_VARINT_MAX;
+  AioHole holes[IO_HOLES_MAX];
+  int hole_count = S_ISREG(st.st_mode) ? io_hole_map(rfd, st.st_size, holes)
+                                       : 0;
+  uint64_t hole_bytes = 0;
+  for (int i = 0; i < hole_count; ++i)
+    hole_bytes += holes[i].len;
+  off_t at, payload_at;
+  uint64_t size = S_ISREG(st.st_mode) ? (uint64_t)st.st_size : 0;
+  if (io_write_header(file, last_name, filename, filter, size, size_width,
+                      payload_width, holes, hole_count, NULL, 0, &at,
+                      &payload_at) != 0) {
+    close(rfd);
+    return -1;
+  }
+  BlockJob job;
+  job.coder = coder;
+  job.size = 0;
+  job.blocks = 0;
+  job.crc = 0;
+  flt_init(&job.filter, filter);
+  if (aio_reader_init_holes(&job.reader, rfd, holes, hole_count) != 0) {
+    close(rfd);
+    return -1;
+  }
+  if (io_writer_attach(&job.writer, file, NULL, 0,
+                       S_ISREG(st.st_mode)
+                           ? io_blocks_bound(coder, st.st_size)
+                           : UINT64_MAX) != 0) {
+    (void)aio_close(&job.reader);
+    close(rfd);
+    return -1;
+  }
+  IoChunk chunks[2 * PIPE_DEPTH];
+  PipeStages stages = {.read = io_blocks_read,
+                       .work = io_blocks_encode,
+                       .write = io_blocks_write,
+                       .ctx = &job,
+                       .small = S_ISREG(st.st_mode) &&
+                                (uint64_t)st.st_size <= coder->block_size};
+  int status = io_chunks_alloc(chunks, &stages, coder->block_size, 0);
+  if (status == 0)
+    status = pipe_run(&stages);
+  // a zero size ends the member
+  unsigned char end = 0;
+  if (status == 0 && (aio_write(&job.writer, &end, 1) != 0 ||
+                      (job.blocks > 1 &&
+                       io_write_crc(&job.writer, job.crc) != 0)))
+    status = -1;
+  if (io_writer_detach(&job.writer, file) != 0 ||
+      aio_close(&job.reader) != 0)
+    status = -1;
+  if (status == 0 &&
+      io_finish_header(file, at, payload_at,
+                       job.writer.seekable ? job.writer.offset : -1,
+                       job.size + hole_bytes, size_width, payload_width) != 0)
+    status = -1;
+  io_chunks_free(chunks);
+  close(rfd);
+  return status;
+}
+
+// Parses block headers from the archive, stops at the end of the member
+static int io_blocks_read_code(void *ctx, void *item) {
+  BlockJob *job = ctx;
+  IoChunk *in = item;
+  uint64_t r_s, c_s;
+  if (io_read_varint(job->rfile, &r_s) != 0)
+    return PIPE_ERROR;
+  if (r_s == 0 && job->blocks <= 1)
+    return PIPE_END;
+  if (r_s == 0) // end of member
+    return io_read_crc(job->rfile, &job->expected) == 0 ? PIPE_END
+                                                         : PIPE_ERROR;
+  ++job->blocks;
+  if (io_read_varint(job->rfile, &c_s) != 0 ||
+      r_s > job->coder->block_size || c_s > job->max_comp) {
+    fprintf(stderr, "Error reading block header.\n");
+    return PIPE_ERROR;
+  }
+  if (fread(in->data, 1, c_s, job->rfile) < c_s ||
+      io_read_crc(job->rfile, &in->crc) != 0) {
+    fprintf(stderr, "Error reading block: unexpected end of file.\n");
+    return PIPE_ERROR;
+  }
+  in->len = c_s;
+  in->raw_len = r_s;
+  return PIPE_OK;
+}
+
+static int io_blocks_decode(void *ctx, void *in_item, void *out_item) {
+  BlockJob *job = ctx;
+  IoChunk *in = in_item, *out = out_item;
+  BitReader br;
+  bs_reader_init(&br, in->data, in->len);
+  if (block_decode(job->coder, &br, out->data, in->raw_len) != 0)
+    return PIPE_ERROR;
+  flt_decode(&job->filter, out->data, in->raw_len);
+  uint32_t crc = crc32c_update(0, out->data, in->raw_len);
+  if (crc != in->crc) {
+    fprintf(stderr, "Error: block checksum mismatch.\n");
+    return PIPE_ERROR;
+  }
+  job->crc = crc32c_combine(job->crc, crc, in->raw_len);
+  out->len = in->raw_len;
+  return PIPE_OK;
+}
+
+static int io_blocks_write_plain(void *ctx, void *item) {
+  BlockJob *job = ctx;
+  return job->discard ? PIPE_OK : io_chunk_write(&job->writer, item);
+}
+
+int io_write_blocks_decompress_file(FILE *wfile, FILE *rfile,
+                                    unsigned char method,
+                                    unsigned char filter) {
+  BlockCoder coder;
+  if (block_coder_init(&coder, method, LZ_DEFAULT_LEVEL) != 0)
+    return -1;
+  int status = io_write_blocks_decompress_with(wfile, rfile, &coder, filter);
+  block_coder_free(&coder);
+  return status;
+}
+
+// Blocks of one member, the holes are skipped in the output. data is the
+// number of bytes they decode to, UINT64_MAX when it is not known
+static int io_blocks_decompress(FILE *wfile, FILE *rfile, BlockCoder *coder,
+                                unsigned char filter, uint64_t data,
+                                const AioHole *holes, int hole_count) {
+  BlockJob job;
+  job.coder = coder;
+  job.rfile = rfile;
+  job.blocks = 0;
+  job.crc = 0;
+  job.discard = wfile == NULL;
+  flt_init(&job.filter, filter);
+  if (!job.discard &&
+      io_writer_attach(&job.writer, wfile, holes, hole_count, data) != 0)
+    return -1;
+  job.max_comp = block_bound(coder->method, coder->block_size);
+  IoChunk chunks[2 * PIPE_DEPTH];
+  PipeStages stages = {.read = io_blocks_read_code,
+                       .work = io_blocks_decode,
+                       .write = io_blocks_write_plain,
+                       .ctx = &job,
+                       .small = data <= coder->block_size};
+  int status =
+      io_chunks_alloc(chunks, &stages, job.max_comp, coder->block_size);
+  if (status == 0)
+    status = pipe_run(&stages);
+  if (status == 0 && job.blocks > 1 && job.crc != job.expected) {
+    fprintf(stderr, "Error: member checksum mismatch.\n");
+    status = -1;
+  }
+  if (!job.discard && io_writer_detach(&job.writer, wfile) != 0)
+    status = -1;
+  io_chunks_free(chunks);
+  return status;
+}
+
+int io_write_blocks_decompress_with(FILE *wfile, FILE *rfile,
+                                    BlockCoder *coder, unsigned char filter) {
+  return io_blocks_decompress(wfile, rfile, coder, filter, UINT64_MAX, NULL,
+                              0);
+}
+
+// Most data bytes per payload byte io_prepare_output believes a header for
+#define IO_PREPARE_RATIO 64
+
+/*
+ * Output sized up front: a new file of the full size is one hole, the data
+ * extents are then allocated in one go so they are not grown chunk by
+ * chunk. The header is not checked against the payload yet, so a member
+ * claiming more than IO_PREPARE_RATIO times the bytes left for its payload
+ * is allocated as it is written instead. Failures here are not errors,
+ * writing reports them
+ */
+static void io_prepare_output(FILE *wfile, FILE *rfile,
+                              const IoHeader *header) {
+  struct stat st;
+  uint64_t stored = header->payload;
+  off_t at = ftello(rfile);
+  if (stored == 0 && fstat(fileno(rfile), &st) == 0 && S_ISREG(st.st_mode) &&
+      at >= 0 && st.st_size > at)
+    stored = st.st_size - at;
+  if (header->data / IO_PREPARE_RATIO > stored)
+    return;
+  int fd = fileno(wfile);
+  if (fflush(wfile) != 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+      st.st_size != 0 || header->size == 0 ||
+      ftruncate(fd, header->size) != 0)
+    return;
+  off_t pos = 0;
+  for (int i = 0; i <= header->hole_count; ++i) {
+    off_t stop =
+        i < header->hole_count ? header->holes[i].offset : (off_t)header->size;
+    if (stop > pos)
+      (void)fallocate(fd, 0, pos, stop - pos);
+    if (i < header->hole_count)
+      pos = header->holes[i].offset + header->holes[i].len;
+  }
+}
+
+int io_write_member(FILE *wfile, FILE *rfile, BlockCoder *coder,
+                    const IoHeader *header) {
+  if (wfile != NULL)
+    io_prepare_output(wfile, rfile, header);
+  if (coder == NULL)
+    return io_static_decompress(wfile, rfile, header->root, header->data,
+                                header->filter, header->holes,
+                                header->hole_count);
+  return io_blocks_decompress(wfile, rfile, coder, header->filter,
+                              header->data, header->holes, header->hole_count);
+}
+
+/*
+ * Deduplicated members (IO_METHOD_DEDUP). New chunks wait in lit until a
+ * reference or a full block makes them a record
+ */
+typedef struct ChunkJob {
+  BlockCoder *coder;
+  CdcIndex *index;
+  FILE *file;
+  unsigned char filter;
+  unsigned char *lit;   // bytes of the new chunks waiting
+  size_t lit_len;
+  uint32_t *lens;       // and their lengths
+  size_t lit_count;
+  unsigned char *cmp;   // a chunk read back, CDC_MAX bytes
+  BitWriter bw;
+  int src_fd;           // input of src_member, kept for the next chunk
+  uint32_t src_member;
+} ChunkJob;
+
+// Most chunks in a record: all but the last of a member are CDC_MIN long
+static size_t io_chunks_max(const BlockCoder *coder) {
+  return coder->block_size / CDC_MIN + 1;
+}
+
+static int io_put_record(FILE *file, uint64_t tag) {
+  return io_write_varint(file, tag) == 0 ? 0 : -1;
+}
+
+// The waiting chunks as one record
+static int io_flush_literals(ChunkJob *job) {
+  if (job->lit_count == 0)
+    return 0;
+  uint32_t crc = crc32c_update(0, job->lit, job->lit_len);
+  FilterState fstate;
+  flt_init(&fstate, job->filter);
+  flt_encode(&fstate, job->lit, job->lit_len);
+  bs_writer_reset(&job->bw);
+  if (block_encode(job->coder, job->lit, job->lit_len, &job->bw) != 0)
+    return -1;
+  size_t c_s = bs_flush(&job->bw);
+  unsigned char head[IO_CRC_SIZE];
+  io_store_crc(head, crc);
+  int status = job->bw.error ||
+                       io_put_record(job->file, job->lit_count << 1 | 1) != 0
+                   ? -1
+                   : 0;
+  for (size_t i = 0; status == 0 && i < job->lit_count; ++i)
+    status = io_write_varint(job->file, job->lens[i]);
+  if (status == 0 &&
+      (io_write_varint(job->file, c_s) != 0 ||
+       fwrite(job->bw.buf, 1, c_s, job->file) < c_s ||
+       fwrite(head, 1, IO_CRC_SIZE, job->file) < IO_CRC_SIZE))
+    status = -1;
+  if (status != 0)
+    fprintf(stderr, "Error writing block to file.\n");
+  job->lit_len = job->lit_count = 0;
+  return status;
+}
+
+// 1 if chunk c holds the len bytes at p, read back from its input
+static int io_chunk_equal(ChunkJob *job, const CdcChunk *c, int rfd,
+                          uint32_t member, char **sources,
+                          const unsigned char *p) {
+  int fd = rfd;
+  if (c->member != member) {
+    if (job->src_fd < 0 || job->src_member != c->member) {
+      if (job->src_fd >= 0)
+        close(job->src_fd);
+      job->src_fd = open(sources[c->member], O_RDONLY);
+      job->src_member = c->member;
+    }
+    fd = job->src_fd;
+  }
+  return fd >= 0 && pread(fd, job->cmp, c->len, c->offset) == c->len &&
+         memcmp(job->cmp, p, c->len) == 0;
+}
+
+// Reference to an earlier chunk, or the chunk added to the waiting ones
+static int io_save_chunk(ChunkJob *job, const unsigned char *p, uint32_t len,
+                         uint64_t offset, int rfd, uint32_t member,
+                         char **sources) {
+  CdcChunk chunk = {hash128(p, len, 0), offset, len, 0, member};
+  int64_t id = cdc_index_find(job->index, chunk.hash, len);
+  if (id >= 0 &&
+      io_chunk_equal(job, &job->index->chunks[id], rfd, member, sources, p)) {
+    if (io_flush_literals(job) != 0 ||
+        io_put_record(job->file, (job->index->count - id) << 1) != 0)
+      return -1;
+    return 0;
+  }
+  if (job->lit_len + len > job->coder->block_size &&
+      io_flush_literals(job) != 0)
+    return -1;
+  memcpy(job->lit + job->lit_len, p, len);
+  job->lit_len += len;
+  job->lens[job->lit_count++] = len;
+  return cdc_index_add(job->index, &chunk) < 0 ? -1 : 0;
+}
+
+int io_save_chunked(FILE *file, char *last_name, char *filename,
+                    BlockCoder *coder, unsigned char filter, CdcIndex *index,
+                    char **sources, uint32_t member) {
+  int rfd = open(filename, O_RDONLY);
+  if (rfd < 0) {
+    fprintf(stderr, "No se pudo abrir el archivo: %s\n", filename);
+    return -1;
+  }
+  struct stat st;
+  if (fstat(rfd, &st) != 0) {
+    close(rfd);
+    return -1;
+  }
+  // at worst every chunk is new, or a reference of two varints
+  size_t size_width = io_size_width(&st);
+  size_t payload_width =
+      S_ISREG(st.st_mode)
+          ? io_varint_size(io_blocks_bound(coder, st.st_size) +
+                           (st.st_size / CDC_MIN + 1) * 2 * IO_VARINT_MAX)
+          : IO_VARINT_MAX;
+  off_t at, payload_at;
+  uint64_t size = S_ISREG(st.st_mode) ? (uint64_t)st.st_size : 0;
+  AioFile reader;
+  if (io_write_header(file, last_name, filename, filter, size, size_width,
+                      payload_width, NULL, 0, NULL, 0, &at,
+                      &payload_at) != 0 ||
+      aio_reader_init(&reader, rfd) != 0) {
+    close(rfd);
+    return -1;
+  }
+  ChunkJob job = {coder, index, file, filter, NULL, 0, NULL, 0, NULL,
+                  {0},   -1,    0};
+  bs_writer_init(&job.bw);
+  size_t cap = coder->block_size + CDC_MAX;
+  unsigned char *win = malloc(cap);
+  job.lit = malloc(coder->block_size);
+  job.lens = malloc(io_chunks_max(coder) * sizeof(uint32_t));
+  job.cmp = malloc(CDC_MAX);
+  int status = win == NULL || job.lit == NULL || job.lens == NULL ||
+                       job.cmp == NULL
+                   ? -1
+                   : 0;
+  // win[pos .. have) is read and not cut yet, a cut needs CDC_MAX of it
+  size_t have = 0, pos = 0;
+  int eof = 0;
+  uint64_t offset = 0;
+  uint32_t crc = 0;
+  while (status == 0) {
+    if (have - pos < CDC_MAX && !eof) {
+      memmove(win, win + pos, have - pos);
+      have -= pos;
+      pos = 0;
+      size_t n = aio_read(&reader, win + have, cap - have);
+      if (reader.error)
+        status = -1;
+      eof = n == 0;
+      have += n;
+      continue;
+    }
+    if (pos == have)
+      break;
+    size_t len = cdc_cut(win + pos, have - pos);
+    crc = crc32c_update(crc, win + pos, len);
+    status = io_save_chunk(&job, win + pos, len, offset, rfd, member,
+                           sources);
+    pos += len;
+    offset += len;
+  }
+  if (status == 0 && (io_flush_literals(&job) != 0 ||
+                      io_put_record(file, 0) != 0))
+    status = -1;
+  if (status == 0) {
+    unsigned char tail[IO_CRC_SIZE];
+    io_store_crc(tail, crc);
+    if (fwrite(tail, 1, IO_CRC_SIZE, file) < IO_CRC_SIZE)
+      status = -1;
+  }
+  if (aio_close(&reader) != 0)
+    status = -1;
+  if (status == 0 && io_finish_header(file, at, payload_at,
+                                      at < 0 ? -1 : ftello(file), offset,
+                                      size_width, payload_width) != 0)
+    status = -1;
+  if (status != 0)
+    fprintf(stderr, "Error saving chunks of %s\n", filename);
+  if (job.src_fd >= 0)
+    close(job.src_fd);
+  bs_writer_free(&job.bw);
+  free(job.cmp);
+  free(job.lens);
+  free(job.lit);
+  free(win);
+  close(rfd);
+  return status;
+}
+
+/*
+ * Restored chunk of a dedup member. Zeros are seeked over and the file
+ * extended to the new position, so the holes of a sparse file come back as
+ * holes, like those of the hole map of other members
+ */
+static int io_put_chunk(FILE *wfile, const unsigned char *buf, size_t n) {
+  if (n > 0 && buf[0] == 0 && memcmp(buf, buf + 1, n - 1) == 0 &&
+      fseeko(wfile, n, SEEK_CUR) == 0) {
+    off_t end = ftello(wfile);
+    return end >= 0 && ftruncate(fileno(wfile), end) == 0 ? 0 : -1;
+  }
+  return fwrite(buf, 1, n, wfile) < n ? -1 : 0;
+}
+
+// A record of new chunks: decode, check, add them to the index and write
+static int io_read_literals(FILE *wfile, FILE *rfile, ChunkJob *job,
+                            uint64_t count, uint64_t *out_off, uint32_t *crc,
+                            uint32_t member) {
+  size_t n = 0;
+  for (uint64_t i = 0; i < count; ++i) {
+    uint64_t len;
+    if (io_read_varint(rfile, &len) != 0 || len == 0 ||
+        len > job->coder->block_size - n)
+      return -1;
+    job->lens[i] = len;
+    n += len;
+  }
+  uint64_t c_s;
+  uint32_t expected;
+  size_t max_comp = block_bound(job->coder->method, job->coder->block_size);
+  if (io_read_varint(rfile, &c_s) != 0 || c_s > max_comp ||
+      fread(job->cmp, 1, c_s, rfile) < c_s ||
+      io_read_crc(rfile, &expected) != 0) {
+    fprintf(stderr, "Error reading block: unexpected end of file.\n");
+    return -1;
+  }
+  BitReader br;
+  bs_reader_init(&br, job->cmp, c_s);
+  if (block_decode(job->coder, &br, job->lit, n) != 0)
+    return -1;
+  FilterState fstate;
+  flt_init(&fstate, job->filter);
+  flt_decode(&fstate, job->lit, n);
+  uint32_t block_crc = crc32c_update(0, job->lit, n);
+  if (block_crc != expected) {
+    fprintf(stderr, "Error: block checksum mismatch.\n");
+    return -1;
+  }
+  for (uint64_t i = 0, at = 0; i < count; at += job->lens[i++]) {
+    CdcChunk chunk = {{0, 0}, *out_off + at, job->lens[i],
+                      crc32c_update(0, job->lit + at, job->lens[i]), member};
+    if (cdc_index_add(job->index, &chunk) < 0 ||
+        (wfile != NULL &&
+         io_put_chunk(wfile, job->lit + at, job->lens[i]) != 0))
+      return -1;
+  }
+  *crc = crc32c_combine(*crc, block_crc, n);
+  *out_off += n;
+  return 0;
+}
+
+// A reference: the chunk is copied from the restored member holding it
+static int io_read_reference(FILE *wfile, ChunkJob *job, uint64_t back,
+                             char **paths, uint64_t *out_off, uint32_t *crc,
+                             uint32_t member) {
+  if (back == 0 || back > job->index->count) {
+    fprintf(stderr, "Error: reference to a chunk before the archive.\n");
+    return -1;
+  }
+  const CdcChunk *c = &job->index->chunks[job->index->count - back];
+  if (wfile != NULL) {
+    int fd;
+    if (c->member == member) {
+      fd = fflush(wfile) == 0 ? fileno(wfile) : -1;
+    } else {
+      if (job->src_fd < 0 || job->src_member != c->member) {
+        if (job->src_fd >= 0)
+          close(job->src_fd);
+        job->src_fd = open(paths[c->member], O_RDONLY);
+        job->src_member = c->member;
+      }
+      fd = job->src_fd;
+    }
+    if (fd < 0 || pread(fd, job->cmp, c->len, c->offset) != c->len ||
+        crc32c_update(0, job->cmp, c->len) != c->crc) {
+      fprintf(stderr, "Error: restored chunk changed or is missing.\n");
+      return -1;
+    }
+    if (io_put_chunk(wfile, job->cmp, c->len) != 0)
+      return -1;
+  }
+  *crc = crc32c_combine(*crc, c->crc, c->len);
+  *out_off += c->len;
+  return 0;
+}
+
+int io_write_chunked(FILE *wfile, FILE *rfile, BlockCoder *coder,
+                     const IoHeader *header, CdcIndex *index, char **paths,
+                     uint32_t member) {
+  ChunkJob job = {coder, index, NULL, header->filter, NULL, 0, NULL, 0, NULL,
+                  {0},   -1,    0};
+  size_t max_comp = block_bound(coder->method, coder->block_size);
+  job.lit = malloc(coder->block_size);
+  job.lens = malloc(io_chunks_max(coder) * sizeof(uint32_t));
+  // compressed blocks and chunks read back share it
+  job.cmp = malloc(max_comp > CDC_MAX ? max_comp : CDC_MAX);
+  int status = job.lit == NULL || job.lens == NULL || job.cmp == NULL ? -1
+                                                                      : 0;
+  uint64_t out_off = 0;
+  uint32_t crc = 0, expected;
+  while (status == 0) {
+    uint64_t tag;
+    if (io_read_varint(rfile, &tag) != 0) {
+      status = -1;
+    } else if (tag == 0) {
+      if (io_read_crc(rfile, &expected) != 0 || crc != expected) {
+        fprintf(stderr, "Error: member checksum mismatch.\n");
+        status = -1;
+      }
+      break;
+    } else if (tag & 1) {
+      if ((tag >> 1) > io_chunks_max(coder)) {
+        fprintf(stderr, "Error reading block header.\n");
+        status = -1;
+      } else {
+        status = io_read_literals(wfile, rfile, &job, tag >> 1, &out_off,
+                                  &crc, member);
+      }
+    } else {
+      status = io_read_reference(wfile, &job, tag >> 1, paths, &out_off,
+                                 &crc, member);
+    }
+    if (status == 0 && header->size > 0 && out_off > header->size) {
+      fprintf(stderr, "Error: member %s is longer than its size.\n",
+              header->name);
+      status = -1;
+    }
+  }
+  if (job.src_fd >= 0)
+    close(job.src_fd);
+  free(job.cmp);
+  free(job.lens);
+  free(job.lit);
+  return status;
+}
+
+// Records of a member written without lengths. Sizes of referenced chunks
+// are not known without the index, header->size is kept
+static int io_walk_chunked(FILE *file) {
+  for (;;) {
+    uint64_t tag, len, c_s;
+    if (io_read_varint(file, &tag) != 0)
+      return -1;
+    if (tag == 0)
+      return fseeko(file, IO_CRC_SIZE, SEEK_CUR);
+    for (uint64_t i = 0; (tag & 1) && i < tag >> 1; ++i)
+      if (io_read_varint(file, &len) != 0)
+        return -1;
+    if ((tag & 1) &&
+        (io_read_varint(file, &c_s) != 0 || c_s > INT64_MAX - IO_CRC_SIZE ||
+         fseeko(file, c_s + IO_CRC_SIZE, SEEK_CUR) != 0))
+      return -1;
+  }
+}
+
+// Blocks of a member written without lengths, skipped by their headers
+static int io_walk_blocks(FILE *file, uint64_t *size) {
+  *size = 0;
+  for (uint64_t blocks = 0;; ++blocks) {
+    uint64_t r_s, c_s;
+    if (io_read_varint(file, &r_s) != 0)
+      return -1;
+    if (r_s == 0) // the member checksum follows after several blocks
+      return blocks > 1 ? fseeko(file, IO_CRC_SIZE, SEEK_CUR) : 0;
+    if (io_read_varint(file, &c_s) != 0 || c_s > INT64_MAX - IO_CRC_SIZE ||
+        fseeko(file, c_s + IO_CRC_SIZE, SEEK_CUR) != 0)
+      return -1;
+    *size += r_s;
+  }
+}
+
+int io_read_member_info(FILE *file, unsigned char method, IoHeader *header,
+                        uint64_t *stored) {
+  off_t start = ftello(file);
+  if (io_read_header(file, method, header) != 0)
+    return -1;
+  int status = 0;
+  if (header->dup > 0) {
+    // nothing after the header
+  } else if (header->payload > 0) {
+    status = fseeko(file, header->payload, SEEK_CUR);
+  } else if (method == IO_METHOD_DEDUP) {
+    status = io_walk_chunked(file);
+  } else if (method == IO_METHOD_STATIC) {
+    // no length, decoding finds the end
+    status = io_write_decompress_file(NULL, file, header->root, header->data,
+                                      header->filter);
+  } else {
+    uint64_t holes = header->size - header->data;
+    status = io_walk_blocks(file, &header->data);
+    header->size = header->data + holes;
+  }
+  // seeking past the end succeeds, a cut archive shows up here
+  struct stat st;
+  off_t end = ftello(file);
+  if (status == 0 && fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode) &&
+      end > st.st_size) {
+    fprintf(stderr, "Error: member %s is truncated.\n", header->name);
+    status = -1;
+  }
+  if (status != 0)
+    return -1;
+  *stored = end - start;
+  return 0;
+}
+
+/*
+ * Duplicate members. The hash only finds candidates, io_same_file
+ * confirms them, so a collision costs a comparison and not the data
+ */
+int io_save_dup(FILE *file, char *last_name, const char *filename,
+                uint64_t size, uint64_t back) {
+  size_t name_len = strlen(filename);
+  if (name_len == 0 || name_len > IO_NAME_MAX || back == 0) {
+    fprintf(stderr, "Error: invalid duplicate member: %s\n", filename);
+    return -1;
+  }
+  unsigned char body[3 * IO_VARINT_MAX + IO_NAME_MAX + 1];
+  size_t b_s = io_put_name(body, last_name, filename, name_len);
+  body[b_s++] = IO_FILTER_DUP;
+  b_s += io_put_varint(body + b_s, size);
+  b_s += io_put_varint(body + b_s, back);
+  if (io_write_varint(file, b_s) != 0 || fwrite(body, 1, b_s, file) < b_s) {
+    fprintf(stderr, "Error writing header of %s\n", filename);
+    return -1;
+  }
+  if (last_name != NULL)
+    memcpy(last_name, filename, name_len + 1);
+  return 0;
+}
+
+// Up to n bytes, fewer only at the end of the file
+static ssize_t io_read_full(int fd, unsigned char *buf, size_t n) {
+  size_t done = 0;
+  while (done < n) {
+    ssize_t r = read(fd, buf + done, n - done);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r < 0)
+      return -1;
+    if (r == 0)
+      break;
+    done += r;
+  }
+  return done;
+}
+
+int io_hash_file(const char *filename, Hash128 *hash) {
+  int fd = open(filename, O_RDONLY);
+  unsigned char *buf = malloc(AIO_CHUNK);
+  if (fd < 0 || buf == NULL) {
+    fprintf(stderr, "No se pudo leer el archivo: %s\n", filename);
+    if (fd >= 0)
+      close(fd);
+    free(buf);
+    return -1;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  Hash128State state;
+  hash128_init(&state, 0);
+  ssize_t n;
+  while ((n = io_read_full(fd, buf, AIO_CHUNK)) > 0)
+    hash128_update(&state, buf, n);
+  close(fd);
+  free(buf);
+  if (n < 0) {
+    fprintf(stderr, "No se pudo leer el archivo: %s\n", filename);
+    return -1;
+  }
+  *hash = hash128_final(&state);
+  return 0;
+}
+
+// Same result as io_same_file for what is left of two open files
+static int io_same_fds(int fa, int fb) {
+  unsigned char *buf = malloc(2 * AIO_CHUNK);
+  int same = fa < 0 || fb < 0 || buf == NULL ? -1 : 1;
+  while (same == 1) {
+    ssize_t na = io_read_full(fa, buf, AIO_CHUNK);
+    ssize_t nb = io_read_full(fb, buf + AIO_CHUNK, AIO_CHUNK);
+    if (na < 0 || nb < 0)
+      same = -1;
+    else if (na != nb || memcmp(buf, buf + AIO_CHUNK, na) != 0)
+      same = 0;
+    else if (na == 0)
+      break;
+  }
+  free(buf);
+  return same;
+}
+
+int io_same_file(const char *a, const char *b) {
+  int fa = open(a, O_RDONLY), fb = open(b, O_RDONLY);
+  int same = io_same_fds(fa, fb);
+  if (same < 0)
+    fprintf(stderr, "Error comparing %s with %s\n", a, b);
+  if (fa >= 0)
+    close(fa);
+  if (fb >= 0)
+    close(fb);
+  return same;
+}
+
+int io_member_matches(FILE *rfile, BlockCoder *coder, const IoHeader *header,
+                      const char *filename) {
+  FILE *tmp = tmpfile();
+  if (tmp == NULL) {
+    perror("tmpfile");
+    return -1;
+  }
+  int same = -1;
+  if (io_write_member(tmp, rfile, coder, header) == 0 && fflush(tmp) == 0 &&
+      lseek(fileno(tmp), 0, SEEK_SET) == 0) {
+    int fd = open(filename, O_RDONLY);
+    same = io_same_fds(fileno(tmp), fd);
+    if (fd >= 0)
+      close(fd);
+  }
+  if (same < 0)
+    fprintf(stderr, "Error comparing %s with member %s\n", filename,
+            header->name);
+  fclose(tmp);
+  return same;
+}
+
+// Plain copy of what is left from the current offsets
+static int io_copy_plain(int out, int in) {
+  unsigned char *buf = malloc(AIO_CHUNK);
+  if (buf == NULL)
+    return -1;
+  ssize_t n;
+  while ((n = io_read_full(in, buf, AIO_CHUNK)) > 0) {
+    ssize_t done = 0;
+    while (done < n) {
+      ssize_t w = write(out, buf + done, n - done);
+      if (w < 0 && errno == EINTR)
+        continue;
+      if (w <= 0) {
+        free(buf);
+        return -1;
+      }
+      done += w;
+    }
+  }
+  free(buf);
+  return n < 0 ? -1 : 0;
+}
+
+int io_copy_file(FILE *wfile, const char *source, uint64_t size) {
+  int in = open(source, O_RDONLY);
+  if (in < 0) {
+    fprintf(stderr, "No se pudo abrir el archivo: %s\n", source);
+    return -1;
+  }
+  int out = fileno(wfile);
+  int status = fflush(wfile) == 0 ? 0 : -1;
+  struct stat st;
+  if (status == 0 && (fstat(in, &st) != 0 || (uint64_t)st.st_size != size)) {
+    fprintf(stderr, "Error: %s changed, it is not the original any more.\n",
+            source);
+    status = -1;
+  }
+  if (status == 0 && ioctl(out, FICLONE, in) != 0) {
+    // no shared extents here: copy in the kernel, or by hand
+    ssize_t n = 0;
+    uint64_t left = size;
+    while (left > 0 &&
+           (n = copy_file_range(in, NULL, out, NULL, left, 0)) > 0)
+      left -= n;
+    // copy_file_range refuses some pairs of file systems before copying
+    if (n < 0 && left == size &&
+        (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+         errno == EOPNOTSUPP))
+      status = io_copy_plain(out, in);
+    else if (left > 0)
+      status = -1;
+  }
+  if (status == 0 && (fstat(out, &st) != 0 || (uint64_t)st.st_size != size))
+    status = -1;
+  if (status != 0)
+    fprintf(stderr, "Error copying %s\n", source);
+  close(in);
+  return status;
+}
+
+/*
+ * Solid groups. Members are read with plain read(): they are mostly small
+ * and an async reader per file would cost more than the file itself
+ */
+typedef struct SolidEntry {
+  uint64_t size;
+  uint32_t crc;
+} SolidEntry;
+
+typedef struct SolidWriter {
+  HuffTree tree;
+  uint64_t counts[ALPHABET_SIZE];
+  unsigned char buf[AIO_CHUNK];
+  unsigned char out[AIO_CHUNK * HC_CODE_BYTES + 8];
+} SolidWriter;
+
+/*
+ * One pass over a member: checksum of the original bytes and, through
+ * the filter, either the byte counts (table NULL) or the codes written to
+ * file. *size gets the bytes read, *written the code bytes
+ */
+static int io_solid_pass(SolidWriter *sw, const char *filename,
+                         unsigned char filter, const HcCodeTable *table,
+                         FILE *file, uint64_t *acc, int *nbits,
+                         uint64_t *size, uint32_t *crc, uint64_t *written) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "No se pudo abrir el archivo: %s\n", filename);
+    return -1;
+  }
+  FilterState fstate;
+  flt_init(&fstate, filter);
+  *size = 0;
+  *crc = 0;
+  ssize_t n;
+  while ((n = io_read_full(fd, sw->buf, AIO_CHUNK)) > 0) {
+    *crc = crc32c_update(*crc, sw->buf, n);
+    flt_encode(&fstate, sw->buf, n);
+    *size += n;
+    if (table == NULL) {
+      for (ssize_t i = 0; i < n; ++i)
+        ++sw->counts[sw->buf[i]];
+      continue;
+    }
+    size_t w = hc_pack_codes(table, sw->buf, n, sw->out, acc, nbits);
+    if (fwrite(sw->out, 1, w, file) < w) {
+      n = -1;
+      break;
+    }
+    *written += w;
+  }
+  close(fd);
+  if (n < 0) {
+    fprintf(stderr, "No se pudo leer el archivo: %s\n", filename);
+    return -1;
+  }
+  return 0;
+}
+
+int io_save_solid(FILE *file, char *last_name, char **filenames,
+                  const unsigned char *filters, int count) {
+  size_t align = alignof(SolidWriter);
+  SolidWriter *sw =
+      aligned_alloc(align, (sizeof(SolidWriter) + align - 1) / align * align);
+  SolidEntry *entries = malloc(count * sizeof(SolidEntry));
+  unsigned char *head =
+      malloc(2 * IO_VARINT_MAX +
+             (size_t)count * (2 * IO_VARINT_MAX + IO_NAME_MAX + 1 +
+                              IO_VARINT_MAX + IO_CRC_SIZE) +
+             IO_TREE_MAX);
+  int status = sw == NULL || entries == NULL || head == NULL ? -1 : 0;
+  if (status != 0)
+    fprintf(stderr, "Error allocating solid group.\n");
+  // first pass: one histogram for the whole group
+  uint64_t total = 0, written = 0;
+  if (status == 0)
+    memset(sw->counts, 0, sizeof(sw->counts));
+  for (int i = 0; status == 0 && i < count; ++i) {
+    status = io_solid_pass(sw, filenames[i], filters[i], NULL, NULL, NULL,
+                           NULL, &entries[i].size, &entries[i].crc, NULL);
+    total += status == 0 ? entries[i].size : 0;
+  }
+  int has_tree = 0;
+  uint64_t bits = 0;
+  if (status == 0 && total > 0) {
+    Node arr[ALPHABET_SIZE];
+    for (int c = 0; c < ALPHABET_SIZE; ++c) {
+      arr[c].byte = c;
+      arr[c].frequency = sw->counts[c];
+      arr[c].is_leaf = 1;
+      arr[c].left = arr[c].right = NULL;
+    }
+    status = hc_tree_build(&sw->tree, arr, (double)total);
+    has_tree = status == 0;
+    for (int c = 0; status == 0 && c < ALPHABET_SIZE; ++c)
+      bits += sw->counts[c] * sw->tree.flat.codes[c].len;
+  }
+  // the header: count, payload, entries and the tree
+  size_t h_s = 0;
+  if (status == 0) {
+    h_s = io_put_varint(head, count);
+    h_s += io_put_varint(head + h_s, (bits + 7) / 8);
+    for (int i = 0; i < count; ++i) {
+      size_t name_len = strlen(filenames[i]);
+      if (name_len == 0 || name_len > IO_NAME_MAX) {
+        fprintf(stderr, "Error: file name too long: %s\n", filenames[i]);
+        status = -1;
+        break;
+      }
+      h_s += io_put_name(head + h_s, last_name, filenames[i], name_len);
+      memcpy(last_name, filenames[i], name_len + 1);
+      head[h_s++] = filters[i];
+      h_s += io_put_varint(head + h_s, entries[i].size);
+      io_store_crc(head + h_s, entries[i].crc);
+      h_s += IO_CRC_SIZE;
+    }
+    if (status == 0 && has_tree)
+      h_s += io_pack_tree(sw->tree.root, head + h_s);
+  }
+  unsigned char len[IO_VARINT_MAX];
+  size_t l_s = io_put_varint(len, h_s);
+  if (status == 0 && (fwrite(len, 1, l_s, file) < l_s ||
+                      fwrite(head, 1, h_s, file) < h_s)) {
+    fprintf(stderr, "Error writing solid group header.\n");
+    status = -1;
+  }
+  // second pass: the codes of every member back to back
+  uint64_t acc = 0;
+  int nbits = 0;
+  for (int i = 0; status == 0 && has_tree && i < count; ++i) {
+    uint64_t size;
+    uint32_t crc;
+    status = io_solid_pass(sw, filenames[i], filters[i], &sw->tree.flat, file,
+                           &acc, &nbits, &size, &crc, &written);
+    if (status == 0 && (size != entries[i].size || crc != entries[i].crc)) {
+      fprintf(stderr, "Error: %s changed while it was compressed.\n",
+              filenames[i]);
+      status = -1;
+    }
+  }
+  if (status == 0 && has_tree) {
+    size_t w = hc_pack_flush(&acc, &nbits, sw->out);
+    if (fwrite(sw->out, 1, w, file) < w)
+      status = -1;
+    written += w;
+    if (status == 0 && written != (bits + 7) / 8) {
+      fprintf(stderr, "Error writing solid group payload.\n");
+      status = -1;
+    }
+  }
+  free(head);
+  free(entries);
+  free(sw);
+  return status;
+}
+
+struct IoSolidGroup {
+  int count;
+  uint64_t payload;
+  IoSolidMember *members;
+  int cap;
+  unsigned char *head;
+  size_t head_cap;
+  char name[IO_NAME_MAX + 1]; // last name read, prefix of the next one
+  Node *root;
+  Node pool[2 * ALPHABET_SIZE - 1];
+  // decoding position in the payload
+  unsigned char chunk[IO_DECODE_CHUNK];
+  size_t chunk_len, bit;
+  uint64_t left; // payload bytes not read yet
+  unsigned char out[AIO_CHUNK];
+};
+
+IoSolidGroup *io_solid_group_new(void) {
+  IoSolidGroup *group = calloc(1, sizeof(IoSolidGroup));
+  if (group == NULL)
+    fprintf(stderr, "Error allocating solid group.\n");
+  return group;
+}
+
+void io_solid_group_free(IoSolidGroup *group) {
+  if (group == NULL)
+    return;
+  free(group->members);
+  free(group->head);
+  free(group);
+}
+
+int io_solid_count(const IoSolidGroup *group) { return group->count; }
+
+uint64_t io_solid_payload(const IoSolidGroup *group) {
+  return group->payload;
+}
+
+const IoSolidMember *io_solid_member(const IoSolidGroup *group, int index) {
+  return &group->members[index];
+}
+
+int io_read_solid_group(FILE *file, IoSolidGroup *group) {
+  uint64_t h_s, count, payload;
+  if (io_read_varint(file, &h_s) != 0)
+    return -1;
+  // a member entry takes at least 8 bytes, the tree at most IO_TREE_MAX
+  if (h_s > 2 * IO_VARINT_MAX +
+                (uint64_t)IO_SOLID_MEMBERS *
+                    (2 * IO_VARINT_MAX + IO_NAME_MAX + 1 + IO_VARINT_MAX +
+                     IO_CRC_SIZE) +
+                IO_TREE_MAX)
+    goto corrupt;
+  if (h_s > group->head_cap) {
+    unsigned char *head = realloc(group->head, h_s);
+    if (head == NULL) {
+      fprintf(stderr, "Error allocating solid group.\n");
+      return -1;
+    }
+    group->head = head;
+    group->head_cap = h_s;
+  }
+  if (fread(group->head, 1, h_s, file) < h_s) {
+    fprintf(stderr, "Error reading solid group: unexpected end of file.\n");
+    return -1;
+  }
+  const unsigned char *buf = group->head;
+  size_t pos = 0;
+  if (io_get_varint(buf, h_s, &pos, &count) != 0 || count == 0 ||
+      count > IO_SOLID_MEMBERS ||
+      io_get_varint(buf, h_s, &pos, &payload) != 0 || payload > INT64_MAX)
+    goto corrupt;
+  if ((int)count > group->cap) {
+    IoSolidMember *members =
+        realloc(group->members, count * sizeof(IoSolidMember));
+    if (members == NULL) {
+      fprintf(stderr, "Error allocating solid group.\n");
+      return -1;
+    }
+    group->members = members;
+    group->cap = count;
+  }
+  uint64_t total = 0;
+  for (uint64_t i = 0; i < count; ++i) {
+    IoSolidMember *m = &group->members[i];
+    uint64_t size;
+    if (io_get_name(buf, h_s, &pos, group->name) != 0 || pos >= h_s ||
+        buf[pos] >= FLT_COUNT)
+      goto corrupt;
+    memcpy(m->name, group->name, sizeof(m->name));
+    m->filter = buf[pos++];
+    if (io_get_varint(buf, h_s, &pos, &size) != 0 || size > INT64_MAX ||
+        size > INT64_MAX - total || h_s - pos < IO_CRC_SIZE)
+      goto corrupt;
+    m->size = size;
+    m->crc = io_load_crc(buf + pos);
+    pos += IO_CRC_SIZE;
+    total += size;
+  }
+  group->root = NULL;
+  if (total > 0) {
+    BitReader br;
+    bs_reader_init(&br, buf + pos, h_s - pos);
+    Node *pool = group->pool;
+    int left = 2 * ALPHABET_SIZE - 1;
+    group->root = io_unpack_node(&br, 0, &pool, &left);
+    if (group->root == NULL)
+      goto corrupt;
+  } else if (pos != h_s || payload != 0) {
+    goto corrupt;
+  }
+  group->count = count;
+  group->payload = payload;
+  group->left = payload;
+  group->chunk_len = group->bit = 0;
+  return 0;
+corrupt:
+  fprintf(stderr, "Error: corrupt solid group header.\n");
+  return -1;
+}
+
+// Next n bytes of the group, the codes of a member never cross into the next
+static int io_solid_decode(FILE *rfile, IoSolidGroup *group, size_t n) {
+  Node *root = group->root;
+  if (root->is_leaf) {
+    // a single byte value takes no bits at all
+    memset(group->out, root->byte, n);
+    return 0;
+  }
+  Node *current = root;
+  size_t bit = group->bit, end = group->chunk_len * 8;
+  for (size_t k = 0; k < n;) {
+    if (bit == end) {
+      size_t r = group->left < IO_DECODE_CHUNK ? group->left : IO_DECODE_CHUNK;
+      if (r == 0 || fread(group->chunk, 1, r, rfile) < r) {
+        fprintf(stderr, "Error reading solid group: unexpected end of file.\n");
+        return -1;
+      }
+      group->left -= r;
+      group->chunk_len = r;
+      bit = 0;
+      end = r * 8;
+    }
+    current = (group->chunk[bit >> 3] >> (7 - (bit & 7))) & 1 ? current->right
+                                                             : current->left;
+    ++bit;
+    if (current->is_leaf) {
+      group->out[k++] = current->byte;
+      current = root;
+    }
+  }
+  group->bit = bit;
+  return 0;
+}
+
+int io_solid_decode_member(FILE *rfile, IoSolidGroup *group, int index,
+                           FILE *wfile) {
+  const IoSolidMember *m = &group->members[index];
+  FilterState fstate;
+  flt_init(&fstate, m->filter);
+  uint32_t crc = 0;
+  // whole FLT_GROUP chunks except at the end, as the filters need
+  for (uint64_t left = m->size; left > 0;) {
+    size_t n = left < AIO_CHUNK ? left : AIO_CHUNK;
+    if (io_solid_decode(rfile, group, n) != 0)
+      return -1;
+    flt_decode(&fstate, group->out, n);
+    crc = crc32c_update(crc, group->out, n);
+    if (wfile != NULL && fwrite(group->out, 1, n, wfile) < n) {
+      fprintf(stderr, "Error writing decompressed data to file.\n");
+      return -1;
+    }
+    left -= n;
+  }
+  if (crc != m->crc) {
+    fprintf(stderr, "Error: member checksum mismatch.\n");
+    return -1;
+  }
+  // after the last member only the padding of the last byte is left
+  if (index == group->count - 1 &&
+      (group->left != 0 || group->chunk_len * 8 - group->bit >= 8)) {
+    fprintf(stderr, "Error: corrupt solid group payload.\n");
+    return -1;
+  }
+  return 0;
+}
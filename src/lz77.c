@@ -0,0 +1,234 @@
+#include "lz77.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint16_t len_base[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const unsigned char len_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                            1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                            4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const unsigned char dist_extra[30] = {0, 0, 0,  0,  1,  1,  2,  2,
+                                             3, 3, 4,  4,  5,  5,  6,  6,
+                                             7, 7, 8,  8,  9,  9,  10, 10,
+                                             11, 11, 12, 12, 13, 13};
+
+// chain links followed per position for levels 1..9
+static const int chain_depth[10] = {0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096};
+
+LzCoder *lz_new(int level) {
+  LzCoder *coder = malloc(sizeof(LzCoder));
+  if (coder == NULL)
+    return NULL;
+  lz_set_level(coder, level);
+  coder->prev = malloc(LZ_BLOCK_SIZE * sizeof(int32_t));
+  coder->tokens = malloc((LZ_BLOCK_SIZE + 1) * sizeof(LzToken));
+  if (coder->prev == NULL || coder->tokens == NULL) {
+    fprintf(stderr, "Error allocating LZ77 coder.\n");
+    lz_free(coder);
+    return NULL;
+  }
+  return coder;
+}
+
+void lz_set_level(LzCoder *coder, int level) {
+  coder->level = level < 1 ? 1 : level > 9 ? 9 : level;
+}
+
+void lz_free(LzCoder *coder) {
+  if (coder == NULL)
+    return;
+  free(coder->prev);
+  free(coder->tokens);
+  free(coder);
+}
+
+static inline uint32_t lz_hash(const unsigned char *p) {
+  uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static inline void lz_insert(LzCoder *coder, const unsigned char *buf,
+                             size_t pos, size_t n) {
+  if (pos + LZ_MIN_MATCH > n)
+    return;
+  uint32_t h = lz_hash(buf + pos);
+  coder->prev[pos] = coder->head[h];
+  coder->head[h] = pos;
+}
+
+// Longest earlier match for pos, its distance is stored in *dist
+static size_t lz_longest_match(LzCoder *coder, const unsigned char *buf,
+                               size_t pos, size_t n, size_t *dist) {
+  size_t best = 0;
+  size_t max = n - pos < LZ_MAX_MATCH ? n - pos : LZ_MAX_MATCH;
+  if (max < LZ_MIN_MATCH)
+    return 0;
+  int chain = chain_depth[coder->level];
+  int32_t cand = coder->head[lz_hash(buf + pos)];
+  while (cand >= 0 && pos - cand <= LZ_WINDOW && chain-- > 0) {
+    const unsigned char *a = buf + cand, *b = buf + pos;
+    // a longer match must at least agree at the current best length
+    if (a[best] == b[best]) {
+      size_t len = 0;
+      while (len < max && a[len] == b[len])
+        ++len;
+      if (len > best) {
+        best = len;
+        *dist = pos - cand;
+        if (len == max)
+          break;
+      }
+    }
+    cand = coder->prev[cand];
+  }
+  return best >= LZ_MIN_MATCH ? best : 0;
+}
+
+/*
+ * Greedy parse, from level 5 on a match is deferred when the next
+ * position starts a longer one (lazy matching).
+ */
+size_t lz_parse(LzCoder *coder, const unsigned char *buf, size_t n) {
+  for (int i = 0; i < (1 << LZ_HASH_BITS); ++i)
+    coder->head[i] = -1;
+  size_t k = 0, pos = 0;
+  while (pos < n) {
+    size_t dist = 0;
+    size_t len = lz_longest_match(coder, buf, pos, n, &dist);
+    lz_insert(coder, buf, pos, n);
+    if (len && coder->level >= 5 && len < LZ_MAX_MATCH && pos + 1 < n) {
+      size_t next_dist = 0;
+      size_t next = lz_longest_match(coder, buf, pos + 1, n, &next_dist);
+      if (next > len) {
+        coder->tokens[k].value = buf[pos];
+        coder->tokens[k++].dist = 0;
+        ++pos;
+        len = next;
+        dist = next_dist;
+        lz_insert(coder, buf, pos, n);
+      }
+    }
+    if (len) {
+      coder->tokens[k].value = len;
+      coder->tokens[k++].dist = dist;
+      for (size_t i = 1; i < len; ++i)
+        lz_insert(coder, buf, pos + i, n);
+      pos += len;
+    } else {
+      coder->tokens[k].value = buf[pos++];
+      coder->tokens[k++].dist = 0;
+    }
+  }
+  return k;
+}
+
+static int lz_length_code(int len) {
+  int c = 28;
+  while (len_base[c] > len)
+    --c;
+  return c;
+}
+
+static int lz_dist_code(int dist) {
+  int c = 29;
+  while (dist_base[c] > dist)
+    --c;
+  return c;
+}
+
+/*
+ * Block layout (bits):
+ * 1. Literal/length table, distance table
+ * 2. Tokens, then LZ_END_OF_BLOCK
+ * A match is its length code + extra bits, distance code + extra bits.
+ */
+int lz_encode_block(LzCoder *coder, const unsigned char *buf, size_t n,
+                    BitWriter *bw) {
+  if (n > LZ_BLOCK_SIZE)
+    return -1;
+  size_t k = lz_parse(coder, buf, n);
+  uint32_t lit_counts[LZ_LITLEN_SYMBOLS] = {0};
+  uint32_t dist_counts[LZ_DIST_SYMBOLS] = {0};
+  for (size_t i = 0; i < k; ++i) {
+    LzToken t = coder->tokens[i];
+    if (t.dist == 0) {
+      ++lit_counts[t.value];
+    } else {
+      ++lit_counts[257 + lz_length_code(t.value)];
+      ++dist_counts[lz_dist_code(t.dist)];
+    }
+  }
+  ++lit_counts[LZ_END_OF_BLOCK];
+
+  HuffTable lit, dist;
+  if (hc_table_from_counts(&lit, lit_counts, LZ_LITLEN_SYMBOLS) != 0 ||
+      hc_table_from_counts(&dist, dist_counts, LZ_DIST_SYMBOLS) != 0)
+    return -1;
+  hc_table_write(bw, &lit);
+  hc_table_write(bw, &dist);
+  for (size_t i = 0; i < k; ++i) {
+    LzToken t = coder->tokens[i];
+    if (t.dist == 0) {
+      hc_write_symbol(bw, &lit, t.value);
+      continue;
+    }
+    int lc = lz_length_code(t.value);
+    hc_write_symbol(bw, &lit, 257 + lc);
+    bs_write_bits(bw, t.value - len_base[lc], len_extra[lc]);
+    int dc = lz_dist_code(t.dist);
+    hc_write_symbol(bw, &dist, dc);
+    bs_write_bits(bw, t.dist - dist_base[dc], dist_extra[dc]);
+  }
+  hc_write_symbol(bw, &lit, LZ_END_OF_BLOCK);
+  return bw->error ? -1 : 0;
+}
+
+static int lz_corrupt(void) {
+  fprintf(stderr, "Error decoding LZ77 block: invalid match or size.\n");
+  return -1;
+}
+
+int lz_decode_block(LzCoder *coder, BitReader *br, unsigned char *buf,
+                    size_t n) {
+  (void)coder;
+  HuffTable lit, dist;
+  if (hc_table_read(br, &lit, LZ_LITLEN_SYMBOLS) != 0 ||
+      hc_table_read(br, &dist, LZ_DIST_SYMBOLS) != 0)
+    return -1;
+  size_t pos = 0;
+  for (;;) {
+    int sym = hc_read_symbol(br, &lit);
+    if (sym < 0 || br->overrun)
+      return lz_corrupt();
+    if (sym == LZ_END_OF_BLOCK)
+      break;
+    if (sym < LZ_END_OF_BLOCK) {
+      if (pos >= n)
+        return lz_corrupt();
+      buf[pos++] = sym;
+      continue;
+    }
+    int lc = sym - 257;
+    if (lc >= 29)
+      return lz_corrupt();
+    size_t len = len_base[lc] + bs_read_bits(br, len_extra[lc]);
+    int dc = hc_read_symbol(br, &dist);
+    if (dc < 0 || dc >= LZ_DIST_SYMBOLS)
+      return lz_corrupt();
+    size_t d = dist_base[dc] + bs_read_bits(br, dist_extra[dc]);
+    if (d > pos || len > n - pos)
+      return lz_corrupt();
+    // byte by byte, the copy may overlap its own output
+    for (size_t i = 0; i < len; ++i, ++pos)
+      buf[pos] = buf[pos - d];
+  }
+  if (pos != n || br->overrun)
+    return lz_corrupt();
+  return 0;
+}
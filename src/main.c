@@ -1,31 +1,360 @@
+#include "analyze.h"
+#include "async_io.h"
 #include "compress.h"
+#include "daemon.h"
+#include "filter.h"
+#include "fixed.h"
+#include "io_tool.h"
+#include "walk.h"
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+static void usage(void) {
+  fprintf(stderr, "to comprees files: compress "
+                  "[-m static|adaptive|order1|bwt|lz77|solid|split|dedup] "
+                  "[-1..-9] "
+                  "[-f auto|none|delta|delta2|delta4|delta8|shuffle4|shuffle8] "
+                  "[-b size] [-D] file1|dir1 file2 ... compresFile.cprs\n");
+  fprintf(stderr, "to decompress file: compress -d file1.cprs\n");
+  fprintf(stderr, "to check a file without writing: compress -t file1.cprs\n");
+  fprintf(stderr, "to list the files inside: compress -l file1.cprs\n");
+  fprintf(stderr, "to add files to an archive: compress -r file1|dir1 ... "
+                  "compresFile.cprs\n");
+  fprintf(stderr, "to see what coding can gain: compress --analyze "
+                  "file1|dir1 ...\n");
+  fprintf(stderr, "to save a fixed code for data like these: compress "
+                  "--save-table table.huft file1|dir1 ...\n");
+  fprintf(stderr, "to serve jobs over a socket: compress --daemon "
+                  "socket [--workers n]\n");
+  fprintf(stderr, "to run one job on a daemon: compress --client socket "
+                  "[-d] [-m method] [-1..-9] [-f filter] input output\n");
+  fprintf(stderr, "-b size: bytes per read or write (4K .. 64M, default "
+                  "256K), -D: keep the files out of the page cache\n");
+}
+
+// "1048576", "1024K" or "1M", 0 if not a size
+static size_t parse_size(const char *text) {
+  char *end;
+  unsigned long long n = strtoull(text, &end, 10);
+  if (end == text)
+    return 0;
+  if (*end == 'K' || *end == 'k')
+    n <<= 10, ++end;
+  else if (*end == 'M' || *end == 'm')
+    n <<= 20, ++end;
+  return *end == '\0' ? n : 0;
+}
+
+// Entropy and predicted sizes of every file below paths
+static int analyze_paths(char **paths, int count) {
+  WalkList inputs;
+  if (walk_paths(paths, count, 0, &inputs) != 0)
+    return 1;
+  int status = 0;
+  for (size_t i = 0; i < inputs.count; ++i) {
+    Analysis an;
+    if (analyze_file(inputs.paths[i], &an) != 0) {
+      status = 1;
+      continue;
+    }
+    analyze_print(stdout, inputs.paths[i], &an);
+  }
+  walk_list_free(&inputs);
+  return status;
+}
+
+// Code table for bytes like those of paths, for tools/gen_decoder
+static int save_table(const char *table_path, char **paths, int count) {
+  WalkList inputs;
+  if (walk_paths(paths, count, 0, &inputs) != 0)
+    return 1;
+  Node arr[ALPHABET_SIZE];
+  for (int i = 0; i < ALPHABET_SIZE; ++i) {
+    arr[i].byte = i;
+    arr[i].frequency = 0;
+  }
+  int status = 0;
+  for (size_t i = 0; i < inputs.count && status == 0; ++i)
+    if (io_read_bytes(arr, inputs.paths[i]) < 0)
+      status = 1;
+  walk_list_free(&inputs);
+  uint64_t counts[ALPHABET_SIZE];
+  for (int i = 0; i < ALPHABET_SIZE; ++i)
+    counts[i] = arr[i].frequency;
+  HuffTable table;
+  if (status == 0 && hc_fixed_table_from_counts(&table, counts) != 0) {
+    fprintf(stderr, "Error building the code table.\n");
+    status = 1;
+  }
+  if (status != 0)
+    return status;
+  FILE *file = fopen(table_path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Error opening file: %s\n", table_path);
+    return 1;
+  }
+  if (hc_fixed_write_table(file, &table) != 0)
+    status = 1;
+  if (fclose(file) != 0 || status != 0) {
+    fprintf(stderr, "Error writing file: %s\n", table_path);
+    return 1;
+  }
+  return 0;
+}
+
+// Serve until SIGINT or SIGTERM
+static int run_daemon(const char *socket_path, int workers) {
+  // blocked before the workers start so they inherit the mask
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+  Daemon *server = daemon_start(socket_path, workers);
+  if (server == NULL)
+    return 1;
+  fprintf(stderr, "Listening on %s\n", socket_path);
+  int sig;
+  while (sigwait(&signals, &sig) != 0)
+    ;
+  daemon_stop(server);
+  return 0;
+}
+
+// One job on the daemon at socket_path, the files opened here
+static int run_client(const char *socket_path, int decode, char *in,
+                      char *out, const CompressOptions *options) {
+  int sock = daemon_connect(socket_path);
+  if (sock < 0) {
+    fprintf(stderr, "Error: no daemon listens on %s\n", socket_path);
+    return 1;
+  }
+  uint64_t written;
+  int status = daemon_run_files(
+      sock, decode ? DAEMON_OP_DECOMPRESS : DAEMON_OP_COMPRESS, in, out,
+      options, &written);
+  close(sock);
+  if (status != HC_OK) {
+    fprintf(stderr, "Error: the job on %s failed (%d)\n", in, status);
+    return 1;
+  }
+  return 0;
+}
+
 int main(int argc, char *argv[]) {
   //
-  if (argc < 3) {
-    fprintf(stderr,
-            "to comprees files: compress file1 file2 ... compresFile.cprs\n");
-    fprintf(stderr, "to decompress file: compress -d file1.cprs\n");
+  CompressOptions options;
+  compress_default_options(&options);
+  int decode = 0, verify = 0, list = 0, analyze = 0, append = 0;
+  const char *daemon_socket = NULL, *table_path = NULL, *client = NULL;
+  int workers = 0, method_set = 0, level_set = 0;
+  if (argc > 1 && strcmp(argv[1], "-decode") == 0)
+    argv[1] = "-d";
+  static const struct option long_options[] = {
+      {"analyze", no_argument, NULL, 'a'},
+      {"append", no_argument, NULL, 'r'},
+      {"daemon", required_argument, NULL, 'S'},
+      {"workers", required_argument, NULL, 'W'},
+      {"save-table", required_argument, NULL, 'T'},
+      {"client", required_argument, NULL, 'C'},
+      {NULL, 0, NULL, 0},
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "dtlrm:f:b:D123456789", long_options,
+                            NULL)) != -1) {
+    switch (opt) {
+    case '1': case '2': case '3': case '4': case '5':
+    case '6': case '7': case '8': case '9':
+      options.level = opt - '0';
+      level_set = 1;
+      break;
+    case 'd':
+      decode = 1;
+      break;
+    case 't':
+      decode = verify = 1;
+      break;
+    case 'l':
+      decode = list = 1;
+      break;
+    case 'a':
+      analyze = 1;
+      break;
+    case 'r':
+      append = 1;
+      break;
+    case 'S':
+      daemon_socket = optarg;
+      break;
+    case 'T':
+      table_path = optarg;
+      break;
+    case 'C':
+      client = optarg;
+      break;
+    case 'W': {
+      char *end;
+      long n = strtol(optarg, &end, 10);
+      if (end == optarg || *end != '\0' || n < 0 || n > DAEMON_MAX_WORKERS) {
+        fprintf(stderr, "Workers must be 0 .. %d\n", DAEMON_MAX_WORKERS);
+        usage();
+        return 1;
+      }
+      workers = n;
+      break;
+    }
+    case 'm':
+      if (strcmp(optarg, "static") == 0) {
+        options.method = IO_METHOD_STATIC;
+      } else if (strcmp(optarg, "adaptive") == 0) {
+        options.method = IO_METHOD_ADAPTIVE;
+      } else if (strcmp(optarg, "order1") == 0) {
+        options.method = IO_METHOD_ORDER1;
+      } else if (strcmp(optarg, "bwt") == 0) {
+        options.method = IO_METHOD_BWT;
+      } else if (strcmp(optarg, "lz77") == 0) {
+        options.method = IO_METHOD_LZ77;
+      } else if (strcmp(optarg, "solid") == 0) {
+        options.method = IO_METHOD_SOLID;
+      } else if (strcmp(optarg, "split") == 0) {
+        options.method = IO_METHOD_SPLIT;
+      } else if (strcmp(optarg, "dedup") == 0) {
+        options.method = IO_METHOD_DEDUP;
+      } else {
+        fprintf(stderr, "Unknown method: %s\n", optarg);
+        usage();
+        return 1;
+      }
+      method_set = 1;
+      break;
+    case 'b':
+      if (aio_set_chunk_size(parse_size(optarg)) != 0) {
+        usage();
+        return 1;
+      }
+      break;
+    case 'D':
+      aio_set_direct(1);
+      break;
+    case 'f': {
+      int filter = flt_parse(optarg);
+      if (filter < 0) {
+        fprintf(stderr, "Unknown filter: %s\n", optarg);
+        usage();
+        return 1;
+      }
+      options.filter = filter;
+      break;
+    }
+    default:
+      usage();
+      return 1;
+    }
+  }
+  if (level_set) {
+    // like gzip, a level alone selects LZ77, the only method with levels
+    if (!method_set) {
+      options.method = IO_METHOD_LZ77;
+    } else if (options.method != IO_METHOD_LZ77) {
+      fprintf(stderr, "Levels -1 .. -9 only apply to -m lz77\n");
+      usage();
+      return 1;
+    }
+  }
+  // compress_encode_files skips argv[0], keep the program name in front
+  argv[optind - 1] = argv[0];
+  argc -= optind - 1;
+  argv += optind - 1;
+  if (daemon_socket != NULL)
+    return run_daemon(daemon_socket, workers);
+  if (client != NULL) {
+    if (argc != 3) {
+      usage();
+      return 1;
+    }
+    return run_client(client, decode, argv[1], argv[2], &options);
+  }
+  if (table_path != NULL) {
+    if (argc < 2) {
+      usage();
+      return 0;
+    }
+    return save_table(table_path, argv + 1, argc - 1);
+  }
+  if (analyze) {
+    if (argc < 2) {
+      usage();
+      return 0;
+    }
+    return analyze_paths(argv + 1, argc - 1);
+  }
+  if (decode ? argc < 2 : argc < 3) {
+    usage();
     return 0;
   }
-  if (strcmp(argv[1], "-d") == 0 || strcmp(argv[1], "-decode") == 0) {
-    printf("Descomprimir %s\n", argv[2]);
-    FILE *file = fopen(argv[2], "rb");
+  if (list) {
+    FILE *file = fopen(argv[1], "rb");
     if (file == NULL) {
-      fprintf(stderr, "Error opening file: %s\n", argv[2]);
+      fprintf(stderr, "Error opening file: %s\n", argv[1]);
       return 1;
     }
-    int status = decompress_file(file);
+    int status = list_file(file);
+    fclose(file);
+    return status < 0;
+  }
+  if (decode) {
+    printf("%s %s\n", verify ? "Verificar" : "Descomprimir", argv[1]);
+    FILE *file = fopen(argv[1], "rb");
+    if (file == NULL) {
+      fprintf(stderr, "Error opening file: %s\n", argv[1]);
+      return 1;
+    }
+    int status = verify ? verify_file(file) : decompress_file(file);
     if (status < 0) {
-      fprintf(stderr, "Error decompressing file: %s\n", argv[2]);
+      fprintf(stderr, "Error %s file: %s\n",
+              verify ? "verifying" : "decompressing", argv[1]);
     }
     fclose(file);
-  } else {
-    // second argument is compressed file name
-    printf("Code: \n");
-    FILE *file = fopen(argv[argc - 1], "wb");
-    compress_encode_files(file, argc, argv);
-    fclose(file);
+    return status < 0;
+  }
+  // directories are replaced by the files below them
+  WalkList inputs;
+  if (walk_paths(argv + 1, argc - 2, 0, &inputs) != 0)
+    return 1;
+  char **names = malloc((inputs.count + 2) * sizeof(char *));
+  if (names == NULL) {
+    walk_list_free(&inputs);
+    return 1;
+  }
+  names[0] = argv[0];
+  memcpy(names + 1, inputs.paths, inputs.count * sizeof(char *));
+  names[inputs.count + 1] = argv[argc - 1];
+  // last argument is compressed file name
+  printf("Code: \n");
+  int status = 1;
+  // -r on a missing archive creates it, like tar
+  FILE *file = append ? fopen(argv[argc - 1], "r+b") : NULL;
+  if (file == NULL && (!append || errno == ENOENT)) {
+    append = 0;
+    file = fopen(argv[argc - 1], "wb");
+  }
+  if (file == NULL)
+    fprintf(stderr, "Error opening file: %s\n", argv[argc - 1]);
+  else {
+    status = append ? compress_append_files(file, inputs.count + 2, names,
+                                            &options)
+                    : compress_encode_files_opt(file, inputs.count + 2, names,
+                                                &options);
+    if (fclose(file) != 0)
+      status = 1;
   }
+  free(names);
+  walk_list_free(&inputs);
+  return status != 0;
 }
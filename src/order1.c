@@ -0,0 +1,150 @@
+#include "order1.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+Order1Coder *o1_new(void) {
+  Order1Coder *coder = malloc(sizeof(Order1Coder));
+  if (coder == NULL)
+    fprintf(stderr, "Error allocating order-1 coder.\n");
+  return coder;
+}
+
+void o1_free(Order1Coder *coder) { free(coder); }
+
+/*
+ * A context gets its own table when its header plus coded bits is smaller
+ * than coding the same bytes with a table built from the whole block.
+ */
+static int o1_choose_tables(Order1Coder *coder) {
+  uint32_t *global = coder->counts[O1_SHARED];
+  memset(global, 0, sizeof(coder->counts[O1_SHARED]));
+  for (int c = 0; c < ALPHABET_SIZE; ++c)
+    for (int s = 0; s < ALPHABET_SIZE; ++s)
+      global[s] += coder->counts[c][s];
+  if (hc_table_from_counts(&coder->tables[O1_SHARED], global, ALPHABET_SIZE))
+    return -1;
+
+  memset(global, 0, sizeof(coder->counts[O1_SHARED]));
+  for (int c = 0; c < ALPHABET_SIZE; ++c) {
+    HuffTable *own = &coder->tables[c];
+    coder->own[c] = 0;
+    if (hc_table_from_counts(own, coder->counts[c], ALPHABET_SIZE) != 0)
+      return -1;
+    uint64_t own_bits =
+        hc_table_cost(own, coder->counts[c]) + hc_table_header_bits(own);
+    uint64_t shared_bits =
+        hc_table_cost(&coder->tables[O1_SHARED], coder->counts[c]);
+    if (own_bits < shared_bits) {
+      coder->own[c] = 1;
+    } else {
+      for (int s = 0; s < ALPHABET_SIZE; ++s)
+        global[s] += coder->counts[c][s];
+    }
+  }
+  // shared table only covers the contexts left without one
+  return hc_table_from_counts(&coder->tables[O1_SHARED], global,
+                              ALPHABET_SIZE);
+}
+
+static int o1_plan(Order1Coder *coder, const unsigned char *buf, size_t n) {
+  memset(coder->counts, 0, sizeof(coder->counts));
+  unsigned char prev = 0;
+  for (size_t i = 0; i < n; ++i) {
+    ++coder->counts[prev][buf[i]];
+    prev = buf[i];
+  }
+  return o1_choose_tables(coder);
+}
+
+int64_t o1_block_bits(Order1Coder *coder, const unsigned char *buf,
+                      size_t n) {
+  if (o1_plan(coder, buf, n) != 0)
+    return -1;
+  const HuffTable *shared = &coder->tables[O1_SHARED];
+  int64_t bits = 9 + hc_table_header_bits(shared);
+  for (int c = 0, last = -1; c < ALPHABET_SIZE; ++c) {
+    if (coder->own[c]) {
+      // gamma code of the gap: 2 * floor(log2(gap)) + 1 bits
+      int k = 0;
+      while (((c - last) >> k) > 1)
+        ++k;
+      bits += 2 * k + 1 + hc_table_header_bits(&coder->tables[c]) +
+              hc_table_cost(&coder->tables[c], coder->counts[c]);
+      last = c;
+    } else {
+      bits += hc_table_cost(shared, coder->counts[c]);
+    }
+  }
+  return bits;
+}
+
+/*
+ * Block layout (bits):
+ * 1. Number of contexts with their own table, 9 bits
+ * 2. Gamma coded gaps between those contexts
+ * 3. Shared table, then one table per listed context
+ * 4. Bytes, each coded with the table of the byte before (0 at start)
+ */
+int o1_encode_block(Order1Coder *coder, const unsigned char *buf, size_t n,
+                    BitWriter *bw) {
+  if (o1_plan(coder, buf, n) != 0)
+    return -1;
+
+  int used = 0;
+  for (int c = 0; c < ALPHABET_SIZE; ++c)
+    used += coder->own[c];
+  bs_write_bits(bw, used, 9);
+  int last = -1;
+  for (int c = 0; c < ALPHABET_SIZE; ++c) {
+    if (coder->own[c]) {
+      bs_write_gamma(bw, c - last);
+      last = c;
+    }
+  }
+  hc_table_write(bw, &coder->tables[O1_SHARED]);
+  for (int c = 0; c < ALPHABET_SIZE; ++c)
+    if (coder->own[c])
+      hc_table_write(bw, &coder->tables[c]);
+
+  unsigned char prev = 0;
+  for (size_t i = 0; i < n; ++i) {
+    int t = coder->own[prev] ? prev : O1_SHARED;
+    hc_write_symbol(bw, &coder->tables[t], buf[i]);
+    prev = buf[i];
+  }
+  return bw->error ? -1 : 0;
+}
+
+int o1_decode_block(Order1Coder *coder, BitReader *br, unsigned char *buf,
+                    size_t n) {
+  memset(coder->own, 0, sizeof(coder->own));
+  int used = bs_read_bits(br, 9);
+  int c = -1;
+  for (int i = 0; i < used; ++i) {
+    c += bs_read_gamma(br);
+    if (br->overrun || c < 0 || c >= ALPHABET_SIZE) {
+      fprintf(stderr, "Error decoding order-1 block: invalid context.\n");
+      return -1;
+    }
+    coder->own[c] = 1;
+  }
+  if (hc_table_read(br, &coder->tables[O1_SHARED], ALPHABET_SIZE) != 0)
+    return -1;
+  for (c = 0; c < ALPHABET_SIZE; ++c)
+    if (coder->own[c] &&
+        hc_table_read(br, &coder->tables[c], ALPHABET_SIZE) != 0)
+      return -1;
+
+  unsigned char prev = 0;
+  for (size_t i = 0; i < n; ++i) {
+    int t = coder->own[prev] ? prev : O1_SHARED;
+    int sym = hc_read_symbol(br, &coder->tables[t]);
+    if (sym < 0 || br->overrun) {
+      fprintf(stderr, "Error decoding order-1 block: invalid code.\n");
+      return -1;
+    }
+    buf[i] = prev = sym;
+  }
+  return 0;
+}
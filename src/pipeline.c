@@ -0,0 +1,219 @@
+#include "pipeline.h"
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Polls before a waiting side goes to sleep
+#define PIPE_SPIN 256
+
+static void spsc_sleep(_Atomic uint32_t *word, uint32_t seen) {
+#ifdef __linux__
+  // returns at once if word no longer holds seen
+  syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT_PRIVATE, seen, NULL, NULL,
+          0);
+#else
+  (void)word, (void)seen;
+  sched_yield();
+#endif
+}
+
+static void spsc_wake(SpscRing *ring, _Atomic uint32_t *word) {
+#ifdef __linux__
+  if (atomic_load(&ring->waiters) != 0)
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL,
+            NULL, 0);
+#else
+  (void)ring, (void)word;
+#endif
+}
+
+// Wait until word moves away from seen
+static void spsc_wait(SpscRing *ring, _Atomic uint32_t *word, uint32_t seen) {
+  for (int i = 0; i < PIPE_SPIN; ++i) {
+    if (atomic_load_explicit(word, memory_order_acquire) != seen)
+      return;
+    sched_yield();
+  }
+  // seq_cst pairs with the store + waiters load in push/pop: either we see
+  // the new value or the other side sees us waiting
+  atomic_fetch_add(&ring->waiters, 1);
+  while (atomic_load(word) == seen)
+    spsc_sleep(word, seen);
+  atomic_fetch_sub(&ring->waiters, 1);
+}
+
+int spsc_init(SpscRing *ring, uint32_t capacity) {
+  uint32_t size = 1;
+  while (size < capacity)
+    size <<= 1;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->waiters, 0);
+  ring->mask = size - 1;
+  ring->items = calloc(size, sizeof(void *));
+  return ring->items == NULL ? -1 : 0;
+}
+
+void spsc_free(SpscRing *ring) {
+  free(ring->items);
+  ring->items = NULL;
+}
+
+void spsc_push(SpscRing *ring, void *item) {
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint32_t head;
+  while (tail - (head = atomic_load_explicit(&ring->head,
+                                             memory_order_acquire)) >
+         ring->mask)
+    spsc_wait(ring, &ring->head, head);
+  ring->items[tail & ring->mask] = item;
+  atomic_store(&ring->tail, tail + 1);
+  spsc_wake(ring, &ring->tail);
+}
+
+void *spsc_pop(SpscRing *ring) {
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint32_t tail;
+  while ((tail = atomic_load_explicit(&ring->tail, memory_order_acquire)) ==
+         head)
+    spsc_wait(ring, &ring->tail, tail);
+  void *item = ring->items[head & ring->mask];
+  atomic_store(&ring->head, head + 1);
+  spsc_wake(ring, &ring->head);
+  return item;
+}
+
+/*
+ * Full queues carry items downstream, free queues bring them back. A NULL
+ * item on a full queue marks the end of the stream.
+ */
+typedef struct Pipeline {
+  PipeStages *stages;
+  SpscRing in_full, in_free, out_full, out_free;
+  atomic_int stop;   // reader: no more input wanted
+  atomic_int failed; // some stage returned PIPE_ERROR
+} Pipeline;
+
+static void *pipe_reader(void *arg) {
+  Pipeline *p = arg;
+  PipeStages *s = p->stages;
+  while (!atomic_load(&p->stop)) {
+    void *in = spsc_pop(&p->in_free);
+    if (atomic_load(&p->stop))
+      break;
+    int r = s->read(s->ctx, in);
+    if (r != PIPE_OK) {
+      if (r == PIPE_ERROR)
+        atomic_store(&p->failed, 1);
+      break;
+    }
+    spsc_push(&p->in_full, in);
+  }
+  spsc_push(&p->in_full, NULL);
+  return NULL;
+}
+
+static void *pipe_writer(void *arg) {
+  Pipeline *p = arg;
+  PipeStages *s = p->stages;
+  void *out;
+  // keep draining after an error so the compute stage never blocks
+  while ((out = spsc_pop(&p->out_full)) != NULL) {
+    if (!atomic_load(&p->failed) && s->write(s->ctx, out) == PIPE_ERROR) {
+      atomic_store(&p->failed, 1);
+      atomic_store(&p->stop, 1);
+    }
+    spsc_push(&p->out_free, out);
+  }
+  return NULL;
+}
+
+// Same stages on the calling thread, for small inputs and when threads are
+// not available
+static int pipe_run_inline(PipeStages *s) {
+  for (;;) {
+    int r = s->read(s->ctx, s->in[0]);
+    if (r != PIPE_OK)
+      return r == PIPE_ERROR ? -1 : 0;
+    r = s->work(s->ctx, s->in[0], s->out[0]);
+    if (r == PIPE_ERROR || s->write(s->ctx, s->out[0]) == PIPE_ERROR)
+      return -1;
+    if (r == PIPE_END)
+      return 0;
+  }
+}
+
+int pipe_run(PipeStages *s) {
+  if (s->small)
+    return pipe_run_inline(s);
+  Pipeline p;
+  p.stages = s;
+  atomic_init(&p.stop, 0);
+  atomic_init(&p.failed, 0);
+  // room for every item plus the end marker
+  if (spsc_init(&p.in_full, PIPE_DEPTH + 1) != 0 ||
+      spsc_init(&p.in_free, PIPE_DEPTH + 1) != 0 ||
+      spsc_init(&p.out_full, PIPE_DEPTH + 1) != 0 ||
+      spsc_init(&p.out_free, PIPE_DEPTH + 1) != 0) {
+    fprintf(stderr, "Error allocating pipeline queues.\n");
+    spsc_free(&p.in_full);
+    spsc_free(&p.in_free);
+    spsc_free(&p.out_full);
+    spsc_free(&p.out_free);
+    return -1;
+  }
+  for (int i = 0; i < PIPE_DEPTH; ++i) {
+    spsc_push(&p.in_free, s->in[i]);
+    spsc_push(&p.out_free, s->out[i]);
+  }
+  pthread_t reader, writer;
+  int status;
+  // nothing has been read or written yet if a thread cannot start
+  if (pthread_create(&writer, NULL, pipe_writer, &p) != 0) {
+    status = pipe_run_inline(s);
+  } else if (pthread_create(&reader, NULL, pipe_reader, &p) != 0) {
+    spsc_push(&p.out_full, NULL);
+    pthread_join(writer, NULL);
+    status = pipe_run_inline(s);
+  } else {
+    status = 0;
+    void *in;
+    while ((in = spsc_pop(&p.in_full)) != NULL) {
+      if (status == 0 && !atomic_load(&p.failed)) {
+        void *out = spsc_pop(&p.out_free);
+        int r = s->work(s->ctx, in, out);
+        if (r == PIPE_ERROR) {
+          status = -1;
+          atomic_store(&p.stop, 1);
+        } else {
+          if (r == PIPE_END) {
+            status = 1;
+            atomic_store(&p.stop, 1);
+          }
+          spsc_push(&p.out_full, out);
+        }
+      }
+      spsc_push(&p.in_free, in);
+    }
+    spsc_push(&p.out_full, NULL);
+    pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+    if (status > 0)
+      status = 0;
+    if (atomic_load(&p.failed))
+      status = -1;
+  }
+  spsc_free(&p.in_full);
+  spsc_free(&p.in_free);
+  spsc_free(&p.out_full);
+  spsc_free(&p.out_free);
+  return status;
+}
@@ -6,25 +6,44 @@ char pq_is_full(PriorityQueue *pq) { return pq->size == pq->capacity; }
 
 char pq_is_empty(PriorityQueue *pq) { return pq->size == 0; }
 
-void pq_new(PriorityQueue *pq, Node *arr, int size) {
-  pq->arr = (Node **)calloc(size, sizeof(Node *));
+int pq_new(PriorityQueue *pq, Node *arr, int size) {
+  pq->arr = (Node **)calloc(size ? size : 1, sizeof(Node *));
   pq->size = 0;
   pq->capacity = size;
+  if (pq->arr == NULL) {
+    perror("malloc failed");
+    return -1;
+  }
   if (arr != NULL) {
     for (int i = 0; i < size; ++i) {
       // Copy
       Node *copy = malloc(sizeof(Node));
       if (copy == NULL) {
         perror("malloc failed");
-        exit(EXIT_FAILURE);
+        // give back the copies made so far
+        for (int j = 0; j < pq->size; ++j)
+          free(pq->arr[j]);
+        pq_erase(pq);
+        return -1;
       }
       *copy = arr[i];
-      pq_push(pq, copy);
+      (void)pq_push(pq, copy);
     }
   }
+  return 0;
 }
 
-void pq_erase(PriorityQueue *pq) { free(pq->arr); }
+void pq_init(PriorityQueue *pq, Node **storage, int capacity) {
+  pq->arr = storage;
+  pq->size = 0;
+  pq->capacity = capacity;
+}
+
+void pq_erase(PriorityQueue *pq) {
+  free(pq->arr);
+  pq->arr = NULL;
+  pq->size = pq->capacity = 0;
+}
 
 void pq_heapifyUp(PriorityQueue *pq, int idx) {
   int p;
@@ -55,34 +74,36 @@ void pq_heapifyDown(PriorityQueue *pq, int idx) {
   }
 }
 
-void pq_push(PriorityQueue *pq, Node *n) {
+int pq_push(PriorityQueue *pq, Node *n) {
   if (pq_is_full(pq)) {
     fprintf(stderr, "Error: PriorityQueue is full\n");
-    exit(EXIT_FAILURE);
+    return -1;
   }
   pq->arr[pq->size] = n;
   pq_heapifyUp(pq, pq->size);
   pq->size++;
+  return 0;
 }
 
 Node *pq_top(PriorityQueue *pq) {
   if (pq_is_empty(pq)) {
     fprintf(stderr,
             "Error, se intentó extraer elemento de cola de prioridad vacía\n");
-    exit(EXIT_FAILURE);
+    return NULL;
   }
   return pq->arr[0];
 }
 
-void pq_pop(PriorityQueue *pq) {
+int pq_pop(PriorityQueue *pq) {
   if (pq_is_empty(pq)) {
     fprintf(stderr,
             "Error, se intentó extraer elemento de cola de prioridad vacía\n");
-    exit(EXIT_FAILURE);
+    return -1;
   }
   pq->size--;
   if (pq->size > 0) {
     pq->arr[0] = pq->arr[pq->size];
     pq_heapifyDown(pq, 0);
   }
+  return 0;
 }
@@ -0,0 +1,151 @@
+#include "split.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bits spent on each cut: the cell count of the segment before it
+#define SPLIT_CUT_BITS 8
+
+SplitCoder *split_new(void) {
+  SplitCoder *coder = malloc(sizeof(SplitCoder));
+  if (coder == NULL)
+    fprintf(stderr, "Error allocating split coder.\n");
+  return coder;
+}
+
+void split_free(SplitCoder *coder) { free(coder); }
+
+// Order-0 entropy in bits of cells [a, b): N log N - sum c log c
+static double split_entropy(const SplitCoder *coder, int a, int b) {
+  const uint32_t *lo = coder->prefix[a], *hi = coder->prefix[b];
+  double total = 0, sum = 0;
+  for (int s = 0; s < ALPHABET_SIZE; ++s) {
+    uint32_t c = hi[s] - lo[s];
+    if (c > 0) {
+      total += c;
+      sum += c * log2(c);
+    }
+  }
+  return total > 0 ? total * log2(total) - sum : 0;
+}
+
+// Exact bits of cells [a, b) with their own table, leaves it in coder->table
+static int64_t split_cost(SplitCoder *coder, int a, int b) {
+  for (int s = 0; s < ALPHABET_SIZE; ++s)
+    coder->counts[s] = coder->prefix[b][s] - coder->prefix[a][s];
+  if (hc_table_from_counts(&coder->table, coder->counts, ALPHABET_SIZE) != 0)
+    return -1;
+  return hc_table_header_bits(&coder->table) +
+         (int64_t)hc_table_cost(&coder->table, coder->counts);
+}
+
+/*
+ * Top down: the cut of [a, b) with the lowest estimated cost is tried with
+ * real tables and kept if it pays for the extra table; both halves are then
+ * split the same way, left first so ends comes out in order.
+ */
+static int split_range(SplitCoder *coder, int a, int b) {
+  if (b - a >= 2) {
+    int best = a + 1;
+    double best_bits = INFINITY;
+    for (int k = a + 1; k < b; ++k) {
+      double bits = split_entropy(coder, a, k) + split_entropy(coder, k, b);
+      if (bits < best_bits) {
+        best_bits = bits;
+        best = k;
+      }
+    }
+    int64_t whole = split_cost(coder, a, b);
+    int64_t left = split_cost(coder, a, best);
+    int64_t right = split_cost(coder, best, b);
+    if (whole < 0 || left < 0 || right < 0)
+      return -1;
+    if (left + right + SPLIT_CUT_BITS < whole)
+      return split_range(coder, a, best) != 0 ||
+                     split_range(coder, best, b) != 0
+                 ? -1
+                 : 0;
+  }
+  coder->ends[coder->segments++] = b;
+  return 0;
+}
+
+int split_plan(SplitCoder *coder, const unsigned char *buf, size_t n) {
+  if (n == 0 || n > SPLIT_BLOCK_SIZE) {
+    fprintf(stderr, "Error: invalid split block of %zu bytes.\n", n);
+    return -1;
+  }
+  int cells = (n + SPLIT_CELL - 1) / SPLIT_CELL;
+  memset(coder->prefix[0], 0, sizeof(coder->prefix[0]));
+  for (int c = 0; c < cells; ++c) {
+    memcpy(coder->prefix[c + 1], coder->prefix[c], sizeof(coder->prefix[c]));
+    size_t stop = (size_t)(c + 1) * SPLIT_CELL;
+    size_t end = stop < n ? stop : n;
+    for (size_t i = (size_t)c * SPLIT_CELL; i < end; ++i)
+      ++coder->prefix[c + 1][buf[i]];
+  }
+  coder->segments = 0;
+  if (split_range(coder, 0, cells) != 0)
+    return -1;
+  return coder->segments;
+}
+
+/*
+ * 8 bits segments - 1, 8 bits cells - 1 of every segment but the last,
+ * then per segment its table and codes
+ */
+int split_encode_block(SplitCoder *coder, const unsigned char *buf, size_t n,
+                       BitWriter *bw) {
+  if (split_plan(coder, buf, n) < 0)
+    return -1;
+  bs_write_bits(bw, coder->segments - 1, 8);
+  for (int i = 0, a = 0; i < coder->segments - 1; a = coder->ends[i++])
+    bs_write_bits(bw, coder->ends[i] - a - 1, SPLIT_CUT_BITS);
+
+  for (int i = 0, a = 0; i < coder->segments; a = coder->ends[i++]) {
+    if (split_cost(coder, a, coder->ends[i]) < 0)
+      return -1;
+    hc_table_write(bw, &coder->table);
+    size_t end = (size_t)coder->ends[i] * SPLIT_CELL;
+    for (size_t j = (size_t)a * SPLIT_CELL; j < end && j < n; ++j)
+      hc_write_symbol(bw, &coder->table, buf[j]);
+  }
+  return bw->error ? -1 : 0;
+}
+
+int split_decode_block(SplitCoder *coder, BitReader *br, unsigned char *buf,
+                       size_t n) {
+  if (n == 0 || n > SPLIT_BLOCK_SIZE) {
+    fprintf(stderr, "Error: invalid split block of %zu bytes.\n", n);
+    return -1;
+  }
+  int cells = (n + SPLIT_CELL - 1) / SPLIT_CELL;
+  coder->segments = bs_read_bits(br, 8) + 1;
+  int a = 0;
+  for (int i = 0; i < coder->segments - 1; ++i) {
+    a += bs_read_bits(br, SPLIT_CUT_BITS) + 1;
+    if (br->overrun || a >= cells) {
+      fprintf(stderr, "Error decoding split block: invalid segment.\n");
+      return -1;
+    }
+    coder->ends[i] = a;
+  }
+  coder->ends[coder->segments - 1] = cells;
+
+  a = 0;
+  for (int i = 0; i < coder->segments; a = coder->ends[i++]) {
+    if (hc_table_read(br, &coder->table, ALPHABET_SIZE) != 0)
+      return -1;
+    size_t end = (size_t)coder->ends[i] * SPLIT_CELL;
+    for (size_t j = (size_t)a * SPLIT_CELL; j < end && j < n; ++j) {
+      int sym = hc_read_symbol(br, &coder->table);
+      if (sym < 0 || br->overrun) {
+        fprintf(stderr, "Error decoding split block: invalid code.\n");
+        return -1;
+      }
+      buf[j] = sym;
+    }
+  }
+  return 0;
+}
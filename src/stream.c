@@ -0,0 +1,479 @@
+#include "stream.h"
+#include "bitstream.h"
+#include "block.h"
+#include "crc32c.h"
+#include "filter.h"
+#include "io_tool.h"
+#include <stdlib.h>
+#include <string.h>
+
+// magic, version, method and filter
+#define STREAM_HEAD (IO_MAGIC_SIZE + 3)
+
+enum {
+  // compressor
+  STREAM_START,  // header not written, filter not chosen yet
+  STREAM_BLOCKS, // header out, blocks follow
+  // decompressor
+  STREAM_HEADER,   // gathering the header
+  STREAM_RECORD,   // gathering the original size of a block, 0 ends
+  STREAM_CODED,    // gathering the coded size
+  STREAM_PAYLOAD,  // gathering coded block and its CRC
+  STREAM_DRAIN,    // decoded block waits for room in out
+  STREAM_CHECKSUM, // gathering the CRC of the stream
+  // both
+  STREAM_DONE,
+};
+
+struct HcStreamState {
+  int decode;
+  int phase;
+  int error; // sticky: every call after an error returns it again
+  CompressOptions options;
+  unsigned char method, filter;
+  BlockCoder coder;
+  int has_coder;
+  FilterState fstate;
+  uint32_t crc;
+  unsigned char *block; // input being gathered, or decoded block to drain
+  size_t block_cap, fill, drained;
+  unsigned char *pend; // compressor: coded bytes waiting for room in out
+  size_t pend_len, pend_pos, pend_cap;
+  unsigned char *hold; // decompressor: a header, varint or block in pieces
+  size_t hold_len, hold_cap;
+  uint64_t r_s, c_s;
+  BitWriter bw;
+  unsigned char trial[FLT_SAMPLE]; // flt_choose_cost
+};
+
+static int stream_streamable(unsigned char method) {
+  return method == IO_METHOD_ADAPTIVE || method == IO_METHOD_ORDER1 ||
+         method == IO_METHOD_BWT || method == IO_METHOD_LZ77 ||
+         method == IO_METHOD_SPLIT;
+}
+
+static int stream_grow(unsigned char **buf, size_t *cap, size_t n) {
+  if (n <= *cap)
+    return 0;
+  size_t want = *cap * 2 > n ? *cap * 2 : n;
+  unsigned char *p = realloc(*buf, want);
+  if (p == NULL)
+    return -1;
+  *buf = p;
+  *cap = want;
+  return 0;
+}
+
+static HcStreamState *stream_state_new(int decode) {
+  HcStreamState *st = calloc(1, sizeof(HcStreamState));
+  if (st == NULL)
+    return NULL;
+  st->decode = decode;
+  st->phase = decode ? STREAM_HEADER : STREAM_START;
+  bs_writer_init(&st->bw);
+  return st;
+}
+
+// Same method keeps the coder's tables, another one replaces them
+static int stream_coder_for(HcStreamState *st, unsigned char method,
+                            int level) {
+  if (block_coder_for(&st->coder, &st->has_coder, method, level) != 0)
+    return -1;
+  return stream_grow(&st->block, &st->block_cap, st->coder.block_size);
+}
+
+static void stream_clear(HcStream *stream) {
+  stream->in = NULL;
+  stream->out = NULL;
+  stream->avail_in = stream->avail_out = 0;
+  stream->total_in = stream->total_out = 0;
+}
+
+int hc_stream_compress_init(HcStream *stream, const CompressOptions *options) {
+  if (stream == NULL)
+    return HC_ERR_ARGS;
+  stream->state = NULL;
+  CompressOptions defaults = {IO_METHOD_LZ77, LZ_DEFAULT_LEVEL, FLT_AUTO};
+  if (options == NULL)
+    options = &defaults;
+  if (!stream_streamable(options->method) ||
+      (options->filter >= FLT_COUNT && options->filter != FLT_AUTO))
+    return HC_ERR_ARGS;
+  HcStreamState *st = stream_state_new(0);
+  if (st == NULL)
+    return HC_ERR_MEMORY;
+  st->options = *options;
+  st->method = options->method;
+  if (stream_coder_for(st, options->method, options->level) != 0) {
+    stream->state = st;
+    hc_stream_end(stream);
+    return HC_ERR_MEMORY;
+  }
+  stream_clear(stream);
+  stream->state = st;
+  return HC_OK;
+}
+
+int hc_stream_decompress_init(HcStream *stream) {
+  if (stream == NULL)
+    return HC_ERR_ARGS;
+  stream_clear(stream);
+  stream->state = stream_state_new(1);
+  return stream->state != NULL ? HC_OK : HC_ERR_MEMORY;
+}
+
+int hc_stream_reset(HcStream *stream) {
+  if (stream == NULL || stream->state == NULL)
+    return HC_ERR_ARGS;
+  HcStreamState *st = stream->state;
+  st->error = HC_OK;
+  st->crc = 0;
+  st->fill = st->drained = 0;
+  st->pend_len = st->pend_pos = 0;
+  st->hold_len = 0;
+  stream_clear(stream);
+  if (st->decode) {
+    // the coder is picked again by the next header
+    st->phase = STREAM_HEADER;
+    return HC_OK;
+  }
+  st->phase = STREAM_START;
+  if (block_coder_reset(&st->coder, st->options.level) != 0) {
+    st->error = HC_ERR_MEMORY;
+    return st->error;
+  }
+  return HC_OK;
+}
+
+void hc_stream_end(HcStream *stream) {
+  if (stream == NULL || stream->state == NULL)
+    return;
+  HcStreamState *st = stream->state;
+  if (st->has_coder)
+    block_coder_free(&st->coder);
+  bs_writer_free(&st->bw);
+  free(st->block);
+  free(st->pend);
+  free(st->hold);
+  free(st);
+  stream->state = NULL;
+}
+
+static int stream_put(HcStreamState *st, const void *src, size_t n) {
+  if (stream_grow(&st->pend, &st->pend_cap, st->pend_len + n) != 0)
+    return HC_ERR_MEMORY;
+  memcpy(st->pend + st->pend_len, src, n);
+  st->pend_len += n;
+  return HC_OK;
+}
+
+// Coded bytes into out, as many as fit
+static void stream_drain(HcStream *stream, HcStreamState *st) {
+  size_t k = st->pend_len - st->pend_pos;
+  if (k > stream->avail_out)
+    k = stream->avail_out;
+  if (k > 0) {
+    memcpy(stream->out, st->pend + st->pend_pos, k);
+    stream->out += k;
+    stream->avail_out -= k;
+    stream->total_out += k;
+    st->pend_pos += k;
+  }
+  if (st->pend_pos == st->pend_len)
+    st->pend_len = st->pend_pos = 0;
+}
+
+// The filter comes from the first block, so the header waits for it
+static int stream_put_header(HcStreamState *st, const unsigned char *buf,
+                             size_t n) {
+  st->filter = st->options.filter;
+  if (st->filter == FLT_AUTO)
+    st->filter = n == 0 ? FLT_NONE
+                        : flt_choose_cost(buf, n < FLT_SAMPLE ? n : FLT_SAMPLE,
+                                          st->trial, block_trial_cost,
+                                          &st->coder);
+  flt_init(&st->fstate, st->filter);
+  unsigned char head[STREAM_HEAD];
+  memcpy(head, HC_STREAM_MAGIC, IO_MAGIC_SIZE);
+  head[IO_MAGIC_SIZE] = IO_FORMAT_VERSION;
+  head[IO_MAGIC_SIZE + 1] = st->method;
+  head[IO_MAGIC_SIZE + 2] = st->filter;
+  st->phase = STREAM_BLOCKS;
+  return stream_put(st, head, STREAM_HEAD);
+}
+
+// One block of buf, which is st->block or the caller's input
+static int stream_encode_block(HcStreamState *st, const unsigned char *buf,
+                               size_t n) {
+  int status = HC_OK;
+  if (st->phase == STREAM_START)
+    status = stream_put_header(st, buf, n);
+  if (status != HC_OK)
+    return status;
+  uint32_t b_crc = crc32c_update(0, buf, n);
+  st->crc = crc32c_combine(st->crc, b_crc, n);
+  if (st->filter != FLT_NONE) {
+    // filters work in place, the caller's input is left alone
+    if (buf != st->block)
+      memcpy(st->block, buf, n);
+    flt_encode(&st->fstate, st->block, n);
+    buf = st->block;
+  }
+  BitWriter *bw = &st->bw;
+  bs_writer_reset(bw);
+  if (block_encode(&st->coder, buf, n, bw) != 0)
+    return HC_ERR_MEMORY;
+  size_t c_s = bs_flush(bw);
+  if (bw->error)
+    return HC_ERR_MEMORY;
+  unsigned char head[2 * IO_VARINT_MAX], tail[IO_CRC_SIZE];
+  size_t h_s = io_put_varint(head, n);
+  h_s += io_put_varint(head + h_s, c_s);
+  io_store_crc(tail, b_crc);
+  status = stream_put(st, head, h_s);
+  if (status == HC_OK)
+    status = stream_put(st, bw->buf, c_s);
+  if (status == HC_OK)
+    status = stream_put(st, tail, IO_CRC_SIZE);
+  return status;
+}
+
+static int stream_close(HcStreamState *st) {
+  int status = HC_OK;
+  if (st->phase == STREAM_START)
+    status = stream_put_header(st, NULL, 0);
+  unsigned char tail[1 + IO_CRC_SIZE] = {0};
+  io_store_crc(tail + 1, st->crc);
+  if (status == HC_OK)
+    status = stream_put(st, tail, sizeof(tail));
+  st->phase = STREAM_DONE;
+  return status;
+}
+
+static int stream_args(HcStream *stream, int decode) {
+  if (stream == NULL || stream->state == NULL ||
+      stream->state->decode != decode ||
+      (stream->in == NULL && stream->avail_in > 0) ||
+      (stream->out == NULL && stream->avail_out > 0))
+    return HC_ERR_ARGS;
+  return stream->state->error;
+}
+
+int hc_stream_compress(HcStream *stream, int finish) {
+  int status = stream_args(stream, 0);
+  if (status != HC_OK)
+    return status;
+  HcStreamState *st = stream->state;
+  size_t bs = st->coder.block_size;
+  for (;;) {
+    stream_drain(stream, st);
+    if (st->pend_len > 0)
+      return HC_OK; // out is full
+    if (st->phase == STREAM_DONE)
+      return HC_STREAM_END;
+    if (st->fill == 0 && stream->avail_in >= bs) {
+      // a whole block in the input is coded where it is
+      status = stream_encode_block(st, stream->in, bs);
+      stream->in += bs;
+      stream->avail_in -= bs;
+      stream->total_in += bs;
+    } else if (stream->avail_in > 0 && st->fill < bs) {
+      size_t k = bs - st->fill;
+      if (k > stream->avail_in)
+        k = stream->avail_in;
+      memcpy(st->block + st->fill, stream->in, k);
+      st->fill += k;
+      stream->in += k;
+      stream->avail_in -= k;
+      stream->total_in += k;
+      continue;
+    } else if (st->fill == bs || (finish && st->fill > 0)) {
+      status = stream_encode_block(st, st->block, st->fill);
+      st->fill = 0;
+    } else if (finish) {
+      status = stream_close(st);
+    } else {
+      return HC_OK; // needs input
+    }
+    if (status != HC_OK) {
+      st->error = status;
+      return status;
+    }
+  }
+}
+
+// Input into hold until it has n bytes, 1 once it has them
+static int stream_gather(HcStream *stream, HcStreamState *st, size_t n) {
+  size_t k = n - st->hold_len;
+  if (k > stream->avail_in)
+    k = stream->avail_in;
+  memcpy(st->hold + st->hold_len, stream->in, k);
+  st->hold_len += k;
+  stream->in += k;
+  stream->avail_in -= k;
+  stream->total_in += k;
+  return st->hold_len == n;
+}
+
+// A varint byte by byte: 1 when complete, 0 for more input, -1 if too long
+static int stream_gather_varint(HcStream *stream, HcStreamState *st,
+                                uint64_t *value) {
+  while (stream->avail_in > 0) {
+    unsigned char c = *stream->in++;
+    --stream->avail_in;
+    ++stream->total_in;
+    st->hold[st->hold_len++] = c;
+    if (!(c & 0x80)) {
+      size_t pos = 0;
+      int ok = io_get_varint(st->hold, st->hold_len, &pos, value) == 0;
+      st->hold_len = 0;
+      return ok ? 1 : -1;
+    }
+    if (st->hold_len == IO_VARINT_MAX)
+      return -1;
+  }
+  return 0;
+}
+
+static int stream_parse_header(HcStreamState *st) {
+  const unsigned char *h = st->hold;
+  st->hold_len = 0;
+  if (memcmp(h, HC_STREAM_MAGIC, IO_MAGIC_SIZE) != 0 ||
+      h[IO_MAGIC_SIZE] != IO_FORMAT_VERSION ||
+      !stream_streamable(h[IO_MAGIC_SIZE + 1]) ||
+      h[IO_MAGIC_SIZE + 2] >= FLT_COUNT)
+    return HC_ERR_CORRUPT;
+  st->method = h[IO_MAGIC_SIZE + 1];
+  st->filter = h[IO_MAGIC_SIZE + 2];
+  flt_init(&st->fstate, st->filter);
+  if (stream_coder_for(st, st->method, LZ_DEFAULT_LEVEL) != 0)
+    return HC_ERR_MEMORY;
+  st->phase = STREAM_RECORD;
+  return HC_OK;
+}
+
+/*
+ * The block in src (c_s coded bytes and the CRC) into the caller's out if
+ * it fits, else into st->block to be drained
+ */
+static int stream_decode_block(HcStream *stream, HcStreamState *st,
+                               const unsigned char *src) {
+  size_t n = st->r_s;
+  int direct = stream->avail_out >= n;
+  unsigned char *dst = direct ? stream->out : st->block;
+  BitReader br;
+  bs_reader_init(&br, src, st->c_s);
+  if (block_decode(&st->coder, &br, dst, n) != 0)
+    return HC_ERR_CORRUPT;
+  flt_decode(&st->fstate, dst, n);
+  uint32_t b_crc = crc32c_update(0, dst, n);
+  if (b_crc != io_load_crc(src + st->c_s))
+    return HC_ERR_CHECKSUM;
+  st->crc = crc32c_combine(st->crc, b_crc, n);
+  if (direct) {
+    stream->out += n;
+    stream->avail_out -= n;
+    stream->total_out += n;
+    st->phase = STREAM_RECORD;
+  } else {
+    st->fill = n;
+    st->drained = 0;
+    st->phase = STREAM_DRAIN;
+  }
+  return HC_OK;
+}
+
+// One step of the decoder, *progress is 0 when it waits for input or room
+static int stream_decode_step(HcStream *stream, HcStreamState *st,
+                              int *progress) {
+  *progress = 0;
+  int got;
+  switch (st->phase) {
+  case STREAM_HEADER:
+    if (stream_grow(&st->hold, &st->hold_cap, IO_VARINT_MAX) != 0)
+      return HC_ERR_MEMORY;
+    if (!stream_gather(stream, st, STREAM_HEAD))
+      return HC_OK;
+    *progress = 1;
+    return stream_parse_header(st);
+  case STREAM_RECORD:
+    got = stream_gather_varint(stream, st, &st->r_s);
+    if (got <= 0)
+      return got < 0 ? HC_ERR_CORRUPT : HC_OK;
+    if (st->r_s > st->coder.block_size)
+      return HC_ERR_CORRUPT;
+    st->phase = st->r_s == 0 ? STREAM_CHECKSUM : STREAM_CODED;
+    *progress = 1;
+    return HC_OK;
+  case STREAM_CODED:
+    got = stream_gather_varint(stream, st, &st->c_s);
+    if (got <= 0)
+      return got < 0 ? HC_ERR_CORRUPT : HC_OK;
+    if (st->c_s > block_bound(st->method, st->coder.block_size))
+      return HC_ERR_CORRUPT;
+    st->phase = STREAM_PAYLOAD;
+    *progress = 1;
+    return HC_OK;
+  case STREAM_PAYLOAD: {
+    size_t n = st->c_s + IO_CRC_SIZE;
+    if (st->hold_len == 0 && stream->avail_in >= n) {
+      // the whole block is in the input, decode it from there
+      const unsigned char *src = stream->in;
+      stream->in += n;
+      stream->avail_in -= n;
+      stream->total_in += n;
+      *progress = 1;
+      return stream_decode_block(stream, st, src);
+    }
+    if (stream_grow(&st->hold, &st->hold_cap, n) != 0)
+      return HC_ERR_MEMORY;
+    if (!stream_gather(stream, st, n))
+      return HC_OK;
+    st->hold_len = 0;
+    *progress = 1;
+    return stream_decode_block(stream, st, st->hold);
+  }
+  case STREAM_DRAIN: {
+    size_t k = st->fill - st->drained;
+    if (k > stream->avail_out)
+      k = stream->avail_out;
+    if (k == 0)
+      return HC_OK;
+    memcpy(stream->out, st->block + st->drained, k);
+    stream->out += k;
+    stream->avail_out -= k;
+    stream->total_out += k;
+    st->drained += k;
+    if (st->drained == st->fill)
+      st->phase = STREAM_RECORD;
+    *progress = 1;
+    return HC_OK;
+  }
+  case STREAM_CHECKSUM:
+    if (!stream_gather(stream, st, IO_CRC_SIZE))
+      return HC_OK;
+    st->hold_len = 0;
+    if (io_load_crc(st->hold) != st->crc)
+      return HC_ERR_CHECKSUM;
+    st->phase = STREAM_DONE;
+    return HC_OK;
+  default:
+    return HC_OK;
+  }
+}
+
+int hc_stream_decompress(HcStream *stream) {
+  int status = stream_args(stream, 1);
+  if (status != HC_OK)
+    return status;
+  HcStreamState *st = stream->state;
+  int progress = 1;
+  while (progress && st->phase != STREAM_DONE) {
+    status = stream_decode_step(stream, st, &progress);
+    if (status != HC_OK) {
+      st->error = status;
+      return status;
+    }
+  }
+  return st->phase == STREAM_DONE ? HC_STREAM_END : HC_OK;
+}
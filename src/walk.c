@@ -0,0 +1,264 @@
+#include "walk.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Bytes of directory entries asked for per getdents64 call
+#define WALK_DENTS (64 * 1024)
+
+// Layout returned by getdents64, glibc does not export it
+typedef struct WalkDirent {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+} WalkDirent;
+
+typedef struct WalkEntry {
+  char *path;
+  int root; // argument it came from, keeps the command line order
+} WalkEntry;
+
+typedef struct WalkVec {
+  WalkEntry *items;
+  size_t count, cap;
+} WalkVec;
+
+/*
+ * Directories waiting to be read are shared by every thread; a thread
+ * sleeps when there are none and others are still reading (they may add
+ * more). The walk ends when none are pending and no thread is busy
+ */
+typedef struct Walker {
+  pthread_mutex_t lock;
+  pthread_cond_t more;
+  WalkVec pending;
+  WalkVec files;
+  int busy;
+  int error;
+} Walker;
+
+static int walk_push(WalkVec *vec, char *path, int root) {
+  if (vec->count == vec->cap) {
+    size_t cap = vec->cap ? 2 * vec->cap : 64;
+    WalkEntry *items = realloc(vec->items, cap * sizeof(WalkEntry));
+    if (items == NULL)
+      return -1;
+    vec->items = items;
+    vec->cap = cap;
+  }
+  vec->items[vec->count++] = (WalkEntry){path, root};
+  return 0;
+}
+
+static void walk_vec_free(WalkVec *vec) {
+  for (size_t i = 0; i < vec->count; ++i)
+    free(vec->items[i].path);
+  free(vec->items);
+  *vec = (WalkVec){0};
+}
+
+static char *walk_join(const char *dir, const char *name) {
+  size_t d = strlen(dir), n = strlen(name);
+  int slash = d > 0 && dir[d - 1] != '/';
+  char *path = malloc(d + slash + n + 1);
+  if (path == NULL)
+    return NULL;
+  memcpy(path, dir, d);
+  path[d] = '/';
+  memcpy(path + d + slash, name, n + 1);
+  return path;
+}
+
+// Type of an entry, asking the inode only when the file system did not say
+static unsigned char walk_type(int dirfd, const WalkDirent *ent) {
+  if (ent->d_type != DT_UNKNOWN)
+    return ent->d_type;
+  struct stat st;
+  if (fstatat(dirfd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+    return DT_UNKNOWN;
+  return S_ISREG(st.st_mode)   ? DT_REG
+         : S_ISDIR(st.st_mode) ? DT_DIR
+                               : DT_UNKNOWN;
+}
+
+// Files of one directory into files, its subdirectories into dirs
+static int walk_read_dir(const WalkEntry *dir, unsigned char *buf,
+                         WalkVec *files, WalkVec *dirs) {
+  int fd = openat(AT_FDCWD, dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "No se pudo abrir el directorio: %s\n", dir->path);
+    return -1;
+  }
+  int status = 0;
+  long n;
+  while (status == 0 &&
+         (n = syscall(SYS_getdents64, fd, buf, WALK_DENTS)) > 0) {
+    for (long pos = 0; status == 0 && pos < n;) {
+      const WalkDirent *ent = (const WalkDirent *)(buf + pos);
+      pos += ent->d_reclen;
+      const char *name = ent->d_name;
+      if (name[0] == '.' &&
+          (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        continue;
+      unsigned char type = walk_type(fd, ent);
+      if (type != DT_REG && type != DT_DIR)
+        continue; // links, devices, fifos and sockets are not archived
+      char *path = walk_join(dir->path, name);
+      if (path == NULL ||
+          walk_push(type == DT_REG ? files : dirs, path, dir->root) != 0) {
+        free(path);
+        fprintf(stderr, "Error allocating directory listing.\n");
+        status = -1;
+      }
+    }
+  }
+  if (status == 0 && n < 0) {
+    fprintf(stderr, "Error reading directory %s: %s\n", dir->path,
+            strerror(errno));
+    status = -1;
+  }
+  close(fd);
+  return status;
+}
+
+static void *walk_thread(void *arg) {
+  Walker *w = arg;
+  unsigned char *buf = malloc(WALK_DENTS);
+  WalkVec files = {0}, dirs = {0};
+  pthread_mutex_lock(&w->lock);
+  if (buf == NULL)
+    w->error = 1;
+  for (;;) {
+    while (w->pending.count == 0 && w->busy > 0 && !w->error)
+      pthread_cond_wait(&w->more, &w->lock);
+    if (w->pending.count == 0 || w->error)
+      break;
+    WalkEntry dir = w->pending.items[--w->pending.count];
+    ++w->busy;
+    pthread_mutex_unlock(&w->lock);
+
+    int status = walk_read_dir(&dir, buf, &files, &dirs);
+    free(dir.path);
+
+    pthread_mutex_lock(&w->lock);
+    for (size_t i = 0; status == 0 && i < files.count; ++i) {
+      status = walk_push(&w->files, files.items[i].path, files.items[i].root);
+      if (status == 0)
+        files.items[i].path = NULL;
+    }
+    for (size_t i = 0; status == 0 && i < dirs.count; ++i) {
+      status = walk_push(&w->pending, dirs.items[i].path, dirs.items[i].root);
+      if (status == 0)
+        dirs.items[i].path = NULL;
+    }
+    walk_vec_free(&files);
+    walk_vec_free(&dirs);
+    if (status != 0)
+      w->error = 1;
+    --w->busy;
+    // new work, an error or the end: sleeping threads must look again
+    pthread_cond_broadcast(&w->more);
+  }
+  pthread_cond_broadcast(&w->more);
+  pthread_mutex_unlock(&w->lock);
+  free(buf);
+  return NULL;
+}
+
+/*
+ * Component by component; where two paths part, a file of that directory
+ * goes before a subdirectory, otherwise names compare as bytes
+ */
+static int walk_compare(const void *pa, const void *pb) {
+  const WalkEntry *a = pa, *b = pb;
+  if (a->root != b->root)
+    return a->root < b->root ? -1 : 1;
+  const char *x = a->path, *y = b->path;
+  for (;;) {
+    size_t lx = strcspn(x, "/"), ly = strcspn(y, "/");
+    int dx = x[lx] == '/', dy = y[ly] == '/';
+    if (lx != ly || memcmp(x, y, lx) != 0 || dx != dy) {
+      if (dx != dy)
+        return dx - dy;
+      int c = memcmp(x, y, lx < ly ? lx : ly);
+      return c != 0 ? c : (lx > ly) - (lx < ly);
+    }
+    if (!dx)
+      return 0;
+    x += lx + 1;
+    y += ly + 1;
+  }
+}
+
+static int walk_threads(int threads) {
+  if (threads > 0)
+    return threads;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  return cpus < 1 ? 1 : cpus > WALK_MAX_THREADS ? WALK_MAX_THREADS : cpus;
+}
+
+int walk_paths(char *const *paths, int count, int threads, WalkList *list) {
+  *list = (WalkList){0};
+  Walker w = {.lock = PTHREAD_MUTEX_INITIALIZER,
+              .more = PTHREAD_COND_INITIALIZER};
+  for (int i = 0; i < count && !w.error; ++i) {
+    struct stat st;
+    char *path = strdup(paths[i]);
+    if (path != NULL && stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+      // "dir/" and "dir" give the same names
+      for (size_t len = strlen(path); len > 1 && path[len - 1] == '/';)
+        path[--len] = '\0';
+      w.error = walk_push(&w.pending, path, i) != 0;
+    } else {
+      // files and anything else go to the coder untouched
+      w.error = path == NULL || walk_push(&w.files, path, i) != 0;
+    }
+    if (w.error)
+      free(path);
+  }
+  int n = w.pending.count == 0 ? 0 : walk_threads(threads);
+  pthread_t tids[WALK_MAX_THREADS];
+  int started = 0;
+  while (!w.error && started < n && started < WALK_MAX_THREADS &&
+         pthread_create(&tids[started], NULL, walk_thread, &w) == 0)
+    ++started;
+  if (started == 0 && w.pending.count > 0)
+    w.error = 1;
+  for (int t = 0; t < started; ++t)
+    pthread_join(tids[t], NULL);
+  walk_vec_free(&w.pending);
+  if (w.error) {
+    fprintf(stderr, "Error walking the input directories.\n");
+    walk_vec_free(&w.files);
+    return -1;
+  }
+  qsort(w.files.items, w.files.count, sizeof(WalkEntry), walk_compare);
+  list->paths = malloc((w.files.count ? w.files.count : 1) * sizeof(char *));
+  if (list->paths == NULL) {
+    fprintf(stderr, "Error allocating directory listing.\n");
+    walk_vec_free(&w.files);
+    return -1;
+  }
+  for (size_t i = 0; i < w.files.count; ++i)
+    list->paths[i] = w.files.items[i].path;
+  list->count = list->cap = w.files.count;
+  free(w.files.items);
+  return 0;
+}
+
+void walk_list_free(WalkList *list) {
+  for (size_t i = 0; i < list->count; ++i)
+    free(list->paths[i]);
+  free(list->paths);
+  *list = (WalkList){0};
+}
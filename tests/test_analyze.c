@@ -0,0 +1,101 @@
+#include "test_framework.h"
+#include "../include/analyze.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+static const char* test_file = "test_analyze.bin";
+
+static void write_file(const unsigned char* buf, size_t n) {
+    FILE* f = fopen(test_file, "wb");
+    fwrite(buf, 1, n, f);
+    fclose(f);
+}
+
+void test_analyze_text() {
+    const char* text = "it was the best of times, it was the worst of times. ";
+    size_t n = 200000;
+    unsigned char* buf = malloc(n);
+    for (size_t i = 0; i < n; i++) buf[i] = text[i % strlen(text)];
+    write_file(buf, n);
+
+    Analysis an;
+    ASSERT_EQ(0, analyze_file((char*)test_file, &an), "Text should be analyzed");
+    ASSERT_EQ(n, an.size, "Size should be counted");
+    ASSERT_TRUE(an.entropy > 3.0 && an.entropy < 4.5, "Text entropy should be about 4 bits");
+    // Huffman codes stay within one bit of the entropy
+    ASSERT_TRUE(an.bits_per_byte >= an.entropy && an.bits_per_byte < an.entropy + 1,
+                "Static code should be within a bit of the entropy");
+    ASSERT_TRUE(an.entropy1 < an.entropy, "Text should depend on the byte before");
+    int counted = 0;
+    for (int len = 0; len < ALPHABET_SIZE; len++) counted += an.depths[len];
+    ASSERT_EQ(an.symbols, counted, "Every used byte should have a code length");
+    ASSERT_TRUE(an.depths[an.max_depth] > 0, "Max depth should be in the distribution");
+    ASSERT_TRUE(an.tree_bytes > 0 && an.static_bytes < n, "Static should pay off");
+    ASSERT_STR_EQ("order1", analyze_best(&an), "Repeated text should pick order1");
+    free(buf);
+    remove(test_file);
+}
+
+void test_analyze_noise() {
+    size_t n = 100000;
+    unsigned char* buf = test_noise_data(n, 4242);
+    write_file(buf, n);
+
+    Analysis an;
+    ASSERT_EQ(0, analyze_file((char*)test_file, &an), "Noise should be analyzed");
+    ASSERT_TRUE(an.entropy > 7.9, "Noise should be near 8 bits/byte");
+    ASSERT_STR_EQ("stored", analyze_best(&an), "Noise should not be worth coding");
+    free(buf);
+    remove(test_file);
+}
+
+void test_analyze_blocks() {
+    // two halves with different bytes: one table per block wins over one tree
+    size_t n = 2 * ANALYZE_BLOCK;
+    unsigned char* buf = malloc(n);
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = (i < ANALYZE_BLOCK ? 'a' : 'A') + (i * 7 / 3) % 13;
+    }
+    write_file(buf, n);
+
+    Analysis an;
+    ASSERT_EQ(0, analyze_file((char*)test_file, &an), "Blocks should be analyzed");
+    ASSERT_TRUE(an.blocked_bytes < an.static_bytes,
+                "Per block tables should beat one tree here");
+    free(buf);
+    remove(test_file);
+}
+
+void test_analyze_edge_cases() {
+    Analysis an;
+    write_file((const unsigned char*)"", 0);
+    ASSERT_EQ(0, analyze_file((char*)test_file, &an), "Empty file should be analyzed");
+    ASSERT_EQ(0, an.size, "Empty file has no bytes");
+    ASSERT_STR_EQ("stored", analyze_best(&an), "Nothing to gain on an empty file");
+
+    unsigned char same[5000];
+    memset(same, 'z', sizeof(same));
+    write_file(same, sizeof(same));
+    ASSERT_EQ(0, analyze_file((char*)test_file, &an), "One byte value should be analyzed");
+    ASSERT_EQ(1, an.symbols, "Only one distinct byte");
+    ASSERT_TRUE(an.entropy == 0, "A single value has no entropy");
+    remove(test_file);
+
+    ASSERT_NEQ(0, analyze_file("no_such_file.bin", &an), "Missing file should fail");
+}
+
+int main() {
+    init_tests();
+
+    printf(COLOR_YELLOW "Testing Analyze Module" COLOR_RESET "\n");
+    printf("========================================\n");
+
+    RUN_TEST(test_analyze_text);
+    RUN_TEST(test_analyze_noise);
+    RUN_TEST(test_analyze_blocks);
+    RUN_TEST(test_analyze_edge_cases);
+
+    TEST_SUMMARY();
+}
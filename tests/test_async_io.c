@@ -0,0 +1,258 @@
+#include "test_framework.h"
+#include "../include/async_io.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char* test_file = "test_async_io.bin";
+
+// Not a multiple of AIO_CHUNK, so the last chunk is short
+static unsigned char* make_data(size_t n) {
+    unsigned char* buf = malloc(n);
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = (unsigned char)(i * 131 + (i >> 12));
+    }
+    return buf;
+}
+
+// Write data with an AioFile writer in uneven pieces, read it back with
+// aio_reader_next and compare
+static int roundtrip(const unsigned char* data, size_t n) {
+    int fd = open(test_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    AioFile writer;
+    if (fd < 0 || aio_writer_init(&writer, fd) != 0) {
+        return 0;
+    }
+    int ok = 1;
+    for (size_t i = 0; i < n; i += 1000) {
+        ok = ok && aio_write(&writer, data + i, n - i < 1000 ? n - i : 1000) == 0;
+    }
+    ok = aio_close(&writer) == 0 && ok && writer.offset == (off_t)n;
+    close(fd);
+
+    fd = open(test_file, O_RDONLY);
+    AioFile reader;
+    if (fd < 0 || aio_reader_init(&reader, fd) != 0) {
+        return 0;
+    }
+    size_t pos = 0;
+    unsigned char* chunk;
+    ssize_t r;
+    while ((r = aio_reader_next(&reader, &chunk)) > 0) {
+        ok = ok && pos + r <= n && memcmp(data + pos, chunk, r) == 0;
+        // chunks stay whole so filters see full groups
+        ok = ok && ((size_t)r == aio_chunk_size() || pos + r == n);
+        pos += r;
+    }
+    ok = aio_close(&reader) == 0 && ok && r == 0 && pos == n;
+    close(fd);
+    return ok;
+}
+
+void test_aio_roundtrip_backends() {
+    size_t n = 5 * AIO_CHUNK + 12345;
+    unsigned char* data = make_data(n);
+
+    aio_set_backend(AIO_BACKEND_AUTO);
+    printf("  io_uring available: %s\n", aio_uring_available() ? "yes" : "no");
+    ASSERT_TRUE(roundtrip(data, n), "Default backend should roundtrip");
+
+    aio_set_backend(AIO_BACKEND_SYNC);
+    ASSERT_FALSE(aio_uring_available(), "Sync backend should not use io_uring");
+    ASSERT_TRUE(roundtrip(data, n), "Sync backend should roundtrip");
+    aio_set_backend(AIO_BACKEND_AUTO);
+
+    free(data);
+    remove(test_file);
+}
+
+void test_aio_empty_and_exact() {
+    unsigned char* data = make_data(2 * AIO_CHUNK);
+    ASSERT_TRUE(roundtrip(data, 0), "Empty file should roundtrip");
+    ASSERT_TRUE(roundtrip(data, AIO_CHUNK), "One exact chunk should roundtrip");
+    ASSERT_TRUE(roundtrip(data, 2 * AIO_CHUNK), "Two exact chunks should roundtrip");
+    free(data);
+    remove(test_file);
+}
+
+void test_aio_small_streams() {
+    size_t n = 3 * AIO_MIN_CHUNK + 5;
+    unsigned char* data = make_data(n);
+    int fd = open(test_file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    AioFile writer;
+    ASSERT_EQ(0, aio_writer_init_size(&writer, fd, NULL, 0, 100),
+              "Small writer should start");
+    ASSERT_TRUE(writer.ring == NULL && writer.chunk_size == AIO_MIN_CHUNK,
+                "A small writer should not set up a ring or big buffers");
+    // more than announced still arrives, in small requests
+    ASSERT_EQ(0, aio_write(&writer, data, n), "Writing should work");
+    ASSERT_EQ(0, aio_close(&writer), "Closing should work");
+    ASSERT_EQ((long)n, (long)writer.offset, "Every byte should be written");
+
+    lseek(fd, 0, SEEK_SET);
+    AioFile reader;
+    ASSERT_EQ(0, aio_reader_init(&reader, fd), "Reader should start");
+    ASSERT_TRUE(reader.ring == NULL && reader.chunk_size == 4 * AIO_MIN_CHUNK,
+                "A file of one chunk should be read without a ring");
+    unsigned char* back = malloc(n);
+    ASSERT_EQ((long)n, (long)aio_read(&reader, back, n),
+              "Reading should get every byte");
+    ASSERT_TRUE(memcmp(data, back, n) == 0, "Bytes should match");
+    ASSERT_EQ(0, aio_close(&reader), "Closing should work");
+    close(fd);
+    free(back);
+    free(data);
+    remove(test_file);
+}
+
+void test_aio_read_copies() {
+    size_t n = 3 * AIO_CHUNK + 77;
+    unsigned char* data = make_data(n);
+    FILE* f = fopen(test_file, "wb");
+    fwrite(data, 1, n, f);
+    fclose(f);
+
+    int fd = open(test_file, O_RDONLY);
+    AioFile reader;
+    ASSERT_EQ(0, aio_reader_init(&reader, fd), "Reader should start");
+    unsigned char* out = malloc(n);
+    size_t got = 0, r;
+    // block sizes that do not line up with chunks
+    while ((r = aio_read(&reader, out + got, n - got < 100000 ? n - got : 100000)) > 0) {
+        got += r;
+    }
+    ASSERT_EQ(n, got, "aio_read should return every byte");
+    ASSERT_TRUE(memcmp(data, out, n) == 0, "aio_read should keep the order");
+    ASSERT_EQ(0, aio_close(&reader), "Reader should close cleanly");
+    close(fd);
+
+    free(out);
+    free(data);
+    remove(test_file);
+}
+
+void test_aio_pipe() {
+    // pipes are not seekable: plain read/write, short reads are fine
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds), "Should create a pipe");
+    AioFile writer, reader;
+    ASSERT_EQ(0, aio_writer_init(&writer, fds[1]), "Pipe writer should start");
+    ASSERT_FALSE(writer.seekable, "Pipe should not be seekable");
+    ASSERT_EQ(0, aio_write(&writer, "hello pipe", 10), "Should queue bytes");
+    ASSERT_EQ(0, aio_close(&writer), "Should write to the pipe");
+    close(fds[1]);
+
+    ASSERT_EQ(0, aio_reader_init(&reader, fds[0]), "Pipe reader should start");
+    char buf[32];
+    size_t got = aio_read(&reader, buf, sizeof(buf));
+    ASSERT_EQ(10, got, "Should read what was written");
+    ASSERT_TRUE(memcmp(buf, "hello pipe", 10) == 0, "Pipe content should match");
+    ASSERT_EQ(0, aio_close(&reader), "Pipe reader should close");
+    close(fds[0]);
+}
+
+void test_aio_chunk_sizes() {
+    size_t n = 3 * AIO_CHUNK + 999;
+    unsigned char* data = make_data(n);
+    ASSERT_EQ(-1, aio_set_chunk_size(3000), "Sizes below 4K should be refused");
+    ASSERT_EQ(-1, aio_set_chunk_size(3 * 4096), "Sizes must be powers of two");
+    ASSERT_EQ(AIO_CHUNK, aio_chunk_size(), "A refused size keeps the old one");
+
+    const size_t sizes[] = {AIO_MIN_CHUNK, 1 << 20, AIO_MAX_CHUNK};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        ASSERT_EQ(0, aio_set_chunk_size(sizes[i]), "Power of two should be taken");
+        ASSERT_TRUE(roundtrip(data, n), "Roundtrip should work with any chunk size");
+    }
+    ASSERT_EQ(0, aio_set_chunk_size(AIO_CHUNK), "Should restore the default");
+    free(data);
+    remove(test_file);
+}
+
+void test_aio_direct() {
+    size_t n = 4 * AIO_CHUNK + 4321;
+    unsigned char* data = make_data(n);
+    aio_set_direct(1);
+    ASSERT_TRUE(roundtrip(data, n), "Direct mode should roundtrip");
+
+    // a writer starting off alignment, as after an archive header
+    int fd = open(test_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ASSERT_EQ(3, write(fd, "hdr", 3), "Should write a header");
+    AioFile writer;
+    ASSERT_EQ(0, aio_writer_init(&writer, fd), "Writer should start");
+    printf("  O_DIRECT here: %s\n", writer.direct_fd >= 0 ? "yes" : "no");
+    ASSERT_EQ(0, aio_write(&writer, data, n), "Should queue the bytes");
+    ASSERT_EQ(0, aio_close(&writer), "Should write every chunk");
+    close(fd);
+    aio_set_direct(0);
+
+    unsigned char* back = malloc(n + 3);
+    FILE* f = fopen(test_file, "rb");
+    ASSERT_EQ(n + 3, fread(back, 1, n + 3, f), "File should hold header and data");
+    fclose(f);
+    ASSERT_TRUE(memcmp(back, "hdr", 3) == 0 && memcmp(back + 3, data, n) == 0,
+                "Unaligned edges and direct chunks should line up");
+    free(back);
+    free(data);
+    remove(test_file);
+}
+
+void test_aio_holes_big_chunks() {
+    // a hole in the middle of what would be one 1 MB request
+    size_t n = 4 * AIO_CHUNK + 100;
+    unsigned char* data = make_data(n);
+    AioHole hole = {AIO_CHUNK, 2 * AIO_CHUNK};
+    ASSERT_EQ(0, aio_set_chunk_size(1 << 20), "Should take 1 MB");
+
+    int fd = open(test_file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    AioFile writer;
+    ASSERT_EQ(0, aio_writer_init_holes(&writer, fd, &hole, 1), "Writer should start");
+    size_t data_len = n - hole.len;
+    ASSERT_EQ(0, aio_write(&writer, data, data_len), "Should queue the bytes");
+    ASSERT_EQ(0, aio_close(&writer), "Should write around the hole");
+    ASSERT_EQ((off_t)n, writer.offset, "Writer should end past the hole");
+
+    ASSERT_EQ(0, lseek(fd, 0, SEEK_SET), "Should rewind");
+    AioFile reader;
+    ASSERT_EQ(0, aio_reader_init_holes(&reader, fd, &hole, 1), "Reader should start");
+    unsigned char* back = malloc(n);
+    ASSERT_EQ(data_len, aio_read(&reader, back, n), "Reader should skip the hole");
+    ASSERT_TRUE(memcmp(back, data, data_len) == 0, "Data around the hole should match");
+    ASSERT_EQ(0, aio_close(&reader), "Reader should close");
+
+    ASSERT_EQ(AIO_CHUNK, pread(fd, back, AIO_CHUNK, AIO_CHUNK + 5),
+              "Hole should read back");
+    int zeros = 1;
+    for (size_t i = 0; i < AIO_CHUNK; i++) {
+        if (back[i] != 0) zeros = 0;
+    }
+    ASSERT_TRUE(zeros, "Nothing should be written into the hole");
+    ASSERT_EQ(100, pread(fd, back, 100, 3 * AIO_CHUNK),
+              "Data after the hole should read back");
+    ASSERT_TRUE(memcmp(back, data + AIO_CHUNK, 100) == 0,
+                "Data after the hole should continue the stream");
+    close(fd);
+    ASSERT_EQ(0, aio_set_chunk_size(AIO_CHUNK), "Should restore the default");
+    free(back);
+    free(data);
+    remove(test_file);
+}
+
+int main() {
+    init_tests();
+
+    printf(COLOR_YELLOW "Testing Async IO Module" COLOR_RESET "\n");
+    printf("========================================\n");
+
+    RUN_TEST(test_aio_roundtrip_backends);
+    RUN_TEST(test_aio_empty_and_exact);
+    RUN_TEST(test_aio_small_streams);
+    RUN_TEST(test_aio_read_copies);
+    RUN_TEST(test_aio_pipe);
+    RUN_TEST(test_aio_chunk_sizes);
+    RUN_TEST(test_aio_direct);
+    RUN_TEST(test_aio_holes_big_chunks);
+
+    TEST_SUMMARY();
+}
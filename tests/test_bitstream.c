@@ -0,0 +1,85 @@
+#include "test_framework.h"
+#include "../include/bitstream.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+void test_bs_write_read_roundtrip() {
+    BitWriter bw;
+    bs_writer_init(&bw);
+
+    // Mix of widths, including values wider than a byte
+    bs_write_bits(&bw, 1, 1);
+    bs_write_bits(&bw, 5, 3);
+    bs_write_bits(&bw, 0xABC, 12);
+    bs_write_bits(&bw, 0xDEADBEEF, 32);
+    size_t size = bs_flush(&bw);
+
+    ASSERT_FALSE(bw.error, "Writer should not report errors");
+    ASSERT_EQ(6, (int)size, "48 bits should take 6 bytes");
+
+    BitReader br;
+    bs_reader_init(&br, bw.buf, size);
+    ASSERT_EQ(1, (int)bs_read_bits(&br, 1), "Should read back 1-bit value");
+    ASSERT_EQ(5, (int)bs_read_bits(&br, 3), "Should read back 3-bit value");
+    ASSERT_EQ(0xABC, (int)bs_read_bits(&br, 12), "Should read back 12-bit value");
+    ASSERT_TRUE(bs_read_bits(&br, 32) == 0xDEADBEEF, "Should read back 32-bit value");
+    ASSERT_FALSE(br.overrun, "Reader should not overrun");
+
+    bs_writer_free(&bw);
+}
+
+void test_bs_msb_first_layout() {
+    BitWriter bw;
+    bs_writer_init(&bw);
+
+    // First bit goes to bit 7, same as the archive bit order
+    bs_write_bits(&bw, 1, 1);
+    bs_write_bits(&bw, 0, 1);
+    bs_write_bits(&bw, 1, 1);
+    size_t size = bs_flush(&bw);
+
+    ASSERT_EQ(1, (int)size, "Three bits should be padded to one byte");
+    ASSERT_EQ(0xA0, (int)bw.buf[0], "Bits should be packed MSB first");
+
+    bs_writer_free(&bw);
+}
+
+void test_bs_reader_overrun() {
+    unsigned char data[1] = {0xFF};
+    BitReader br;
+    bs_reader_init(&br, data, 1);
+
+    ASSERT_EQ(0xFF, (int)bs_read_bits(&br, 8), "Should read the only byte");
+    ASSERT_FALSE(br.overrun, "No overrun after reading available data");
+    ASSERT_EQ(0, bs_read_bit(&br), "Reading past the end yields zero bits");
+    ASSERT_TRUE(br.overrun, "Overrun flag should be set");
+}
+
+void test_bs_writer_reset() {
+    BitWriter bw;
+    bs_writer_init(&bw);
+
+    bs_write_bits(&bw, 0xFF, 8);
+    bs_writer_reset(&bw);
+    bs_write_bits(&bw, 0x0F, 8);
+    size_t size = bs_flush(&bw);
+
+    ASSERT_EQ(1, (int)size, "Reset should drop previous content");
+    ASSERT_EQ(0x0F, (int)bw.buf[0], "Only the new byte should remain");
+
+    bs_writer_free(&bw);
+}
+
+int main() {
+    init_tests();
+
+    printf(COLOR_YELLOW "Testing Bitstream Module" COLOR_RESET "\n");
+    printf("========================================\n");
+
+    RUN_TEST(test_bs_write_read_roundtrip);
+    RUN_TEST(test_bs_msb_first_layout);
+    RUN_TEST(test_bs_reader_overrun);
+    RUN_TEST(test_bs_writer_reset);
+
+    TEST_SUMMARY();
+}
@@ -0,0 +1,118 @@
+#include "test_framework.h"
+#include "../include/bwt.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+void test_bwt_known_transform() {
+    BwtCoder* coder = bwt_new();
+    ASSERT_NOT_NULL(coder, "Coder should be allocated");
+
+    const unsigned char* text = (const unsigned char*)"banana";
+    unsigned char last[6];
+    uint32_t primary = bwt_forward(coder, text, 6, last);
+
+    // rotations sorted: abanan anaban ananab banana nabana nanaba
+    ASSERT_TRUE(memcmp(last, "nnbaaa", 6) == 0, "Last column should be nnbaaa");
+    ASSERT_EQ(3, (int)primary, "Original row should be 3");
+
+    unsigned char back[6];
+    bwt_inverse(coder, last, 6, primary, back);
+    ASSERT_TRUE(memcmp(back, text, 6) == 0, "Inverse should restore banana");
+
+    bwt_free(coder);
+}
+
+// Encode and decode one block, returns the encoded size or 0 on failure
+static size_t block_roundtrip(BwtCoder* coder, const unsigned char* buf, size_t n) {
+    BitWriter bw;
+    bs_writer_init(&bw);
+    size_t size = 0;
+    if (bwt_encode_block(coder, buf, n, &bw) == 0) {
+        size = bs_flush(&bw);
+        unsigned char* out = malloc(n);
+        BitReader br;
+        bs_reader_init(&br, bw.buf, size);
+        if (bwt_decode_block(coder, &br, out, n) != 0 || memcmp(out, buf, n) != 0) {
+            size = 0;
+        }
+        free(out);
+    }
+    bs_writer_free(&bw);
+    return size;
+}
+
+void test_bwt_block_roundtrip() {
+    BwtCoder* coder = bwt_new();
+    const char* text = "she sells sea shells by the sea shore. ";
+    size_t n = 100 * strlen(text);
+    unsigned char* buf = malloc(n);
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = text[i % strlen(text)];
+    }
+
+    size_t size = block_roundtrip(coder, buf, n);
+    ASSERT_TRUE(size > 0, "Text block should roundtrip");
+    ASSERT_TRUE(size < n / 20, "Repeated text should compress far below order-0");
+
+    free(buf);
+    bwt_free(coder);
+}
+
+void test_bwt_edge_blocks() {
+    BwtCoder* coder = bwt_new();
+
+    unsigned char one[1] = {'x'};
+    ASSERT_TRUE(block_roundtrip(coder, one, 1) > 0, "Single byte block should roundtrip");
+
+    // periodic data has identical rotations
+    unsigned char same[5000];
+    memset(same, 'a', sizeof(same));
+    ASSERT_TRUE(block_roundtrip(coder, same, sizeof(same)) > 0,
+                "Constant block should roundtrip");
+
+    unsigned char noise[4096];
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < sizeof(noise); i++) noise[i] = test_rand(&seed);
+    ASSERT_TRUE(block_roundtrip(coder, noise, sizeof(noise)) > 0,
+                "Random block should roundtrip");
+
+    bwt_free(coder);
+}
+
+void test_bwt_rejects_corrupt_block() {
+    BwtCoder* coder = bwt_new();
+    unsigned char buf[1000];
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = (unsigned char)("abcab"[i % 5]);
+    }
+    BitWriter bw;
+    bs_writer_init(&bw);
+    ASSERT_EQ(0, bwt_encode_block(coder, buf, sizeof(buf), &bw), "Should encode");
+    size_t size = bs_flush(&bw);
+
+    // primary index out of range
+    bw.buf[0] = 0xFF;
+    unsigned char out[1000];
+    BitReader br;
+    bs_reader_init(&br, bw.buf, size);
+    ASSERT_NEQ(0, bwt_decode_block(coder, &br, out, sizeof(out)),
+               "Corrupt header should be rejected");
+
+    bs_writer_free(&bw);
+    bwt_free(coder);
+}
+
+int main() {
+    init_tests();
+
+    printf(COLOR_YELLOW "Testing Block Sorting Module" COLOR_RESET "\n");
+    printf("========================================\n");
+
+    RUN_TEST(test_bwt_known_transform);
+    RUN_TEST(test_bwt_block_roundtrip);
+    RUN_TEST(test_bwt_edge_blocks);
+    RUN_TEST(test_bwt_rejects_corrupt_block);
+
+    TEST_SUMMARY();
+}
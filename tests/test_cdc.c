@@ -0,0 +1,102 @@
+#include "test_framework.h"
+#include "../include/cdc.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+// Cut offsets of buf into cuts, returns how many
+static size_t cut_all(const unsigned char* buf, size_t n, size_t* cuts) {
+    size_t count = 0;
+    for (size_t pos = 0; pos < n;) {
+        size_t avail = n - pos < CDC_MAX ? n - pos : CDC_MAX;
+        pos += cdc_cut(buf + pos, avail);
+        cuts[count++] = pos;
+    }
+    return count;
+}
+
+void test_cdc_limits() {
+    size_t n = 4 << 20;
+    unsigned char* buf = test_noise_data(n, 5);
+    size_t* cuts = malloc((n / CDC_MIN + 1) * sizeof(size_t));
+    size_t count = cut_all(buf, n, cuts);
+    int in_range = 1;
+    for (size_t i = 0; i + 1 < count; i++) {
+        size_t len = cuts[i] - (i > 0 ? cuts[i - 1] : 0);
+        if (len < CDC_MIN || len > CDC_MAX) in_range = 0;
+    }
+    ASSERT_TRUE(in_range, "Chunks should stay between CDC_MIN and CDC_MAX");
+    ASSERT_TRUE(count > n / (4 << CDC_AVG_BITS) && count < n / CDC_MIN,
+                "Chunks should average about 8 KB");
+    ASSERT_EQ(100, (int)cdc_cut(buf, 100), "A short tail is one chunk");
+
+    memset(buf, 0, CDC_MAX * 2);
+    ASSERT_EQ(CDC_MAX, (int)cdc_cut(buf, CDC_MAX * 2),
+              "Data without cuts should end at CDC_MAX");
+    free(cuts);
+    free(buf);
+}
+
+void test_cdc_insert_shift() {
+    // the same data after 100 inserted bytes is cut at the same places
+    size_t n = 2 << 20, shift = 100;
+    unsigned char* buf = test_noise_data(n + shift, 9);
+    size_t* a = malloc((n / CDC_MIN + 2) * sizeof(size_t));
+    size_t* b = malloc((n / CDC_MIN + 2) * sizeof(size_t));
+    size_t count_a = cut_all(buf + shift, n, a);
+    size_t count_b = cut_all(buf, n + shift, b);
+    size_t found = 0;
+    for (size_t i = 0, j = 0; i < count_a && j < count_b;) {
+        if (a[i] + shift == b[j]) found++, i++, j++;
+        else if (a[i] + shift < b[j]) i++;
+        else j++;
+    }
+    ASSERT_TRUE(found + 2 >= count_a, "Cuts after an insertion should come back");
+    free(a);
+    free(b);
+    free(buf);
+}
+
+void test_cdc_index() {
+    CdcIndex index;
+    ASSERT_EQ(0, cdc_index_init(&index, 1), "Index should be created");
+    int ok = 1;
+    for (uint32_t i = 0; i < 5000; i++) {
+        CdcChunk chunk = {hash128(&i, sizeof(i), 0), i * 10ull, 100 + i % 7,
+                          0, i % 3};
+        if (cdc_index_add(&index, &chunk) != i) ok = 0;
+    }
+    ASSERT_TRUE(ok, "Ids should follow the order chunks are added");
+    for (uint32_t i = 0; i < 5000; i += 7) {
+        if (cdc_index_find(&index, hash128(&i, sizeof(i), 0), 100 + i % 7) != i)
+            ok = 0;
+    }
+    ASSERT_TRUE(ok, "Every chunk should be found after the table grows");
+    uint32_t key = 42;
+    ASSERT_EQ(-1, (int)cdc_index_find(&index, hash128(&key, sizeof(key), 0), 1),
+              "Another length is another chunk");
+    key = 9999;
+    ASSERT_EQ(-1, (int)cdc_index_find(&index, hash128(&key, sizeof(key), 0),
+                                      100 + key % 7),
+              "Unknown hash should not be found");
+    cdc_index_free(&index);
+
+    ASSERT_EQ(0, cdc_index_init(&index, 0), "Decoder index should be created");
+    ASSERT_EQ(-1, (int)cdc_index_find(&index, hash128("x", 1, 0), 1),
+              "Decoder index has no lookups");
+    cdc_index_free(&index);
+}
+
+int main() {
+    init_tests();
+
+    printf(COLOR_YELLOW "Testing Chunking Module" COLOR_RESET "\n");
+    printf("========================================\n");
+
+    RUN_TEST(test_cdc_limits);
+    RUN_TEST(test_cdc_insert_shift);
+    RUN_TEST(test_cdc_index);
+
+    TEST_SUMMARY();
+}
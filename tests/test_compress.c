@@ -1,8 +1,12 @@
 #include "test_framework.h"
 #include "../include/compress.h"
+#include "../include/io_tool.h"
+#include "../include/async_io.h"
+#include "../include/walk.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <sys/stat.h>
 
@@ -275,6 +279,819 @@ void test_decompress_invalid_file() {
     cleanup_test_file(invalid_file);
 }
 
+// Compress input_file with the given method and check it decodes back
+static void check_method_roundtrip(unsigned char method, const char* input_file,
+                                   const char* compressed_file) {
+    size_t original_size = get_file_size(input_file);
+
+    char* argv[] = {"program", (char*)input_file, (char*)compressed_file};
+    int argc = 3;
+    CompressOptions options;
+    compress_default_options(&options);
+    options.method = method;
+
+    FILE* comp_file = fopen(compressed_file, "wb");
+    char result = compress_encode_files_opt(comp_file, argc, argv, &options);
+    fclose(comp_file);
+    ASSERT_EQ(0, result, "Compression should succeed");
+    ASSERT_TRUE(get_file_size(compressed_file) < original_size,
+                "Archive should be smaller than the input");
+
+    rename(input_file, "test_method.orig");
+    FILE* decomp_file = fopen(compressed_file, "rb");
+    int decomp_result = decompress_file(decomp_file);
+    fclose(decomp_file);
+
+    ASSERT_EQ(0, decomp_result, "Decompression should succeed");
+    ASSERT_TRUE(compare_files("test_method.orig", input_file),
+                "Roundtrip should restore the original content");
+
+    cleanup_test_file(input_file);
+    cleanup_test_file("test_method.orig");
+    cleanup_test_file(compressed_file);
+}
+
+void test_adaptive_roundtrip() {
+    // Larger than one adaptive block so the tree gets rebuilt
+    FILE* f = fopen("test_adaptive.txt", "wb");
+    for (int i = 0; i < 10000; i++) {
+        fputc("adaptive huffman "[i % 17], f);
+    }
+    fclose(f);
+    check_method_roundtrip(IO_METHOD_ADAPTIVE, "test_adaptive.txt",
+                           "test_adaptive.cprs");
+}
+
+void test_order1_roundtrip() {
+    FILE* f = fopen("test_order1.txt", "wb");
+    for (int i = 0; i < 5000; i++) {
+        fprintf(f, "key%d=value%d;\n", i % 50, i % 7);
+    }
+    fclose(f);
+    check_method_roundtrip(IO_METHOD_ORDER1, "test_order1.txt",
+                           "test_order1.cprs");
+}
+
+void test_bwt_roundtrip() {
+    FILE* f = fopen("test_bwt.txt", "wb");
+    for (int i = 0; i < 3000; i++) {
+        fprintf(f, "line %d: the quick brown fox\n", i % 40);
+    }
+    fclose(f);
+    check_method_roundtrip(IO_METHOD_BWT, "test_bwt.txt", "test_bwt.cprs");
+}
+
+void test_lz77_roundtrip() {
+    FILE* f = fopen("test_lz77.txt", "wb");
+    for (int i = 0; i < 3000; i++) {
+        fprintf(f, "2024-01-01 12:00:%02d INFO request %d served\n", i % 60, i % 9);
+    }
+    fclose(f);
+    check_method_roundtrip(IO_METHOD_LZ77, "test_lz77.txt", "test_lz77.cprs");
+}
+
+void test_filtered_roundtrip() {
+    // int32 ramp: the filter is chosen automatically for both paths
+    const unsigned char methods[] = {IO_METHOD_STATIC, IO_METHOD_LZ77};
+    for (size_t m = 0; m < sizeof(methods); m++) {
+        FILE* f = fopen("test_filter.bin", "wb");
+        for (int i = 0; i < 5000; i++) {
+            int32_t v = 70000 + i * 5;
+            fwrite(&v, sizeof(v), 1, f);
+        }
+        fputc(1, f); // partial sample at the end
+        fclose(f);
+        check_method_roundtrip(methods[m], "test_filter.bin",
+                               "test_filter.cprs");
+    }
+}
+
+// int32 ramp followed by text, so filters and every method see some work
+static void flip_byte(const char* filename, long from_end) {
+    FILE* file = fopen(filename, "r+b");
+    fseek(file, -from_end, SEEK_END);
+    int c = fgetc(file);
+    fseek(file, -from_end, SEEK_END);
+    fputc(c ^ 0x10, file);
+    fclose(file);
+}
+
+void test_verify_archive() {
+    const unsigned char methods[] = {IO_METHOD_STATIC, IO_METHOD_LZ77};
+    for (size_t m = 0; m < sizeof(methods); m++) {
+        FILE* input = fopen("test_verify.txt", "w");
+        for (int i = 0; i < 2000; i++) {
+            fprintf(input, "line %d of the verify test\n", i * 7);
+        }
+        fclose(input);
+        char* argv[] = {"program", "test_verify.txt", "test_verify.cprs"};
+        CompressOptions options;
+        compress_default_options(&options);
+        options.method = methods[m];
+        FILE* comp_file = fopen("test_verify.cprs", "wb");
+        ASSERT_EQ(0, compress_encode_files_opt(comp_file, 3, argv, &options),
+                  "Compression should succeed");
+        fclose(comp_file);
+        cleanup_test_file("test_verify.txt");
+
+        FILE* file = fopen("test_verify.cprs", "rb");
+        ASSERT_EQ(0, verify_file(file), "Intact archive should verify");
+        fclose(file);
+        ASSERT_TRUE(!file_exists("test_verify.txt"),
+                    "Verify mode should not write the members");
+
+        // a payload byte just before the trailing checksums
+        flip_byte("test_verify.cprs", 12);
+        file = fopen("test_verify.cprs", "rb");
+        ASSERT_EQ(-1, verify_file(file), "Damaged archive should fail to verify");
+        fclose(file);
+        ASSERT_TRUE(!file_exists("test_verify.txt"),
+                    "Verify mode should not write the members");
+        cleanup_test_file("test_verify.cprs");
+    }
+}
+
+void test_member_info() {
+    const unsigned char methods[] = {IO_METHOD_STATIC, IO_METHOD_ADAPTIVE,
+                                     IO_METHOD_LZ77};
+    create_test_file("test_info_a.txt", "listing reads only the member headers\n");
+    FILE* input = fopen("test_info_b.txt", "w");
+    for (int i = 0; i < 5000; i++) {
+        fprintf(input, "%d,", i % 97);
+    }
+    fclose(input);
+    size_t size_a = get_file_size("test_info_a.txt");
+    size_t size_b = get_file_size("test_info_b.txt");
+    for (size_t m = 0; m < sizeof(methods); m++) {
+        char* argv[] = {"program", "test_info_a.txt", "test_info_b.txt",
+                        "test_info.cprs"};
+        CompressOptions options;
+        compress_default_options(&options);
+        options.method = methods[m];
+        FILE* file = fopen("test_info.cprs", "wb");
+        ASSERT_EQ(0, compress_encode_files_opt(file, 4, argv, &options),
+                  "Compression should succeed");
+        fclose(file);
+
+        file = fopen("test_info.cprs", "rb");
+        ASSERT_EQ(methods[m], io_read_archive_header(file),
+                  "Archive header should name the method");
+        static IoHeader header;
+        io_header_init(&header);
+        uint64_t stored_a, stored_b;
+        ASSERT_EQ(0, io_read_member_info(file, methods[m], &header, &stored_a),
+                  "First member header should be read");
+        ASSERT_STR_EQ("test_info_a.txt", header.name,
+                      "First member name should be listed");
+        ASSERT_TRUE(header.size == size_a, "Original size should come from the header");
+        ASSERT_EQ(0, io_read_member_info(file, methods[m], &header, &stored_b),
+                  "Second member header should be read");
+        ASSERT_STR_EQ("test_info_b.txt", header.name,
+                      "Second name should be rebuilt from the shared prefix");
+        ASSERT_TRUE(header.size == size_b, "Original size should come from the header");
+        ASSERT_EQ(get_file_size("test_info.cprs") - IO_MAGIC_SIZE - 2,
+                  stored_a + stored_b,
+                  "Stored sizes should cover the whole archive");
+        ASSERT_TRUE(io_is_end_of_file(file), "Listing should end at the end");
+        rewind(file);
+        ASSERT_EQ(0, list_file(file), "list_file should succeed");
+        fclose(file);
+    }
+    cleanup_test_file("test_info_a.txt");
+    cleanup_test_file("test_info_b.txt");
+    cleanup_test_file("test_info.cprs");
+}
+
+static size_t compress_names(unsigned char method, int argc, char** argv) {
+    CompressOptions options;
+    compress_default_options(&options);
+    options.method = method;
+    FILE* file = fopen(argv[argc - 1], "wb");
+    ASSERT_EQ(0, compress_encode_files_opt(file, argc, argv, &options),
+              "Compression should succeed");
+    fclose(file);
+    return get_file_size(argv[argc - 1]);
+}
+
+void test_solid_roundtrip() {
+    // many tiny members, an empty one and one spanning several buffers
+    enum { TINY = 40 };
+    char names[TINY + 2][32];
+    char* argv[TINY + 4];
+    argv[0] = "program";
+    for (int i = 0; i < TINY; i++) {
+        snprintf(names[i], sizeof(names[i]), "test_solid_%02d.txt", i);
+        char content[64];
+        snprintf(content, sizeof(content), "tiny member %d, value %d\n", i, i * i);
+        create_test_file(names[i], content);
+        argv[i + 1] = names[i];
+    }
+    FILE* input = fopen("test_solid_big.txt", "w");
+    for (int i = 0; i < 60000; i++) {
+        fprintf(input, "%d;", i % 1013);
+    }
+    fclose(input);
+    strcpy(names[TINY], "test_solid_big.txt");
+    argv[TINY + 1] = names[TINY];
+    argv[TINY + 2] = "test_solid.cprs";
+    size_t static_size = compress_names(IO_METHOD_STATIC, TINY + 3, argv);
+
+    create_test_file("test_solid_empty.txt", "");
+    strcpy(names[TINY + 1], "test_solid_empty.txt");
+    argv[TINY + 2] = names[TINY + 1];
+    argv[TINY + 3] = "test_solid.cprs";
+    size_t solid_size = compress_names(IO_METHOD_SOLID, TINY + 4, argv);
+    ASSERT_TRUE(solid_size < static_size,
+                "One shared tree should beat a tree per member");
+
+    FILE* file = fopen("test_solid.cprs", "rb");
+    ASSERT_EQ(0, verify_file(file), "Solid archive should verify");
+    fclose(file);
+    for (int i = 0; i < TINY + 2; i++) {
+        char orig[48];
+        snprintf(orig, sizeof(orig), "%s.orig", names[i]);
+        rename(names[i], orig);
+    }
+    file = fopen("test_solid.cprs", "rb");
+    ASSERT_EQ(0, decompress_file(file), "Decompression should succeed");
+    fclose(file);
+    int same = 1;
+    for (int i = 0; i < TINY + 2; i++) {
+        char orig[48];
+        snprintf(orig, sizeof(orig), "%s.orig", names[i]);
+        if (!compare_files(orig, names[i])) same = 0;
+        cleanup_test_file(orig);
+        cleanup_test_file(names[i]);
+    }
+    ASSERT_TRUE(same, "Every member should come back unchanged");
+
+    flip_byte("test_solid.cprs", 200);
+    file = fopen("test_solid.cprs", "rb");
+    ASSERT_EQ(-1, verify_file(file), "Damaged solid archive should fail");
+    fclose(file);
+    cleanup_test_file("test_solid.cprs");
+}
+
+void test_sparse_roundtrip() {
+    // mostly holes: some text in the middle and a tail past a long hole
+    const off_t size = 64 * AIO_CHUNK + 123;
+    const unsigned char methods[] = {IO_METHOD_STATIC, IO_METHOD_LZ77,
+                                     IO_METHOD_DEDUP};
+    for (size_t m = 0; m < sizeof(methods); m++) {
+        FILE* input = fopen("test_sparse.img", "wb");
+        ASSERT_EQ(0, ftruncate(fileno(input), size), "Image should be sized");
+        fseeko(input, 5 * AIO_CHUNK + 7, SEEK_SET);
+        for (int i = 0; i < 3000; i++) {
+            fprintf(input, "sector %d\n", i);
+        }
+        fseeko(input, size - 50, SEEK_SET);
+        fputs("the end of the image, after the last hole", input);
+        fclose(input);
+
+        char* argv[] = {"program", "test_sparse.img", "test_sparse.cprs"};
+        CompressOptions options;
+        compress_default_options(&options);
+        options.method = methods[m];
+        FILE* comp_file = fopen("test_sparse.cprs", "wb");
+        ASSERT_EQ(0, compress_encode_files_opt(comp_file, 3, argv, &options),
+                  "Compression should succeed");
+        fclose(comp_file);
+        ASSERT_TRUE(get_file_size("test_sparse.cprs") < 64 * 1024,
+                    "Holes should not be coded");
+
+        rename("test_sparse.img", "test_sparse.orig");
+        FILE* file = fopen("test_sparse.cprs", "rb");
+        ASSERT_EQ(0, decompress_file(file), "Decompression should succeed");
+        fclose(file);
+        ASSERT_EQ((long)size, (long)get_file_size("test_sparse.img"),
+                  "Restored image should keep its size");
+        ASSERT_TRUE(compare_files("test_sparse.orig", "test_sparse.img"),
+                    "Holes should read back as zeros");
+        struct stat st;
+        stat("test_sparse.img", &st);
+        ASSERT_TRUE((off_t)st.st_blocks * 512 < size / 2,
+                    "Restored image should stay sparse");
+        cleanup_test_file("test_sparse.img");
+        cleanup_test_file("test_sparse.orig");
+        cleanup_test_file("test_sparse.cprs");
+    }
+}
+
+void test_static_empty_members() {
+    // a walked directory with empty files among the others
+    if (system("rm -rf test_static_dir test_static_dir.orig") != 0) return;
+    mkdir("test_static_dir", 0755);
+    mkdir("test_static_dir/sub", 0755);
+    create_test_file("test_static_dir/a.txt", "some text to code\n");
+    create_test_file("test_static_dir/empty", "");
+    create_test_file("test_static_dir/sub/b.txt", "more text\n");
+    create_test_file("test_static_dir/sub/empty", "");
+    char* dirs[] = {"test_static_dir"};
+    WalkList list;
+    ASSERT_EQ(0, walk_paths(dirs, 1, 0, &list), "Walk should succeed");
+    ASSERT_EQ(4, (int)list.count, "Empty files should be walked");
+    char* argv[6] = {"program"};
+    for (size_t i = 0; i < list.count; i++) argv[i + 1] = list.paths[i];
+    argv[list.count + 1] = "test_static.cprs";
+    CompressOptions options;
+    compress_default_options(&options);
+    FILE* comp_file = fopen("test_static.cprs", "wb");
+    ASSERT_EQ(0, compress_encode_files_opt(comp_file, (int)list.count + 2,
+                                           argv, &options),
+              "Static compression should store empty files");
+    fclose(comp_file);
+
+    rename("test_static_dir", "test_static_dir.orig");
+    FILE* file = fopen("test_static.cprs", "rb");
+    ASSERT_EQ(0, decompress_file(file), "Decompression should succeed");
+    fclose(file);
+    int same = 1;
+    for (size_t i = 0; i < list.count; i++) {
+        char orig[256];
+        snprintf(orig, sizeof(orig), "test_static_dir.orig%s",
+                 list.paths[i] + strlen("test_static_dir"));
+        same = same && compare_files(orig, list.paths[i]);
+    }
+    ASSERT_TRUE(same, "Every file should come back, empty ones too");
+    ASSERT_EQ(0, (int)get_file_size("test_static_dir/sub/empty"),
+              "An empty file should stay empty");
+    walk_list_free(&list);
+    cleanup_test_file("test_static.cprs");
+    if (system("rm -rf test_static_dir test_static_dir.orig") != 0)
+        perror("rm");
+}
+
+void test_oversized_member() {
+    // a header claiming 1 TB over a payload of 5 bytes
+    FILE* file = fopen("test_oversized.cprs", "w+b");
+    ASSERT_EQ(0, io_write_archive_header(file, IO_METHOD_LZ77),
+              "Archive header should be written");
+    unsigned char body[64];
+    size_t n = 0;
+    body[n++] = 0;
+    body[n++] = 13;
+    memcpy(body + n, "test_huge.out", 13);
+    n += 13;
+    body[n++] = 0; // no filter
+    n += io_put_varint(body + n, (uint64_t)1 << 40);
+    n += io_put_varint(body + n, 5);
+    body[n++] = 0;
+    unsigned char head[IO_VARINT_MAX];
+    size_t h_s = io_put_varint(head, n);
+    fwrite(head, 1, h_s, file);
+    fwrite(body, 1, n, file);
+    fwrite("\x01\x02\x03\x04\x05", 1, 5, file);
+    rewind(file);
+    cleanup_test_file("test_huge.out");
+    ASSERT_TRUE(decompress_file(file) != 0, "The member should fail");
+    fclose(file);
+    ASSERT_TRUE(!file_exists("test_huge.out"),
+                "A failed member should leave no output behind");
+    cleanup_test_file("test_huge.out");
+    cleanup_test_file("test_oversized.cprs");
+}
+
+static int append_names(unsigned char method, int argc, char** argv) {
+    CompressOptions options;
+    compress_default_options(&options);
+    options.method = method;
+    FILE* file = fopen(argv[argc - 1], "r+b");
+    int status = compress_append_files(file, argc, argv, &options);
+    fclose(file);
+    return status;
+}
+
+void test_append_members() {
+    const unsigned char methods[] = {IO_METHOD_STATIC, IO_METHOD_LZ77,
+                                     IO_METHOD_SOLID};
+    const char* names[] = {"test_append_a.txt", "test_append_b.txt",
+                           "test_append_c.txt"};
+    for (size_t m = 0; m < sizeof(methods); m++) {
+        create_test_file(names[0], "first member, written with the archive\n");
+        create_test_file(names[1], "second member, appended later on\n");
+        create_test_file(names[2], "third member, appended with the second\n");
+        char* first[] = {"program", (char*)names[0], "test_append.cprs"};
+        compress_names(methods[m], 3, first);
+        size_t before = get_file_size("test_append.cprs");
+
+        // the method of the archive wins over the one asked for
+        char* more[] = {"program", (char*)names[1], (char*)names[2],
+                        "test_append.cprs"};
+        ASSERT_EQ(0, append_names(IO_METHOD_ADAPTIVE, 4, more),
+                  "Append should succeed");
+        size_t after = get_file_size("test_append.cprs");
+        ASSERT_TRUE(after > before, "Archive should grow");
+
+        // a failed append leaves the archive as it was
+        char* missing[] = {"program", (char*)names[0], "test_append_none.txt",
+                           "test_append.cprs"};
+        ASSERT_EQ(-1, append_names(methods[m], 4, missing),
+                  "Append of a missing file should fail");
+        ASSERT_EQ(after, get_file_size("test_append.cprs"),
+                  "Failed append should be cut back");
+
+        FILE* file = fopen("test_append.cprs", "rb");
+        ASSERT_EQ((int)methods[m], io_read_archive_header(file),
+                  "Header should keep the first method");
+        fclose(file);
+        file = fopen("test_append.cprs", "rb");
+        ASSERT_EQ(0, verify_file(file), "Appended archive should verify");
+        fclose(file);
+        for (int i = 0; i < 3; i++) {
+            char orig[48];
+            snprintf(orig, sizeof(orig), "%s.orig", names[i]);
+            rename(names[i], orig);
+        }
+        file = fopen("test_append.cprs", "rb");
+        ASSERT_EQ(0, decompress_file(file), "Decompression should succeed");
+        fclose(file);
+        int same = 1;
+        for (int i = 0; i < 3; i++) {
+            char orig[48];
+            snprintf(orig, sizeof(orig), "%s.orig", names[i]);
+            if (!compare_files(orig, names[i])) same = 0;
+            cleanup_test_file(orig);
+            cleanup_test_file(names[i]);
+        }
+        ASSERT_TRUE(same, "Old and appended members should come back");
+    }
+
+    // nothing is written after a damaged member
+    create_test_file(names[0], "a member that will be cut short, then appended to\n");
+    char* first[] = {"program", (char*)names[0], "test_append.cprs"};
+    compress_names(IO_METHOD_LZ77, 3, first);
+    size_t cut = get_file_size("test_append.cprs") - 3;
+    ASSERT_EQ(0, truncate("test_append.cprs", cut), "Archive should be cut");
+    ASSERT_EQ(-1, append_names(IO_METHOD_LZ77, 3, first),
+              "Append to a damaged archive should fail");
+    ASSERT_EQ(cut, get_file_size("test_append.cprs"),
+              "Damaged archive should be left alone");
+    cleanup_test_file(names[0]);
+    cleanup_test_file("test_append.cprs");
+}
+
+void test_dedup_members() {
+    const unsigned char methods[] = {IO_METHOD_STATIC, IO_METHOD_LZ77};
+    // b and d copy a, c has the size of a but one byte changed
+    const char* names[] = {"test_dup_a.txt", "test_dup_b.txt",
+                           "test_dup_c.txt", "test_dup_d.txt"};
+    for (int f = 0; f < 4; f++) {
+        FILE* input = fopen(names[f], "w");
+        for (int i = 0; i < 20000; i++) {
+            fprintf(input, "%d:%c,", i % 317, f == 2 && i == 9000 ? 'y' : 'x');
+        }
+        fclose(input);
+    }
+    for (size_t m = 0; m < sizeof(methods); m++) {
+        char* unique[] = {"program", (char*)names[0], (char*)names[2],
+                          "test_dup.cprs"};
+        size_t unique_size = compress_names(methods[m], 4, unique);
+        char* argv[] = {"program", (char*)names[0], (char*)names[1],
+                        (char*)names[2], (char*)names[3], "test_dup.cprs"};
+        size_t size = compress_names(methods[m], 6, argv);
+        ASSERT_TRUE(size < unique_size + 64,
+                    "Copies should cost only their headers");
+
+        FILE* file = fopen("test_dup.cprs", "rb");
+        ASSERT_EQ((int)methods[m], io_read_archive_header(file),
+                  "Archive header should be read");
+        static IoHeader header;
+        io_header_init(&header);
+        const uint64_t backs[] = {0, 1, 0, 3};
+        int refs = 1;
+        for (int i = 0; i < 4; i++) {
+            uint64_t stored;
+            if (io_read_member_info(file, methods[m], &header, &stored) != 0 ||
+                header.dup != backs[i] ||
+                header.size != get_file_size(names[i]))
+                refs = 0;
+        }
+        ASSERT_TRUE(refs, "Only exact copies should refer to their original");
+        ASSERT_TRUE(io_is_end_of_file(file), "Listing should end at the end");
+        rewind(file);
+        ASSERT_EQ(0, list_file(file), "list_file should succeed");
+        fclose(file);
+
+        file = fopen("test_dup.cprs", "rb");
+        ASSERT_EQ(0, verify_file(file), "Archive with copies should verify");
+        fclose(file);
+        for (int i = 0; i < 4; i++) {
+            char orig[48];
+            snprintf(orig, sizeof(orig), "%s.orig", names[i]);
+            rename(names[i], orig);
+        }
+        file = fopen("test_dup.cprs", "rb");
+        ASSERT_EQ(0, decompress_file(file), "Decompression should succeed");
+        fclose(file);
+        int same = 1;
+        for (int i = 0; i < 4; i++) {
+            char orig[48];
+            snprintf(orig, sizeof(orig), "%s.orig", names[i]);
+            if (!compare_files(orig, names[i])) same = 0;
+            rename(orig, names[i]);
+        }
+        ASSERT_TRUE(same, "Copies should be restored from their original");
+
+        // copies appended later refer to the members already there
+        char* old[] = {"program", (char*)names[0], (char*)names[2],
+                       "test_dup.cprs"};
+        compress_names(methods[m], 4, old);
+        size = get_file_size("test_dup.cprs");
+        char* more[] = {"program", (char*)names[1], (char*)names[3],
+                        "test_dup.cprs"};
+        ASSERT_EQ(0, append_names(methods[m], 4, more),
+                  "Append should succeed");
+        ASSERT_TRUE(get_file_size("test_dup.cprs") < size + 64,
+                    "Appended copies should cost only their headers");
+        file = fopen("test_dup.cprs", "rb");
+        ASSERT_EQ((int)methods[m], io_read_archive_header(file),
+                  "Archive header should be read");
+        io_header_init(&header);
+        const uint64_t appended[] = {0, 0, 2, 1};
+        refs = 1;
+        for (int i = 0; i < 4; i++) {
+            uint64_t stored;
+            if (io_read_member_info(file, methods[m], &header, &stored) != 0 ||
+                header.dup != appended[i])
+                refs = 0;
+        }
+        ASSERT_TRUE(refs, "Appended copies should refer back to old members");
+        fclose(file);
+        for (int i = 0; i < 4; i++) {
+            char orig[48];
+            snprintf(orig, sizeof(orig), "%s.orig", names[i]);
+            rename(names[i], orig);
+        }
+        file = fopen("test_dup.cprs", "rb");
+        ASSERT_EQ(0, decompress_file(file), "Decompression should succeed");
+        fclose(file);
+        same = 1;
+        for (int i = 0; i < 4; i++) {
+            char orig[48];
+            snprintf(orig, sizeof(orig), "%s.orig", names[i]);
+            if (!compare_files(orig, names[i])) same = 0;
+            rename(orig, names[i]);
+        }
+        ASSERT_TRUE(same, "Appended copies should be restored");
+    }
+
+    // a reference to a member before the first one
+    FILE* file = fopen("test_dup.cprs", "wb");
+    char last_name[IO_NAME_MAX + 1] = "";
+    ASSERT_EQ(0, io_write_archive_header(file, IO_METHOD_LZ77),
+              "Header should be written");
+    ASSERT_EQ(0, io_save_dup(file, last_name, "test_dup_e.txt", 10, 1),
+              "Duplicate header should be written");
+    fclose(file);
+    file = fopen("test_dup.cprs", "rb");
+    ASSERT_EQ(-1, decompress_file(file), "Dangling reference should fail");
+    fclose(file);
+    ASSERT_TRUE(get_file_size("test_dup_e.txt") == 0,
+                "Nothing should be copied for it");
+    cleanup_test_file("test_dup_e.txt");
+    for (int i = 0; i < 4; i++) {
+        cleanup_test_file(names[i]);
+    }
+    cleanup_test_file("test_dup.cprs");
+}
+
+void test_chunked_members() {
+    // v2 is v1 with a line inserted, v3 holds v1 twice, v4 (appended
+    // later) too with a line between the copies
+    const char* names[] = {"test_cdc_v1.txt", "test_cdc_v2.txt",
+                           "test_cdc_v3.txt", "test_cdc_v4.txt"};
+    FILE* files[4];
+    for (int f = 0; f < 4; f++) files[f] = fopen(names[f], "w");
+    for (int copy = 0; copy < 2; copy++) {
+        uint32_t x = 12345;
+        for (int i = 0; i < 30000; i++) {
+            char line[32];
+            snprintf(line, sizeof(line), "%u;%u\n", test_rand(&x) % 5000, i);
+            if (copy == 0) fputs(line, files[0]);
+            if (copy == 0) fputs(line, files[1]);
+            if (copy == 1 && i == 0) fputs("the end\n", files[3]);
+            fputs(line, files[2]);
+            fputs(line, files[3]);
+            if (copy == 0 && i == 15000) fputs("a new line in version 2\n", files[1]);
+        }
+    }
+    for (int f = 0; f < 4; f++) fclose(files[f]);
+
+    char* argv[] = {"program", (char*)names[0], (char*)names[1],
+                    (char*)names[2], "test_cdc.cprs"};
+    size_t split_size = compress_names(IO_METHOD_SPLIT, 5, argv);
+    size_t dedup_size = compress_names(IO_METHOD_DEDUP, 5, argv);
+    ASSERT_TRUE(dedup_size * 3 < split_size,
+                "Shared chunks should be stored once");
+
+    // references are relative: the chunks before the append are counted
+    // by the decoder and not by the appending run
+    char* more[] = {"program", (char*)names[3], "test_cdc.cprs"};
+    ASSERT_EQ(0, append_names(IO_METHOD_DEDUP, 3, more), "Append should succeed");
+
+    FILE* file = fopen("test_cdc.cprs", "rb");
+    ASSERT_EQ(IO_METHOD_DEDUP, io_read_archive_header(file),
+              "Archive header should name the method");
+    static IoHeader header;
+    io_header_init(&header);
+    uint64_t total = 0;
+    int sizes = 1;
+    for (int i = 0; i < 4; i++) {
+        uint64_t stored;
+        if (io_read_member_info(file, IO_METHOD_DEDUP, &header, &stored) != 0 ||
+            header.size != get_file_size(names[i]))
+            sizes = 0;
+        total += stored;
+    }
+    ASSERT_TRUE(sizes, "Members should list their original sizes");
+    ASSERT_EQ(get_file_size("test_cdc.cprs") - IO_MAGIC_SIZE - 2, total,
+              "Stored sizes should cover the whole archive");
+    fclose(file);
+
+    file = fopen("test_cdc.cprs", "rb");
+    ASSERT_EQ(0, verify_file(file), "Deduplicated archive should verify");
+    fclose(file);
+    for (int i = 0; i < 4; i++) {
+        char orig[48];
+        snprintf(orig, sizeof(orig), "%s.orig", names[i]);
+        rename(names[i], orig);
+    }
+    file = fopen("test_cdc.cprs", "rb");
+    ASSERT_EQ(0, decompress_file(file), "Decompression should succeed");
+    fclose(file);
+    int same = 1;
+    for (int i = 0; i < 4; i++) {
+        char orig[48];
+        snprintf(orig, sizeof(orig), "%s.orig", names[i]);
+        if (!compare_files(orig, names[i])) same = 0;
+        cleanup_test_file(orig);
+        cleanup_test_file(names[i]);
+    }
+    ASSERT_TRUE(same, "Members should be rebuilt from their chunks");
+
+    flip_byte("test_cdc.cprs", 40);
+    file = fopen("test_cdc.cprs", "rb");
+    ASSERT_EQ(-1, verify_file(file), "Damaged archive should fail");
+    fclose(file);
+    cleanup_test_file("test_cdc.cprs");
+}
+
+static unsigned char* make_buffer_input(size_t n) {
+    unsigned char* buf = malloc(n);
+    for (size_t i = 0; i < n / 2; i += 4) {
+        int32_t v = 1000 + (int32_t)i * 3;
+        memcpy(buf + i, &v, 4);
+    }
+    for (size_t i = n / 2; i < n; i++) {
+        buf[i] = "buffer api roundtrip "[i % 21];
+    }
+    return buf;
+}
+
+void test_buffer_roundtrip() {
+    size_t n = 300000;
+    unsigned char* src = make_buffer_input(n);
+    for (unsigned char method = IO_METHOD_STATIC; method <= IO_METHOD_LZ77;
+         method++) {
+        CompressOptions options;
+        compress_default_options(&options);
+        options.method = method;
+        size_t cap = hc_compress_bound(n, method);
+        unsigned char* comp = malloc(cap);
+        unsigned char* back = malloc(n);
+        size_t c_len = 0, d_len = 0, size = 0;
+        ASSERT_EQ(HC_OK, hc_compress_buffer(src, n, comp, cap, &c_len, &options),
+                  "Buffer compression should succeed");
+        ASSERT_TRUE(c_len < n, "Buffer output should be smaller than input");
+        ASSERT_EQ(HC_OK, hc_decompressed_size(comp, c_len, &size),
+                  "Frame header should be readable");
+        ASSERT_EQ(n, size, "Frame should record the original size");
+        ASSERT_EQ(HC_OK, hc_decompress_buffer(comp, c_len, back, n, &d_len),
+                  "Buffer decompression should succeed");
+        ASSERT_EQ(n, d_len, "Decompressed length should match");
+        ASSERT_TRUE(memcmp(src, back, n) == 0,
+                    "Buffer roundtrip should restore the input");
+        free(comp);
+        free(back);
+    }
+    free(src);
+}
+
+void test_buffer_small_inputs() {
+    const unsigned char same[] = "aaaaaaaaaaaaaaaa";
+    unsigned char comp[1024], back[64];
+    size_t c_len, d_len;
+    // empty input and a single byte value, both have special cases
+    ASSERT_EQ(HC_OK, hc_compress_buffer(NULL, 0, comp, sizeof(comp), &c_len,
+                                        NULL),
+              "Empty buffer should compress");
+    ASSERT_EQ(HC_OK, hc_decompress_buffer(comp, c_len, NULL, 0, &d_len),
+              "Empty frame should decompress");
+    ASSERT_EQ(0, d_len, "Empty frame should give no bytes");
+    ASSERT_EQ(HC_OK, hc_compress_buffer(same, 16, comp, sizeof(comp), &c_len,
+                                        NULL),
+              "Single symbol buffer should compress");
+    ASSERT_EQ(HC_OK, hc_decompress_buffer(comp, c_len, back, sizeof(back),
+                                          &d_len),
+              "Single symbol frame should decompress");
+    ASSERT_TRUE(d_len == 16 && memcmp(same, back, 16) == 0,
+                "Single symbol roundtrip should restore the input");
+}
+
+void test_buffer_errors() {
+    size_t n = 20000;
+    unsigned char* src = make_buffer_input(n);
+    size_t cap = hc_compress_bound(n, IO_METHOD_STATIC);
+    unsigned char* comp = malloc(cap);
+    unsigned char* back = malloc(n);
+    size_t c_len, d_len;
+    ASSERT_EQ(HC_ERR_SPACE, hc_compress_buffer(src, n, comp, 100, &c_len, NULL),
+              "Small dst should be reported, not overflowed");
+    ASSERT_EQ(HC_OK, hc_compress_buffer(src, n, comp, cap, &c_len, NULL),
+              "Compression should succeed");
+    ASSERT_EQ(HC_ERR_SPACE, hc_decompress_buffer(comp, c_len, back, n - 1,
+                                                 &d_len),
+              "Small dst should be reported on decompression");
+    ASSERT_EQ(HC_ERR_CORRUPT, hc_decompress_buffer(comp, c_len / 2, back, n,
+                                                   &d_len),
+              "Truncated frame should be rejected");
+    comp[0] = 'X';
+    ASSERT_EQ(HC_ERR_CORRUPT, hc_decompress_buffer(comp, c_len, back, n,
+                                                   &d_len),
+              "Bad magic should be rejected");
+    CompressOptions options;
+    compress_default_options(&options);
+    options.method = 42;
+    ASSERT_EQ(HC_ERR_ARGS, hc_compress_buffer(src, n, comp, cap, &c_len,
+                                              &options),
+              "Unknown method should be rejected");
+    free(src);
+    free(comp);
+    free(back);
+}
+
+void test_buffer_corrupt_blocks() {
+    // flipped payload bytes must fail cleanly for every block method
+    size_t n = 50000;
+    unsigned char* src = make_buffer_input(n);
+    unsigned char* back = malloc(n);
+    for (unsigned char method = IO_METHOD_ADAPTIVE; method <= IO_METHOD_LZ77;
+         method++) {
+        CompressOptions options;
+        compress_default_options(&options);
+        options.method = method;
+        size_t cap = hc_compress_bound(n, method);
+        unsigned char* comp = malloc(cap);
+        size_t c_len, d_len;
+        ASSERT_EQ(HC_OK, hc_compress_buffer(src, n, comp, cap, &c_len, &options),
+                  "Compression should succeed");
+        for (size_t i = 12; i < c_len; i += 7) {
+            comp[i] ^= 0x5A;
+        }
+        int status = hc_decompress_buffer(comp, c_len, back, n, &d_len);
+        // the checksums leave no way for damaged data to come back as HC_OK
+        ASSERT_TRUE(status == HC_ERR_CORRUPT || status == HC_ERR_CHECKSUM,
+                    "Corrupt frame should be rejected");
+        free(comp);
+    }
+    free(src);
+    free(back);
+}
+
+void test_buffer_context_reuse() {
+    // one context pair for many payloads and methods, as a service would
+    HcCompressCtx* cctx = hc_cctx_new();
+    HcDecompressCtx* dctx = hc_dctx_new();
+    ASSERT_TRUE(cctx != NULL && dctx != NULL, "Contexts should be created");
+    size_t n = 9000;
+    unsigned char* src = make_buffer_input(n);
+    unsigned char* back = malloc(n);
+    const unsigned char methods[] = {IO_METHOD_STATIC, IO_METHOD_ADAPTIVE,
+                                     IO_METHOD_ADAPTIVE, IO_METHOD_LZ77,
+                                     IO_METHOD_STATIC, IO_METHOD_BWT};
+    int all_ok = 1;
+    for (size_t m = 0; m < sizeof(methods); m++) {
+        CompressOptions options;
+        compress_default_options(&options);
+        options.method = methods[m];
+        size_t len = n - m * 1000; // different sizes on each call
+        size_t cap = hc_compress_bound(len, methods[m]);
+        unsigned char* comp = malloc(cap);
+        size_t c_len, d_len;
+        if (hc_compress_ctx(cctx, src, len, comp, cap, &c_len, &options) != HC_OK ||
+            hc_decompress_ctx(dctx, comp, c_len, back, len, &d_len) != HC_OK ||
+            d_len != len || memcmp(src, back, len) != 0) {
+            all_ok = 0;
+        }
+        free(comp);
+    }
+    ASSERT_TRUE(all_ok, "Reused contexts should roundtrip every payload");
+    free(src);
+    free(back);
+    hc_cctx_free(cctx);
+    hc_dctx_free(dctx);
+}
+
 int main() {
     init_tests();
     
@@ -287,6 +1104,25 @@ int main() {
     RUN_TEST(test_compress_decompress_roundtrip);
     RUN_TEST(test_compress_empty_file);
     RUN_TEST(test_decompress_invalid_file);
+    RUN_TEST(test_adaptive_roundtrip);
+    RUN_TEST(test_order1_roundtrip);
+    RUN_TEST(test_bwt_roundtrip);
+    RUN_TEST(test_lz77_roundtrip);
+    RUN_TEST(test_filtered_roundtrip);
+    RUN_TEST(test_verify_archive);
+    RUN_TEST(test_member_info);
+    RUN_TEST(test_solid_roundtrip);
+    RUN_TEST(test_sparse_roundtrip);
+    RUN_TEST(test_static_empty_members);
+    RUN_TEST(test_oversized_member);
+    RUN_TEST(test_append_members);
+    RUN_TEST(test_dedup_members);
+    RUN_TEST(test_chunked_members);
+    RUN_TEST(test_buffer_roundtrip);
+    RUN_TEST(test_buffer_small_inputs);
+    RUN_TEST(test_buffer_errors);
+    RUN_TEST(test_buffer_corrupt_blocks);
+    RUN_TEST(test_buffer_context_reuse);
 
     TEST_SUMMARY();
 }
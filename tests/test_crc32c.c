@@ -0,0 +1,90 @@
+#include "test_framework.h"
+#include "../include/crc32c.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+// Bitwise reference, one polynomial step per bit
+static uint32_t crc_reference(const unsigned char* buf, size_t n) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < n; i++) {
+        crc ^= buf[i];
+        for (int k = 0; k < 8; k++) {
+            crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+void test_crc32c_known_values() {
+    ASSERT_EQ(0xE3069283u, crc32c_update(0, "123456789", 9),
+              "Check value of CRC-32C");
+    ASSERT_EQ(0u, crc32c_update(0, "", 0), "Empty input should give 0");
+    uint32_t crc = crc32c_update(0, "1234", 4);
+    ASSERT_EQ(0xE3069283u, crc32c_update(crc, "56789", 5),
+              "Updates should continue the checksum");
+}
+
+void test_crc32c_hardware_matches_table() {
+    // Lengths around the interleaved stretches and every alignment
+    size_t n = 3 * 8192 * 2 + 3 * 256 + 77;
+    unsigned char* buf = test_noise_data(n + 8, 12345);
+    const size_t lengths[] = {0, 1, 7, 8, 255, 768, 769, 24576, 24583, n};
+    int same = 1;
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        for (size_t off = 0; off < 8; off++) {
+            uint32_t ref = crc_reference(buf + off, lengths[l]);
+            crc32c_set_software(1);
+            uint32_t sw = crc32c_update(0, buf + off, lengths[l]);
+            crc32c_set_software(0);
+            uint32_t hw = crc32c_update(0, buf + off, lengths[l]);
+            if (ref != sw || ref != hw) same = 0;
+        }
+    }
+    ASSERT_TRUE(same, "Table and instruction paths should match the reference");
+    free(buf);
+}
+
+void test_crc32c_combine() {
+    size_t n = 100000;
+    unsigned char* buf = test_noise_data(n, 12345);
+    uint32_t whole = crc32c_update(0, buf, n);
+    const size_t cuts[] = {0, 1, 4096, 77777, n};
+    int same = 1;
+    for (size_t c = 0; c < sizeof(cuts) / sizeof(cuts[0]); c++) {
+        uint32_t a = crc32c_update(0, buf, cuts[c]);
+        uint32_t b = crc32c_update(0, buf + cuts[c], n - cuts[c]);
+        if (crc32c_combine(a, b, n - cuts[c]) != whole) same = 0;
+    }
+    ASSERT_TRUE(same, "Combined checksums should equal the whole checksum");
+    free(buf);
+}
+
+void test_crc32c_detects_flips() {
+    size_t n = 50000;
+    unsigned char* buf = test_noise_data(n, 12345);
+    uint32_t crc = crc32c_update(0, buf, n);
+    int caught = 1;
+    for (size_t i = 0; i < n; i += 997) {
+        buf[i] ^= 1 << (i % 8);
+        if (crc32c_update(0, buf, n) == crc) caught = 0;
+        buf[i] ^= 1 << (i % 8);
+    }
+    ASSERT_TRUE(caught, "Every single bit flip should change the checksum");
+    free(buf);
+}
+
+int main() {
+    init_tests();
+
+    printf(COLOR_YELLOW "Testing CRC32C Module" COLOR_RESET "\n");
+    printf("========================================\n");
+
+    RUN_TEST(test_crc32c_known_values);
+    RUN_TEST(test_crc32c_hardware_matches_table);
+    RUN_TEST(test_crc32c_combine);
+    RUN_TEST(test_crc32c_detects_flips);
+
+    TEST_SUMMARY();
+}
@@ -0,0 +1,371 @@
+#include "test_framework.h"
+#include "../include/daemon.h"
+#include "../include/io_tool.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static char dir[] = "/tmp/test_daemon_XXXXXX";
+static char socket_path[64];
+
+// dir/name in path, a file of n bytes of text and noise when n > 0
+static void make_file(char* path, const char* name, size_t n, uint32_t seed) {
+    sprintf(path, "%s/%s", dir, name);
+    if (n == 0) return;
+    unsigned char* buf = test_text_data(n, seed, 1000, 700);
+    FILE* file = fopen(path, "wb");
+    fwrite(buf, 1, n, file);
+    fclose(file);
+    free(buf);
+}
+
+static int same_files(const char* a, const char* b) {
+    FILE* fa = fopen(a, "rb");
+    FILE* fb = fopen(b, "rb");
+    int same = fa != NULL && fb != NULL;
+    while (same) {
+        int ca = fgetc(fa), cb = fgetc(fb);
+        if (ca != cb) same = 0;
+        if (ca == EOF) break;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return same;
+}
+
+// Compress in to mid and back to out through descriptors
+static int fd_roundtrip(int sock, const char* in, const char* mid,
+                        const char* out, const CompressOptions* options) {
+    int a = open(in, O_RDONLY);
+    int b = open(mid, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    uint64_t written;
+    int st = daemon_run_fds(sock, DAEMON_OP_COMPRESS, a, b, options, &written);
+    close(a);
+    close(b);
+    if (st != HC_OK) return st;
+    a = open(mid, O_RDONLY);
+    b = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    st = daemon_run_fds(sock, DAEMON_OP_DECOMPRESS, a, b, NULL, &written);
+    close(a);
+    close(b);
+    return st;
+}
+
+void test_daemon_fd_jobs() {
+    Daemon* daemon = daemon_start(socket_path, 2);
+    ASSERT_TRUE(daemon != NULL, "Daemon should start");
+    int sock = daemon_connect(socket_path);
+    ASSERT_TRUE(sock >= 0, "Client should connect");
+
+    char in[128], mid[128], out[128];
+    make_file(in, "in.txt", 200000, 1);
+    make_file(mid, "in.hufb", 0, 0);
+    make_file(out, "in.out", 0, 0);
+    unsigned char methods[] = {IO_METHOD_STATIC, IO_METHOD_ADAPTIVE,
+                               IO_METHOD_ORDER1, IO_METHOD_BWT,
+                               IO_METHOD_LZ77, IO_METHOD_SPLIT};
+    int ok = 1;
+    // one connection carries every job
+    for (size_t i = 0; i < sizeof(methods); i++) {
+        CompressOptions options;
+        compress_default_options(&options);
+        options.method = methods[i];
+        if (fd_roundtrip(sock, in, mid, out, &options) != HC_OK ||
+            !same_files(in, out))
+            ok = 0;
+    }
+    ASSERT_TRUE(ok, "Every method should round trip through the daemon");
+
+    FILE* file = fopen(mid, "rb");
+    char magic[4] = {0};
+    ASSERT_EQ(4, (int)fread(magic, 1, 4, file), "Frame should be written");
+    fclose(file);
+    ASSERT_TRUE(memcmp(magic, "HUFB", 4) == 0,
+                "Jobs should produce buffer API frames");
+
+    make_file(in, "empty.txt", 0, 0);
+    fclose(fopen(in, "wb"));
+    ASSERT_EQ(HC_OK, fd_roundtrip(sock, in, mid, out, NULL),
+              "An empty input should round trip");
+    ASSERT_TRUE(same_files(in, out), "Empty output should stay empty");
+
+    close(sock);
+    daemon_stop(daemon);
+    ASSERT_TRUE(access(socket_path, F_OK) != 0,
+                "Stopping should remove the socket");
+}
+
+void test_daemon_path_jobs() {
+    Daemon* daemon = daemon_start(socket_path, 1);
+    int sock = daemon_connect(socket_path);
+    char in[128], mid[128], out[128];
+    make_file(in, "path.txt", 100000, 2);
+    make_file(mid, "path.hufb", 0, 0);
+    make_file(out, "path.out", 0, 0);
+    uint64_t written = 0;
+    ASSERT_EQ(HC_OK,
+              daemon_run_paths(sock, DAEMON_OP_COMPRESS, in, mid, NULL,
+                               &written),
+              "Daemon should compress named files");
+    ASSERT_TRUE(written > 0 && written < 100000,
+                "Reply should count the compressed bytes");
+    ASSERT_EQ(HC_OK,
+              daemon_run_paths(sock, DAEMON_OP_DECOMPRESS, mid, out, NULL,
+                               &written),
+              "Daemon should decompress named files");
+    ASSERT_EQ(100000, (int)written, "Reply should count the restored bytes");
+    ASSERT_TRUE(same_files(in, out), "Named output should match the input");
+
+    ASSERT_EQ(HC_ERR_ARGS,
+              daemon_run_paths(sock, DAEMON_OP_COMPRESS, "path.txt", out, NULL,
+                               &written),
+              "Relative paths should be refused");
+    char missing[128];
+    make_file(missing, "missing.txt", 0, 0);
+    ASSERT_EQ(DAEMON_ERR_IO,
+              daemon_run_paths(sock, DAEMON_OP_COMPRESS, missing, out, NULL,
+                               &written),
+              "A missing input should be an I/O error");
+    ASSERT_EQ(HC_ERR_CORRUPT,
+              daemon_run_paths(sock, DAEMON_OP_DECOMPRESS, in, out, NULL,
+                               &written),
+              "Text is not a frame");
+    ASSERT_EQ(HC_ERR_ARGS,
+              daemon_run_paths(sock, 7, in, out, NULL, &written),
+              "An unknown operation should be refused");
+    ASSERT_EQ(HC_OK,
+              daemon_run_paths(sock, DAEMON_OP_COMPRESS, in, mid, NULL,
+                               &written),
+              "Errors should leave the connection usable");
+    close(sock);
+    daemon_stop(daemon);
+}
+
+void test_daemon_same_file() {
+    Daemon* daemon = daemon_start(socket_path, 1);
+    int sock = daemon_connect(socket_path);
+    char in[128], link_path[128], mid[128], out[128];
+    make_file(in, "same.txt", 50000, 3);
+    make_file(link_path, "same.link", 0, 0);
+    make_file(mid, "same.hufb", 0, 0);
+    make_file(out, "same.out", 0, 0);
+    ASSERT_EQ(0, link(in, link_path), "Hard link should be made");
+    uint64_t written;
+    ASSERT_EQ(HC_ERR_ARGS,
+              daemon_run_paths(sock, DAEMON_OP_COMPRESS, in, in, NULL,
+                               &written),
+              "Output on the input path should be refused");
+    ASSERT_EQ(HC_ERR_ARGS,
+              daemon_run_paths(sock, DAEMON_OP_COMPRESS, in, link_path, NULL,
+                               &written),
+              "Output on a hard link to the input should be refused");
+    int a = open(in, O_RDONLY), b = open(link_path, O_WRONLY);
+    ASSERT_EQ(HC_ERR_ARGS,
+              daemon_run_fds(sock, DAEMON_OP_COMPRESS, a, b, NULL, &written),
+              "Descriptors of one file should be refused");
+    close(a);
+    close(b);
+    ASSERT_EQ(HC_ERR_ARGS,
+              daemon_run_files(sock, DAEMON_OP_COMPRESS, in, link_path, NULL,
+                               &written),
+              "The client should refuse it too");
+    struct stat st;
+    ASSERT_TRUE(stat(in, &st) == 0 && st.st_size == 50000,
+                "The input should be intact");
+
+    // the client opens the files, so it needs no absolute paths
+    char cwd[4096];
+    ASSERT_TRUE(getcwd(cwd, sizeof(cwd)) != NULL, "Should know the cwd");
+    ASSERT_EQ(0, chdir(dir), "Should enter the test directory");
+    ASSERT_EQ(HC_OK,
+              daemon_run_files(sock, DAEMON_OP_COMPRESS, "same.txt",
+                               "same.hufb", NULL, &written),
+              "Client files should compress");
+    ASSERT_EQ(HC_OK,
+              daemon_run_files(sock, DAEMON_OP_DECOMPRESS, "same.hufb",
+                               "same.out", NULL, &written),
+              "Client files should decompress");
+    ASSERT_TRUE(same_files(in, out), "Client output should match the input");
+    ASSERT_EQ(0, chdir(cwd), "Should go back");
+    unlink(link_path);
+    close(sock);
+    daemon_stop(daemon);
+}
+
+void test_daemon_bad_request() {
+    Daemon* daemon = daemon_start(socket_path, 1);
+    int sock = daemon_connect(socket_path);
+    DaemonRequest req = {{'N', 'O', 'P', 'E'}, DAEMON_OP_COMPRESS, 0, 0, 0, 0};
+    ASSERT_EQ((int)sizeof(req), (int)write(sock, &req, sizeof(req)),
+              "Request should be sent");
+    char byte;
+    ASSERT_EQ(0, (int)read(sock, &byte, 1),
+              "A bad magic should close the connection");
+    close(sock);
+
+    sock = daemon_connect(socket_path);
+    uint64_t written;
+    ASSERT_EQ(DAEMON_ERR_PROTO,
+              daemon_run_fds(sock, DAEMON_OP_COMPRESS, -1, -1, NULL, &written),
+              "Invalid descriptors should not be sent");
+    close(sock);
+    daemon_stop(daemon);
+}
+
+void test_daemon_client_gone() {
+    Daemon* daemon = daemon_start(socket_path, 1);
+    char in[128], mid[128], out[128];
+    make_file(in, "gone.txt", 20000, 4);
+    make_file(mid, "gone.hufb", 0, 0);
+    make_file(out, "gone.out", 0, 0);
+    DaemonRequest req = {{'H', 'U', 'F', 'D'}, DAEMON_OP_COMPRESS, 0, 0, 0,
+                         (uint32_t)(strlen(in) + strlen(mid) + 2)};
+    // jobs whose client resets the connection instead of reading the reply
+    for (int i = 0; i < 20; i++) {
+        int sock = daemon_connect(socket_path);
+        struct linger reset = {1, 0};
+        setsockopt(sock, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+        if (write(sock, &req, sizeof(req)) != (ssize_t)sizeof(req) ||
+            write(sock, in, strlen(in) + 1) < 0 ||
+            write(sock, mid, strlen(mid) + 1) < 0)
+            break;
+        if (i % 2 == 0) usleep(1000);
+        close(sock);
+    }
+    int sock = daemon_connect(socket_path);
+    uint64_t written;
+    ASSERT_EQ(HC_OK,
+              daemon_run_paths(sock, DAEMON_OP_COMPRESS, in, mid, NULL,
+                               &written),
+              "Clients that went away should not break the daemon");
+    ASSERT_EQ(HC_OK,
+              daemon_run_paths(sock, DAEMON_OP_DECOMPRESS, mid, out, NULL,
+                               &written),
+              "The next job should work too");
+    ASSERT_TRUE(same_files(in, out), "Output should match the input");
+    close(sock);
+    daemon_stop(daemon);
+}
+
+typedef struct {
+    int index;
+    int ok;
+} ClientJob;
+
+static void* client_main(void* arg) {
+    ClientJob* job = arg;
+    char in[128], mid[128], out[128], name[32];
+    sprintf(name, "client%d.txt", job->index);
+    make_file(in, name, 50000 + 1000 * job->index, job->index);
+    sprintf(name, "client%d.hufb", job->index);
+    make_file(mid, name, 0, 0);
+    sprintf(name, "client%d.out", job->index);
+    make_file(out, name, 0, 0);
+    int sock = daemon_connect(socket_path);
+    job->ok = sock >= 0;
+    CompressOptions options;
+    compress_default_options(&options);
+    options.method = IO_METHOD_LZ77;
+    for (int round = 0; round < 5 && job->ok; round++)
+        job->ok = fd_roundtrip(sock, in, mid, out, &options) == HC_OK &&
+                  same_files(in, out);
+    if (sock >= 0) close(sock);
+    return NULL;
+}
+
+void test_daemon_concurrent_clients() {
+    Daemon* daemon = daemon_start(socket_path, 3);
+    pthread_t threads[8];
+    ClientJob jobs[8];
+    for (int i = 0; i < 8; i++) {
+        jobs[i].index = i;
+        pthread_create(&threads[i], NULL, client_main, &jobs[i]);
+    }
+    int ok = 1;
+    for (int i = 0; i < 8; i++) {
+        pthread_join(threads[i], NULL);
+        ok = ok && jobs[i].ok;
+    }
+    ASSERT_TRUE(ok, "More clients than workers should all be served");
+    daemon_stop(daemon);
+}
+
+void test_daemon_idle_clients() {
+    Daemon* daemon = daemon_start(socket_path, 1);
+    char in[128], mid[128];
+    make_file(in, "idle.txt", 5000, 6);
+    make_file(mid, "idle.hufb", 0, 0);
+    int socks[4], ok = 1;
+    uint64_t written;
+    // more connections left open than workers, each after a job
+    for (int i = 0; i < 4; i++) {
+        socks[i] = daemon_connect(socket_path);
+        ok = ok && daemon_run_paths(socks[i], DAEMON_OP_COMPRESS, in, mid,
+                                    NULL, &written) == HC_OK;
+    }
+    ASSERT_TRUE(ok, "An idle client should not hold the only worker");
+    ASSERT_EQ(HC_OK,
+              daemon_run_paths(socks[0], DAEMON_OP_COMPRESS, in, mid, NULL,
+                               &written),
+              "An idle connection should be served again");
+    for (int i = 0; i < 4; i++) close(socks[i]);
+    daemon_stop(daemon);
+}
+
+void test_daemon_stop_with_idle_client() {
+    Daemon* daemon = daemon_start(socket_path, 1);
+    int busy = daemon_connect(socket_path);
+    int queued = daemon_connect(socket_path);
+    ASSERT_TRUE(busy >= 0 && queued >= 0, "Clients should connect");
+    // let the daemon accept both
+    usleep(50000);
+    daemon_stop(daemon);
+    char byte;
+    ASSERT_EQ(0, (int)read(busy, &byte, 1),
+              "Stopping should close an idle connection");
+    ASSERT_TRUE(read(queued, &byte, 1) <= 0,
+                "Stopping should close a queued connection");
+    close(busy);
+    close(queued);
+    ASSERT_TRUE(daemon_connect(socket_path) < 0,
+                "Nobody should listen after stopping");
+
+    Daemon* first = daemon_start(socket_path, 1);
+    ASSERT_TRUE(daemon_start(socket_path, 1) == NULL,
+                "A second daemon should not take a live socket");
+    daemon_stop(first);
+}
+
+int main() {
+    init_tests();
+
+    printf(COLOR_YELLOW "Testing Daemon Module" COLOR_RESET "\n");
+    printf("========================================\n");
+
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    sprintf(socket_path, "%s/hufd.sock", dir);
+
+    RUN_TEST(test_daemon_fd_jobs);
+    RUN_TEST(test_daemon_path_jobs);
+    RUN_TEST(test_daemon_same_file);
+    RUN_TEST(test_daemon_bad_request);
+    RUN_TEST(test_daemon_client_gone);
+    RUN_TEST(test_daemon_concurrent_clients);
+    RUN_TEST(test_daemon_idle_clients);
+    RUN_TEST(test_daemon_stop_with_idle_client);
+
+    char command[128];
+    sprintf(command, "rm -rf %s", dir);
+    if (system(command) != 0) perror("rm");
+
+    TEST_SUMMARY();
+}
@@ -0,0 +1,157 @@
+#include "test_framework.h"
+#include "../include/filter.h"
+#include "../include/block.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+// Slowly increasing little endian int32 samples
+static unsigned char* make_ramp(size_t count) {
+    unsigned char* buf = malloc(count * 4);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t v = 100000 + (uint32_t)(i * 3) + (uint32_t)(i % 5);
+        memcpy(buf + i * 4, &v, 4);
+    }
+    return buf;
+}
+
+// Filter buf in chunks of chunk bytes, undo it in chunks of the same size
+static int roundtrip(unsigned char kind, const unsigned char* buf, size_t n,
+                     size_t chunk) {
+    unsigned char* work = malloc(n);
+    memcpy(work, buf, n);
+    FilterState enc, dec;
+    flt_init(&enc, kind);
+    flt_init(&dec, kind);
+    for (size_t i = 0; i < n; i += chunk) {
+        flt_encode(&enc, work + i, n - i < chunk ? n - i : chunk);
+    }
+    for (size_t i = 0; i < n; i += chunk) {
+        flt_decode(&dec, work + i, n - i < chunk ? n - i : chunk);
+    }
+    int ok = memcmp(buf, work, n) == 0;
+    free(work);
+    return ok;
+}
+
+void test_flt_roundtrip_all_kinds() {
+    // Odd size so the last group has a partial sample
+    size_t n = 3 * FLT_GROUP + 7;
+    unsigned char* buf = malloc(n);
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = (unsigned char)(i * 31 + (i >> 7));
+    }
+    for (unsigned char kind = FLT_NONE; kind < FLT_COUNT; kind++) {
+        ASSERT_TRUE(roundtrip(kind, buf, n, FLT_GROUP),
+                    "Filter should be undone exactly");
+        ASSERT_TRUE(roundtrip(kind, buf, n, 2 * FLT_GROUP),
+                    "Chunk size multiple of FLT_GROUP should not matter");
+    }
+    free(buf);
+}
+
+void test_flt_delta_state_spans_chunks() {
+    unsigned char* buf = make_ramp(2048);
+    unsigned char whole[8192], split[8192];
+    memcpy(whole, buf, sizeof(whole));
+    memcpy(split, buf, sizeof(split));
+
+    FilterState a, b;
+    flt_init(&a, FLT_DELTA4);
+    flt_init(&b, FLT_DELTA4);
+    flt_encode(&a, whole, sizeof(whole));
+    // a chunk that ends in the middle of a sample
+    flt_encode(&b, split, 4097);
+    flt_encode(&b, split + 4097, sizeof(split) - 4097);
+    ASSERT_TRUE(memcmp(whole, split, sizeof(whole)) == 0,
+                "Delta output should not depend on chunking");
+    free(buf);
+}
+
+void test_flt_choose() {
+    unsigned char* ramp = make_ramp(FLT_SAMPLE / 4);
+    unsigned char kind = flt_choose(ramp, FLT_SAMPLE);
+    ASSERT_TRUE(kind == FLT_DELTA4 || kind == FLT_SHUFFLE4,
+                "Int32 samples should pick a 4 byte filter");
+    free(ramp);
+
+    const char* text = "plain english text does not need any filter at all. ";
+    size_t n = 100 * strlen(text);
+    unsigned char* buf = malloc(n);
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = text[i % strlen(text)];
+    }
+    ASSERT_EQ(FLT_NONE, flt_choose(buf, n), "Text should stay unfiltered");
+    free(buf);
+}
+
+// Floats in [1, 2): one exponent byte over three bytes of noise
+static unsigned char* make_floats(size_t count, uint32_t seed) {
+    unsigned char* buf = malloc(count * 4);
+    for (size_t i = 0; i < count; i++) {
+        test_rand(&seed);
+        float v = 1.0f + (float)(seed >> 8) / (float)(1 << 24);
+        memcpy(buf + i * 4, &v, 4);
+    }
+    return buf;
+}
+
+void test_flt_choose_cost() {
+    unsigned char* floats = make_floats(FLT_SAMPLE / 4, 11);
+    unsigned char* trial = malloc(FLT_SAMPLE);
+    ASSERT_EQ(FLT_NONE, flt_choose_with(floats, FLT_SAMPLE, trial),
+              "Order-0 sizes cannot tell the planes apart");
+    BlockCoder coder;
+    ASSERT_EQ(0, block_coder_init(&coder, IO_METHOD_LZ77, LZ_DEFAULT_LEVEL),
+              "Coder should start");
+    ASSERT_EQ(FLT_SHUFFLE4,
+              flt_choose_cost(floats, FLT_SAMPLE, trial, block_trial_cost,
+                              &coder),
+              "LZ77 should pick shuffle4 for floats");
+    ASSERT_EQ(FLT_NONE,
+              flt_choose_cost(floats, FLT_SAMPLE, trial, NULL, NULL),
+              "Without a coder the order-0 choice should stay");
+    block_coder_free(&coder);
+
+    const char* text = "plain english text does not need any filter at all. ";
+    size_t n = 100 * strlen(text);
+    unsigned char* buf = malloc(n);
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = text[i % strlen(text)];
+    }
+    ASSERT_EQ(0, block_coder_init(&coder, IO_METHOD_ADAPTIVE, 0),
+              "Adaptive coder should start");
+    ASSERT_EQ(FLT_NONE,
+              flt_choose_cost(buf, n, trial, block_trial_cost, &coder),
+              "Text should stay unfiltered");
+    block_coder_free(&coder);
+    free(buf);
+    free(trial);
+    free(floats);
+}
+
+void test_flt_parse() {
+    ASSERT_EQ(FLT_AUTO, flt_parse("auto"), "auto should parse");
+    ASSERT_EQ(FLT_DELTA4, flt_parse("delta4"), "delta4 should parse");
+    ASSERT_EQ(FLT_SHUFFLE8, flt_parse("shuffle8"), "shuffle8 should parse");
+    ASSERT_EQ(-1, flt_parse("zip"), "Unknown names should be rejected");
+    for (unsigned char kind = FLT_NONE; kind < FLT_COUNT; kind++) {
+        ASSERT_EQ(kind, flt_parse(flt_name(kind)), "Names should round trip");
+    }
+}
+
+int main() {
+    init_tests();
+
+    printf(COLOR_YELLOW "Testing Filter Module" COLOR_RESET "\n");
+    printf("========================================\n");
+
+    RUN_TEST(test_flt_roundtrip_all_kinds);
+    RUN_TEST(test_flt_delta_state_spans_chunks);
+    RUN_TEST(test_flt_choose);
+    RUN_TEST(test_flt_choose_cost);
+    RUN_TEST(test_flt_parse);
+
+    TEST_SUMMARY();
+}
@@ -0,0 +1,165 @@
+#include "test_framework.h"
+#include "../include/fixed.h"
+#include "fixed_text.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+// Text like the table was made from, with a byte of noise now and then
+static unsigned char* make_text(size_t n, uint32_t seed) {
+    return test_text_data(n, seed, 97, 96);
+}
+
+// Encode and decode with the generated decoder, 1 if it matched
+static int roundtrip(const unsigned char* buf, size_t n, size_t* coded) {
+    size_t cap = hc_fixed_bound(n), len;
+    unsigned char* mid = malloc(cap);
+    unsigned char* out = malloc(n + 1);
+    int ok = hc_fixed_encode(&hc_fixed_text, buf, n, mid, cap, &len) ==
+                 HC_OK &&
+             hc_fixed_decode(&hc_fixed_text, mid, len, out, n) == HC_OK &&
+             memcmp(buf, out, n) == 0;
+    if (coded) *coded = len;
+    free(mid);
+    free(out);
+    return ok;
+}
+
+void test_fixed_roundtrip() {
+    ASSERT_TRUE(hc_fixed_text.every_byte,
+                "A table from counts should code every byte");
+    int ok = 1;
+    for (size_t n = 0; n <= 100 && ok; n++) {
+        unsigned char* buf = make_text(n, 7 + n);
+        ok = roundtrip(buf, n, NULL);
+        free(buf);
+    }
+    ASSERT_TRUE(ok, "Sizes 0 to 100 should decode");
+
+    size_t n = 1000000, coded;
+    unsigned char* buf = make_text(n, 3);
+    ASSERT_TRUE(roundtrip(buf, n, &coded), "A large input should decode");
+    ASSERT_TRUE(coded < n * 3 / 4, "Text should get shorter");
+
+    unsigned char all[256 * 4];
+    for (int i = 0; i < 256 * 4; i++) all[i] = i * 7;
+    ASSERT_TRUE(roundtrip(all, sizeof(all), NULL),
+                "Every byte value should decode");
+    free(buf);
+}
+
+void test_fixed_generic() {
+    size_t n = 200000, cap = hc_fixed_bound(n), len;
+    unsigned char* buf = make_text(n, 5);
+    unsigned char* mid = malloc(cap);
+    unsigned char* a = malloc(n);
+    unsigned char* b = malloc(n);
+    ASSERT_EQ(HC_OK, hc_fixed_encode(&hc_fixed_text, buf, n, mid, cap, &len),
+              "Encode should work");
+    ASSERT_EQ(HC_OK, hc_fixed_decode(&hc_fixed_text, mid, len, a, n),
+              "The generated decoder should work");
+    ASSERT_EQ(HC_OK, hc_fixed_decode_table(hc_fixed_text.table, mid, len, b, n),
+              "The table decoder should work");
+    ASSERT_TRUE(memcmp(a, b, n) == 0 && memcmp(a, buf, n) == 0,
+                "Both decoders should give the same bytes");
+    free(buf);
+    free(mid);
+    free(a);
+    free(b);
+}
+
+void test_fixed_table_file() {
+    char path[] = "/tmp/test_fixed_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0, "Temporary file should be created");
+    FILE* file = fdopen(fd, "w+");
+    ASSERT_EQ(0, hc_fixed_write_table(file, hc_fixed_text.table),
+              "Writing the table should work");
+    rewind(file);
+    HuffTable table;
+    ASSERT_EQ(0, hc_fixed_read_table(file, &table),
+              "Reading the table back should work");
+    ASSERT_TRUE(memcmp(table.lens, hc_fixed_text.table->lens, 256) == 0 &&
+                    memcmp(table.codes, hc_fixed_text.table->codes,
+                           256 * sizeof(table.codes[0])) == 0,
+                "The table should come back with the same codes");
+    fclose(file);
+
+    const char* bad[] = {"HUFT 2\n0 1\n", "HUFX 1\n0 1\n",
+                         "HUFT 1\n0 1\n0 1\n", "HUFT 1\n256 1\n",
+                         "HUFT 1\n0 16\n", "HUFT 1\n# nothing\n",
+                         "HUFT 1\n0 1\n1 1\n2 1\n"};
+    int rejected = 0;
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        file = fopen(path, "w+");
+        fputs(bad[i], file);
+        rewind(file);
+        rejected += hc_fixed_read_table(file, &table) != 0;
+        fclose(file);
+    }
+    ASSERT_EQ((int)(sizeof(bad) / sizeof(bad[0])), rejected,
+              "Bad tables should be refused");
+
+    file = fopen(path, "w+");
+    fputs("# two symbols\nHUFT 1\n65 1\n  66 1\n", file);
+    rewind(file);
+    ASSERT_EQ(0, hc_fixed_read_table(file, &table),
+              "Comments and blank space should be skipped");
+    ASSERT_TRUE(table.lens['A'] == 1 && table.lens['B'] == 1 &&
+                    table.lens['C'] == 0,
+                "Only the listed bytes should get a code");
+    fclose(file);
+    remove(path);
+
+    uint64_t counts[256] = {0};
+    counts['a'] = UINT64_MAX;
+    counts['b'] = 1;
+    ASSERT_EQ(0, hc_fixed_table_from_counts(&table, counts),
+              "Huge counts should be scaled");
+    int every = 1;
+    for (int c = 0; c < 256; c++) every = every && table.lens[c] != 0;
+    ASSERT_TRUE(every && table.lens['a'] == 1,
+                "Unseen bytes should still get a code");
+}
+
+void test_fixed_errors() {
+    size_t n = 5000, cap = hc_fixed_bound(n), len;
+    unsigned char* buf = make_text(n, 9);
+    unsigned char* mid = malloc(cap);
+    unsigned char* out = malloc(n);
+    ASSERT_EQ(HC_ERR_SPACE,
+              hc_fixed_encode(&hc_fixed_text, buf, n, mid, cap - 1, &len),
+              "A short output should be refused");
+    ASSERT_EQ(HC_ERR_ARGS, hc_fixed_encode(NULL, buf, n, mid, cap, &len),
+              "A missing code should be refused");
+    ASSERT_EQ(HC_OK, hc_fixed_encode(&hc_fixed_text, buf, n, mid, cap, &len),
+              "Encode should work");
+    ASSERT_EQ(HC_ERR_CORRUPT,
+              hc_fixed_decode(&hc_fixed_text, mid, len / 2, out, n),
+              "Truncated data should be caught");
+    ASSERT_EQ(HC_ERR_CORRUPT,
+              hc_fixed_decode_table(hc_fixed_text.table, mid, len / 2, out, n),
+              "The table decoder should catch it too");
+    ASSERT_EQ(HC_ERR_CORRUPT, hc_fixed_decode(&hc_fixed_text, mid, 0, out, 1),
+              "No data for one byte should be caught");
+    ASSERT_EQ(HC_ERR_ARGS, hc_fixed_decode(&hc_fixed_text, NULL, 4, out, 1),
+              "A missing input should be refused");
+    free(buf);
+    free(mid);
+    free(out);
+}
+
+int main() {
+    init_tests();
+
+    printf(COLOR_YELLOW "Testing Fixed Code Module" COLOR_RESET "\n");
+    printf("========================================\n");
+
+    RUN_TEST(test_fixed_roundtrip);
+    RUN_TEST(test_fixed_generic);
+    RUN_TEST(test_fixed_table_file);
+    RUN_TEST(test_fixed_errors);
+
+    TEST_SUMMARY();
+}
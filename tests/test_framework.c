@@ -10,3 +10,29 @@ void init_tests(void) {
     tests_passed = 0;
     tests_failed = 0;
 }
+
+unsigned char* test_text_data(size_t n, uint32_t seed, size_t period,
+                              size_t text_len) {
+    const char* text = "the quick brown fox jumps over the lazy dog. ";
+    size_t len = strlen(text);
+    unsigned char* buf = malloc(n ? n : 1);
+    if (buf == NULL) {
+        fprintf(stderr, "Out of memory for %zu bytes of test data\n", n);
+        exit(1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint32_t r = test_rand(&seed);
+        buf[i] = i % period < text_len ? (unsigned char)text[i % len]
+                                       : (unsigned char)r;
+    }
+    return buf;
+}
+
+unsigned char* test_noise_data(size_t n, uint32_t seed) {
+    return test_text_data(n, seed, 1, 0);
+}
+
+uint32_t test_rand(uint32_t* x) {
+    *x = *x * 1103515245u + 12345u;
+    return *x >> 16;
+}
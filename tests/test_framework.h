@@ -1,6 +1,7 @@
 #ifndef TEST_FRAMEWORK_H
 #define TEST_FRAMEWORK_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -134,4 +135,16 @@ extern int tests_failed;
 // Initialize test counters
 void init_tests(void);
 
+// n bytes of repeated English text where, in every period bytes, those
+// from text_len on are noise from an LCG started at seed. Exits when out
+// of memory; the caller frees the buffer
+unsigned char* test_text_data(size_t n, uint32_t seed, size_t period,
+                              size_t text_len);
+
+// n bytes of noise only, the same as test_text_data with no text
+unsigned char* test_noise_data(size_t n, uint32_t seed);
+
+// Advances the LCG at x, returns its top 16 bits
+uint32_t test_rand(uint32_t* x);
+
 #endif // TEST_FRAMEWORK_H
@@ -0,0 +1,72 @@
+#include "test_framework.h"
+#include "../include/hash128.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+void test_hash128_known_values() {
+    // values of the reference MurmurHash3_x64_128, seed 0
+    Hash128 h = hash128("", 0, 0);
+    ASSERT_TRUE(h.lo == 0 && h.hi == 0, "Empty input should hash to 0");
+    h = hash128("hello", 5, 0);
+    ASSERT_TRUE(h.lo == 0xcbd8a7b341bd9b02ull && h.hi == 0x5b1e906a48ae1d19ull,
+                "Short input should match the reference");
+    const char* fox = "The quick brown fox jumps over the lazy dog";
+    h = hash128(fox, strlen(fox), 0);
+    ASSERT_TRUE(h.lo == 0xe34bbc7bbc071b6cull && h.hi == 0x7a433ca9c49a9347ull,
+                "Input with a tail should match the reference");
+    unsigned char bytes[768];
+    for (int i = 0; i < 768; i++) bytes[i] = i;
+    h = hash128(bytes, sizeof(bytes), 0);
+    ASSERT_TRUE(h.lo == 0xcf926c3003b926b6ull && h.hi == 0xfa53d9e5e2f34638ull,
+                "Whole blocks should match the reference");
+}
+
+void test_hash128_pieces() {
+    size_t n = 1000;
+    unsigned char* buf = malloc(n);
+    for (size_t i = 0; i < n; i++) buf[i] = (unsigned char)(i * 31 + 7);
+    Hash128 whole = hash128(buf, n, 42);
+    int same = 1;
+    const size_t steps[] = {1, 3, 15, 16, 17, 100, 999};
+    for (size_t s = 0; s < sizeof(steps) / sizeof(steps[0]); s++) {
+        Hash128State state;
+        hash128_init(&state, 42);
+        for (size_t i = 0; i < n; i += steps[s]) {
+            hash128_update(&state, buf + i, n - i < steps[s] ? n - i : steps[s]);
+        }
+        if (!hash128_equal(whole, hash128_final(&state))) same = 0;
+    }
+    ASSERT_TRUE(same, "Pieces of any size should give the same hash");
+    free(buf);
+}
+
+void test_hash128_sensitivity() {
+    unsigned char buf[64] = {0};
+    Hash128 base = hash128(buf, sizeof(buf), 0);
+    int differs = 1;
+    for (size_t i = 0; i < sizeof(buf) * 8; i++) {
+        buf[i / 8] ^= 1 << (i % 8);
+        if (hash128_equal(base, hash128(buf, sizeof(buf), 0))) differs = 0;
+        buf[i / 8] ^= 1 << (i % 8);
+    }
+    ASSERT_TRUE(differs, "Every bit flip should change the hash");
+    ASSERT_FALSE(hash128_equal(base, hash128(buf, sizeof(buf) - 1, 0)),
+                 "Length should change the hash");
+    ASSERT_FALSE(hash128_equal(base, hash128(buf, sizeof(buf), 1)),
+                 "Seed should change the hash");
+}
+
+int main() {
+    init_tests();
+
+    printf(COLOR_YELLOW "Testing Hash128 Module" COLOR_RESET "\n");
+    printf("========================================\n");
+
+    RUN_TEST(test_hash128_known_values);
+    RUN_TEST(test_hash128_pieces);
+    RUN_TEST(test_hash128_sensitivity);
+
+    TEST_SUMMARY();
+}
@@ -169,6 +169,174 @@ void test_hc_memory_management() {
     cleanup_test_file(test_file);
 }
 
+void test_hc_adaptive_roundtrip() {
+    // Encoder and decoder must rebuild identical trees block after block
+    size_t n = 3 * HC_ADAPTIVE_BLOCK + 100;
+    unsigned char* input = malloc(n);
+    for (size_t i = 0; i < n; i++) {
+        // skewed distribution that changes halfway
+        input[i] = (i < n / 2) ? "aaaabbc"[i % 7] : "xyzxyq"[i % 6];
+    }
+
+    AdaptiveModel enc;
+    ASSERT_EQ(0, hc_adaptive_init(&enc), "Adaptive encoder should initialize");
+    BitWriter bw;
+    bs_writer_init(&bw);
+    int status = 0;
+    for (size_t off = 0; off < n; off += HC_ADAPTIVE_BLOCK) {
+        size_t len = n - off < HC_ADAPTIVE_BLOCK ? n - off : HC_ADAPTIVE_BLOCK;
+        status |= hc_adaptive_encode_block(&enc, input + off, len, &bw);
+    }
+    size_t size = bs_flush(&bw);
+    ASSERT_EQ(0, status, "Adaptive encoding should succeed");
+    ASSERT_TRUE(size < n, "Skewed data should shrink");
+
+    AdaptiveModel dec;
+    ASSERT_EQ(0, hc_adaptive_init(&dec), "Adaptive decoder should initialize");
+    unsigned char* output = malloc(n);
+    BitReader br;
+    bs_reader_init(&br, bw.buf, size);
+    for (size_t off = 0; off < n; off += HC_ADAPTIVE_BLOCK) {
+        size_t len = n - off < HC_ADAPTIVE_BLOCK ? n - off : HC_ADAPTIVE_BLOCK;
+        status |= hc_adaptive_decode_block(&dec, &br, output + off, len);
+    }
+    ASSERT_EQ(0, status, "Adaptive decoding should succeed");
+    ASSERT_TRUE(memcmp(input, output, n) == 0, "Decoded data should match input");
+
+    hc_adaptive_free(&enc);
+    hc_adaptive_free(&dec);
+    bs_writer_free(&bw);
+    free(input);
+    free(output);
+}
+
+void test_hc_canonical_table() {
+    // Fibonacci counts would give a 20-level tree without a limit
+    uint32_t counts[300] = {0};
+    uint32_t a = 1, b = 1;
+    for (int i = 0; i < 20; i++) {
+        counts[i * 13] = a;
+        uint32_t t = a + b;
+        a = b;
+        b = t;
+    }
+    counts[299] = 7;
+
+    HuffTable table;
+    ASSERT_EQ(0, hc_table_from_counts(&table, counts, 300), "Table should build");
+    int max_len = 0, used = 0;
+    for (int s = 0; s < 300; s++) {
+        if (table.lens[s] > max_len) max_len = table.lens[s];
+        if (table.lens[s]) used++;
+        if (counts[s] == 0) {
+            ASSERT_EQ(0, table.lens[s], "Unused symbols should have no code");
+        }
+    }
+    ASSERT_EQ(21, used, "Every used symbol should have a code");
+    ASSERT_TRUE(max_len <= HC_MAX_CODE_LENGTH, "Code lengths should be limited");
+
+    // Header and symbols survive a write/read cycle
+    BitWriter bw;
+    bs_writer_init(&bw);
+    hc_table_write(&bw, &table);
+    ASSERT_EQ((int)hc_table_header_bits(&table), (int)(bw.pos * 8 + bw.nbits),
+              "Header size estimate should match written bits");
+    for (int s = 0; s < 300; s++) {
+        if (counts[s]) hc_write_symbol(&bw, &table, s);
+    }
+    size_t size = bs_flush(&bw);
+
+    HuffTable read;
+    BitReader br;
+    bs_reader_init(&br, bw.buf, size);
+    ASSERT_EQ(0, hc_table_read(&br, &read, 300), "Table should read back");
+    int match = 1;
+    for (int s = 0; s < 300; s++) {
+        if (counts[s] && hc_read_symbol(&br, &read) != s) match = 0;
+    }
+    ASSERT_TRUE(match, "Symbols should decode with the read table");
+
+    bs_writer_free(&bw);
+}
+
+void test_hc_table_rejects_bad_lengths() {
+    // Three codes of length 1 cannot form a prefix code
+    unsigned char lens[4] = {1, 1, 1, 0};
+    HuffTable table;
+    ASSERT_NEQ(0, hc_table_build(&table, lens, 4), "Oversubscribed lengths should fail");
+}
+
+void test_hc_tree_build_matches_heap_tree() {
+    // Skewed counts with ties, rebuilt twice in the same storage
+    static HuffTree tree;
+    Node arr[ALPHABET_SIZE], copy[ALPHABET_SIZE];
+    double total = 0;
+    for (int i = 0; i < ALPHABET_SIZE; i++) {
+        arr[i].byte = i;
+        arr[i].frequency = (i % 5 == 0) ? 0 : (i % 17) + 1;
+        arr[i].is_leaf = 1;
+        arr[i].left = arr[i].right = NULL;
+        total += arr[i].frequency;
+    }
+    memcpy(copy, arr, sizeof(arr));
+    Node* root = hc_tree_from_histogram(copy, total);
+    unsigned char** code = hc_build_code(root);
+    int same = 1;
+    for (int round = 0; round < 2; round++) {
+        memcpy(copy, arr, sizeof(arr));
+        ASSERT_EQ(0, hc_tree_build(&tree, copy, total), "Tree build should succeed");
+        for (int c = 0; c < ALPHABET_SIZE; c++) {
+            if ((code[c] == NULL) != (tree.code[c] == NULL)) {
+                same = 0;
+            } else if (code[c] != NULL &&
+                       memcmp(code[c], tree.code[c], 1 + (code[c][0] + 7) / 8) != 0) {
+                same = 0;
+            }
+        }
+    }
+    ASSERT_TRUE(same, "Pooled tree should give the same codes as the heap tree");
+    hc_free_tree(root);
+    hc_free_code(code);
+}
+
+void test_hc_flat_table_long_codes() {
+    // Fibonacci counts give codes longer than HC_WORD_BITS
+    static HuffTree tree;
+    Node arr[ALPHABET_SIZE];
+    double total = 0, a = 1, b = 1;
+    for (int i = 0; i < ALPHABET_SIZE; i++) {
+        arr[i].byte = i;
+        arr[i].frequency = i < 40 ? a : 0;
+        arr[i].is_leaf = 1;
+        arr[i].left = arr[i].right = NULL;
+        total += arr[i].frequency;
+        if (i < 40) { double t = a + b; a = b; b = t; }
+    }
+    ASSERT_EQ(0, hc_tree_build(&tree, arr, total), "Tree build should succeed");
+    ASSERT_TRUE(tree.flat.codes[0].len > HC_WORD_BITS, "Rarest byte should spill");
+
+    // Packing through the flat table gives the bits of the jagged codes
+    unsigned char in[200];
+    for (int i = 0; i < 200; i++) in[i] = (i * 7) % 40;
+    BitWriter bw;
+    bs_writer_init(&bw);
+    for (int i = 0; i < 200; i++) {
+        const unsigned char* c = tree.code[in[i]];
+        for (int j = 0; j < c[0]; j++)
+            bs_write_bits(&bw, (c[1 + j / 8] >> (7 - j % 8)) & 1, 1);
+    }
+    size_t ref_len = bs_flush(&bw);
+    unsigned char out[200 * 8];
+    uint64_t acc = 0;
+    int nbits = 0;
+    size_t len = hc_pack_codes(&tree.flat, in, 100, out, &acc, &nbits);
+    len += hc_pack_codes(&tree.flat, in + 100, 100, out + len, &acc, &nbits);
+    len += hc_pack_flush(&acc, &nbits, out + len);
+    ASSERT_EQ(ref_len, len, "Packed length should match");
+    ASSERT_TRUE(memcmp(bw.buf, out, len) == 0, "Packed bits should match");
+    bs_writer_free(&bw);
+}
+
 int main() {
     init_tests();
     
@@ -181,6 +349,11 @@ int main() {
     RUN_TEST(test_hc_code_uniqueness);
     RUN_TEST(test_hc_empty_file);
     RUN_TEST(test_hc_memory_management);
+    RUN_TEST(test_hc_adaptive_roundtrip);
+    RUN_TEST(test_hc_canonical_table);
+    RUN_TEST(test_hc_table_rejects_bad_lengths);
+    RUN_TEST(test_hc_tree_build_matches_heap_tree);
+    RUN_TEST(test_hc_flat_table_long_codes);
 
     TEST_SUMMARY();
 }
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 
 // Helper functions
@@ -162,6 +163,87 @@ void test_io_save_and_read_tree() {
     cleanup_test_file(source_file);
 }
 
+void test_io_compact_header() {
+    Node* tree = create_test_tree();
+    create_test_file("test_hdr_a.txt", "ab");
+    create_test_file("test_hdr_b.txt", "abba");
+    unsigned char** code = calloc(256, sizeof(unsigned char*));
+    code['a'] = calloc(2, sizeof(unsigned char));
+    code['a'][0] = 1;
+    code['b'] = calloc(2, sizeof(unsigned char));
+    code['b'][0] = 1;
+    code['b'][1] = 128;
+
+    unsigned char packed[IO_TREE_MAX];
+    ASSERT_EQ(3, (int)io_pack_tree(tree, packed),
+              "Two leaves should pack into 19 bits");
+
+    FILE* file = fopen("test_hdr.bin", "wb");
+    char last_name[IO_NAME_MAX + 1] = "";
+    ASSERT_EQ(0, io_save_static(file, last_name, "test_hdr_a.txt", code, tree, 0),
+              "First member should be written");
+    ASSERT_EQ(0, io_save_static(file, last_name, "test_hdr_b.txt", code, tree, 0),
+              "Second member should be written");
+    fclose(file);
+
+    static IoHeader header;
+    io_header_init(&header);
+    file = fopen("test_hdr.bin", "rb");
+    ASSERT_EQ(0, io_read_header(file, IO_METHOD_STATIC, &header),
+              "First header should be read");
+    ASSERT_STR_EQ("test_hdr_a.txt", header.name, "Should read the first name");
+    ASSERT_EQ(2, (int)header.size, "Should read the first size");
+    ASSERT_EQ(0, io_write_decompress_file(NULL, file, header.root, header.size,
+                                          header.filter),
+              "First payload should check");
+    long start = ftell(file);
+    ASSERT_EQ(0, io_read_header(file, IO_METHOD_STATIC, &header),
+              "Second header should be read");
+    ASSERT_TRUE(ftell(file) - start < 20,
+                "A shared name prefix and varints should keep the header small");
+    ASSERT_STR_EQ("test_hdr_b.txt", header.name, "Should rebuild the second name");
+    ASSERT_EQ(4, (int)header.size, "Should read the second size");
+    ASSERT_TRUE(!header.root->is_leaf && header.root->left->byte == 'a' &&
+                header.root->right->byte == 'b',
+                "Should unpack the same tree");
+    fclose(file);
+
+    free_test_tree(tree);
+    free(code['a']);
+    free(code['b']);
+    free(code);
+    cleanup_test_file("test_hdr.bin");
+    cleanup_test_file("test_hdr_a.txt");
+    cleanup_test_file("test_hdr_b.txt");
+}
+
+void test_io_hole_map() {
+    // 4 chunks of hole, 1.5 chunks of data, then a hole to the end
+    int fd = open("test_holes.bin", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    off_t size = 10 * AIO_CHUNK + 100;
+    ASSERT_EQ(0, ftruncate(fd, size), "Sparse file should be sized");
+    char data[AIO_CHUNK + AIO_CHUNK / 2];
+    memset(data, 'x', sizeof(data));
+    ASSERT_EQ((int)sizeof(data),
+              (int)pwrite(fd, data, sizeof(data), 4 * AIO_CHUNK + 10),
+              "Data should be written in the middle");
+    AioHole holes[IO_HOLES_MAX];
+    int count = io_hole_map(fd, size, holes);
+    if (count == 0) {
+        printf("  (file system without SEEK_HOLE, skipped)\n");
+    } else {
+        ASSERT_EQ(2, count, "A hole on each side of the data");
+        ASSERT_TRUE(holes[0].offset == 0 && holes[0].len == 4 * AIO_CHUNK,
+                    "Leading hole should stop at the chunk holding data");
+        ASSERT_TRUE(holes[1].offset == 6 * AIO_CHUNK &&
+                        holes[1].offset + holes[1].len == size,
+                    "Trailing hole should start at a chunk and run to the end");
+    }
+    ASSERT_EQ(0, (int)lseek(fd, 0, SEEK_CUR), "Position should be back at 0");
+    close(fd);
+    cleanup_test_file("test_holes.bin");
+}
+
 void test_io_file_size_operations() {
     const char* test_file = "test_size.bin";
     
@@ -248,6 +330,8 @@ int main() {
     RUN_TEST(test_io_read_bytes);
     RUN_TEST(test_io_unique_file_creation);
     RUN_TEST(test_io_save_and_read_tree);
+    RUN_TEST(test_io_compact_header);
+    RUN_TEST(test_io_hole_map);
     RUN_TEST(test_io_file_size_operations);
     RUN_TEST(test_io_end_of_file_detection);
     RUN_TEST(test_io_error_handling);
@@ -0,0 +1,104 @@
+#include "test_framework.h"
+#include "../include/lz77.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Encode and decode one block, returns the encoded size or 0 on failure
+static size_t block_roundtrip(int level, const unsigned char* buf, size_t n) {
+    LzCoder* coder = lz_new(level);
+    BitWriter bw;
+    bs_writer_init(&bw);
+    size_t size = 0;
+    if (lz_encode_block(coder, buf, n, &bw) == 0) {
+        size = bs_flush(&bw);
+        unsigned char* out = malloc(n);
+        BitReader br;
+        bs_reader_init(&br, bw.buf, size);
+        if (lz_decode_block(coder, &br, out, n) != 0 || memcmp(out, buf, n) != 0) {
+            size = 0;
+        }
+        free(out);
+    }
+    bs_writer_free(&bw);
+    lz_free(coder);
+    return size;
+}
+
+void test_lz_parse_finds_matches() {
+    LzCoder* coder = lz_new(LZ_DEFAULT_LEVEL);
+    const unsigned char* text = (const unsigned char*)"abcdefabcdefabcdef";
+    size_t k = lz_parse(coder, text, 18);
+
+    // six literals and one overlapping match of 12 at distance 6
+    ASSERT_EQ(7, (int)k, "Should emit six literals and one match");
+    ASSERT_EQ(12, coder->tokens[6].value, "Match should cover the repeats");
+    ASSERT_EQ(6, coder->tokens[6].dist, "Match should point one period back");
+
+    lz_free(coder);
+}
+
+void test_lz_roundtrip_levels() {
+    size_t n = 200000;
+    unsigned char* buf = malloc(n);
+    uint32_t seed = 7;
+    for (size_t i = 0; i < n; i++) {
+        // words from a small vocabulary, like a log file
+        buf[i] = test_rand(&seed) % 64 ? "GET /index.html 200\n"[i % 20] : (unsigned char)(seed >> 8);
+    }
+
+    size_t fast = block_roundtrip(1, buf, n);
+    size_t best = block_roundtrip(9, buf, n);
+    ASSERT_TRUE(fast > 0, "Level 1 should roundtrip");
+    ASSERT_TRUE(best > 0, "Level 9 should roundtrip");
+    ASSERT_TRUE(best <= fast, "Level 9 should not be worse than level 1");
+    ASSERT_TRUE(best < n / 2, "Repetitive data should compress");
+
+    free(buf);
+}
+
+void test_lz_edge_blocks() {
+    unsigned char one[1] = {'z'};
+    ASSERT_TRUE(block_roundtrip(6, one, 1) > 0, "Single byte should roundtrip");
+
+    unsigned char run[LZ_MAX_MATCH * 3];
+    memset(run, 'r', sizeof(run));
+    size_t size = block_roundtrip(6, run, sizeof(run));
+    ASSERT_TRUE(size > 0 && size < 20, "Long run should become a few matches");
+}
+
+void test_lz_rejects_corrupt_block() {
+    unsigned char buf[300];
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = (unsigned char)("xyzzy"[i % 5]);
+    }
+    LzCoder* coder = lz_new(6);
+    BitWriter bw;
+    bs_writer_init(&bw);
+    ASSERT_EQ(0, lz_encode_block(coder, buf, sizeof(buf), &bw), "Should encode");
+    size_t size = bs_flush(&bw);
+
+    // decoding into a smaller block must not overflow it
+    unsigned char out[100];
+    BitReader br;
+    bs_reader_init(&br, bw.buf, size);
+    ASSERT_NEQ(0, lz_decode_block(coder, &br, out, sizeof(out)),
+               "Block larger than declared should be rejected");
+
+    bs_writer_free(&bw);
+    lz_free(coder);
+}
+
+int main() {
+    init_tests();
+
+    printf(COLOR_YELLOW "Testing LZ77 Module" COLOR_RESET "\n");
+    printf("========================================\n");
+
+    RUN_TEST(test_lz_parse_finds_matches);
+    RUN_TEST(test_lz_roundtrip_levels);
+    RUN_TEST(test_lz_edge_blocks);
+    RUN_TEST(test_lz_rejects_corrupt_block);
+
+    TEST_SUMMARY();
+}
@@ -0,0 +1,128 @@
+#include "test_framework.h"
+#include "../include/order1.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Encode buf as one block and decode it back, returns the encoded size
+static size_t roundtrip(const unsigned char* buf, size_t n, int* ok) {
+    Order1Coder* coder = o1_new();
+    BitWriter bw;
+    bs_writer_init(&bw);
+    *ok = o1_encode_block(coder, buf, n, &bw) == 0;
+    size_t size = bs_flush(&bw);
+
+    unsigned char* out = malloc(n + 1);
+    BitReader br;
+    bs_reader_init(&br, bw.buf, size);
+    *ok = *ok && o1_decode_block(coder, &br, out, n) == 0 &&
+          memcmp(buf, out, n) == 0;
+
+    free(out);
+    bs_writer_free(&bw);
+    o1_free(coder);
+    return size;
+}
+
+void test_o1_roundtrip_text() {
+    const char* text = "the cat sat on the mat, then the cat ate the rat. ";
+    size_t n = 20 * strlen(text);
+    unsigned char* buf = malloc(n);
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = text[i % strlen(text)];
+    }
+
+    int ok;
+    size_t size = roundtrip(buf, n, &ok);
+    ASSERT_TRUE(ok, "Order-1 block should decode to the original text");
+    ASSERT_TRUE(size < n / 2, "Repetitive text should compress well");
+
+    free(buf);
+}
+
+void test_o1_beats_order0_on_context() {
+    // Each byte fully determines the next one
+    size_t n = 1 << 16;
+    unsigned char* buf = malloc(n);
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = (unsigned char)((i * 37) % 64);
+    }
+
+    int ok;
+    size_t size = roundtrip(buf, n, &ok);
+    ASSERT_TRUE(ok, "Order-1 block should decode");
+    // order-0 needs 6 bits per byte here, order-1 needs 1
+    ASSERT_TRUE(size < n * 2 / 8, "Order-1 should exploit the previous byte");
+
+    free(buf);
+}
+
+void test_o1_small_and_binary() {
+    unsigned char one[1] = {42};
+    int ok;
+    roundtrip(one, 1, &ok);
+    ASSERT_TRUE(ok, "Single byte block should decode");
+
+    unsigned char all[512];
+    for (int i = 0; i < 512; i++) {
+        all[i] = (unsigned char)(i * 7 + (i >> 8));
+    }
+    roundtrip(all, sizeof(all), &ok);
+    ASSERT_TRUE(ok, "Block with every byte value should decode");
+}
+
+void test_o1_truncated_block() {
+    unsigned char buf[256];
+    for (int i = 0; i < 256; i++) {
+        buf[i] = (unsigned char)i;
+    }
+    Order1Coder* coder = o1_new();
+    BitWriter bw;
+    bs_writer_init(&bw);
+    ASSERT_EQ(0, o1_encode_block(coder, buf, sizeof(buf), &bw), "Should encode");
+    size_t size = bs_flush(&bw);
+
+    unsigned char out[256];
+    BitReader br;
+    bs_reader_init(&br, bw.buf, size / 2);
+    ASSERT_NEQ(0, o1_decode_block(coder, &br, out, sizeof(out)),
+               "Truncated block should be rejected");
+
+    bs_writer_free(&bw);
+    o1_free(coder);
+}
+
+void test_o1_block_bits_exact() {
+    const char* text = "order one contexts: the cat sat on the mat. ";
+    size_t n = 30000;
+    unsigned char* buf = malloc(n);
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = i % 7 == 0 ? (unsigned char)(i * 13) : text[i % strlen(text)];
+    }
+    Order1Coder* coder = o1_new();
+    int64_t bits = o1_block_bits(coder, buf, n);
+    BitWriter bw;
+    bs_writer_init(&bw);
+    ASSERT_EQ(0, o1_encode_block(coder, buf, n, &bw), "Should encode");
+    uint64_t written = bw.pos * 8 + bw.nbits;
+    ASSERT_EQ((uint64_t)bits, written, "Estimate should match the bits written");
+
+    bs_writer_free(&bw);
+    o1_free(coder);
+    free(buf);
+}
+
+int main() {
+    init_tests();
+
+    printf(COLOR_YELLOW "Testing Order-1 Module" COLOR_RESET "\n");
+    printf("========================================\n");
+
+    RUN_TEST(test_o1_roundtrip_text);
+    RUN_TEST(test_o1_beats_order0_on_context);
+    RUN_TEST(test_o1_small_and_binary);
+    RUN_TEST(test_o1_truncated_block);
+    RUN_TEST(test_o1_block_bits_exact);
+
+    TEST_SUMMARY();
+}
@@ -0,0 +1,149 @@
+#include "test_framework.h"
+#include "../include/pipeline.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define ITEMS 100000
+
+static void* producer(void* arg) {
+    SpscRing* ring = arg;
+    for (uintptr_t i = 1; i <= ITEMS; i++) {
+        spsc_push(ring, (void*)i);
+    }
+    return NULL;
+}
+
+void test_spsc_order_across_threads() {
+    SpscRing ring;
+    ASSERT_EQ(0, spsc_init(&ring, 4), "Ring should initialize");
+    pthread_t thread;
+    pthread_create(&thread, NULL, producer, &ring);
+    int in_order = 1;
+    for (uintptr_t i = 1; i <= ITEMS; i++) {
+        if ((uintptr_t)spsc_pop(&ring) != i) {
+            in_order = 0;
+        }
+    }
+    pthread_join(thread, NULL);
+    ASSERT_TRUE(in_order, "Items should come out in push order");
+    spsc_free(&ring);
+}
+
+// Stages over counters: read produces 1..limit, work doubles, write sums
+typedef struct Job {
+    int next, limit;
+    int fail_read, fail_work, fail_write, end_at;
+    long sum;
+    int writes;
+    pthread_t reader; // thread of the last read
+} Job;
+
+static int job_read(void* ctx, void* in) {
+    Job* job = ctx;
+    job->reader = pthread_self();
+    if (job->fail_read && job->next == job->fail_read) return PIPE_ERROR;
+    if (job->next > job->limit) return PIPE_END;
+    *(int*)in = job->next++;
+    return PIPE_OK;
+}
+
+static int job_work(void* ctx, void* in, void* out) {
+    Job* job = ctx;
+    int v = *(int*)in;
+    if (job->fail_work && v == job->fail_work) return PIPE_ERROR;
+    *(int*)out = 2 * v;
+    return job->end_at && v == job->end_at ? PIPE_END : PIPE_OK;
+}
+
+static int job_write(void* ctx, void* out) {
+    Job* job = ctx;
+    if (job->fail_write && job->writes + 1 == job->fail_write) return PIPE_ERROR;
+    job->sum += *(int*)out;
+    job->writes++;
+    return PIPE_OK;
+}
+
+static int run(Job* job) {
+    int items[2 * PIPE_DEPTH];
+    PipeStages stages = {.read = job_read,
+                         .work = job_work,
+                         .write = job_write,
+                         .ctx = job};
+    for (int i = 0; i < PIPE_DEPTH; i++) {
+        stages.in[i] = &items[i];
+        stages.out[i] = &items[PIPE_DEPTH + i];
+    }
+    return pipe_run(&stages);
+}
+
+void test_pipe_run_all_items() {
+    Job job = {.next = 1, .limit = 1000};
+    ASSERT_EQ(0, run(&job), "Pipeline should succeed");
+    ASSERT_EQ(1000, job.writes, "Every item should be written");
+    ASSERT_TRUE(job.sum == 1000L * 1001, "Every item should be worked once");
+
+    Job empty = {.next = 1, .limit = 0};
+    ASSERT_EQ(0, run(&empty), "Empty input should succeed");
+    ASSERT_EQ(0, empty.writes, "Nothing should be written");
+}
+
+void test_pipe_run_end_from_work() {
+    Job job = {.next = 1, .limit = 1000, .end_at = 10};
+    ASSERT_EQ(0, run(&job), "Stopping early should succeed");
+    ASSERT_EQ(10, job.writes, "Output up to the last item should be written");
+    ASSERT_TRUE(job.next <= 10 + PIPE_DEPTH + 2,
+                "Reader should stop shortly after");
+}
+
+void test_pipe_run_errors() {
+    Job r = {.next = 1, .limit = 1000, .fail_read = 50};
+    ASSERT_EQ(-1, run(&r), "Read error should fail the pipeline");
+
+    Job w = {.next = 1, .limit = 1000, .fail_work = 50};
+    ASSERT_EQ(-1, run(&w), "Work error should fail the pipeline");
+    ASSERT_TRUE(w.writes < 50, "Nothing after the failed item is written");
+
+    Job o = {.next = 1, .limit = 1000, .fail_write = 50};
+    ASSERT_EQ(-1, run(&o), "Write error should fail the pipeline");
+    ASSERT_EQ(49, o.writes, "Writes should stop at the error");
+}
+
+void test_pipe_run_small() {
+    // only the first item of each side exists
+    int items[2];
+    Job job = {.next = 1, .limit = 3};
+    PipeStages stages = {.read = job_read,
+                         .work = job_work,
+                         .write = job_write,
+                         .ctx = &job,
+                         .small = 1};
+    stages.in[0] = &items[0];
+    stages.out[0] = &items[1];
+    ASSERT_EQ(0, pipe_run(&stages), "Small pipeline should succeed");
+    ASSERT_TRUE(job.writes == 3 && job.sum == 12,
+                "Every item should still be worked and written");
+    ASSERT_TRUE(pthread_equal(job.reader, pthread_self()),
+                "Small input should be read on the calling thread");
+
+    Job w = {.next = 1, .limit = 10, .fail_work = 5};
+    stages.ctx = &w;
+    ASSERT_EQ(-1, pipe_run(&stages), "Work error should fail it too");
+    ASSERT_EQ(4, w.writes, "Writes should stop at the error");
+}
+
+int main() {
+    init_tests();
+
+    printf(COLOR_YELLOW "Testing Pipeline Module" COLOR_RESET "\n");
+    printf("========================================\n");
+
+    RUN_TEST(test_spsc_order_across_threads);
+    RUN_TEST(test_pipe_run_all_items);
+    RUN_TEST(test_pipe_run_end_from_work);
+    RUN_TEST(test_pipe_run_errors);
+    RUN_TEST(test_pipe_run_small);
+
+    TEST_SUMMARY();
+}
@@ -0,0 +1,119 @@
+#include "test_framework.h"
+#include "../include/split.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+// Encode buf as one block and decode it back, returns the encoded size
+static size_t roundtrip(const unsigned char* buf, size_t n, int* ok) {
+    SplitCoder* coder = split_new();
+    BitWriter bw;
+    bs_writer_init(&bw);
+    *ok = split_encode_block(coder, buf, n, &bw) == 0;
+    size_t size = bs_flush(&bw);
+
+    unsigned char* out = malloc(n + 1);
+    BitReader br;
+    bs_reader_init(&br, bw.buf, size);
+    *ok = *ok && split_decode_block(coder, &br, out, n) == 0 &&
+          memcmp(buf, out, n) == 0;
+
+    free(out);
+    bs_writer_free(&bw);
+    split_free(coder);
+    return size;
+}
+
+// Bytes of buf coded with one order-0 table, header included
+static size_t one_table_bytes(const unsigned char* buf, size_t n) {
+    uint32_t counts[ALPHABET_SIZE] = {0};
+    for (size_t i = 0; i < n; i++) counts[buf[i]]++;
+    HuffTable table;
+    if (hc_table_from_counts(&table, counts, ALPHABET_SIZE) != 0) return 0;
+    return (hc_table_header_bits(&table) + hc_table_cost(&table, counts)) / 8;
+}
+
+// Text, then noise over 16 byte values, then text again
+static unsigned char* make_mixed(size_t n) {
+    unsigned char* buf = test_text_data(n, 0, n, n);
+    uint32_t x = 777;
+    for (size_t i = n / 3; i < 2 * n / 3; i++)
+        buf[i] = 0xC0 + (test_rand(&x) & 15);
+    return buf;
+}
+
+void test_split_roundtrip_mixed() {
+    size_t n = 300000;
+    unsigned char* buf = make_mixed(n);
+    int ok;
+    size_t size = roundtrip(buf, n, &ok);
+    ASSERT_TRUE(ok, "Split block should decode to the original data");
+    ASSERT_TRUE(size < one_table_bytes(buf, n),
+                "Segments should beat one table over the whole block");
+    free(buf);
+}
+
+void test_split_plan() {
+    size_t n = SPLIT_BLOCK_SIZE;
+    unsigned char* buf = make_mixed(n);
+    SplitCoder* coder = split_new();
+    int mixed = split_plan(coder, buf, n);
+    ASSERT_TRUE(mixed >= 3, "Each change of statistics should start a segment");
+
+    free(buf);
+    buf = test_text_data(n, 0, n, n);
+    ASSERT_EQ(1, split_plan(coder, buf, n),
+              "Uniform data should keep a single table");
+    ASSERT_EQ(1, split_plan(coder, buf, 100),
+              "A block smaller than a cell has one segment");
+    split_free(coder);
+    free(buf);
+}
+
+void test_split_small_blocks() {
+    unsigned char one = 'a';
+    int ok;
+    roundtrip(&one, 1, &ok);
+    ASSERT_TRUE(ok, "A single byte block should decode");
+
+    size_t n = 3 * SPLIT_CELL + 5;
+    unsigned char* buf = malloc(n);
+    for (size_t i = 0; i < n; i++) buf[i] = i < 2 * SPLIT_CELL ? 'x' : i;
+    roundtrip(buf, n, &ok);
+    ASSERT_TRUE(ok, "A partial last cell should decode");
+    free(buf);
+}
+
+void test_split_rejects_garbage() {
+    size_t n = 50000;
+    unsigned char* garbage = malloc(n);
+    unsigned char* out = malloc(n);
+    uint32_t x = 99;
+    int failed = 1;
+    SplitCoder* coder = split_new();
+    for (int round = 0; round < 20; round++) {
+        for (size_t i = 0; i < n; i++) garbage[i] = test_rand(&x);
+        BitReader br;
+        bs_reader_init(&br, garbage, 64);
+        if (split_decode_block(coder, &br, out, n) == 0) failed = 0;
+    }
+    ASSERT_TRUE(failed, "Truncated garbage should not decode");
+    split_free(coder);
+    free(garbage);
+    free(out);
+}
+
+int main() {
+    init_tests();
+
+    printf(COLOR_YELLOW "Testing Split Coder Module" COLOR_RESET "\n");
+    printf("========================================\n");
+
+    RUN_TEST(test_split_roundtrip_mixed);
+    RUN_TEST(test_split_plan);
+    RUN_TEST(test_split_small_blocks);
+    RUN_TEST(test_split_rejects_garbage);
+
+    TEST_SUMMARY();
+}
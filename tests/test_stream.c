@@ -0,0 +1,259 @@
+#include "test_framework.h"
+#include "../include/stream.h"
+#include "../include/io_tool.h"
+#include "../include/filter.h"
+#include "../include/lz77.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+// Text with a run of noise over its last sixth
+static unsigned char* make_data(size_t n, uint32_t seed) {
+    return test_text_data(n, seed, n ? n : 1, n - n / 6);
+}
+
+static size_t next_size(uint32_t* x, size_t max) {
+    return 1 + test_rand(x) % max;
+}
+
+/*
+ * Push src through a stream in pieces of at most chunk bytes, with at most
+ * room bytes of output per call. Returns the last status
+ */
+static int run_stream(HcStream* s, int decode, const unsigned char* src,
+                      size_t n, unsigned char* dst, size_t cap, size_t* len,
+                      size_t chunk, size_t room) {
+    uint32_t x = 42;
+    size_t in_pos = 0;
+    *len = 0;
+    for (int calls = 0; calls < 10000000; calls++) {
+        size_t k = next_size(&x, chunk);
+        if (k > n - in_pos) k = n - in_pos;
+        size_t r = next_size(&x, room);
+        if (r > cap - *len) r = cap - *len;
+        s->in = src + in_pos;
+        s->avail_in = k;
+        s->out = dst + *len;
+        s->avail_out = r;
+        int st = decode ? hc_stream_decompress(s)
+                        : hc_stream_compress(s, in_pos + k == n);
+        in_pos += k - s->avail_in;
+        *len += r - s->avail_out;
+        if (st != HC_OK) return st;
+        if (decode && in_pos == n && s->avail_out > 0) return HC_OK;
+    }
+    return HC_OK;
+}
+
+// Compress and decompress buf with the given piece sizes, 1 if it matched
+static int roundtrip(const unsigned char* buf, size_t n,
+                     const CompressOptions* options, size_t chunk, size_t room,
+                     size_t* coded) {
+    size_t cap = 2 * n + 4096;
+    unsigned char* mid = malloc(cap);
+    unsigned char* out = malloc(n + 1);
+    HcStream c, d;
+    size_t mid_len = 0, out_len = 0;
+    int ok = hc_stream_compress_init(&c, options) == HC_OK &&
+             run_stream(&c, 0, buf, n, mid, cap, &mid_len, chunk, room) ==
+                 HC_STREAM_END &&
+             c.total_in == n && c.total_out == mid_len;
+    ok = ok && hc_stream_decompress_init(&d) == HC_OK &&
+         run_stream(&d, 1, mid, mid_len, out, n + 1, &out_len, chunk,
+                    room) == HC_STREAM_END &&
+         out_len == n && memcmp(buf, out, n) == 0 && d.total_in == mid_len;
+    if (coded) *coded = mid_len;
+    hc_stream_end(&c);
+    hc_stream_end(&d);
+    free(mid);
+    free(out);
+    return ok;
+}
+
+void test_stream_methods() {
+    size_t n = 1500000;
+    unsigned char* buf = make_data(n, 3);
+    unsigned char methods[] = {IO_METHOD_ADAPTIVE, IO_METHOD_ORDER1,
+                               IO_METHOD_BWT, IO_METHOD_LZ77, IO_METHOD_SPLIT};
+    int ok = 1;
+    for (size_t i = 0; i < sizeof(methods); i++) {
+        CompressOptions options;
+        compress_default_options(&options);
+        options.method = methods[i];
+        size_t coded;
+        if (!roundtrip(buf, n, &options, 300000, 200000, &coded) ||
+            coded >= n)
+            ok = 0;
+    }
+    ASSERT_TRUE(ok, "Every block method should stream both ways");
+    free(buf);
+}
+
+void test_stream_tiny_pieces() {
+    size_t n = 200000;
+    unsigned char* buf = make_data(n, 5);
+    ASSERT_TRUE(roundtrip(buf, n, NULL, 7, 5, NULL),
+                "A few bytes per call in and out should work");
+    ASSERT_TRUE(roundtrip(buf, n, NULL, 1, 1, NULL),
+                "One byte per call should work");
+    ASSERT_TRUE(roundtrip(buf, n, NULL, 4 * n, 4 * n, NULL),
+                "Everything in one call should work");
+
+    // int32 ramps are where auto picks a filter, carried across blocks
+    size_t m = 3 * LZ_BLOCK_SIZE / 2;
+    unsigned char* ramp = malloc(m);
+    for (size_t i = 0; i < m; i++) ramp[i] = (i / 4 * 7) >> (8 * (i % 4));
+    CompressOptions options = {IO_METHOD_LZ77, LZ_DEFAULT_LEVEL, FLT_AUTO};
+    ASSERT_TRUE(roundtrip(ramp, m, &options, 65536, 999, NULL),
+                "Filtered blocks should stream");
+    free(ramp);
+    free(buf);
+}
+
+void test_stream_empty() {
+    HcStream s;
+    unsigned char out[64], back[8];
+    ASSERT_EQ(HC_OK, hc_stream_compress_init(&s, NULL), "Init should work");
+    s.out = out;
+    s.avail_out = sizeof(out);
+    ASSERT_EQ(HC_OK, hc_stream_compress(&s, 0), "No input, nothing to do");
+    ASSERT_EQ(0, (int)s.total_out, "Nothing is written before a block");
+    ASSERT_EQ(HC_STREAM_END, hc_stream_compress(&s, 1),
+              "Finishing an empty stream should end it");
+    size_t len = s.total_out;
+    ASSERT_EQ(HC_STREAM_END, hc_stream_compress(&s, 1),
+              "Calls after the end should keep returning it");
+    hc_stream_end(&s);
+
+    ASSERT_EQ(HC_OK, hc_stream_decompress_init(&s), "Init should work");
+    s.in = out;
+    s.avail_in = len;
+    s.out = back;
+    s.avail_out = sizeof(back);
+    ASSERT_EQ(HC_STREAM_END, hc_stream_decompress(&s),
+              "An empty stream should decode");
+    ASSERT_EQ(0, (int)s.total_out, "An empty stream restores nothing");
+    hc_stream_end(&s);
+}
+
+void test_stream_errors() {
+    HcStream s;
+    CompressOptions options;
+    compress_default_options(&options); // static needs the whole input
+    ASSERT_EQ(HC_ERR_ARGS, hc_stream_compress_init(&s, &options),
+              "Static should not stream");
+    options.method = IO_METHOD_SOLID;
+    ASSERT_EQ(HC_ERR_ARGS, hc_stream_compress_init(&s, &options),
+              "Solid should not stream");
+
+    size_t n = 100000, cap = 2 * n;
+    unsigned char* buf = make_data(n, 9);
+    unsigned char* mid = malloc(cap + 16);
+    unsigned char* out = malloc(n);
+    size_t len, out_len;
+    ASSERT_EQ(HC_OK, hc_stream_compress_init(&s, NULL), "Init should work");
+    ASSERT_EQ(HC_STREAM_END,
+              run_stream(&s, 0, buf, n, mid, cap, &len, n, cap),
+              "Compression should end");
+    ASSERT_EQ(HC_ERR_ARGS, hc_stream_decompress(&s),
+              "A compressor should not decompress");
+    hc_stream_end(&s);
+
+    // bytes after the stream are not consumed
+    memcpy(mid + len, "TAIL", 4);
+    ASSERT_EQ(HC_OK, hc_stream_decompress_init(&s), "Init should work");
+    s.in = mid;
+    s.avail_in = len + 4;
+    s.out = out;
+    s.avail_out = n;
+    ASSERT_EQ(HC_STREAM_END, hc_stream_decompress(&s), "Stream should end");
+    ASSERT_EQ(4, (int)s.avail_in, "Trailing bytes should stay in the input");
+
+    ASSERT_EQ(HC_OK, hc_stream_reset(&s), "Reset should work");
+    s.in = mid;
+    s.avail_in = len - 1;
+    s.out = out;
+    s.avail_out = n;
+    ASSERT_EQ(HC_OK, hc_stream_decompress(&s),
+              "A truncated stream waits for more input");
+    ASSERT_EQ(0, (int)s.avail_in, "All input should be taken");
+
+    mid[len / 2] ^= 0x10;
+    ASSERT_EQ(HC_OK, hc_stream_reset(&s), "Reset should work");
+    int st = run_stream(&s, 1, mid, len, out, n, &out_len, 1000, 1000);
+    ASSERT_TRUE(st == HC_ERR_CORRUPT || st == HC_ERR_CHECKSUM,
+                "A flipped bit should be caught");
+    ASSERT_EQ(st, hc_stream_decompress(&s), "Errors should stick");
+
+    memcpy(mid, "HUFB", 4);
+    ASSERT_EQ(HC_OK, hc_stream_reset(&s), "Reset should work");
+    s.in = mid;
+    s.avail_in = len;
+    s.out = out;
+    s.avail_out = n;
+    ASSERT_EQ(HC_ERR_CORRUPT, hc_stream_decompress(&s),
+              "A buffer frame is not a stream");
+    hc_stream_end(&s);
+    free(buf);
+    free(mid);
+    free(out);
+}
+
+void test_stream_reset() {
+    size_t n = 300000, cap = 2 * n;
+    unsigned char* a = make_data(n, 11);
+    unsigned char* b = make_data(n, 12);
+    unsigned char* mid_a = malloc(cap);
+    unsigned char* mid_b = malloc(cap);
+    size_t len_a, len_b, len_again;
+    HcStream s;
+    ASSERT_EQ(HC_OK, hc_stream_compress_init(&s, NULL), "Init should work");
+    int ok = run_stream(&s, 0, a, n, mid_a, cap, &len_a, 9999, 7777) ==
+             HC_STREAM_END;
+    ok = ok && hc_stream_reset(&s) == HC_OK &&
+         run_stream(&s, 0, b, n, mid_b, cap, &len_b, 9999, 7777) ==
+             HC_STREAM_END;
+    ASSERT_TRUE(ok, "A reset stream should compress again");
+    unsigned char* again = malloc(cap);
+    ok = hc_stream_reset(&s) == HC_OK &&
+         run_stream(&s, 0, a, n, again, cap, &len_again, n, cap) ==
+             HC_STREAM_END;
+    ASSERT_TRUE(ok && len_again == len_a && memcmp(again, mid_a, len_a) == 0,
+                "Output should not depend on the piece sizes or the reuse");
+    hc_stream_end(&s);
+
+    unsigned char* out = malloc(n + 1);
+    size_t out_len;
+    ASSERT_EQ(HC_OK, hc_stream_decompress_init(&s), "Init should work");
+    ok = run_stream(&s, 1, mid_a, len_a, out, n + 1, &out_len, 5000, 3000) ==
+             HC_STREAM_END &&
+         out_len == n && memcmp(out, a, n) == 0;
+    ok = ok && hc_stream_reset(&s) == HC_OK &&
+         run_stream(&s, 1, mid_b, len_b, out, n + 1, &out_len, 5000, 3000) ==
+             HC_STREAM_END &&
+         out_len == n && memcmp(out, b, n) == 0;
+    ASSERT_TRUE(ok, "A reset decoder should decode the next stream");
+    hc_stream_end(&s);
+    free(a);
+    free(b);
+    free(mid_a);
+    free(mid_b);
+    free(again);
+    free(out);
+}
+
+int main() {
+    init_tests();
+
+    printf(COLOR_YELLOW "Testing Stream Module" COLOR_RESET "\n");
+    printf("========================================\n");
+
+    RUN_TEST(test_stream_methods);
+    RUN_TEST(test_stream_tiny_pieces);
+    RUN_TEST(test_stream_empty);
+    RUN_TEST(test_stream_errors);
+    RUN_TEST(test_stream_reset);
+
+    TEST_SUMMARY();
+}
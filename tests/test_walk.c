@@ -0,0 +1,101 @@
+#include "test_framework.h"
+#include "../include/walk.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static void make_file(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file) {
+        fputs(path, file);
+        fclose(file);
+    }
+}
+
+static void remove_tree(const char* path) {
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", path);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "could not remove %s\n", path);
+    }
+}
+
+void test_walk_sorted_tree() {
+    remove_tree("test_walk_dir");
+    mkdir("test_walk_dir", 0755);
+    mkdir("test_walk_dir/b", 0755);
+    mkdir("test_walk_dir/b/deep", 0755);
+    mkdir("test_walk_dir/empty", 0755);
+    make_file("test_walk_dir/z.txt");
+    make_file("test_walk_dir/a.txt");
+    make_file("test_walk_dir/b.txt");
+    make_file("test_walk_dir/b/x.txt");
+    make_file("test_walk_dir/b/deep/y.txt");
+    symlink("a.txt", "test_walk_dir/link.txt");
+    make_file("test_walk_plain.txt");
+
+    // plain files keep their place, "dir/" is the same as "dir"
+    char* args[] = {"test_walk_plain.txt", "test_walk_dir/", "missing.txt"};
+    WalkList list;
+    ASSERT_EQ(0, walk_paths(args, 3, 0, &list), "Walk should succeed");
+    const char* expected[] = {
+        "test_walk_plain.txt",        "test_walk_dir/a.txt",
+        "test_walk_dir/b.txt",        "test_walk_dir/z.txt",
+        "test_walk_dir/b/x.txt",      "test_walk_dir/b/deep/y.txt",
+        "missing.txt"};
+    ASSERT_EQ(7, (int)list.count, "Links and directories are not listed");
+    int same = list.count == 7;
+    for (size_t i = 0; same && i < list.count; i++) {
+        if (strcmp(expected[i], list.paths[i]) != 0) same = 0;
+    }
+    ASSERT_TRUE(same, "Files of a directory come before its subdirectories");
+    walk_list_free(&list);
+
+    remove_tree("test_walk_dir");
+    unlink("test_walk_plain.txt");
+}
+
+void test_walk_threads_agree() {
+    remove_tree("test_walk_wide");
+    mkdir("test_walk_wide", 0755);
+    char path[128];
+    int files = 0;
+    for (int d = 0; d < 30; d++) {
+        snprintf(path, sizeof(path), "test_walk_wide/d%02d", d);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "test_walk_wide/d%02d/sub", d);
+        mkdir(path, 0755);
+        for (int f = 0; f < 20; f++, files++) {
+            snprintf(path, sizeof(path), "test_walk_wide/d%02d/%s/f%02d",
+                     d, f % 2 ? "sub" : ".", f);
+            make_file(path);
+        }
+    }
+    char* args[] = {"test_walk_wide"};
+    WalkList one, many;
+    ASSERT_EQ(0, walk_paths(args, 1, 1, &one), "One thread should succeed");
+    ASSERT_EQ(0, walk_paths(args, 1, 8, &many), "Eight threads should succeed");
+    ASSERT_EQ(files, (int)one.count, "Every file should be found");
+    int same = one.count == many.count;
+    for (size_t i = 0; same && i < one.count; i++) {
+        if (strcmp(one.paths[i], many.paths[i]) != 0) same = 0;
+    }
+    ASSERT_TRUE(same, "The order should not depend on the threads");
+    walk_list_free(&one);
+    walk_list_free(&many);
+    remove_tree("test_walk_wide");
+}
+
+int main() {
+    init_tests();
+
+    printf(COLOR_YELLOW "Testing Directory Walk Module" COLOR_RESET "\n");
+    printf("========================================\n");
+
+    RUN_TEST(test_walk_sorted_tree);
+    RUN_TEST(test_walk_threads_agree);
+
+    TEST_SUMMARY();
+}
@@ -0,0 +1,322 @@
+/*
+ * gen_decoder: saved code table -> C source of a specialized decoder
+ *
+ *   gen_decoder tables/<name>.huft <name> <out_dir>
+ *
+ * writes <out_dir>/fixed_<name>.c and fixed_<name>.h. The codes become
+ * constants (HuffTable, HcCodeTable and two level lookup tables) and the
+ * decoder is built for this table only: second level, invalid code checks
+ * and the number of symbols per 64-bit refill are known here, so the code
+ * for them is left out or unrolled instead of being decided per symbol.
+ *
+ * Runs at build time before the library exists, so it only uses headers.
+ */
+#include "fixed.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bits of the input one fast path refill guarantees
+#define GEN_REFILL_BITS 56
+
+typedef struct GenTable {
+  unsigned char lens[ALPHABET_SIZE];
+  uint32_t codes[ALPHABET_SIZE];
+  unsigned short count[HC_MAX_CODE_LENGTH + 1];
+  unsigned short symbol[ALPHABET_SIZE];
+  int used, max_len, complete;
+  int root_bits, sub_bits, subs;
+  uint16_t root[1 << HC_FIXED_ROOT_BITS];
+  uint16_t *sub;
+} GenTable;
+
+// Same format and checks as hc_fixed_read_table
+static int gen_read_table(const char *path, GenTable *t) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    fprintf(stderr, "Error opening code table: %s\n", path);
+    return -1;
+  }
+  char line[128];
+  int header = 0, status = 0;
+  while (status == 0 && fgets(line, sizeof(line), file) != NULL) {
+    char *p = line + strspn(line, " \t\r\n");
+    if (*p == '\0' || *p == '#')
+      continue;
+    int a, b;
+    char magic[8];
+    if (!header) {
+      header = sscanf(p, "%7s %d", magic, &a) == 2 &&
+               strcmp(magic, HC_FIXED_MAGIC) == 0 && a == HC_FIXED_VERSION;
+      status = header ? 0 : -1;
+    } else if (sscanf(p, "%d %d", &a, &b) != 2 || a < 0 ||
+               a >= ALPHABET_SIZE || b < 1 || b > HC_MAX_CODE_LENGTH ||
+               t->lens[a] != 0) {
+      status = -1;
+    } else {
+      t->lens[a] = b;
+      ++t->used;
+    }
+  }
+  fclose(file);
+  if (status != 0 || !header || t->used == 0) {
+    fprintf(stderr, "Error: %s is not a valid code table\n", path);
+    return -1;
+  }
+  return 0;
+}
+
+// Canonical codes in (length, byte) order, as hc_table_build assigns them
+static int gen_assign_codes(GenTable *t) {
+  for (int c = 0; c < ALPHABET_SIZE; ++c) {
+    t->count[t->lens[c]]++;
+    if (t->lens[c] > t->max_len)
+      t->max_len = t->lens[c];
+  }
+  t->count[0] = 0;
+  int left = 1;
+  for (int len = 1; len <= HC_MAX_CODE_LENGTH; ++len) {
+    left = 2 * left - t->count[len];
+    if (left < 0) {
+      fprintf(stderr, "Error: the code lengths are oversubscribed\n");
+      return -1;
+    }
+  }
+  t->complete = left == 0;
+  uint32_t next[HC_MAX_CODE_LENGTH + 2];
+  unsigned short offs[HC_MAX_CODE_LENGTH + 2];
+  next[1] = 0;
+  offs[1] = 0;
+  for (int len = 1; len <= HC_MAX_CODE_LENGTH; ++len) {
+    next[len + 1] = (next[len] + t->count[len]) << 1;
+    offs[len + 1] = offs[len] + t->count[len];
+  }
+  for (int c = 0; c < ALPHABET_SIZE; ++c) {
+    if (t->lens[c] == 0)
+      continue;
+    t->codes[c] = next[t->lens[c]]++;
+    t->symbol[offs[t->lens[c]]++] = c;
+  }
+  return 0;
+}
+
+/*
+ * Entries: byte in bits 0-7, code length in bits 8-11, 0 for no code.
+ * Root entries of codes longer than root_bits have bit 15 set and the
+ * offset of their second level table, indexed by the next sub_bits bits
+ */
+static int gen_lookup_tables(GenTable *t) {
+  t->root_bits =
+      t->max_len < HC_FIXED_ROOT_BITS ? t->max_len : HC_FIXED_ROOT_BITS;
+  t->sub_bits = t->max_len - t->root_bits;
+  t->sub = calloc((size_t)1 << t->root_bits << t->sub_bits, sizeof(uint16_t));
+  if (t->sub == NULL)
+    return -1;
+  for (int c = 0; c < ALPHABET_SIZE; ++c) {
+    int len = t->lens[c];
+    if (len == 0)
+      continue;
+    uint16_t entry = c | len << 8;
+    if (len <= t->root_bits) {
+      uint32_t first = t->codes[c] << (t->root_bits - len);
+      for (uint32_t i = 0; i < 1u << (t->root_bits - len); ++i)
+        t->root[first + i] = entry;
+      continue;
+    }
+    int rest = len - t->root_bits;
+    uint32_t prefix = t->codes[c] >> rest;
+    if (t->root[prefix] == 0)
+      t->root[prefix] = 0x8000 | (t->subs++ << t->sub_bits);
+    uint32_t first = (t->root[prefix] & 0x7FFF) +
+                     ((t->codes[c] & ((1u << rest) - 1)) << (t->sub_bits - rest));
+    for (uint32_t i = 0; i < 1u << (t->sub_bits - rest); ++i)
+      t->sub[first + i] = entry;
+  }
+  return 0;
+}
+
+static void gen_array(FILE *out, const char *type, const char *name,
+                      const uint32_t *values, size_t n, int hex) {
+  fprintf(out, "static const %s %s[%zu] = {", type, name, n);
+  for (size_t i = 0; i < n; ++i)
+    fprintf(out, hex ? "%s0x%04x," : "%s%u,", i % 12 == 0 ? "\n    " : " ",
+            values[i]);
+  fprintf(out, "\n};\n\n");
+}
+
+static void gen_field(FILE *out, const char *name, const uint32_t *values,
+                      size_t n) {
+  fprintf(out, "    .%s = {", name);
+  for (size_t i = 0; i < n; ++i)
+    fprintf(out, "%s%u,", i % 16 == 0 ? "\n        " : " ", values[i]);
+  fprintf(out, "\n    },\n");
+}
+
+// One symbol of the fast path, every check decided here
+static void gen_step(FILE *out, const GenTable *t) {
+  fprintf(out, "#define STEP() \\\n"
+               "  do { \\\n"
+               "    uint32_t e = root[acc >> %d]; \\\n",
+          64 - t->root_bits);
+  if (t->subs > 0)
+    fprintf(out, "    if (e & 0x8000) \\\n"
+                 "      e = sub[(e & 0x7FFF) + ((acc >> %d) & 0x%x)]; \\\n",
+            64 - t->max_len, (1u << t->sub_bits) - 1);
+  if (!t->complete)
+    fprintf(out, "    if ((e >> 8) == 0) \\\n"
+                 "      return HC_ERR_CORRUPT; \\\n");
+  fprintf(out, "    dst[out++] = (unsigned char)e; \\\n"
+               "    acc <<= e >> 8; \\\n"
+               "    nbits -= e >> 8; \\\n"
+               "  } while (0)\n\n");
+}
+
+static void gen_decoder(FILE *out, const GenTable *t, const char *name) {
+  int unroll = GEN_REFILL_BITS / t->max_len;
+  gen_step(out, t);
+  fprintf(out,
+          "static inline uint64_t load_be64(const unsigned char *p) {\n"
+          "  uint64_t v;\n"
+          "  memcpy(&v, p, sizeof(v));\n"
+          "#if !defined(__BYTE_ORDER__) || "
+          "__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__\n"
+          "  v = __builtin_bswap64(v);\n"
+          "#endif\n"
+          "  return v;\n"
+          "}\n\n");
+  fprintf(out,
+          "static int decode_%s(const unsigned char *src, size_t n,\n"
+          "%*sunsigned char *dst, size_t size) {\n"
+          "  uint64_t acc = 0; // next bits, left aligned\n"
+          "  int nbits = 0;\n"
+          "  size_t pos = 0, out = 0;\n"
+          "  // 8 bytes give %d bits or more, %d codes of up to %d bits\n"
+          "  while (size - out >= %d && n - pos >= 8) {\n"
+          "    acc |= load_be64(src + pos) >> nbits;\n"
+          "    pos += (63 - nbits) >> 3;\n"
+          "    nbits |= %d;\n",
+          name, (int)strlen(name) + 19, "", GEN_REFILL_BITS, unroll, t->max_len,
+          unroll, GEN_REFILL_BITS);
+  for (int i = 0; i < unroll; ++i)
+    fprintf(out, "    STEP();\n");
+  fprintf(out, "  }\n");
+  fprintf(out,
+          "  // last symbols byte by byte, a code may not run past the input\n"
+          "  while (out < size) {\n"
+          "    for (; nbits <= 56 && pos < n; nbits += 8)\n"
+          "      acc |= (uint64_t)src[pos++] << (56 - nbits);\n"
+          "    uint32_t e = root[acc >> %d];\n",
+          64 - t->root_bits);
+  if (t->subs > 0)
+    fprintf(out,
+            "    if (e & 0x8000)\n"
+            "      e = sub[(e & 0x7FFF) + ((acc >> %d) & 0x%x)];\n",
+            64 - t->max_len, (1u << t->sub_bits) - 1);
+  fprintf(out, "    int len = e >> 8;\n"
+               "    if (len == 0 || len > nbits)\n"
+               "      return HC_ERR_CORRUPT;\n"
+               "    dst[out++] = (unsigned char)e;\n"
+               "    acc <<= len;\n"
+               "    nbits -= len;\n"
+               "  }\n"
+               "  return HC_OK;\n"
+               "}\n\n");
+}
+
+static int gen_source(const GenTable *t, const char *table_path,
+                      const char *name, const char *dir) {
+  // the file name only, the output does not depend on where the tree is
+  const char *slash = strrchr(table_path, '/');
+  if (slash != NULL)
+    table_path = slash + 1;
+  char guard[256];
+  size_t g = 0;
+  for (; name[g] != '\0' && g + 1 < sizeof(guard); ++g)
+    guard[g] = name[g] >= 'a' && name[g] <= 'z' ? name[g] - 'a' + 'A' : name[g];
+  guard[g] = '\0';
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/fixed_%s.h", dir, name);
+  FILE *out = fopen(path, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Error opening file: %s\n", path);
+    return -1;
+  }
+  fprintf(out,
+          "// Generated by tools/gen_decoder from %s, do not edit\n"
+          "#ifndef FIXED_%s_H\n#define FIXED_%s_H\n\n"
+          "#include \"fixed.h\"\n\n"
+          "extern const HcFixedCode hc_fixed_%s;\n\n#endif\n",
+          table_path, guard, guard, name);
+  if (fclose(out) != 0)
+    return -1;
+
+  snprintf(path, sizeof(path), "%s/fixed_%s.c", dir, name);
+  out = fopen(path, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Error opening file: %s\n", path);
+    return -1;
+  }
+  fprintf(out,
+          "// Generated by tools/gen_decoder from %s, do not edit\n"
+          "// %d codes of 1 to %d bits, %s, %d second level tables\n"
+          "#include \"fixed_%s.h\"\n#include <string.h>\n\n",
+          table_path, t->used, t->max_len,
+          t->complete ? "complete" : "with unused codes", t->subs, name);
+  uint32_t values[ALPHABET_SIZE << 7];
+  for (int c = 0; c < ALPHABET_SIZE; ++c)
+    values[c] = t->lens[c];
+  fprintf(out, "static const HuffTable table = {\n    .nsyms = %d,\n",
+          ALPHABET_SIZE);
+  gen_field(out, "lens", values, ALPHABET_SIZE);
+  gen_field(out, "codes", t->codes, ALPHABET_SIZE);
+  for (int len = 0; len <= HC_MAX_CODE_LENGTH; ++len)
+    values[len] = t->count[len];
+  gen_field(out, "count", values, HC_MAX_CODE_LENGTH + 1);
+  for (int i = 0; i < t->used; ++i)
+    values[i] = t->symbol[i];
+  gen_field(out, "symbol", values, t->used);
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "static const HcCodeTable codes = {\n    .codes = {");
+  for (int c = 0; c < ALPHABET_SIZE; ++c)
+    fprintf(out, "%s{0x%x, %d},", c % 6 == 0 ? "\n        " : " ",
+            t->codes[c], t->lens[c]);
+  fprintf(out, "\n    },\n};\n\n");
+
+  for (int i = 0; i < 1 << t->root_bits; ++i)
+    values[i] = t->root[i];
+  gen_array(out, "uint16_t", "root", values, (size_t)1 << t->root_bits, 1);
+  if (t->subs > 0) {
+    size_t n = (size_t)t->subs << t->sub_bits;
+    for (size_t i = 0; i < n; ++i)
+      values[i] = t->sub[i];
+    gen_array(out, "uint16_t", "sub", values, n, 1);
+  }
+  gen_decoder(out, t, name);
+  fprintf(out,
+          "const HcFixedCode hc_fixed_%s = {\"%s\", &table, &codes, %d,\n"
+          "%*sdecode_%s};\n",
+          name, name, t->used == ALPHABET_SIZE, (int)strlen(name) + 31, "",
+          name);
+  return fclose(out) == 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 4) {
+    fprintf(stderr, "usage: gen_decoder table.huft name out_dir\n");
+    return 1;
+  }
+  for (const char *p = argv[2]; *p; ++p)
+    if (!(*p == '_' || (*p >= 'a' && *p <= 'z') || (*p >= '0' && *p <= '9'))) {
+      fprintf(stderr, "Error: the name must be a C identifier in lower case\n");
+      return 1;
+    }
+  GenTable *t = calloc(1, sizeof(GenTable));
+  int status = t == NULL || gen_read_table(argv[1], t) != 0 ||
+               gen_assign_codes(t) != 0 || gen_lookup_tables(t) != 0 ||
+               gen_source(t, argv[1], argv[2], argv[3]) != 0;
+  if (t != NULL)
+    free(t->sub);
+  free(t);
+  return status;
+}